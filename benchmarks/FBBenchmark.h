@@ -0,0 +1,68 @@
+//
+//  FBBenchmark.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/*!
+ * @class FBBenchmark
+ *
+ * Times one operation, a method taking no arguments or one object, by
+ * calling it until enough time has passed to trust the average. Each call
+ * runs in its own autorelease pool, so freeing what it made is part of its
+ * cost.
+ *
+ * Allocations are the objects allocated plus the malloc calls made by
+ * FBCocoa's own code, and are only counted when built with GNUstep.
+ */
+@interface FBBenchmark : NSObject {
+  NSString*  name;
+  id         target;
+  SEL        selector;
+  id         object;
+  NSUInteger bytesPerOp;
+
+  double     nsPerOp;
+  double     allocationsPerOp;
+}
+
++ (FBBenchmark*)benchmarkWithName:(NSString*)aName
+                           target:(id)aTarget
+                         selector:(SEL)aSelector
+                       bytesPerOp:(NSUInteger)bytes;
+
+/*!
+ * Times a method taking one argument, calling it with anObject each time,
+ * so one method can be timed on several fixtures.
+ */
++ (FBBenchmark*)benchmarkWithName:(NSString*)aName
+                           target:(id)aTarget
+                         selector:(SEL)aSelector
+                           object:(id)anObject
+                       bytesPerOp:(NSUInteger)bytes;
+
+/*!
+ * Runs each benchmark whose name contains filter (all of them if nil) and
+ * prints its results, comparing them with those in the baseline file if
+ * there is one. With record set, the results are written to the baseline
+ * file instead. Returns the number of regressions: benchmarks more than
+ * tolerance (0.2 for 20%) slower than their baseline, or allocating more.
+ */
++ (int)runBenchmarks:(NSArray*)benchmarks
+              filter:(NSString*)filter
+            baseline:(NSString*)baselinePath
+           tolerance:(double)tolerance
+              record:(BOOL)record;
+
+- (void)run;
+
+- (NSString*)name;
+- (double)nsPerOp;
+- (double)megabytesPerSecond;
+- (double)allocationsPerOp;
+
+@end
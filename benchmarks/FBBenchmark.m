@@ -0,0 +1,269 @@
+//
+//  FBBenchmark.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBBenchmark.h"
+#include <stdint.h>
+#include <stdio.h>
+#ifdef __APPLE__
+  #include <mach/mach_time.h>
+#else
+  #include <time.h>
+#endif
+#ifdef GNUSTEP
+  #import <Foundation/NSDebug.h>
+#endif
+
+// keep calling an operation until this much time has passed
+#define kMinBenchmarkTime 200000000ull
+
+// a benchmark may allocate this many more times per op than its baseline
+#define kAllocationSlack 0.5
+
+
+#ifdef GNUSTEP
+/*
+ * FBCocoa's own mallocs, counted by wrapping them at link time
+ * (-Wl,--wrap=malloc); the objects Foundation allocates are counted by
+ * GNUstep's allocation debugging.
+ */
+static unsigned long long FBMallocCount = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+  FBMallocCount++;
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+  FBMallocCount++;
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+  FBMallocCount++;
+  return __real_realloc(ptr, size);
+}
+#endif
+
+static uint64_t FBNanoseconds(void)
+{
+#ifdef __APPLE__
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0) {
+    mach_timebase_info(&timebase);
+  }
+  return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+#endif
+}
+
+/*
+ * Allocations so far, or 0 where they can't be counted.
+ */
+static unsigned long long FBAllocationCount(void)
+{
+#ifdef GNUSTEP
+  unsigned long long count = FBMallocCount;
+  Class* classes = GSDebugAllocationClassList();
+  for (; classes && *classes; classes++) {
+    count += GSDebugAllocationTotal(*classes);
+  }
+  return count;
+#else
+  return 0;
+#endif
+}
+
+
+@interface FBBenchmark (Private)
+
++ (NSDictionary*)baselineWithContentsOfFile:(NSString*)path;
+- (uint64_t)runIterations:(unsigned long)iterations;
+
+@end
+
+
+@implementation FBBenchmark
+
++ (FBBenchmark*)benchmarkWithName:(NSString*)aName
+                           target:(id)aTarget
+                         selector:(SEL)aSelector
+                       bytesPerOp:(NSUInteger)bytes
+{
+  return [self benchmarkWithName:aName target:aTarget selector:aSelector object:nil bytesPerOp:bytes];
+}
+
++ (FBBenchmark*)benchmarkWithName:(NSString*)aName
+                           target:(id)aTarget
+                         selector:(SEL)aSelector
+                           object:(id)anObject
+                       bytesPerOp:(NSUInteger)bytes
+{
+  FBBenchmark* benchmark = [[[FBBenchmark alloc] init] autorelease];
+  benchmark->name       = [aName copy];
+  benchmark->target     = [aTarget retain];
+  benchmark->selector   = aSelector;
+  benchmark->object     = [anObject retain];
+  benchmark->bytesPerOp = bytes;
+  return benchmark;
+}
+
+- (void)dealloc
+{
+  [name release];
+  [target release];
+  [object release];
+  [super dealloc];
+}
+
++ (int)runBenchmarks:(NSArray*)benchmarks
+              filter:(NSString*)filter
+            baseline:(NSString*)baselinePath
+           tolerance:(double)tolerance
+              record:(BOOL)record
+{
+#ifdef GNUSTEP
+  GSDebugAllocationActive(YES);
+#endif
+
+  NSDictionary* baseline = record ? nil : [self baselineWithContentsOfFile:baselinePath];
+  NSMutableString* recorded = [NSMutableString string];
+  int regressions = 0;
+
+  for (int i = 0; i < [benchmarks count]; i++) {
+    FBBenchmark* benchmark = [benchmarks objectAtIndex:i];
+    if (filter && [[benchmark name] rangeOfString:filter].location == NSNotFound) {
+      continue;
+    }
+    [benchmark run];
+
+    printf("%-28s %12.1f ns/op", [[benchmark name] UTF8String], [benchmark nsPerOp]);
+    if (benchmark->bytesPerOp > 0) {
+      printf(" %9.2f MB/s", [benchmark megabytesPerSecond]);
+    } else {
+      printf(" %14s", "");
+    }
+    printf(" %9.1f allocs/op", [benchmark allocationsPerOp]);
+
+    NSArray* expected = [baseline objectForKey:[benchmark name]];
+    if (expected) {
+      double expectedNs     = [[expected objectAtIndex:0] doubleValue];
+      double expectedAllocs = [[expected objectAtIndex:1] doubleValue];
+      double change = expectedNs > 0 ? [benchmark nsPerOp] / expectedNs - 1 : 0;
+      printf("  %+6.1f%%", change * 100);
+      if (change > tolerance) {
+        printf("  REGRESSION: slower than baseline %.1f ns/op", expectedNs);
+        regressions++;
+      } else if ([benchmark allocationsPerOp] > expectedAllocs + kAllocationSlack) {
+        printf("  REGRESSION: more allocations than baseline %.1f", expectedAllocs);
+        regressions++;
+      }
+    }
+    printf("\n");
+    fflush(stdout);
+
+    [recorded appendFormat:@"%@\t%.1f\t%.1f\n",
+     [benchmark name], [benchmark nsPerOp], [benchmark allocationsPerOp]];
+  }
+
+  if (record) {
+    if (![recorded writeToFile:baselinePath atomically:YES encoding:NSUTF8StringEncoding error:NULL]) {
+      fprintf(stderr, "Couldn't write the baseline to %s\n", [baselinePath UTF8String]);
+      return 1;
+    }
+    printf("Baseline written to %s\n", [baselinePath UTF8String]);
+  } else if (baseline == nil) {
+    printf("No baseline at %s to compare with\n", [baselinePath UTF8String]);
+  } else if (regressions > 0) {
+    printf("\n%d REGRESSION%s against %s\n", regressions, regressions == 1 ? "" : "S",
+           [baselinePath UTF8String]);
+  }
+  return regressions;
+}
+
+- (void)run
+{
+  // once to warm up, then as many times as it takes to be measurable
+  [self runIterations:1];
+  unsigned long iterations = 1;
+  uint64_t elapsed = [self runIterations:iterations];
+  while (elapsed < kMinBenchmarkTime) {
+    unsigned long estimate = elapsed > 0 ? (unsigned long)(iterations * 1.2 * kMinBenchmarkTime / elapsed) : 0;
+    iterations = MAX(iterations * 2, MIN(estimate, iterations * 100));
+    elapsed = [self runIterations:iterations];
+  }
+  nsPerOp = (double)elapsed / iterations;
+}
+
+- (NSString*)name
+{
+  return name;
+}
+
+- (double)nsPerOp
+{
+  return nsPerOp;
+}
+
+- (double)megabytesPerSecond
+{
+  return nsPerOp > 0 ? (bytesPerOp / 1048576.0) / (nsPerOp / 1e9) : 0;
+}
+
+- (double)allocationsPerOp
+{
+  return allocationsPerOp;
+}
+
+#pragma mark Private Methods
++ (NSDictionary*)baselineWithContentsOfFile:(NSString*)path
+{
+  NSString* contents = [NSString stringWithContentsOfFile:path
+                                                 encoding:NSUTF8StringEncoding
+                                                    error:NULL];
+  if (contents == nil) {
+    return nil;
+  }
+
+  NSMutableDictionary* baseline = [NSMutableDictionary dictionary];
+  NSArray* lines = [contents componentsSeparatedByString:@"\n"];
+  for (int i = 0; i < [lines count]; i++) {
+    NSArray* fields = [[lines objectAtIndex:i] componentsSeparatedByString:@"\t"];
+    if ([fields count] == 3) {
+      [baseline setObject:[fields subarrayWithRange:NSMakeRange(1, 2)]
+                   forKey:[fields objectAtIndex:0]];
+    }
+  }
+  return baseline;
+}
+
+- (uint64_t)runIterations:(unsigned long)iterations
+{
+  unsigned long long allocations = FBAllocationCount();
+  uint64_t start = FBNanoseconds();
+  for (unsigned long i = 0; i < iterations; i++) {
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    [target performSelector:selector withObject:object];
+    [pool release];
+  }
+  uint64_t elapsed = FBNanoseconds() - start;
+
+  // the pools are counted too, being part of every op
+  allocationsPerOp = (double)(FBAllocationCount() - allocations) / iterations;
+  return elapsed;
+}
+
+@end
@@ -0,0 +1,69 @@
+//
+//  FBHotPathBenchmarks.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class FBConnect;
+@class FBMultiqueryRequest;
+@class FBRowSchema;
+@class FBProjection;
+@class FBTableStore;
+@class SBJsonParser;
+@class SBJsonWriter;
+
+
+/*!
+ * @class FBHotPathBenchmarks
+ *
+ * Benchmarks of what every API call goes through: signing and encoding the
+ * request, and parsing the response and handing it out, on fixtures shaped
+ * like real traffic. The friend list is 500 rows of the user table; a batch
+ * is 20 queries of 25 rows; a multiquery is 3 queries of 100 rows. Large
+ * responses are the same rows, as many as make 100KB, 1MB and 10MB.
+ */
+@interface FBHotPathBenchmarks : NSObject {
+  FBConnect*           connect;
+  SBJsonParser*        jsonParser;
+  SBJsonWriter*        jsonWriter;
+
+  NSArray*             friendRows;
+  NSData*              friendsJSON;
+  NSData*              friendsBinary;
+  FBProjection*        friendsProjection;
+  FBRowSchema*         friendsSchema;
+
+  NSDictionary*        callArguments;
+  NSDictionary*        signedArguments;
+  NSString*            requestString;
+  NSData*              uploadBody;
+
+  NSArray*             batchResponse;
+  NSData*              batchJSON;
+  FBMultiqueryRequest* multiquery;
+  NSArray*             multiqueryResult;
+  NSDictionary*        multiquerySchemas;
+  NSData*              multiqueryJSON;
+  NSData*              multiqueryBinary;
+
+  NSArray*             largeJSON;
+
+  FBTableStore*        tableStore;
+  NSString*            tableQuery;
+}
+
+/*!
+ * FBBenchmarks for each operation.
+ */
+- (NSArray*)benchmarks;
+
+/*!
+ * The size of each FQL fixture as JSON and encoded by FBBinaryCoder, for
+ * printing.
+ */
+- (NSString*)sizeReport;
+
+@end
@@ -0,0 +1,528 @@
+//
+//  FBHotPathBenchmarks.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBHotPathBenchmarks.h"
+#import "FBBenchmark.h"
+#import "FBArenaParser.h"
+#import "FBBatchRequest.h"
+#import "FBBinaryCoder.h"
+#import "FBConnect.h"
+#import "FBMultiqueryRequest.h"
+#import "FBRowSchema.h"
+#import "FBTableStore.h"
+#import "JSON.h"
+#import "NSData+.h"
+#import "NSString+.h"
+
+#define kFriendCount         500
+#define kBatchSize           20
+#define kBatchRows           25
+#define kMultiqueryQueries   3
+#define kMultiqueryRows      100
+#define kUploadSize          (64 * 1024)
+#define kLargeFixtureCount   3
+
+
+@interface FBConnect (Private)
+
+- (NSDictionary*)completeArgumentsForMethod:(NSString*)method
+                                  arguments:(NSDictionary*)dict;
+
+- (NSString*)sigForArguments:(NSDictionary*)dict
+                      secret:(NSString*)secret;
+
+- (NSData*)postDataForMethod:(NSString*)method
+                   arguments:(NSDictionary*)dict
+                       files:(NSArray*)files;
+
+@end
+
+
+@interface FBMethodRequest (Internal)
+
+- (id)resultForUTF8String:(const char*)bytes;
+
+@end
+
+
+/*
+ * A row of the user table, as an application would model it.
+ */
+@interface FBBenchmarkUser : NSObject {
+  long long uid;
+  NSString* name;
+  NSString* pic_square;
+  BOOL      is_app_user;
+}
+
+/*
+ * Filled in by hand from a row SBJsonParser made, as FBRowSchema would.
+ */
+- (id)initWithRow:(NSDictionary*)row;
+
+@end
+
+@implementation FBBenchmarkUser
+
+- (id)initWithRow:(NSDictionary*)row
+{
+  if (self = [super init]) {
+    id value = [row objectForKey:@"uid"];
+    uid = (value && value != [NSNull null]) ? [value longLongValue] : 0;
+    value = [row objectForKey:@"name"];
+    name = (value != [NSNull null]) ? [value retain] : nil;
+    value = [row objectForKey:@"pic_square"];
+    pic_square = (value != [NSNull null]) ? [value retain] : nil;
+    value = [row objectForKey:@"is_app_user"];
+    is_app_user = (value && value != [NSNull null]) ? [value boolValue] : NO;
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [name release];
+  [pic_square release];
+  [super dealloc];
+}
+
+@end
+
+
+@interface FBHotPathBenchmarks (Private)
+
+- (NSArray*)userRowsFrom:(NSUInteger)first count:(NSUInteger)count;
+
+- (void)benchJSONParse;
+- (void)benchJSONWrite;
+- (void)benchArenaParse;
+- (void)benchArenaProjection;
+- (void)benchRowSchema;
+- (void)benchManualMapping;
+- (void)benchMultiqueryRowSchema;
+- (void)benchMultiqueryManualMapping;
+- (NSArray*)usersForRows:(NSArray*)rows;
+- (void)benchBinaryEncode;
+- (void)benchBinaryDecode;
+- (void)benchJSONParseData:(NSData*)json;
+- (void)benchJSONWriteObject:(id)object;
+- (void)benchBinaryEncodeObject:(id)object;
+- (void)benchBinaryDecodeData:(NSData*)binary;
+- (void)benchArenaParseData:(NSData*)json;
+- (void)benchSignature;
+- (void)benchMD5;
+- (void)benchURLEncode;
+- (void)benchURLDecode;
+- (void)benchPostData;
+- (void)benchBatchFanOut;
+- (void)benchMultiqueryFanOut;
+- (void)benchTableStoreLookup;
+
+@end
+
+
+/*
+ * The UTF-8 of string with a NUL after it, for the parsers which take C
+ * strings.
+ */
+static NSData* FBCStringData(NSString* string)
+{
+  const char* utf8 = [string UTF8String];
+  return [NSData dataWithBytes:utf8 length:strlen(utf8) + 1];
+}
+
+
+@implementation FBHotPathBenchmarks
+
+- (id)init
+{
+  if (!(self = [super init])) {
+    return nil;
+  }
+
+  connect    = [[FBConnect sessionWithAPIKey:@"8c6f6e9b2a1d4f3e5b7a9c0d1e2f3a4b" delegate:nil] retain];
+  jsonParser = [[SBJsonParser alloc] init];
+  jsonWriter = [[SBJsonWriter alloc] init];
+
+  // fql.query: SELECT uid, name, pic_square, ... FROM user WHERE uid IN (friends)
+  friendRows        = [[self userRowsFrom:0 count:kFriendCount] retain];
+  friendsJSON       = [FBCStringData([friendRows JSONRepresentation]) retain];
+  friendsBinary     = [[FBBinaryCoder dataWithObject:friendRows error:NULL] retain];
+  friendsProjection = [[FBProjection projectionWithString:@"uid, name, pic_square"] retain];
+  friendsSchema     = [[FBRowSchema alloc] initWithClass:[FBBenchmarkUser class]];
+  [friendsSchema addField:@"uid" type:FBFieldInteger ivar:@"uid"];
+  [friendsSchema addField:@"name" type:FBFieldString ivar:@"name"];
+  [friendsSchema addField:@"pic_square" type:FBFieldString ivar:@"pic_square"];
+  [friendsSchema addField:@"is_app_user" type:FBFieldBool ivar:@"is_app_user"];
+
+  NSString* query = @"SELECT uid, name, pic_square, status, online_presence, profile_url "
+                    @"FROM user WHERE uid IN (SELECT uid2 FROM friend WHERE uid1 = 100000123456789)";
+  callArguments   = [[NSDictionary dictionaryWithObject:query forKey:@"query"] retain];
+  signedArguments = [[connect completeArgumentsForMethod:@"fql.query" arguments:callArguments] retain];
+  requestString   = [[NSString urlEncodeArguments:signedArguments] retain];
+
+  NSMutableData* upload = [NSMutableData dataWithLength:kUploadSize];
+  uint8_t* uploadBytes = [upload mutableBytes];
+  for (int i = 0; i < kUploadSize; i++) {
+    uploadBytes[i] = (uint8_t)(i * 2654435761u >> 24);
+  }
+  uploadBody = [upload retain];
+
+  // each result of a batch comes back as a string of JSON
+  NSMutableArray* batchResults = [NSMutableArray arrayWithCapacity:kBatchSize];
+  for (int i = 0; i < kBatchSize; i++) {
+    [batchResults addObject:[[self userRowsFrom:i * kBatchRows count:kBatchRows] JSONRepresentation]];
+  }
+  batchJSON     = [FBCStringData([batchResults JSONRepresentation]) retain];
+  batchResponse = [[jsonParser fragmentWithUTF8String:[batchJSON bytes]] retain];
+
+  NSMutableArray* multiqueryResults = [NSMutableArray arrayWithCapacity:kMultiqueryQueries];
+  NSMutableDictionary* queries = [NSMutableDictionary dictionary];
+  for (int i = 0; i < kMultiqueryQueries; i++) {
+    NSString* name = [NSString stringWithFormat:@"query%d", i];
+    [queries setObject:query forKey:name];
+    [multiqueryResults addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                                  name, @"name",
+                                  [self userRowsFrom:i * kMultiqueryRows count:kMultiqueryRows], @"fql_result_set",
+                                  nil]];
+  }
+  multiquery = (FBMultiqueryRequest*)
+    [[FBMultiqueryRequest requestWithMethod:@"fql.multiquery"
+                                  arguments:[NSDictionary dictionaryWithObject:[queries JSONRepresentation]
+                                                                        forKey:@"queries"]
+                                     parent:connect
+                                     target:nil
+                                   selector:NULL] retain];
+  NSMutableDictionary* schemas = [NSMutableDictionary dictionary];
+  for (int i = 0; i < kMultiqueryQueries; i++) {
+    [schemas setObject:friendsSchema forKey:[NSString stringWithFormat:@"query%d", i]];
+  }
+  multiquerySchemas = [schemas copy];
+  multiqueryResult = [multiqueryResults copy];
+  multiqueryJSON   = [FBCStringData([multiqueryResult JSONRepresentation]) retain];
+  multiqueryBinary = [[FBBinaryCoder dataWithObject:multiqueryResult error:NULL] retain];
+
+  // rows enough to make each size, from the size of the friend list's rows
+  NSUInteger largeSizes[kLargeFixtureCount] = {100 * 1024, 1024 * 1024, 10 * 1024 * 1024};
+  NSMutableArray* large = [NSMutableArray arrayWithCapacity:kLargeFixtureCount];
+  for (int i = 0; i < kLargeFixtureCount; i++) {
+    NSUInteger rows = largeSizes[i] * kFriendCount / ([friendsJSON length] - 1) + 1;
+    NSAutoreleasePool* fixturePool = [[NSAutoreleasePool alloc] init];
+    [large addObject:FBCStringData([[self userRowsFrom:0 count:rows] JSONRepresentation])];
+    [fixturePool release];
+  }
+  largeJSON = [large copy];
+
+  tableStore = [[FBTableStore alloc] init];
+  [tableStore addTable:@"user" primaryKey:@"uid" indexedColumns:nil];
+  NSArray* uids = [friendRows valueForKey:@"uid"];
+  [tableStore addRows:friendRows
+             forQuery:[NSString stringWithFormat:@"SELECT uid, name, pic_square FROM user WHERE uid IN (%@)",
+                       [uids componentsJoinedByString:@", "]]];
+  tableQuery = [[NSString alloc] initWithFormat:@"SELECT name, pic_square FROM user WHERE uid IN (%@, %@, %@, %@, %@)",
+                [uids objectAtIndex:3], [uids objectAtIndex:50], [uids objectAtIndex:150],
+                [uids objectAtIndex:250], [uids objectAtIndex:450]];
+
+  return self;
+}
+
+- (void)dealloc
+{
+  [connect release];
+  [jsonParser release];
+  [jsonWriter release];
+  [friendRows release];
+  [friendsJSON release];
+  [friendsBinary release];
+  [friendsProjection release];
+  [friendsSchema release];
+  [callArguments release];
+  [signedArguments release];
+  [requestString release];
+  [uploadBody release];
+  [batchResponse release];
+  [batchJSON release];
+  [multiquery release];
+  [multiqueryResult release];
+  [multiquerySchemas release];
+  [multiqueryJSON release];
+  [multiqueryBinary release];
+  [largeJSON release];
+  [tableStore release];
+  [tableQuery release];
+  [super dealloc];
+}
+
+- (NSArray*)benchmarks
+{
+  NSUInteger friendsLength = [friendsJSON length] - 1;
+  NSMutableArray* benchmarks = [NSMutableArray arrayWithObjects:
+          [FBBenchmark benchmarkWithName:@"json.parse" target:self
+                                selector:@selector(benchJSONParse) bytesPerOp:friendsLength],
+          [FBBenchmark benchmarkWithName:@"json.write" target:self
+                                selector:@selector(benchJSONWrite) bytesPerOp:friendsLength],
+          [FBBenchmark benchmarkWithName:@"arena.parse" target:self
+                                selector:@selector(benchArenaParse) bytesPerOp:friendsLength],
+          [FBBenchmark benchmarkWithName:@"arena.projection" target:self
+                                selector:@selector(benchArenaProjection) bytesPerOp:friendsLength],
+          [FBBenchmark benchmarkWithName:@"rowschema.decode" target:self
+                                selector:@selector(benchRowSchema) bytesPerOp:friendsLength],
+          [FBBenchmark benchmarkWithName:@"rowschema.manual" target:self
+                                selector:@selector(benchManualMapping) bytesPerOp:friendsLength],
+          [FBBenchmark benchmarkWithName:@"rowschema.decode.multiquery" target:self
+                                selector:@selector(benchMultiqueryRowSchema) bytesPerOp:[multiqueryJSON length] - 1],
+          [FBBenchmark benchmarkWithName:@"rowschema.manual.multiquery" target:self
+                                selector:@selector(benchMultiqueryManualMapping) bytesPerOp:[multiqueryJSON length] - 1],
+          [FBBenchmark benchmarkWithName:@"binary.encode" target:self
+                                selector:@selector(benchBinaryEncode) bytesPerOp:[friendsBinary length]],
+          [FBBenchmark benchmarkWithName:@"binary.decode" target:self
+                                selector:@selector(benchBinaryDecode) bytesPerOp:[friendsBinary length]],
+          [FBBenchmark benchmarkWithName:@"json.parse.multiquery" target:self
+                                selector:@selector(benchJSONParseData:) object:multiqueryJSON
+                              bytesPerOp:[multiqueryJSON length] - 1],
+          [FBBenchmark benchmarkWithName:@"json.write.multiquery" target:self
+                                selector:@selector(benchJSONWriteObject:) object:multiqueryResult
+                              bytesPerOp:[multiqueryJSON length] - 1],
+          [FBBenchmark benchmarkWithName:@"binary.encode.multiquery" target:self
+                                selector:@selector(benchBinaryEncodeObject:) object:multiqueryResult
+                              bytesPerOp:[multiqueryBinary length]],
+          [FBBenchmark benchmarkWithName:@"binary.decode.multiquery" target:self
+                                selector:@selector(benchBinaryDecodeData:) object:multiqueryBinary
+                              bytesPerOp:[multiqueryBinary length]],
+          [FBBenchmark benchmarkWithName:@"connect.sigForArguments" target:self
+                                selector:@selector(benchSignature) bytesPerOp:0],
+          [FBBenchmark benchmarkWithName:@"data.md5" target:self
+                                selector:@selector(benchMD5) bytesPerOp:[uploadBody length]],
+          [FBBenchmark benchmarkWithName:@"string.urlEncodeArguments" target:self
+                                selector:@selector(benchURLEncode) bytesPerOp:[requestString length]],
+          [FBBenchmark benchmarkWithName:@"string.urlDecodeArguments" target:self
+                                selector:@selector(benchURLDecode) bytesPerOp:[requestString length]],
+          [FBBenchmark benchmarkWithName:@"connect.postData" target:self
+                                selector:@selector(benchPostData) bytesPerOp:0],
+          [FBBenchmark benchmarkWithName:@"batch.fanout" target:self
+                                selector:@selector(benchBatchFanOut) bytesPerOp:[batchJSON length] - 1],
+          [FBBenchmark benchmarkWithName:@"multiquery.fanout" target:self
+                                selector:@selector(benchMultiqueryFanOut) bytesPerOp:[multiqueryJSON length] - 1],
+          [FBBenchmark benchmarkWithName:@"tablestore.lookup" target:self
+                                selector:@selector(benchTableStoreLookup) bytesPerOp:0],
+          nil];
+
+  // parsing large responses, and freeing what was parsed
+  NSString* largeNames[kLargeFixtureCount] = {@"100k", @"1m", @"10m"};
+  for (int i = 0; i < kLargeFixtureCount; i++) {
+    NSData* json = [largeJSON objectAtIndex:i];
+    [benchmarks addObject:[FBBenchmark benchmarkWithName:[@"json.parse." stringByAppendingString:largeNames[i]]
+                                                  target:self
+                                                selector:@selector(benchJSONParseData:)
+                                                  object:json
+                                              bytesPerOp:[json length] - 1]];
+    [benchmarks addObject:[FBBenchmark benchmarkWithName:[@"arena.parse." stringByAppendingString:largeNames[i]]
+                                                  target:self
+                                                selector:@selector(benchArenaParseData:)
+                                                  object:json
+                                              bytesPerOp:[json length] - 1]];
+  }
+  return benchmarks;
+}
+
+- (NSString*)sizeReport
+{
+  NSUInteger jsonSizes[]   = {[friendsJSON length] - 1, [multiqueryJSON length] - 1};
+  NSUInteger binarySizes[] = {[friendsBinary length], [multiqueryBinary length]};
+  const char* fixtures[]   = {"friends", "multiquery"};
+
+  NSMutableString* report = [NSMutableString stringWithFormat:@"%-12s %12s %12s %8s\n",
+                             "fixture", "json", "binary", "ratio"];
+  for (int i = 0; i < 2; i++) {
+    [report appendFormat:@"%-12s %12lu %12lu %7.1f%%\n", fixtures[i],
+     (unsigned long)jsonSizes[i], (unsigned long)binarySizes[i],
+     100.0 * binarySizes[i] / jsonSizes[i]];
+  }
+  return report;
+}
+
+#pragma mark Private Methods
+- (NSArray*)userRowsFrom:(NSUInteger)first count:(NSUInteger)count
+{
+  static NSString* firstNames[] = {@"Mark", @"Chris", @"Dustin", @"Sheryl", @"Andrew", @"Naomi", @"Priya", @"Jurgen"};
+  static NSString* lastNames[]  = {@"Moskovitz", @"Hughes", @"Sandberg", @"Bosworth", @"Okafor", @"Nakamura", @"Ostergaard"};
+
+  NSMutableArray* rows = [NSMutableArray arrayWithCapacity:count];
+  for (NSUInteger i = first; i < first + count; i++) {
+    NSString* uid = [NSString stringWithFormat:@"%llu", 100000000000000ull + i * 7919];
+    NSString* name = [NSString stringWithFormat:@"%@ %@", firstNames[i % 8], lastNames[(i / 8) % 7]];
+    NSDictionary* status = [NSDictionary dictionaryWithObjectsAndKeys:
+                            [NSString stringWithFormat:@"is thinking about item %lu on the list", (unsigned long)i], @"message",
+                            [NSDecimalNumber numberWithUnsignedLong:1270000000 + i * 37], @"time",
+                            [NSString stringWithFormat:@"%lu", (unsigned long)(i * 104729)], @"status_id",
+                            nil];
+    [rows addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                     [NSDecimalNumber decimalNumberWithString:uid], @"uid",
+                     name, @"name",
+                     [NSString stringWithFormat:@"http://profile.ak.fbcdn.net/hprofile-ak-snc1/%@_%lu_q.jpg", uid, (unsigned long)(i % 9973)], @"pic_square",
+                     (i % 3) ? status : (id)[NSNull null], @"status",
+                     (i % 4) ? @"offline" : @"active", @"online_presence",
+                     [NSString stringWithFormat:@"http://www.facebook.com/profile.php?id=%@", uid], @"profile_url",
+                     [NSNumber numberWithBool:(i % 5 == 0)], @"is_app_user",
+                     nil]];
+  }
+  return rows;
+}
+
+- (void)benchJSONParse
+{
+  [jsonParser fragmentWithUTF8String:[friendsJSON bytes]];
+}
+
+- (void)benchJSONWrite
+{
+  [jsonWriter stringWithObject:friendRows];
+}
+
+- (void)benchArenaParse
+{
+  [FBArenaParser objectWithUTF8String:[friendsJSON bytes] error:NULL];
+}
+
+- (void)benchArenaProjection
+{
+  [FBArenaParser objectWithUTF8String:[friendsJSON bytes] projection:friendsProjection error:NULL];
+}
+
+- (void)benchRowSchema
+{
+  [friendsSchema resultWithUTF8String:[friendsJSON bytes]
+                           projection:[friendsSchema projection]
+                                error:NULL];
+}
+
+- (void)benchManualMapping
+{
+  // what an application without a schema does with the same response
+  [self usersForRows:[jsonParser fragmentWithUTF8String:[friendsJSON bytes]]];
+}
+
+- (void)benchMultiqueryRowSchema
+{
+  [FBRowSchema multiqueryResultWithUTF8String:[multiqueryJSON bytes]
+                                      schemas:multiquerySchemas
+                                   projection:nil
+                                        error:NULL];
+}
+
+- (void)benchMultiqueryManualMapping
+{
+  NSArray* results = [jsonParser fragmentWithUTF8String:[multiqueryJSON bytes]];
+  NSMutableDictionary* users = [NSMutableDictionary dictionaryWithCapacity:[results count]];
+  for (int i = 0; i < [results count]; i++) {
+    NSDictionary* result = [results objectAtIndex:i];
+    [users setObject:[self usersForRows:[result objectForKey:@"fql_result_set"]]
+              forKey:[result objectForKey:@"name"]];
+  }
+}
+
+- (NSArray*)usersForRows:(NSArray*)rows
+{
+  NSMutableArray* users = [NSMutableArray arrayWithCapacity:[rows count]];
+  for (int i = 0; i < [rows count]; i++) {
+    FBBenchmarkUser* user = [[FBBenchmarkUser alloc] initWithRow:[rows objectAtIndex:i]];
+    [users addObject:user];
+    [user release];
+  }
+  return users;
+}
+
+- (void)benchBinaryEncode
+{
+  [FBBinaryCoder dataWithObject:friendRows error:NULL];
+}
+
+- (void)benchBinaryDecode
+{
+  [FBBinaryCoder objectWithData:friendsBinary error:NULL];
+}
+
+- (void)benchJSONParseData:(NSData*)json
+{
+  [jsonParser fragmentWithUTF8String:[json bytes]];
+}
+
+- (void)benchArenaParseData:(NSData*)json
+{
+  [FBArenaParser objectWithUTF8String:[json bytes] error:NULL];
+}
+
+- (void)benchJSONWriteObject:(id)object
+{
+  [jsonWriter stringWithObject:object];
+}
+
+- (void)benchBinaryEncodeObject:(id)object
+{
+  [FBBinaryCoder dataWithObject:object error:NULL];
+}
+
+- (void)benchBinaryDecodeData:(NSData*)binary
+{
+  [FBBinaryCoder objectWithData:binary error:NULL];
+}
+
+- (void)benchSignature
+{
+  [connect sigForArguments:signedArguments secret:@"0f1e2d3c4b5a69788796a5b4c3d2e1f0"];
+}
+
+- (void)benchMD5
+{
+  [uploadBody md5];
+}
+
+- (void)benchURLEncode
+{
+  [NSString urlEncodeArguments:signedArguments];
+}
+
+- (void)benchURLDecode
+{
+  [requestString urlDecodeArguments];
+}
+
+- (void)benchPostData
+{
+  // files are NSImages, which headless builds leave out, so only the fields
+  [connect postDataForMethod:@"photos.upload" arguments:callArguments files:nil];
+}
+
+- (void)benchBatchFanOut
+{
+  // a batch marks each request it answers finished, so every op needs new
+  // ones; they're built from the signed string to leave signing untimed
+  NSMutableArray* requests = [NSMutableArray arrayWithCapacity:kBatchSize];
+  for (int i = 0; i < kBatchSize; i++) {
+    [requests addObject:[FBMethodRequest requestWithRequest:requestString
+                                                     parent:connect
+                                                     target:nil
+                                                   selector:NULL]];
+  }
+  FBBatchRequest* batch = [FBBatchRequest requestWithRequest:requestString
+                                                    requests:requests
+                                                      parent:connect];
+  [batch success:batchResponse];
+}
+
+- (void)benchMultiqueryFanOut
+{
+  [multiquery success:[multiquery resultForUTF8String:[multiqueryJSON bytes]]];
+}
+
+- (void)benchTableStoreLookup
+{
+  NSString* remoteQuery;
+  [tableStore rowsForQuery:tableQuery remoteQuery:&remoteQuery];
+}
+
+@end
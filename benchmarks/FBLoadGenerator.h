@@ -0,0 +1,99 @@
+//
+//  FBLoadGenerator.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class FBConnect;
+
+/*!
+ * The bytes malloc has handed out and not had back.
+ */
+long long FBHeapBytesInUse(void);
+
+
+/*!
+ * @class FBLoadGenerator
+ *
+ * Drives a number of FBConnect clients against a REST server, such as an
+ * FBStubServer, for a set duration. Each client keeps one call outstanding
+ * at a time, cycling through an fql.query, an fql.multiquery of three
+ * queries, a batch.run of batchSize queries and users.getLoggedInUser.
+ *
+ * Runs from the run loop of the thread it was started on, calling back the
+ * target's selector with itself once the last call has completed.
+ */
+@interface FBLoadGenerator : NSObject {
+  NSMutableArray*  clients;
+  NSTimeInterval   duration;
+  NSUInteger       batchSize;
+  NSUInteger       rowCount;
+
+  id               target;
+  SEL              selector;
+
+  NSUInteger*      steps;
+  NSUInteger*      pendingCalls;
+
+  NSTimeInterval   startTime;
+  NSTimeInterval   finishTime;
+  long long        startHeapSize;
+  long long        peakHeapSize;
+  long long        finishHeapSize;
+  NSUInteger       outstandingCalls;
+  NSUInteger       failureCount;
+  NSCountedSet*    errorCodes;
+  NSMutableArray*  latencies;
+}
+
+/*!
+ * Makes clientCount FBConnects calling the server at url.
+ */
+- (id)initWithURL:(NSString*)url clientCount:(NSUInteger)clientCount;
+
+- (NSArray*)clients;
+
+/*!
+ * 10 seconds by default.
+ */
+- (void)setDuration:(NSTimeInterval)seconds;
+
+/*!
+ * The calls in each batch.run, 5 by default.
+ */
+- (void)setBatchSize:(NSUInteger)size;
+
+/*!
+ * The LIMIT of each query, 25 by default.
+ */
+- (void)setRowCount:(NSUInteger)count;
+
+- (void)startWithTarget:(id)aTarget selector:(SEL)aSelector;
+
+- (BOOL)isFinished;
+- (NSUInteger)callCount;
+- (NSUInteger)failureCount;
+- (NSTimeInterval)duration;
+- (double)callsPerSecond;
+
+/*!
+ * The latency below which the given fraction (0.99 for the p99) of calls
+ * completed.
+ */
+- (NSTimeInterval)latencyAtPercentile:(double)percentile;
+
+/*!
+ * The growth of the heap while running, at its largest and at the end.
+ */
+- (long long)peakHeapGrowth;
+- (long long)heapGrowth;
+
+/*!
+ * A summary of the run, for printing.
+ */
+- (NSString*)report;
+
+@end
@@ -0,0 +1,285 @@
+//
+//  FBLoadGenerator.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBLoadGenerator.h"
+#import "FBConnect.h"
+#ifdef __APPLE__
+  #include <malloc/malloc.h>
+#else
+  #include <malloc.h>
+#endif
+
+#define kDefaultDuration  10.0
+#define kDefaultBatchSize 5
+#define kDefaultRowCount  25
+
+// the calls each client cycles through
+enum {
+  FBLoadQueryStep,
+  FBLoadMultiqueryStep,
+  FBLoadBatchStep,
+  FBLoadLoggedInUserStep,
+  FBLoadStepCount
+};
+
+
+long long FBHeapBytesInUse(void)
+{
+#ifdef __APPLE__
+  struct mstats stats = mstats();
+  return stats.bytes_used;
+#else
+  struct mallinfo info = mallinfo();
+  return (long long)info.uordblks + info.hblkhd;
+#endif
+}
+
+
+@interface FBLoadGenerator (Private)
+
+- (NSString*)queryForClient:(NSUInteger)client;
+- (void)callNextForClient:(NSUInteger)client;
+- (void)callFinished:(id<FBRequest>)request;
+- (void)finishIfDone;
+
+@end
+
+
+@implementation FBLoadGenerator
+
+- (id)initWithURL:(NSString*)url clientCount:(NSUInteger)clientCount
+{
+  if (self = [super init]) {
+    clients = [[NSMutableArray alloc] initWithCapacity:clientCount];
+    for (NSUInteger i = 0; i < clientCount; i++) {
+      FBConnect* client = [FBConnect sessionWithAPIKey:[NSString stringWithFormat:@"load%lu", (unsigned long)i]
+                                              delegate:nil];
+      [client setSecret:@"load"];
+      [client setRESTURL:url];
+      [clients addObject:client];
+    }
+    duration   = kDefaultDuration;
+    batchSize  = kDefaultBatchSize;
+    rowCount   = kDefaultRowCount;
+    errorCodes = [[NSCountedSet alloc] init];
+    latencies  = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [clients release];
+  [errorCodes release];
+  [latencies release];
+  free(steps);
+  free(pendingCalls);
+  [super dealloc];
+}
+
+- (NSArray*)clients
+{
+  return clients;
+}
+
+- (void)setDuration:(NSTimeInterval)seconds
+{
+  duration = seconds;
+}
+
+- (void)setBatchSize:(NSUInteger)size
+{
+  batchSize = MAX(1, size);
+}
+
+- (void)setRowCount:(NSUInteger)count
+{
+  rowCount = count;
+}
+
+- (void)startWithTarget:(id)aTarget selector:(SEL)aSelector
+{
+  target   = aTarget;
+  selector = aSelector;
+
+  steps        = calloc([clients count], sizeof(NSUInteger));
+  pendingCalls = calloc([clients count], sizeof(NSUInteger));
+
+  startHeapSize = FBHeapBytesInUse();
+  peakHeapSize  = startHeapSize;
+  startTime     = [NSDate timeIntervalSinceReferenceDate];
+
+  for (NSUInteger i = 0; i < [clients count]; i++) {
+    [self callNextForClient:i];
+  }
+  [self finishIfDone];
+}
+
+- (BOOL)isFinished
+{
+  return finishTime > 0;
+}
+
+- (NSUInteger)callCount
+{
+  return [latencies count];
+}
+
+- (NSUInteger)failureCount
+{
+  return failureCount;
+}
+
+- (NSTimeInterval)duration
+{
+  return finishTime - startTime;
+}
+
+- (double)callsPerSecond
+{
+  return [self duration] > 0 ? [latencies count] / [self duration] : 0;
+}
+
+- (NSTimeInterval)latencyAtPercentile:(double)percentile
+{
+  if ([latencies count] == 0) {
+    return 0;
+  }
+  NSArray* sorted = [latencies sortedArrayUsingSelector:@selector(compare:)];
+  NSUInteger index = MIN((NSUInteger)(percentile * [sorted count]), [sorted count] - 1);
+  return [[sorted objectAtIndex:index] doubleValue];
+}
+
+- (long long)peakHeapGrowth
+{
+  return peakHeapSize - startHeapSize;
+}
+
+- (long long)heapGrowth
+{
+  return finishHeapSize - startHeapSize;
+}
+
+- (NSString*)report
+{
+  // failures by error code
+  NSMutableString* errors = [NSMutableString string];
+  NSArray* codes = [[errorCodes allObjects] sortedArrayUsingSelector:@selector(compare:)];
+  for (int i = 0; i < [codes count]; i++) {
+    NSNumber* code = [codes objectAtIndex:i];
+    [errors appendFormat:@", %@: %lu", code, (unsigned long)[errorCodes countForObject:code]];
+  }
+
+  return [NSString stringWithFormat:
+          @"clients: %lu\n"
+          @"calls: %lu (%lu failed%@)\n"
+          @"duration: %.3fs\n"
+          @"throughput: %.1f calls/s\n"
+          @"latency p50: %.2fms p90: %.2fms p99: %.2fms max: %.2fms\n"
+          @"heap growth: %lld bytes (peak %lld)\n",
+          (unsigned long)[clients count],
+          (unsigned long)[self callCount], (unsigned long)failureCount,
+          errors,
+          [self duration], [self callsPerSecond],
+          [self latencyAtPercentile:0.5] * 1000, [self latencyAtPercentile:0.9] * 1000,
+          [self latencyAtPercentile:0.99] * 1000, [self latencyAtPercentile:1] * 1000,
+          [self heapGrowth], [self peakHeapGrowth]];
+}
+
+#pragma mark Private Methods
+- (NSString*)queryForClient:(NSUInteger)client
+{
+  return [NSString stringWithFormat:
+          @"SELECT uid, name, pic_square, status, profile_update_time FROM user "
+          @"WHERE uid IN (SELECT uid2 FROM friend WHERE uid1 = %lu) LIMIT %lu",
+          (unsigned long)client, (unsigned long)rowCount];
+}
+
+- (void)callNextForClient:(NSUInteger)client
+{
+  if ([NSDate timeIntervalSinceReferenceDate] - startTime >= duration) {
+    return;
+  }
+
+  FBConnect* connect = [clients objectAtIndex:client];
+  NSNumber* clientNumber = [NSNumber numberWithUnsignedLong:client];
+  NSNumber* now = [NSNumber numberWithDouble:[NSDate timeIntervalSinceReferenceDate]];
+  NSArray* userData = [NSArray arrayWithObjects:clientNumber, now, nil];
+  NSString* query = [self queryForClient:client];
+
+  NSUInteger step = steps[client]++ % FBLoadStepCount;
+  NSUInteger calls = step == FBLoadBatchStep ? batchSize : 1;
+  pendingCalls[client] += calls;
+  outstandingCalls += calls;
+
+  NSMutableArray* requests = [NSMutableArray arrayWithCapacity:calls];
+  if (step == FBLoadQueryStep) {
+    [requests addObject:[connect fqlQuery:query
+                                   target:self
+                                 selector:@selector(callFinished:)]];
+  } else if (step == FBLoadMultiqueryStep) {
+    NSDictionary* queries = [NSDictionary dictionaryWithObjectsAndKeys:
+                             query, @"friends",
+                             @"SELECT uid, name FROM user WHERE uid = 100000000000001", @"me",
+                             @"SELECT page_id, name, pic_small FROM page WHERE page_id IN "
+                             @"(SELECT page_id FROM page_fan WHERE uid = 100000000000001)", @"pages",
+                             nil];
+    [requests addObject:[connect fqlMultiquery:queries
+                                        target:self
+                                      selector:@selector(callFinished:)]];
+  } else if (step == FBLoadBatchStep) {
+    [connect startBatch];
+    for (NSUInteger i = 0; i < batchSize; i++) {
+      [requests addObject:[connect fqlQuery:query
+                                     target:self
+                                   selector:@selector(callFinished:)]];
+    }
+    [connect sendBatch];
+  } else {
+    [requests addObject:[connect callMethod:@"users.getLoggedInUser"
+                              withArguments:nil
+                                     target:self
+                                   selector:@selector(callFinished:)]];
+  }
+
+  for (int i = 0; i < [requests count]; i++) {
+    [[requests objectAtIndex:i] setUserData:userData];
+  }
+}
+
+- (void)callFinished:(id<FBRequest>)request
+{
+  NSArray* userData = [request userData];
+  NSUInteger client = [[userData objectAtIndex:0] unsignedLongValue];
+  NSTimeInterval latency = [NSDate timeIntervalSinceReferenceDate] - [[userData objectAtIndex:1] doubleValue];
+  [latencies addObject:[NSNumber numberWithDouble:latency]];
+  if ([request error]) {
+    failureCount++;
+    [errorCodes addObject:[NSNumber numberWithInteger:[[request error] code]]];
+  }
+  peakHeapSize = MAX(peakHeapSize, FBHeapBytesInUse());
+
+  outstandingCalls--;
+  if (--pendingCalls[client] == 0) {
+    [self callNextForClient:client];
+  }
+  [self finishIfDone];
+}
+
+- (void)finishIfDone
+{
+  if (outstandingCalls > 0 || [self isFinished]) {
+    return;
+  }
+
+  finishTime     = [NSDate timeIntervalSinceReferenceDate];
+  finishHeapSize = FBHeapBytesInUse();
+
+  DELEGATE(target, selector);
+}
+
+@end
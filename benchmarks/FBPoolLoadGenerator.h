@@ -0,0 +1,80 @@
+//
+//  FBPoolLoadGenerator.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class FBClientPool;
+
+
+/*!
+ * @class FBPoolLoadGenerator
+ *
+ * Drives an FBClientPool of many sessions against a REST server, such as an
+ * FBStubServer, for a set duration. Each FBPooledClient keeps one fql.query
+ * queued or outstanding at a time, so the pool always has more work than
+ * connections once there are more clients than maxConcurrentRequests.
+ *
+ * The heap is measured before and after the clients are added, to give the
+ * memory held by each idle session.
+ *
+ * Runs from the run loop of the thread it was started on, calling back the
+ * target's selector with itself once the last call has completed.
+ */
+@interface FBPoolLoadGenerator : NSObject {
+  FBClientPool*    pool;
+  NSMutableArray*  clients;
+  NSTimeInterval   duration;
+  NSUInteger       rowCount;
+
+  id               target;
+  SEL              selector;
+
+  long long        idleHeapGrowth;
+  NSTimeInterval   startTime;
+  NSTimeInterval   finishTime;
+  NSUInteger       outstandingCalls;
+  NSUInteger       callCount;
+  NSUInteger       failureCount;
+}
+
+/*!
+ * Makes a pool of clientCount sessions calling the server at url.
+ */
+- (id)initWithURL:(NSString*)url clientCount:(NSUInteger)clientCount;
+
+- (FBClientPool*)pool;
+
+/*!
+ * 10 seconds by default.
+ */
+- (void)setDuration:(NSTimeInterval)seconds;
+
+/*!
+ * The LIMIT of each query, 25 by default.
+ */
+- (void)setRowCount:(NSUInteger)count;
+
+- (void)startWithTarget:(id)aTarget selector:(SEL)aSelector;
+
+- (BOOL)isFinished;
+- (NSUInteger)clientCount;
+- (NSUInteger)callCount;
+- (NSUInteger)failureCount;
+- (NSTimeInterval)duration;
+- (double)callsPerSecond;
+
+/*!
+ * The growth of the heap from adding the clients, divided among them.
+ */
+- (double)bytesPerIdleClient;
+
+/*!
+ * A line summarizing the run, for printing.
+ */
+- (NSString*)report;
+
+@end
@@ -0,0 +1,169 @@
+//
+//  FBPoolLoadGenerator.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBPoolLoadGenerator.h"
+#import "FBLoadGenerator.h"
+#import "FBClientPool.h"
+#import "FBPooledClient.h"
+
+#define kDefaultDuration 10.0
+#define kDefaultRowCount 25
+
+
+@interface FBPoolLoadGenerator (Private)
+
+- (void)callNextForClient:(NSUInteger)client;
+- (void)callFinished:(id<FBRequest>)request;
+- (void)finishIfDone;
+
+@end
+
+
+@implementation FBPoolLoadGenerator
+
+- (id)initWithURL:(NSString*)url clientCount:(NSUInteger)clientCount
+{
+  if (self = [super init]) {
+    pool = [[FBClientPool poolWithAPIKey:@"load"] retain];
+    [pool setSecret:@"load"];
+    [pool setRESTURL:url];
+    clients = [[NSMutableArray alloc] initWithCapacity:clientCount];
+
+    long long heapSize = FBHeapBytesInUse();
+    for (NSUInteger i = 0; i < clientCount; i++) {
+      NSString* uid = [NSString stringWithFormat:@"%llu", 100000000000000ull + i];
+      NSString* sessionKey = [NSString stringWithFormat:@"2.load%lu_%@-%@", (unsigned long)i, uid, uid];
+      [clients addObject:[pool addClientWithUid:uid sessionKey:sessionKey secret:nil]];
+    }
+    idleHeapGrowth = FBHeapBytesInUse() - heapSize;
+
+    duration = kDefaultDuration;
+    rowCount = kDefaultRowCount;
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [clients release];
+  [pool release];
+  [super dealloc];
+}
+
+- (FBClientPool*)pool
+{
+  return pool;
+}
+
+- (void)setDuration:(NSTimeInterval)seconds
+{
+  duration = seconds;
+}
+
+- (void)setRowCount:(NSUInteger)count
+{
+  rowCount = count;
+}
+
+- (void)startWithTarget:(id)aTarget selector:(SEL)aSelector
+{
+  target    = aTarget;
+  selector  = aSelector;
+  startTime = [NSDate timeIntervalSinceReferenceDate];
+
+  for (NSUInteger i = 0; i < [clients count]; i++) {
+    [self callNextForClient:i];
+  }
+  [self finishIfDone];
+}
+
+- (BOOL)isFinished
+{
+  return finishTime > 0;
+}
+
+- (NSUInteger)clientCount
+{
+  return [clients count];
+}
+
+- (NSUInteger)callCount
+{
+  return callCount;
+}
+
+- (NSUInteger)failureCount
+{
+  return failureCount;
+}
+
+- (NSTimeInterval)duration
+{
+  return finishTime - startTime;
+}
+
+- (double)callsPerSecond
+{
+  return [self duration] > 0 ? callCount / [self duration] : 0;
+}
+
+- (double)bytesPerIdleClient
+{
+  return [clients count] > 0 ? (double)idleHeapGrowth / [clients count] : 0;
+}
+
+- (NSString*)report
+{
+  return [NSString stringWithFormat:
+          @"sessions: %6lu  calls: %8lu (%lu failed)  throughput: %9.1f calls/s  idle: %7.0f bytes/session\n",
+          (unsigned long)[clients count],
+          (unsigned long)callCount, (unsigned long)failureCount,
+          [self callsPerSecond], [self bytesPerIdleClient]];
+}
+
+#pragma mark Private Methods
+- (void)callNextForClient:(NSUInteger)client
+{
+  if ([NSDate timeIntervalSinceReferenceDate] - startTime >= duration) {
+    return;
+  }
+
+  outstandingCalls++;
+  NSString* query = [NSString stringWithFormat:
+                     @"SELECT uid, name, pic_square FROM user "
+                     @"WHERE uid IN (SELECT uid2 FROM friend WHERE uid1 = %@) LIMIT %lu",
+                     [[clients objectAtIndex:client] uid], (unsigned long)rowCount];
+  id<FBRequest> request = [[clients objectAtIndex:client] fqlQuery:query
+                                                            target:self
+                                                          selector:@selector(callFinished:)];
+  [request setUserData:[NSNumber numberWithUnsignedLong:client]];
+}
+
+- (void)callFinished:(id<FBRequest>)request
+{
+  callCount++;
+  if ([request error]) {
+    failureCount++;
+  }
+
+  outstandingCalls--;
+  [self callNextForClient:[[request userData] unsignedLongValue]];
+  [self finishIfDone];
+}
+
+- (void)finishIfDone
+{
+  if (outstandingCalls > 0 || [self isFinished]) {
+    return;
+  }
+
+  finishTime = [NSDate timeIntervalSinceReferenceDate];
+
+  DELEGATE(target, selector);
+}
+
+@end
@@ -0,0 +1,103 @@
+//
+//  FBStubServer.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef enum {
+  FBStubLatencyConstant,   // always low
+  FBStubLatencyUniform,    // anywhere from low to high
+  FBStubLatencyLogNormal   // a median of low and a p99 of high
+} FBStubLatencyDistribution;
+
+
+/*!
+ * @class FBStubServer
+ *
+ * A local stand-in for the REST server, to point FBConnect's setRESTURL: at.
+ * Answers fql.query, fql.multiquery, batch.run and users.getLoggedInUser
+ * with synthetic results:
+ *
+ *   SELECT cols FROM table WHERE key IN (values) - a row for each value
+ *   SELECT cols FROM table ... LIMIT n OFFSET m  - rows m to m + n
+ *   SELECT cols FROM table ...                   - rowCount rows
+ *
+ * Responses are held back by a latency drawn from the configured
+ * distribution, and calls may be failed with injected error codes, each of
+ * the calls in a batch.run independently. Signatures and sessions are not
+ * checked.
+ *
+ * Serves from the run loop of the thread it was started on, and should be
+ * configured before it is started.
+ */
+@interface FBStubServer : NSObject {
+  NSFileHandle*        listener;
+  unsigned short       port;
+  NSMutableSet*        connections;
+
+  FBStubLatencyDistribution latencyDistribution;
+  NSTimeInterval       lowLatency;
+  NSTimeInterval       highLatency;
+  NSMutableDictionary* errorRates;
+  NSUInteger           rowCount;
+  BOOL                 compressesResponses;
+
+  unsigned long        requestCount;
+  unsigned long        callCount;
+  unsigned long        injectedErrorCount;
+}
+
+/*!
+ * Configures the server from the options the command line tools take:
+ *
+ *   -latency constant|uniform|lognormal -low ms -high ms
+ *   -rows n -errors code:rate,code:rate -gzip NO
+ */
+- (void)setOptionsFromDefaults:(NSUserDefaults*)defaults;
+
+/*!
+ * Listens on 127.0.0.1, on any free port if aPort is 0.
+ */
+- (BOOL)startOnPort:(unsigned short)aPort error:(NSError**)error;
+- (void)stop;
+
+- (unsigned short)port;
+
+/*!
+ * The URL to give FBConnect's setRESTURL:.
+ */
+- (NSString*)restURL;
+
+/*!
+ * Constant at 0 by default.
+ */
+- (void)setLatencyDistribution:(FBStubLatencyDistribution)distribution
+                           low:(NSTimeInterval)low
+                          high:(NSTimeInterval)high;
+
+/*!
+ * Fails the given fraction of calls with the error code, such as
+ * FBAPITooManyCallsError or FBSessionExpiredError.
+ */
+- (void)setErrorRate:(double)rate forCode:(int)code;
+- (void)removeAllErrorRates;
+
+/*!
+ * The rows answering a query with neither keys nor a LIMIT. 25 by default.
+ */
+- (void)setRowCount:(NSUInteger)count;
+- (NSUInteger)rowCount;
+
+/*!
+ * Gzips responses for clients which accept it. On by default.
+ */
+- (void)setCompressesResponses:(BOOL)compress;
+
+- (unsigned long)requestCount;
+- (unsigned long)callCount;
+- (unsigned long)injectedErrorCount;
+
+@end
@@ -0,0 +1,719 @@
+//
+//  FBStubServer.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBStubServer.h"
+#import "FBConnect.h"
+#import "FBCocoa.h"
+#import "FBInflater.h"
+#import "JSON.h"
+#import "NSData+.h"
+#import "NSString+.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define kStubLoggedInUser   100000000000001ull
+#define kStubFirstID        100000000000000ull
+#define kStubFirstTime      1270000000
+#define kDefaultRowCount    25
+#define kListenBacklog      128
+
+// the p99 of a standard normal distribution
+#define kNormalP99 2.326
+
+
+static NSError* FBStubServerError(NSString* message)
+{
+  return [NSError errorWithDomain:kFBErrorDomainKey
+                             code:FBAPIUnknownError
+                         userInfo:[NSDictionary dictionaryWithObject:message
+                                                              forKey:kFBErrorMessageKey]];
+}
+
+static NSString* FBStubErrorMessage(int code)
+{
+  switch (code) {
+    case FBAPIUnknownError:        return @"An unknown error occurred";
+    case FBAPIServiceError:        return @"Service temporarily unavailable";
+    case FBAPIMethodError:         return @"Unknown method";
+    case FBAPITooManyCallsError:   return @"Application request limit reached";
+    case FBParamSessionKeyError:   return @"Session key invalid or no longer valid";
+    case FBSessionExpiredError:    return @"Session key expired";
+    case FBSessionInvalidError:    return @"Invalid session key";
+    case FBSessionRequiredError:   return @"Session key required";
+    case FBFQLParserError:         return @"Parser error";
+  }
+  return [NSString stringWithFormat:@"Error %d", code];
+}
+
+static double FBStubRandom(void)
+{
+  // never 0, which the log normal can't take
+  return (random() + 1.0) / ((double)RAND_MAX + 2.0);
+}
+
+
+/*
+ * One client's connection, which may carry many requests.
+ */
+@interface FBStubConnection : NSObject {
+@public
+  FBStubServer*  server;
+  NSFileHandle*  handle;
+  NSMutableData* buffer;
+  BOOL           keepAlive;
+}
+
+- (id)initWithHandle:(NSFileHandle*)aHandle server:(FBStubServer*)aServer;
+- (void)readRequest;
+- (void)sendResponse:(NSData*)response;
+- (void)close;
+
+@end
+
+
+@interface FBStubServer (Private)
+
+- (void)connectionAccepted:(NSNotification*)notification;
+- (void)connectionClosed:(FBStubConnection*)connection;
+- (void)connection:(FBStubConnection*)connection
+   receivedRequest:(NSString*)requestLine
+           headers:(NSDictionary*)headers
+              body:(NSData*)body;
+- (NSDictionary*)argumentsForRequest:(NSString*)requestLine
+                             headers:(NSDictionary*)headers
+                                body:(NSData*)body;
+- (NSDictionary*)multipartArguments:(NSData*)body boundary:(NSString*)boundary;
+- (id)resultForArguments:(NSDictionary*)arguments;
+- (NSDictionary*)injectedErrorForArguments:(NSDictionary*)arguments;
+- (NSArray*)rowsForQuery:(NSString*)query;
+- (id)valueForColumn:(NSString*)column row:(NSUInteger)row;
+- (NSTimeInterval)nextLatency;
+
+@end
+
+
+@implementation FBStubConnection
+
+- (id)initWithHandle:(NSFileHandle*)aHandle server:(FBStubServer*)aServer
+{
+  if (self = [super init]) {
+    server = aServer;
+    handle = [aHandle retain];
+    buffer = [[NSMutableData alloc] init];
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(dataAvailable:)
+                                                 name:NSFileHandleReadCompletionNotification
+                                               object:handle];
+    [handle readInBackgroundAndNotify];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [NSObject cancelPreviousPerformRequestsWithTarget:self];
+  [handle release];
+  [buffer release];
+  [super dealloc];
+}
+
+- (void)dataAvailable:(NSNotification*)notification
+{
+  NSData* data = [[notification userInfo] objectForKey:NSFileHandleNotificationDataItem];
+  if ([data length] == 0) {
+    [self close];
+    return;
+  }
+  [buffer appendData:data];
+  [self readRequest];
+}
+
+- (void)readRequest
+{
+  const char* bytes = [buffer bytes];
+  NSUInteger length = [buffer length];
+  NSUInteger headerEnd = NSNotFound;
+  for (NSUInteger i = 0; i + 3 < length; i++) {
+    if (memcmp(bytes + i, "\r\n\r\n", 4) == 0) {
+      headerEnd = i;
+      break;
+    }
+  }
+  if (headerEnd == NSNotFound) {
+    [handle readInBackgroundAndNotify];
+    return;
+  }
+
+  NSString* header = [[[NSString alloc] initWithBytes:bytes
+                                               length:headerEnd
+                                             encoding:NSISOLatin1StringEncoding] autorelease];
+  NSArray* lines = [header componentsSeparatedByString:@"\r\n"];
+  NSMutableDictionary* headers = [NSMutableDictionary dictionary];
+  for (int i = 1; i < [lines count]; i++) {
+    NSString* line = [lines objectAtIndex:i];
+    NSRange colon = [line rangeOfString:@":"];
+    if (colon.location != NSNotFound) {
+      NSString* value = [line substringFromIndex:colon.location + 1];
+      [headers setObject:[value stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]]
+                  forKey:[[line substringToIndex:colon.location] lowercaseString]];
+    }
+  }
+
+  NSUInteger bodyStart = headerEnd + 4;
+  NSUInteger bodyLength = [[headers objectForKey:@"content-length"] intValue];
+  if (bodyStart + bodyLength > length) {
+    [handle readInBackgroundAndNotify];
+    return;
+  }
+  NSData* body = [buffer subdataWithRange:NSMakeRange(bodyStart, bodyLength)];
+  [buffer replaceBytesInRange:NSMakeRange(0, bodyStart + bodyLength) withBytes:NULL length:0];
+
+  NSString* requestLine = [lines objectAtIndex:0];
+  NSString* connectionHeader = [[headers objectForKey:@"connection"] lowercaseString];
+  keepAlive = [requestLine hasSuffix:@"HTTP/1.1"] ?
+    ![connectionHeader isEqualToString:@"close"] :
+    [connectionHeader isEqualToString:@"keep-alive"];
+
+  [server connection:self receivedRequest:requestLine headers:headers body:body];
+}
+
+- (void)sendResponse:(NSData*)response
+{
+  @try {
+    [handle writeData:response];
+  } @catch (NSException* exception) {
+    // the client has gone
+    [self close];
+    return;
+  }
+
+  if (!keepAlive) {
+    [self close];
+  } else if ([buffer length] > 0) {
+    [self readRequest];
+  } else {
+    [handle readInBackgroundAndNotify];
+  }
+}
+
+- (void)close
+{
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [NSObject cancelPreviousPerformRequestsWithTarget:self];
+  [handle closeFile];
+  [server connectionClosed:self];
+}
+
+@end
+
+
+@implementation FBStubServer
+
+- (id)init
+{
+  if (self = [super init]) {
+    connections         = [[NSMutableSet alloc] init];
+    errorRates          = [[NSMutableDictionary alloc] init];
+    latencyDistribution = FBStubLatencyConstant;
+    rowCount            = kDefaultRowCount;
+    compressesResponses = YES;
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [self stop];
+  [connections release];
+  [errorRates release];
+  [super dealloc];
+}
+
+- (void)setOptionsFromDefaults:(NSUserDefaults*)defaults
+{
+  NSString* distribution = [defaults stringForKey:@"latency"];
+  NSTimeInterval low  = [defaults doubleForKey:@"low"] / 1000;
+  NSTimeInterval high = [defaults objectForKey:@"high"] ? [defaults doubleForKey:@"high"] / 1000 : low;
+  if ([distribution isEqualToString:@"uniform"]) {
+    [self setLatencyDistribution:FBStubLatencyUniform low:low high:high];
+  } else if ([distribution isEqualToString:@"lognormal"]) {
+    [self setLatencyDistribution:FBStubLatencyLogNormal low:low high:high];
+  } else {
+    [self setLatencyDistribution:FBStubLatencyConstant low:low high:high];
+  }
+
+  if ([defaults objectForKey:@"rows"]) {
+    [self setRowCount:[defaults integerForKey:@"rows"]];
+  }
+  if ([defaults objectForKey:@"gzip"]) {
+    [self setCompressesResponses:[defaults boolForKey:@"gzip"]];
+  }
+
+  NSArray* errors = [[defaults stringForKey:@"errors"] componentsSeparatedByString:@","];
+  for (int i = 0; i < [errors count]; i++) {
+    NSArray* codeAndRate = [[errors objectAtIndex:i] componentsSeparatedByString:@":"];
+    if ([codeAndRate count] == 2) {
+      [self setErrorRate:[[codeAndRate objectAtIndex:1] doubleValue]
+                 forCode:[[codeAndRate objectAtIndex:0] intValue]];
+    }
+  }
+}
+
+- (BOOL)startOnPort:(unsigned short)aPort error:(NSError**)error
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family      = AF_INET;
+  address.sin_port        = htons(aPort);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addressLength = sizeof(address);
+
+  if (fd < 0 ||
+      bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+      listen(fd, kListenBacklog) != 0 ||
+      getsockname(fd, (struct sockaddr*)&address, &addressLength) != 0) {
+    if (error) {
+      *error = FBStubServerError([NSString stringWithFormat:@"Can't listen on port %d: %s",
+                                  aPort, strerror(errno)]);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+    return NO;
+  }
+  port = ntohs(address.sin_port);
+
+  listener = [[NSFileHandle alloc] initWithFileDescriptor:fd closeOnDealloc:YES];
+  [[NSNotificationCenter defaultCenter] addObserver:self
+                                           selector:@selector(connectionAccepted:)
+                                               name:NSFileHandleConnectionAcceptedNotification
+                                             object:listener];
+  [listener acceptConnectionInBackgroundAndNotify];
+  return YES;
+}
+
+- (void)stop
+{
+  if (listener == nil) {
+    return;
+  }
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [listener closeFile];
+  [listener release];
+  listener = nil;
+
+  NSArray* open = [connections allObjects];
+  for (int i = 0; i < [open count]; i++) {
+    [[open objectAtIndex:i] close];
+  }
+}
+
+- (unsigned short)port
+{
+  return port;
+}
+
+- (NSString*)restURL
+{
+  return [NSString stringWithFormat:@"http://127.0.0.1:%d/restserver.php", port];
+}
+
+- (void)setLatencyDistribution:(FBStubLatencyDistribution)distribution
+                           low:(NSTimeInterval)low
+                          high:(NSTimeInterval)high
+{
+  latencyDistribution = distribution;
+  lowLatency          = MAX(0.0, low);
+  highLatency         = MAX(lowLatency, high);
+}
+
+- (void)setErrorRate:(double)rate forCode:(int)code
+{
+  [errorRates setObject:[NSNumber numberWithDouble:rate]
+                 forKey:[NSNumber numberWithInt:code]];
+}
+
+- (void)removeAllErrorRates
+{
+  [errorRates removeAllObjects];
+}
+
+- (void)setRowCount:(NSUInteger)count
+{
+  rowCount = count;
+}
+
+- (NSUInteger)rowCount
+{
+  return rowCount;
+}
+
+- (void)setCompressesResponses:(BOOL)compress
+{
+  compressesResponses = compress;
+}
+
+- (unsigned long)requestCount
+{
+  return requestCount;
+}
+
+- (unsigned long)callCount
+{
+  return callCount;
+}
+
+- (unsigned long)injectedErrorCount
+{
+  return injectedErrorCount;
+}
+
+#pragma mark Private Methods
+- (void)connectionAccepted:(NSNotification*)notification
+{
+  NSFileHandle* handle = [[notification userInfo] objectForKey:NSFileHandleNotificationFileHandleItem];
+  FBStubConnection* connection = [[FBStubConnection alloc] initWithHandle:handle server:self];
+  [connections addObject:connection];
+  [connection release];
+  [listener acceptConnectionInBackgroundAndNotify];
+}
+
+- (void)connectionClosed:(FBStubConnection*)connection
+{
+  [[connection retain] autorelease];
+  [connections removeObject:connection];
+}
+
+- (void)connection:(FBStubConnection*)connection
+   receivedRequest:(NSString*)requestLine
+           headers:(NSDictionary*)headers
+              body:(NSData*)body
+{
+  requestCount++;
+  NSDictionary* arguments = [self argumentsForRequest:requestLine headers:headers body:body];
+  id result = [self resultForArguments:arguments];
+  NSData* content = [([result isKindOfClass:[NSArray class]] || [result isKindOfClass:[NSDictionary class]] ?
+                      [result JSONRepresentation] : [result JSONFragment])
+                     dataUsingEncoding:NSUTF8StringEncoding];
+
+  NSData* compressed = nil;
+  NSString* accepted = [headers objectForKey:@"accept-encoding"];
+  if (compressesResponses && accepted && [accepted rangeOfString:@"gzip"].location != NSNotFound) {
+    compressed = [content gzipData];
+  }
+
+  NSMutableString* header = [NSMutableString stringWithString:@"HTTP/1.1 200 OK\r\n"];
+  [header appendString:@"Content-Type: text/javascript; charset=UTF-8\r\n"];
+  [header appendFormat:@"Content-Length: %lu\r\n", (unsigned long)[(compressed ? compressed : content) length]];
+  if (compressed) {
+    [header appendString:@"Content-Encoding: gzip\r\n"];
+  }
+  [header appendFormat:@"Connection: %@\r\n\r\n", connection->keepAlive ? @"keep-alive" : @"close"];
+
+  NSMutableData* response = [NSMutableData dataWithData:[header dataUsingEncoding:NSISOLatin1StringEncoding]];
+  [response appendData:(compressed ? compressed : content)];
+
+  NSTimeInterval latency = [self nextLatency];
+  if (latency > 0) {
+    [connection performSelector:@selector(sendResponse:) withObject:response afterDelay:latency];
+  } else {
+    [connection sendResponse:response];
+  }
+}
+
+- (NSDictionary*)argumentsForRequest:(NSString*)requestLine
+                             headers:(NSDictionary*)headers
+                                body:(NSData*)body
+{
+  // GET /restserver.php?method=...&sig=... HTTP/1.1
+  NSMutableDictionary* arguments = [NSMutableDictionary dictionary];
+  NSArray* parts = [requestLine componentsSeparatedByString:@" "];
+  NSString* target = [parts count] > 1 ? [parts objectAtIndex:1] : @"";
+  NSRange query = [target rangeOfString:@"?"];
+  if (query.location != NSNotFound) {
+    [arguments addEntriesFromDictionary:[[target substringFromIndex:query.location + 1] urlDecodeArguments]];
+  }
+
+  if ([body length] == 0) {
+    return arguments;
+  }
+  if ([[[headers objectForKey:@"content-encoding"] lowercaseString] isEqualToString:@"gzip"]) {
+    FBInflater* inflater = [[[FBInflater alloc] init] autorelease];
+    NSMutableData* inflated = [NSMutableData data];
+    if (![inflater inflateData:body intoBuffer:inflated]) {
+      return arguments;
+    }
+    body = inflated;
+  }
+
+  NSString* contentType = [headers objectForKey:@"content-type"];
+  NSRange boundary = [contentType rangeOfString:@"boundary="];
+  if (boundary.location != NSNotFound) {
+    [arguments addEntriesFromDictionary:
+     [self multipartArguments:body boundary:[contentType substringFromIndex:NSMaxRange(boundary)]]];
+  } else {
+    NSString* form = [[[NSString alloc] initWithData:body encoding:NSUTF8StringEncoding] autorelease];
+    [arguments addEntriesFromDictionary:[form urlDecodeArguments]];
+  }
+  return arguments;
+}
+
+- (NSDictionary*)multipartArguments:(NSData*)body boundary:(NSString*)boundary
+{
+  // Latin-1 keeps every byte, so the fields can be cut out and decoded after
+  NSString* form = [[[NSString alloc] initWithData:body encoding:NSISOLatin1StringEncoding] autorelease];
+  NSArray* parts = [form componentsSeparatedByString:[@"--" stringByAppendingString:boundary]];
+  NSMutableDictionary* fields = [NSMutableDictionary dictionary];
+  for (int i = 0; i < [parts count]; i++) {
+    NSString* part = [parts objectAtIndex:i];
+    NSRange headerEnd = [part rangeOfString:@"\r\n\r\n"];
+    NSRange nameStart = [part rangeOfString:@"name=\""];
+    if (headerEnd.location == NSNotFound || nameStart.location == NSNotFound ||
+        nameStart.location > headerEnd.location) {
+      continue;
+    }
+    NSString* afterName = [part substringFromIndex:NSMaxRange(nameStart)];
+    NSString* name = [afterName substringToIndex:[afterName rangeOfString:@"\""].location];
+
+    NSString* value = [part substringFromIndex:NSMaxRange(headerEnd)];
+    if ([value hasSuffix:@"\r\n"]) {
+      value = [value substringToIndex:[value length] - 2];
+    }
+    NSData* valueData = [value dataUsingEncoding:NSISOLatin1StringEncoding];
+    value = [[[NSString alloc] initWithData:valueData encoding:NSUTF8StringEncoding] autorelease];
+    if (value) {
+      [fields setObject:value forKey:name];
+    }
+  }
+  return fields;
+}
+
+- (id)resultForArguments:(NSDictionary*)arguments
+{
+  callCount++;
+  NSDictionary* error = [self injectedErrorForArguments:arguments];
+  if (error) {
+    injectedErrorCount++;
+    return error;
+  }
+
+  NSString* method = [[arguments objectForKey:@"method"] lowercaseString];
+  if ([method isEqualToString:@"fql.query"]) {
+    return [self rowsForQuery:[arguments objectForKey:@"query"]];
+  }
+
+  if ([method isEqualToString:@"fql.multiquery"]) {
+    NSDictionary* queries = [[arguments objectForKey:@"queries"] JSONValue];
+    if ([queries isKindOfClass:[NSDictionary class]]) {
+      NSMutableArray* results = [NSMutableArray arrayWithCapacity:[queries count]];
+      NSArray* names = [queries allKeys];
+      for (int i = 0; i < [names count]; i++) {
+        NSString* name = [names objectAtIndex:i];
+        [results addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                            name, @"name",
+                            [self rowsForQuery:[queries objectForKey:name]], @"fql_result_set",
+                            nil]];
+      }
+      return results;
+    }
+  }
+
+  if ([method isEqualToString:@"batch.run"]) {
+    NSArray* feed = [[arguments objectForKey:@"method_feed"] JSONValue];
+    if ([feed isKindOfClass:[NSArray class]]) {
+      // each call's result comes back as a string of JSON
+      NSMutableArray* results = [NSMutableArray arrayWithCapacity:[feed count]];
+      for (int i = 0; i < [feed count]; i++) {
+        id result = [self resultForArguments:[[feed objectAtIndex:i] urlDecodeArguments]];
+        [results addObject:([result isKindOfClass:[NSArray class]] || [result isKindOfClass:[NSDictionary class]] ?
+                            [result JSONRepresentation] : [result JSONFragment])];
+      }
+      return results;
+    }
+  }
+
+  if ([method isEqualToString:@"users.getloggedinuser"]) {
+    return [NSNumber numberWithUnsignedLongLong:kStubLoggedInUser];
+  }
+
+  int code = method ? FBAPIMethodError : FBParamError;
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [NSNumber numberWithInt:code], @"error_code",
+          FBStubErrorMessage(code), @"error_msg",
+          nil];
+}
+
+- (NSDictionary*)injectedErrorForArguments:(NSDictionary*)arguments
+{
+  if ([errorRates count] == 0) {
+    return nil;
+  }
+
+  double roll = FBStubRandom();
+  NSArray* codes = [errorRates allKeys];
+  for (int i = 0; i < [codes count]; i++) {
+    NSNumber* code = [codes objectAtIndex:i];
+    roll -= [[errorRates objectForKey:code] doubleValue];
+    if (roll < 0) {
+      NSMutableArray* requestArgs = [NSMutableArray arrayWithCapacity:[arguments count]];
+      NSArray* keys = [arguments allKeys];
+      for (int j = 0; j < [keys count]; j++) {
+        [requestArgs addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                                [keys objectAtIndex:j], @"key",
+                                [arguments objectForKey:[keys objectAtIndex:j]], @"value",
+                                nil]];
+      }
+      return [NSDictionary dictionaryWithObjectsAndKeys:
+              code, @"error_code",
+              FBStubErrorMessage([code intValue]), @"error_msg",
+              requestArgs, @"request_args",
+              nil];
+    }
+  }
+  return nil;
+}
+
+- (NSArray*)rowsForQuery:(NSString*)query
+{
+  // SELECT cols FROM table [WHERE key IN (values) | key = value ...] [LIMIT n [OFFSET m]]
+  NSScanner* scanner = [NSScanner scannerWithString:(query ? query : @"")];
+  [scanner setCaseSensitive:NO];
+  NSString* columnList = nil;
+  if (![scanner scanString:@"SELECT" intoString:NULL] ||
+      ![scanner scanUpToString:@"FROM" intoString:&columnList] ||
+      ![scanner scanString:@"FROM" intoString:NULL]) {
+    return [NSArray array];
+  }
+
+  NSMutableArray* columns = [NSMutableArray array];
+  NSArray* names = [columnList componentsSeparatedByString:@","];
+  for (int i = 0; i < [names count]; i++) {
+    NSString* column = [[names objectAtIndex:i] stringByTrimmingCharactersInSet:
+                        [NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    if ([column isEqualToString:@"*"]) {
+      [columns addObject:@"uid"];
+      [columns addObject:@"name"];
+    } else if ([column length] > 0) {
+      [columns addObject:column];
+    }
+  }
+
+  NSString* keyColumn = nil;
+  NSMutableArray* keys = nil;
+  NSCharacterSet* identifier = [NSCharacterSet characterSetWithCharactersInString:
+                                @"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_"];
+  [scanner scanCharactersFromSet:identifier intoString:NULL];
+  if ([scanner scanString:@"WHERE" intoString:NULL] &&
+      [scanner scanCharactersFromSet:identifier intoString:&keyColumn]) {
+    NSString* values = nil;
+    if ([scanner scanString:@"IN" intoString:NULL] && [scanner scanString:@"(" intoString:NULL] &&
+        ![scanner scanString:@"SELECT" intoString:NULL] &&
+        [scanner scanUpToString:@")" intoString:&values]) {
+      keys = [NSMutableArray arrayWithArray:[values componentsSeparatedByString:@","]];
+    } else if ([scanner scanString:@"=" intoString:NULL] &&
+               [scanner scanUpToCharactersFromSet:[NSCharacterSet whitespaceCharacterSet]
+                                       intoString:&values]) {
+      keys = [NSMutableArray arrayWithObject:values];
+    }
+    NSCharacterSet* quotes = [NSCharacterSet characterSetWithCharactersInString:@"'\" \t\r\n"];
+    for (int i = 0; i < [keys count]; i++) {
+      [keys replaceObjectAtIndex:i withObject:
+       [[keys objectAtIndex:i] stringByTrimmingCharactersInSet:quotes]];
+    }
+  }
+
+  NSUInteger first = 0;
+  NSUInteger count = keys ? [keys count] : rowCount;
+  NSRange limit = [query rangeOfString:@"LIMIT" options:NSCaseInsensitiveSearch | NSBackwardsSearch];
+  if (limit.location != NSNotFound) {
+    // LIMIT n OFFSET m, or LIMIT m, n
+    NSScanner* limitScanner = [NSScanner scannerWithString:[query substringFromIndex:NSMaxRange(limit)]];
+    [limitScanner setCaseSensitive:NO];
+    int n = 0, m = 0;
+    if ([limitScanner scanInt:&n]) {
+      if ([limitScanner scanString:@"," intoString:NULL] && [limitScanner scanInt:&m]) {
+        int swap = n; n = m; m = swap;
+      } else if ([limitScanner scanString:@"OFFSET" intoString:NULL]) {
+        [limitScanner scanInt:&m];
+      }
+      first = MAX(m, 0);
+      count = first < count ? MIN((NSUInteger)MAX(n, 0), count - first) : 0;
+    }
+  }
+
+  NSMutableArray* rows = [NSMutableArray arrayWithCapacity:count];
+  for (NSUInteger i = first; i < first + count; i++) {
+    NSMutableDictionary* row = [NSMutableDictionary dictionaryWithCapacity:[columns count]];
+    for (int j = 0; j < [columns count]; j++) {
+      NSString* column = [columns objectAtIndex:j];
+      id value;
+      if (keys && [column caseInsensitiveCompare:keyColumn] == NSOrderedSame) {
+        NSString* key = [keys objectAtIndex:i];
+        value = [key longLongValue] > 0 ? (id)[NSDecimalNumber decimalNumberWithString:key] : (id)key;
+      } else {
+        value = [self valueForColumn:column row:i];
+      }
+      [row setObject:value forKey:column];
+    }
+    [rows addObject:row];
+  }
+  return rows;
+}
+
+- (id)valueForColumn:(NSString*)column row:(NSUInteger)row
+{
+  NSString* name = [column lowercaseString];
+  if ([name isEqualToString:@"uid"] || [name hasSuffix:@"id"]) {
+    return [NSDecimalNumber numberWithUnsignedLongLong:kStubFirstID + row];
+  }
+  if ([name hasSuffix:@"time"]) {
+    return [NSNumber numberWithUnsignedLong:kStubFirstTime + row * 60];
+  }
+  if ([name hasPrefix:@"is_"]) {
+    return [NSNumber numberWithBool:(row % 2 == 0)];
+  }
+  if ([name hasPrefix:@"pic"] || [name hasSuffix:@"url"]) {
+    return [NSString stringWithFormat:@"http://127.0.0.1/%@/%lu.jpg", name, (unsigned long)row];
+  }
+  if ([name isEqualToString:@"name"]) {
+    return [NSString stringWithFormat:@"Stub User %lu", (unsigned long)row];
+  }
+  return [NSString stringWithFormat:@"%@ %lu", column, (unsigned long)row];
+}
+
+- (NSTimeInterval)nextLatency
+{
+  switch (latencyDistribution) {
+    case FBStubLatencyUniform:
+      return lowLatency + FBStubRandom() * (highLatency - lowLatency);
+
+    case FBStubLatencyLogNormal:
+      if (lowLatency > 0) {
+        // Box-Muller for a standard normal
+        double sigma  = log(highLatency / lowLatency) / kNormalP99;
+        double normal = sqrt(-2 * log(FBStubRandom())) * cos(2 * M_PI * FBStubRandom());
+        return lowLatency * exp(sigma * normal);
+      }
+      return 0;
+
+    default:
+      return lowLatency;
+  }
+}
+
+@end
@@ -0,0 +1,183 @@
+//
+//  fbload.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+//  Drives concurrent FBConnect clients against a REST server and reports
+//  what they saw:
+//
+//    fbload [-url http://127.0.0.1:8080/restserver.php] [-clients 10]
+//           [-duration 10] [-batch 5] [-rows 25] [-trace trace.json]
+//    fbload -pool YES [-clients 1000] [-concurrent 16] [-duration 10] [-rows 25]
+//
+//  Without -url, an FBStubServer is run in process on its own thread,
+//  taking fbstub's options. With -trace, the timeline of the last requests is
+//  saved for chrome://tracing.
+//
+//  With -pool, the sessions are FBPooledClients of one FBClientPool, run at
+//  1, 10, 100, 1000 and 10000 sessions in turn unless -clients is given, and
+//  each run reports its throughput and the memory held by an idle session.
+//
+
+#import <Foundation/Foundation.h>
+#import "FBConnect.h"
+#import "FBLoadGenerator.h"
+#import "FBPoolLoadGenerator.h"
+#import "FBClientPool.h"
+#import "FBStubServer.h"
+#import "FBTracer.h"
+
+#define kDefaultClients 10
+#define kTraceCapacity  200000
+#define kMaxPoolClients 10000
+
+// NSConditionLock conditions of the stub server's thread
+enum {
+  FBStubStarting,
+  FBStubStarted
+};
+
+
+/*
+ * Runs an FBStubServer on the thread it's started on.
+ */
+@interface FBStubServerThread : NSObject {
+@public
+  FBStubServer*    server;
+  NSConditionLock* started;
+  BOOL             listening;
+}
+
+- (void)run;
+
+@end
+
+@implementation FBStubServerThread
+
+- (void)run
+{
+  NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+  [started lock];
+  listening = [server startOnPort:0 error:NULL];
+  [started unlockWithCondition:FBStubStarted];
+  if (listening) {
+    [[NSRunLoop currentRunLoop] run];
+  }
+  [pool release];
+}
+
+@end
+
+
+static void FBRunUntilFinished(id generator)
+{
+  while (![generator isFinished]) {
+    NSAutoreleasePool* loopPool = [[NSAutoreleasePool alloc] init];
+    [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+                             beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    [loopPool release];
+  }
+}
+
+static int FBRunPool(NSString* url, NSUserDefaults* defaults)
+{
+  NSUInteger first = 1;
+  NSUInteger last  = kMaxPoolClients;
+  if ([defaults objectForKey:@"clients"]) {
+    first = last = MAX([defaults integerForKey:@"clients"], 1);
+  }
+
+  BOOL failed = NO;
+  for (NSUInteger clients = first; clients <= last; clients *= 10) {
+    NSAutoreleasePool* runPool = [[NSAutoreleasePool alloc] init];
+    FBPoolLoadGenerator* generator = [[FBPoolLoadGenerator alloc] initWithURL:url clientCount:clients];
+    if ([defaults objectForKey:@"concurrent"]) {
+      [[generator pool] setMaxConcurrentRequests:[defaults integerForKey:@"concurrent"]];
+    }
+    if ([defaults objectForKey:@"duration"]) {
+      [generator setDuration:[defaults doubleForKey:@"duration"]];
+    }
+    if ([defaults objectForKey:@"rows"]) {
+      [generator setRowCount:[defaults integerForKey:@"rows"]];
+    }
+
+    [generator startWithTarget:nil selector:NULL];
+    FBRunUntilFinished(generator);
+    printf("%s", [[generator report] UTF8String]);
+    fflush(stdout);
+
+    failed = failed || [generator callCount] == 0;
+    [generator release];
+    [runPool release];
+  }
+  return failed ? 1 : 0;
+}
+
+
+int main(int argc, const char* argv[])
+{
+  NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+  NSUserDefaults* defaults = [NSUserDefaults standardUserDefaults];
+
+  NSString* url = [defaults stringForKey:@"url"];
+  if (url == nil) {
+    FBStubServerThread* stub = [[FBStubServerThread alloc] init];
+    stub->server  = [[FBStubServer alloc] init];
+    stub->started = [[NSConditionLock alloc] initWithCondition:FBStubStarting];
+    [stub->server setOptionsFromDefaults:defaults];
+    [NSThread detachNewThreadSelector:@selector(run) toTarget:stub withObject:nil];
+
+    [stub->started lockWhenCondition:FBStubStarted];
+    [stub->started unlock];
+    if (!stub->listening) {
+      fprintf(stderr, "Couldn't start the stub server\n");
+      [pool release];
+      return 1;
+    }
+    url = [stub->server restURL];
+    printf("Serving %s\n", [url UTF8String]);
+  }
+
+  if ([defaults boolForKey:@"pool"]) {
+    int status = FBRunPool(url, defaults);
+    [pool release];
+    return status;
+  }
+
+  int clients = [defaults objectForKey:@"clients"] ? [defaults integerForKey:@"clients"] : kDefaultClients;
+  FBLoadGenerator* generator = [[FBLoadGenerator alloc] initWithURL:url clientCount:MAX(clients, 1)];
+  if ([defaults objectForKey:@"duration"]) {
+    [generator setDuration:[defaults doubleForKey:@"duration"]];
+  }
+  if ([defaults objectForKey:@"batch"]) {
+    [generator setBatchSize:[defaults integerForKey:@"batch"]];
+  }
+  if ([defaults objectForKey:@"rows"]) {
+    [generator setRowCount:[defaults integerForKey:@"rows"]];
+  }
+
+  NSString* tracePath = [defaults stringForKey:@"trace"];
+  if (tracePath) {
+    [FBTracer startWithCapacity:kTraceCapacity];
+  }
+
+  [generator startWithTarget:nil selector:NULL];
+  FBRunUntilFinished(generator);
+  printf("%s", [[generator report] UTF8String]);
+
+  if (tracePath) {
+    [FBTracer stop];
+    NSError* error = nil;
+    if ([FBTracer writeChromeTraceToFile:tracePath error:&error]) {
+      printf("trace: %lu events in %s\n", (unsigned long)[FBTracer eventCount], [tracePath UTF8String]);
+    } else {
+      fprintf(stderr, "%s\n", [[[error userInfo] objectForKey:kFBErrorMessageKey] UTF8String]);
+    }
+  }
+
+  BOOL failed = [generator callCount] == 0;
+  [generator release];
+  [pool release];
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,226 @@
+//
+//  fbstress.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+//  Submits requests from many threads at once through an FBLoopbackTransport
+//  and checks that every one is called back exactly once:
+//
+//    fbstress [-threads 16] [-calls 2000] [-batch 5] [-latency 0.001]
+//
+//  Each thread makes its calls in turn, every other one as part of a
+//  batch.run of -batch calls built up in that thread's own batch. The calls
+//  of each batch are put in a request group of their own. Exits with 1 if
+//  any call is never called back, or called back more than once, or if the
+//  connect still holds any group once every call has been answered.
+//
+
+#import <Foundation/Foundation.h>
+#import "FBConnect.h"
+#import "FBLoopbackTransport.h"
+#import "FBMethodRequest.h"
+#ifdef __APPLE__
+  #include <libkern/OSAtomic.h>
+#else
+  #define OSAtomicIncrement32Barrier(ptr) __sync_add_and_fetch(ptr, 1)
+#endif
+
+#define kDefaultThreads   16
+#define kDefaultCalls     2000
+#define kDefaultBatchSize 5
+#define kDefaultLatency   0.001
+#define kTimeout          60.0
+
+static volatile int32_t groupsDeallocated = 0;
+
+// NSConditionLock conditions of the submitting threads
+enum {
+  FBStressSubmitting,
+  FBStressSubmitted
+};
+
+
+/*
+ * The group of one batch's calls, which counts itself out once the connect
+ * lets go of it.
+ */
+@interface FBStressGroup : NSObject {
+}
+@end
+
+@implementation FBStressGroup
+
+- (void)dealloc
+{
+  OSAtomicIncrement32Barrier(&groupsDeallocated);
+  [super dealloc];
+}
+
+@end
+
+
+/*
+ * Makes one thread's calls, and counts the callbacks of all of them.
+ */
+@interface FBStressWorker : NSObject {
+@public
+  FBConnect*       connect;
+  NSUInteger       threadCount;
+  NSUInteger       callsPerThread;
+  NSUInteger       batchSize;
+
+  volatile int32_t* callbacks;
+  volatile int32_t  callbackCount;
+  volatile int32_t  failureCount;
+
+  volatile int32_t  groupCount;
+
+  NSConditionLock* submitted;
+  NSUInteger       threadsSubmitted;
+}
+
+- (void)submitFromThread:(NSNumber*)threadIndex;
+- (void)callFinished:(id<FBRequest>)request;
+
+@end
+
+@implementation FBStressWorker
+
+- (void)submitFromThread:(NSNumber*)threadIndex
+{
+  NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+  NSUInteger first = [threadIndex unsignedIntegerValue] * callsPerThread;
+
+  NSUInteger call = 0;
+  while (call < callsPerThread) {
+    NSAutoreleasePool* callPool = [[NSAutoreleasePool alloc] init];
+    BOOL batched = (call / batchSize) % 2 == 1;
+    NSUInteger calls = batched ? MIN(batchSize, callsPerThread - call) : 1;
+    FBStressGroup* group = nil;
+    if (batched) {
+      [connect startBatch];
+      group = [[[FBStressGroup alloc] init] autorelease];
+      OSAtomicIncrement32Barrier(&groupCount);
+    }
+    for (NSUInteger i = 0; i < calls; i++, call++) {
+      NSString* callId = [NSString stringWithFormat:@"%lu", (unsigned long)(first + call)];
+      NSString* method = (call % 3 == 0) ? @"users.getLoggedInUser" : @"fql.query";
+      id<FBRequest> request =
+        [connect callMethod:method
+              withArguments:[NSDictionary dictionaryWithObjectsAndKeys:
+                             callId, @"call_id",
+                             @"SELECT uid, name FROM user WHERE uid = 100000000000001", @"query",
+                             nil]
+                     target:self
+                   selector:@selector(callFinished:)];
+      [connect addRequest:request toGroup:group];
+    }
+    if (batched) {
+      [connect sendBatch];
+    }
+    [callPool release];
+  }
+
+  [submitted lock];
+  threadsSubmitted++;
+  [submitted unlockWithCondition:(threadsSubmitted == threadCount) ? FBStressSubmitted : FBStressSubmitting];
+  [pool release];
+}
+
+- (void)callFinished:(id<FBRequest>)request
+{
+  // called back on the network thread, as the calls weren't made on the
+  // main thread
+  if ([request error]) {
+    OSAtomicIncrement32Barrier(&failureCount);
+  }
+  NSUInteger callId = [[[(FBMethodRequest*)request arguments] objectForKey:@"call_id"] integerValue];
+  OSAtomicIncrement32Barrier(&callbacks[callId]);
+  OSAtomicIncrement32Barrier(&callbackCount);
+}
+
+@end
+
+
+int main(int argc, const char* argv[])
+{
+  NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+  NSUserDefaults* defaults = [NSUserDefaults standardUserDefaults];
+
+  FBStressWorker* worker = [[FBStressWorker alloc] init];
+  worker->threadCount    = [defaults objectForKey:@"threads"] ? MAX([defaults integerForKey:@"threads"], 1) : kDefaultThreads;
+  worker->callsPerThread = [defaults objectForKey:@"calls"] ? MAX([defaults integerForKey:@"calls"], 1) : kDefaultCalls;
+  worker->batchSize      = [defaults objectForKey:@"batch"] ? MAX([defaults integerForKey:@"batch"], 1) : kDefaultBatchSize;
+  worker->submitted      = [[NSConditionLock alloc] initWithCondition:FBStressSubmitting];
+
+  NSUInteger totalCalls = worker->threadCount * worker->callsPerThread;
+  worker->callbacks = calloc(totalCalls, sizeof(int32_t));
+
+  FBLoopbackTransport* transport = [[FBLoopbackTransport alloc] init];
+  [transport setLatency:[defaults objectForKey:@"latency"] ? [defaults doubleForKey:@"latency"] : kDefaultLatency];
+  [transport setResponse:@"100000000000001" forMethod:@"users.getLoggedInUser"];
+  [transport setResponse:[NSArray arrayWithObject:
+                          [NSDictionary dictionaryWithObjectsAndKeys:
+                           @"100000000000001", @"uid", @"Mark Moskovitz", @"name", nil]]
+               forMethod:@"fql.query"];
+
+  worker->connect = [[FBConnect sessionWithAPIKey:@"stress" delegate:nil] retain];
+  [worker->connect setSecret:@"stress"];
+  [worker->connect setTransport:transport];
+
+  NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
+  for (NSUInteger i = 0; i < worker->threadCount; i++) {
+    [NSThread detachNewThreadSelector:@selector(submitFromThread:)
+                             toTarget:worker
+                           withObject:[NSNumber numberWithUnsignedInteger:i]];
+  }
+  [worker->submitted lockWhenCondition:FBStressSubmitted];
+  [worker->submitted unlock];
+  NSTimeInterval submitTime = [NSDate timeIntervalSinceReferenceDate] - startTime;
+
+  NSDate* timeout = [NSDate dateWithTimeIntervalSinceNow:kTimeout];
+  while ((NSUInteger)worker->callbackCount < totalCalls && [timeout timeIntervalSinceNow] > 0) {
+    NSAutoreleasePool* loopPool = [[NSAutoreleasePool alloc] init];
+    [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+                             beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    [loopPool release];
+  }
+  NSTimeInterval finishTime = [NSDate timeIntervalSinceReferenceDate] - startTime;
+
+  // wait a while longer once everything seems answered, for any repeats
+  [NSThread sleepForTimeInterval:MAX(0.5, [transport latency] * 10)];
+
+  NSUInteger missing = 0;
+  NSUInteger repeated = 0;
+  for (NSUInteger i = 0; i < totalCalls; i++) {
+    if (worker->callbacks[i] == 0) {
+      missing++;
+    } else if (worker->callbacks[i] > 1) {
+      repeated++;
+    }
+  }
+
+  // every group's calls have been answered, so the connect holds none of them
+  int32_t groupsHeld = worker->groupCount - groupsDeallocated;
+
+  printf("threads: %lu\n"
+         "calls: %lu (%d failed) over %lu HTTP requests\n"
+         "submitted in: %.3fs, answered in: %.3fs (%.1f calls/s)\n"
+         "never called back: %lu, called back more than once: %lu\n"
+         "request groups still held: %d of %d\n",
+         (unsigned long)worker->threadCount,
+         (unsigned long)totalCalls, worker->failureCount, [transport requestCount],
+         submitTime, finishTime, finishTime > 0 ? totalCalls / finishTime : 0,
+         (unsigned long)missing, (unsigned long)repeated,
+         groupsHeld, worker->groupCount);
+
+  BOOL failed = missing > 0 || repeated > 0 || groupsHeld > 0;
+  free((void*)worker->callbacks);
+  [worker->connect release];
+  [worker->submitted release];
+  [worker release];
+  [transport release];
+  [pool release];
+  return failed ? 1 : 0;
+}
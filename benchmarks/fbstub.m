@@ -0,0 +1,44 @@
+//
+//  fbstub.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+//  Serves a stand-in for the REST server until killed:
+//
+//    fbstub [-port 8080] [-latency lognormal -low 40 -high 400] [-rows 500]
+//           [-errors 4:0.01,102:0.005] [-gzip NO]
+//
+
+#import <Foundation/Foundation.h>
+#import "FBConnect.h"
+#import "FBStubServer.h"
+
+#define kDefaultPort 8080
+
+
+int main(int argc, const char* argv[])
+{
+  NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+  NSUserDefaults* defaults = [NSUserDefaults standardUserDefaults];
+  FBStubServer* server = [[FBStubServer alloc] init];
+  [server setOptionsFromDefaults:defaults];
+
+  NSError* error = nil;
+  int port = [defaults objectForKey:@"port"] ? [defaults integerForKey:@"port"] : kDefaultPort;
+  if (![server startOnPort:port error:&error]) {
+    fprintf(stderr, "%s\n", [[[error userInfo] objectForKey:kFBErrorMessageKey] UTF8String]);
+    [server release];
+    [pool release];
+    return 1;
+  }
+  printf("Serving %s\n", [[server restURL] UTF8String]);
+  fflush(stdout);
+
+  [[NSRunLoop currentRunLoop] run];
+
+  [server release];
+  [pool release];
+  return 0;
+}
@@ -0,0 +1,12 @@
+//
+//  Cocoa.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+//  Stands in for Cocoa when FBCocoa is built with FB_HEADLESS, which leaves
+//  out everything that needs AppKit or WebKit.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreFoundation/CoreFoundation.h>
@@ -0,0 +1,41 @@
+//
+//  main.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+//  Prints the size of the FQL fixtures as JSON and as FBBinaryCoder data, then
+//  runs the hot path benchmarks, exiting with 1 if any regressed against the
+//  baseline. Takes its options as user defaults:
+//
+//    fbbench -baseline baseline.txt [-record YES] [-filter json] [-tolerance 0.2]
+//
+
+#import <Foundation/Foundation.h>
+#import "FBBenchmark.h"
+#import "FBHotPathBenchmarks.h"
+
+#define kDefaultBaseline  @"baseline.txt"
+#define kDefaultTolerance 0.2
+
+
+int main(int argc, const char* argv[])
+{
+  NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+  NSUserDefaults* defaults = [NSUserDefaults standardUserDefaults];
+  NSString* baseline = [defaults stringForKey:@"baseline"];
+  NSString* tolerance = [defaults stringForKey:@"tolerance"];
+
+  FBHotPathBenchmarks* hotPath = [[FBHotPathBenchmarks alloc] init];
+  printf("%s\n", [[hotPath sizeReport] UTF8String]);
+  int regressions = [FBBenchmark runBenchmarks:[hotPath benchmarks]
+                                        filter:[defaults stringForKey:@"filter"]
+                                      baseline:(baseline ? baseline : kDefaultBaseline)
+                                     tolerance:(tolerance ? [tolerance doubleValue] : kDefaultTolerance)
+                                        record:[defaults boolForKey:@"record"]];
+  [hotPath release];
+
+  [pool release];
+  return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+//
+//  FBArenaParser.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+extern NSString* const FBArenaParserErrorDomain;
+
+struct FBProjectionNode;
+
+
+/*!
+ * @class FBProjection
+ *
+ * The parts of a response to keep, as key paths such as "name" or
+ * "fql_result_set.uid". Arrays are passed through, so "uid" keeps the uid of
+ * every row of an FQL result. A key path keeps the whole of its value, and
+ * keys not on any path are skipped over without being parsed.
+ */
+@interface FBProjection : NSObject {
+  NSArray*                 keyPaths;
+  struct FBProjectionNode* root;
+}
+
++ (FBProjection*)projectionWithKeyPaths:(NSArray*)paths;
+
+/*!
+ * Key paths separated by commas, such as @"uid, name, pic_square".
+ */
++ (FBProjection*)projectionWithString:(NSString*)expression;
+
+- (id)initWithKeyPaths:(NSArray*)paths;
+
+- (NSArray*)keyPaths;
+
+@end
+
+
+/*!
+ * @class FBArenaParser
+ *
+ * Parses JSON into a handful of large blocks of memory instead of an object
+ * per value. Dictionaries and arrays are returned as read-only NSDictionary
+ * and NSArray subclasses over those blocks; the values in them are only made
+ * into objects when they're read, as the same classes SBJsonParser would
+ * return. Everything is freed at once when the last object read from the
+ * result goes away.
+ *
+ * Values are made afresh each time they're read, so hold on to those read
+ * more than once. Looking up a key searches the dictionary's keys in turn,
+ * which is quick for the small dictionaries API results are made of.
+ */
+@interface FBArenaParser : NSObject {
+}
+
+/*!
+ * Parses NUL terminated UTF-8, which need not outlive the call. A top level
+ * string, number, boolean or null is returned as an ordinary object.
+ */
++ (id)objectWithUTF8String:(const char*)bytes error:(NSError**)error;
+
+/*!
+ * Parses only the parts of the input on projection's key paths; anything
+ * else is scanned past. A nil projection keeps everything.
+ */
++ (id)objectWithUTF8String:(const char*)bytes
+                projection:(FBProjection*)projection
+                     error:(NSError**)error;
+
+@end
@@ -0,0 +1,1023 @@
+//
+//  FBArenaParser.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBArenaParser_Internal.h"
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define kMaxDepth 512
+#define kMinBlockSize 4096
+
+NSString* const FBArenaParserErrorDomain = @"FBArenaParserErrorDomain";
+
+
+typedef struct FBProjectionKey {
+  char*                    name;
+  size_t                   length;
+  struct FBProjectionNode* child;     // NULL keeps the whole value
+} FBProjectionKey;
+
+typedef struct FBProjectionNode {
+  unsigned int     count;
+  FBProjectionKey* keys;
+} FBProjectionNode;
+
+typedef struct FBArenaBlock {
+  struct FBArenaBlock* next;
+  size_t               used;
+  size_t               capacity;
+  char                 bytes[];
+} FBArenaBlock;
+
+
+/*
+ * Owns the blocks a result was parsed into. Every object read from the result
+ * retains it.
+ */
+@interface FBArena : NSObject {
+@public
+  FBArenaBlock*  blocks;
+  CFAllocatorRef textDeallocator;
+}
+
+- (id)initWithCapacity:(size_t)capacity;
+
+@end
+
+@interface FBArenaDictionary : NSDictionary {
+  FBArena*    arena;
+  FBJSONNode* node;
+}
+
+- (id)initWithArena:(FBArena*)anArena node:(FBJSONNode*)aNode;
+
+@end
+
+@interface FBArenaArray : NSArray {
+  FBArena*    arena;
+  FBJSONNode* node;
+}
+
+- (id)initWithArena:(FBArena*)anArena node:(FBJSONNode*)aNode;
+
+@end
+
+@interface FBArenaKeyEnumerator : NSEnumerator {
+  FBArena*     arena;
+  FBJSONNode*  node;
+  unsigned int index;
+}
+
+- (id)initWithArena:(FBArena*)anArena node:(FBJSONNode*)aNode;
+
+@end
+
+
+@interface FBProjection (Private)
+
+- (FBProjectionNode*)rootNode;
+
+@end
+
+
+typedef struct {
+  const char* c;
+  FBArena*    arena;
+  FBJSONNode* stack;
+  size_t      top;
+  size_t      capacity;
+  int         depth;
+  NSString*   failure;
+} FBArenaParseState;
+
+
+#pragma mark Arena
+static void* FBArenaAlloc(FBArena* arena, size_t size)
+{
+  size = (size + 7) & ~(size_t)7;
+  FBArenaBlock* block = arena->blocks;
+  if (block == NULL || block->capacity - block->used < size) {
+    size_t capacity = MAX(size, block ? block->capacity * 2 : kMinBlockSize);
+    FBArenaBlock* newBlock = malloc(sizeof(FBArenaBlock) + capacity);
+    if (newBlock == NULL) {
+      return NULL;
+    }
+    newBlock->next     = block;
+    newBlock->used     = 0;
+    newBlock->capacity = capacity;
+    arena->blocks = block = newBlock;
+  }
+  void* bytes = block->bytes + block->used;
+  block->used += size;
+  return bytes;
+}
+
+/*
+ * Strings made over the arena's text each retain it, and give it back here
+ * when they're done with it.
+ */
+static void FBReleaseArena(void* bytes, void* info)
+{
+  CFRelease((CFTypeRef)info);
+}
+
+static id FBObjectForNode(FBArena* arena, FBJSONNode* node)
+{
+  switch (node->type) {
+    case kNodeNull:
+      return [NSNull null];
+    case kNodeFalse:
+      return [NSNumber numberWithBool:NO];
+    case kNodeTrue:
+      return [NSNumber numberWithBool:YES];
+    case kNodeNumber: {
+      NSString* text = [[NSString alloc] initWithBytesNoCopy:(void*)node->value.text
+                                                      length:node->length
+                                                    encoding:NSASCIIStringEncoding
+                                                freeWhenDone:NO];
+      NSDecimalNumber* number = [NSDecimalNumber decimalNumberWithString:text];
+      [text release];
+      return number;
+    }
+    case kNodeASCIIString:
+      if (node->length == 0) {
+        return @"";
+      }
+      CFRetain((CFTypeRef)arena);
+      return [(id)CFStringCreateWithBytesNoCopy(NULL, (const UInt8*)node->value.text, node->length,
+                                                kCFStringEncodingASCII, false,
+                                                arena->textDeallocator) autorelease];
+    case kNodeString: {
+      id string = (id)CFStringCreateWithBytes(NULL, (const UInt8*)node->value.text, node->length,
+                                              kCFStringEncodingUTF8, false);
+      return string ? [string autorelease] : @"";
+    }
+    case kNodeArray:
+      return [[[FBArenaArray alloc] initWithArena:arena node:node] autorelease];
+    case kNodeDictionary:
+      return [[[FBArenaDictionary alloc] initWithArena:arena node:node] autorelease];
+  }
+  return nil;
+}
+
+
+#pragma mark Parsing
+static BOOL FBParseFail(FBArenaParseState* s, NSString* failure)
+{
+  if (s->failure == nil) {
+    s->failure = failure;
+  }
+  return NO;
+}
+
+static void FBSkipWhitespace(FBArenaParseState* s)
+{
+  while (isspace((unsigned char)*s->c)) {
+    s->c++;
+  }
+}
+
+static BOOL FBPushNode(FBArenaParseState* s, FBJSONNode* node)
+{
+  if (s->top == s->capacity) {
+    size_t capacity = MAX(s->capacity * 2, 64);
+    FBJSONNode* stack = realloc(s->stack, capacity * sizeof(FBJSONNode));
+    if (stack == NULL) {
+      return FBParseFail(s, @"Out of memory");
+    }
+    s->stack    = stack;
+    s->capacity = capacity;
+  }
+  s->stack[s->top++] = *node;
+  return YES;
+}
+
+static BOOL FBParseHexQuad(const char* in, const char* end, unsigned int* code)
+{
+  if (end - in < 4) {
+    return NO;
+  }
+  *code = 0;
+  for (int i = 0; i < 4; i++) {
+    char h = in[i];
+    int digit = (h >= '0' && h <= '9') ? h - '0'
+              : (h >= 'a' && h <= 'f') ? h - 'a' + 10
+              : (h >= 'A' && h <= 'F') ? h - 'A' + 10 : -1;
+    if (digit < 0) {
+      return NO;
+    }
+    *code = *code * 16 + digit;
+  }
+  return YES;
+}
+
+static char* FBPutUTF8(char* out, unsigned int code)
+{
+  if (code < 0x80) {
+    *out++ = code;
+  } else if (code < 0x800) {
+    *out++ = 0xc0 | (code >> 6);
+    *out++ = 0x80 | (code & 0x3f);
+  } else if (code < 0x10000) {
+    *out++ = 0xe0 | (code >> 12);
+    *out++ = 0x80 | ((code >> 6) & 0x3f);
+    *out++ = 0x80 | (code & 0x3f);
+  } else {
+    *out++ = 0xf0 | (code >> 18);
+    *out++ = 0x80 | ((code >> 12) & 0x3f);
+    *out++ = 0x80 | ((code >> 6) & 0x3f);
+    *out++ = 0x80 | (code & 0x3f);
+  }
+  return out;
+}
+
+/*
+ * Finds the closing quote of the string starting at s->c.
+ */
+static BOOL FBScanString(FBArenaParseState* s, const char** stringEnd,
+                         BOOL* hasEscapes, unsigned char* highBits)
+{
+  const char* end = s->c;
+  *hasEscapes = NO;
+  *highBits = 0;
+  for (;;) {
+    unsigned char ch = *end;
+    if (ch == '"') {
+      break;
+    } else if (ch == '\\') {
+      if (end[1] == '\0') {
+        return FBParseFail(s, @"Unexpected EOF while parsing string");
+      }
+      *hasEscapes = YES;
+      end += 2;
+    } else if (ch == '\0') {
+      return FBParseFail(s, @"Unexpected EOF while parsing string");
+    } else if (ch < 0x20) {
+      return FBParseFail(s, [NSString stringWithFormat:@"Unescaped control character '0x%x'", ch]);
+    } else {
+      *highBits |= ch;
+      end++;
+    }
+  }
+  *stringEnd = end;
+  return YES;
+}
+
+/*
+ * Called just past the opening quote.
+ */
+static BOOL FBParseString(FBArenaParseState* s, FBJSONNode* node)
+{
+  // find the end first; unescaping never makes a string longer, so it can
+  // then be copied or unescaped straight into place
+  const char* start = s->c;
+  const char* end;
+  BOOL hasEscapes;
+  unsigned char highBits;
+  if (!FBScanString(s, &end, &hasEscapes, &highBits)) {
+    return NO;
+  }
+
+  size_t spanLength = end - start;
+  if (spanLength > UINT_MAX) {
+    return FBParseFail(s, @"String too long");
+  }
+  char* text = FBArenaAlloc(s->arena, MAX(spanLength, 1));
+  if (text == NULL) {
+    return FBParseFail(s, @"Out of memory");
+  }
+
+  char* out = text;
+  if (!hasEscapes) {
+    memcpy(text, start, spanLength);
+    out += spanLength;
+  } else {
+    const char* in = start;
+    while (in < end) {
+      if (*in != '\\') {
+        *out++ = *in++;
+        continue;
+      }
+      in++;
+      switch (*in++) {
+        case '"':  *out++ = '"';  break;
+        case '\\': *out++ = '\\'; break;
+        case '/':  *out++ = '/';  break;
+        case 'b':  *out++ = '\b'; break;
+        case 'f':  *out++ = '\f'; break;
+        case 'n':  *out++ = '\n'; break;
+        case 'r':  *out++ = '\r'; break;
+        case 't':  *out++ = '\t'; break;
+        case 'u': {
+          unsigned int code, low;
+          if (!FBParseHexQuad(in, end, &code)) {
+            return FBParseFail(s, @"Broken unicode character");
+          }
+          in += 4;
+          if (code >= 0xd800 && code < 0xdc00) {
+            if (!(end - in >= 6 && in[0] == '\\' && in[1] == 'u' &&
+                  FBParseHexQuad(in + 2, end, &low) && low >= 0xdc00 && low < 0xe000)) {
+              return FBParseFail(s, @"Missing low character in surrogate pair");
+            }
+            in += 6;
+            code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+          } else if (code >= 0xdc00 && code < 0xe000) {
+            return FBParseFail(s, @"Invalid high character in surrogate pair");
+          }
+          if (code >= 0x80) {
+            highBits |= 0x80;
+          }
+          out = FBPutUTF8(out, code);
+          break;
+        }
+        default:
+          return FBParseFail(s, [NSString stringWithFormat:@"Illegal escape sequence '0x%x'", in[-1]]);
+      }
+    }
+  }
+
+  node->type       = (highBits & 0x80) ? kNodeString : kNodeASCIIString;
+  node->length     = (unsigned int)(out - text);
+  node->value.text = text;
+  s->c = end + 1;
+  return YES;
+}
+
+static BOOL FBParseNumber(FBArenaParseState* s, FBJSONNode* node)
+{
+  const char* start = s->c;
+  const char* c = start;
+
+  if (*c == '-') {
+    c++;
+  }
+  if (*c == '0') {
+    c++;
+    if (isdigit((unsigned char)*c)) {
+      return FBParseFail(s, @"Leading 0 disallowed in number");
+    }
+  } else if (!isdigit((unsigned char)*c)) {
+    return FBParseFail(s, @"No digits after initial minus");
+  }
+  while (isdigit((unsigned char)*c)) {
+    c++;
+  }
+
+  if (*c == '.') {
+    c++;
+    if (!isdigit((unsigned char)*c)) {
+      return FBParseFail(s, @"No digits after decimal point");
+    }
+    while (isdigit((unsigned char)*c)) {
+      c++;
+    }
+  }
+
+  if (*c == 'e' || *c == 'E') {
+    c++;
+    if (*c == '-' || *c == '+') {
+      c++;
+    }
+    if (!isdigit((unsigned char)*c)) {
+      return FBParseFail(s, @"No digits after exponent");
+    }
+    while (isdigit((unsigned char)*c)) {
+      c++;
+    }
+  }
+
+  size_t length = c - start;
+  char* text = FBArenaAlloc(s->arena, length);
+  if (text == NULL) {
+    return FBParseFail(s, @"Out of memory");
+  }
+  memcpy(text, start, length);
+  node->type       = kNodeNumber;
+  node->length     = (unsigned int)length;
+  node->value.text = text;
+  s->c = c;
+  return YES;
+}
+
+/*
+ * Moves past a value by its brackets and quotes alone, building nothing.
+ */
+static BOOL FBSkipValue(FBArenaParseState* s)
+{
+  FBSkipWhitespace(s);
+  const char* c = s->c;
+  int depth = 0;
+  do {
+    switch (*c) {
+      case '\0':
+        return FBParseFail(s, @"Unexpected end of string");
+      case '"':
+        for (c++; *c != '"'; c++) {
+          if (*c == '\0') {
+            return FBParseFail(s, @"Unexpected EOF while parsing string");
+          }
+          if (*c == '\\' && c[1] != '\0') {
+            c++;
+          }
+        }
+        c++;
+        break;
+      case '{':
+      case '[':
+        depth++;
+        c++;
+        break;
+      case '}':
+      case ']':
+        if (--depth < 0) {
+          return FBParseFail(s, @"Unbalanced brackets");
+        }
+        c++;
+        break;
+      default:
+        if (depth > 0) {
+          c += MAX(strcspn(c, "\"{}[]"), 1);
+        } else {
+          const char* literal = c;
+          c += strcspn(c, ",}] \t\r\n");
+          if (c == literal) {
+            return FBParseFail(s, @"Unrecognised leading character");
+          }
+        }
+        break;
+    }
+  } while (depth > 0);
+  s->c = c;
+  return YES;
+}
+
+static FBProjectionKey* FBProjectionMatch(FBProjectionNode* projection,
+                                          const char* name, size_t length)
+{
+  for (unsigned int i = 0; i < projection->count; i++) {
+    FBProjectionKey* key = &projection->keys[i];
+    if (key->length == length && memcmp(key->name, name, length) == 0) {
+      return key;
+    }
+  }
+  return NULL;
+}
+
+static BOOL FBParseValue(FBArenaParseState* s, FBJSONNode* node, FBProjectionNode* projection);
+
+/*
+ * Elements are gathered on the parse stack, then copied into the arena in
+ * one piece once the container is closed and their number is known. A
+ * projection picks out the keys of dictionaries to keep, and applies to each
+ * element of an array.
+ */
+static BOOL FBParseContainer(FBArenaParseState* s, FBJSONNode* node, BOOL isDictionary,
+                             FBProjectionNode* projection)
+{
+  char close = isDictionary ? '}' : ']';
+  if (++s->depth > kMaxDepth) {
+    return FBParseFail(s, @"Nested too deep");
+  }
+  size_t base = s->top;
+
+  FBSkipWhitespace(s);
+  if (*s->c == close) {
+    s->c++;
+  } else {
+    for (;;) {
+      FBJSONNode child;
+      FBProjectionNode* childProjection = projection;
+      BOOL keep = YES;
+      if (isDictionary) {
+        FBSkipWhitespace(s);
+        if (*s->c != '"') {
+          return FBParseFail(s, @"Object key string expected");
+        }
+        s->c++;
+
+        if (projection) {
+          // compare the key in place where possible, so skipped keys cost
+          // nothing but the scan
+          const char* end;
+          BOOL hasEscapes;
+          unsigned char highBits;
+          FBProjectionKey* match;
+          if (!FBScanString(s, &end, &hasEscapes, &highBits)) {
+            return NO;
+          }
+          if (hasEscapes) {
+            if (!FBParseString(s, &child)) {
+              return NO;
+            }
+            match = FBProjectionMatch(projection, child.value.text, child.length);
+          } else {
+            match = FBProjectionMatch(projection, s->c, end - s->c);
+            if (match == NULL) {
+              s->c = end + 1;
+            } else if (!FBParseString(s, &child)) {
+              return NO;
+            }
+          }
+          keep = match != NULL;
+          childProjection = match ? match->child : NULL;
+        } else if (!FBParseString(s, &child)) {
+          return NO;
+        }
+        if (keep && !FBPushNode(s, &child)) {
+          return NO;
+        }
+
+        FBSkipWhitespace(s);
+        if (*s->c != ':') {
+          return FBParseFail(s, @"Expected ':' separating key and value");
+        }
+        s->c++;
+      }
+
+      if (!keep) {
+        if (!FBSkipValue(s)) {
+          return NO;
+        }
+      } else if (!FBParseValue(s, &child, childProjection) || !FBPushNode(s, &child)) {
+        return NO;
+      }
+
+      FBSkipWhitespace(s);
+      if (*s->c == ',') {
+        s->c++;
+        FBSkipWhitespace(s);
+        if (*s->c == close) {
+          return FBParseFail(s, isDictionary ? @"Trailing comma disallowed in object"
+                                             : @"Trailing comma disallowed in array");
+        }
+      } else if (*s->c == close) {
+        s->c++;
+        break;
+      } else if (*s->c == '\0') {
+        return FBParseFail(s, isDictionary ? @"End of input while parsing object"
+                                           : @"End of input while parsing array");
+      } else {
+        return FBParseFail(s, isDictionary ? @"Expected ',' or '}' in object"
+                                           : @"Expected ',' or ']' in array");
+      }
+    }
+  }
+
+  size_t count = s->top - base;
+  node->type           = isDictionary ? kNodeDictionary : kNodeArray;
+  node->length         = (unsigned int)(isDictionary ? count / 2 : count);
+  node->value.children = NULL;
+  if (count > 0) {
+    node->value.children = FBArenaAlloc(s->arena, count * sizeof(FBJSONNode));
+    if (node->value.children == NULL) {
+      return FBParseFail(s, @"Out of memory");
+    }
+    memcpy(node->value.children, s->stack + base, count * sizeof(FBJSONNode));
+  }
+  s->top = base;
+  s->depth--;
+  return YES;
+}
+
+static BOOL FBParseValue(FBArenaParseState* s, FBJSONNode* node, FBProjectionNode* projection)
+{
+  FBSkipWhitespace(s);
+  node->length = 0;
+
+  const char* c = s->c;
+  switch (*c) {
+    case '{':
+      s->c++;
+      return FBParseContainer(s, node, YES, projection);
+    case '[':
+      s->c++;
+      return FBParseContainer(s, node, NO, projection);
+    case '"':
+      s->c++;
+      return FBParseString(s, node);
+    case 't':
+      if (strncmp(c, "true", 4) == 0) {
+        s->c += 4;
+        node->type = kNodeTrue;
+        return YES;
+      }
+      return FBParseFail(s, @"Expected 'true'");
+    case 'f':
+      if (strncmp(c, "false", 5) == 0) {
+        s->c += 5;
+        node->type = kNodeFalse;
+        return YES;
+      }
+      return FBParseFail(s, @"Expected 'false'");
+    case 'n':
+      if (strncmp(c, "null", 4) == 0) {
+        s->c += 4;
+        node->type = kNodeNull;
+        return YES;
+      }
+      return FBParseFail(s, @"Expected 'null'");
+    case '\0':
+      return FBParseFail(s, @"Unexpected end of string");
+  }
+
+  if (*c == '-' || isdigit((unsigned char)*c)) {
+    return FBParseNumber(s, node);
+  }
+  return FBParseFail(s, @"Unrecognised leading character");
+}
+
+
+#pragma mark Internal
+FBArena* FBArenaParse(const char* bytes, FBProjection* projection,
+                      FBJSONNode** root, NSError** error)
+{
+  FBArenaParseState state;
+  memset(&state, 0, sizeof(state));
+
+  FBArena* result = nil;
+  if (bytes == NULL) {
+    state.failure = @"Input was 'nil'";
+  } else {
+    // text and nodes together rarely come to twice the input
+    size_t inputLength = strlen(bytes);
+    FBArena* arena = [[FBArena alloc] initWithCapacity:2 * inputLength];
+    state.c     = bytes;
+    state.arena = arena;
+
+    FBJSONNode node;
+    BOOL parsed = FBParseValue(&state, &node, [projection rootNode]);
+    if (parsed) {
+      FBSkipWhitespace(&state);
+      if (*state.c != '\0') {
+        parsed = FBParseFail(&state, @"Garbage after JSON");
+      }
+    }
+    free(state.stack);
+
+    if (parsed) {
+      *root = FBArenaAlloc(arena, sizeof(FBJSONNode));
+      if (*root) {
+        **root = node;
+        result = [[arena retain] autorelease];
+      } else {
+        FBParseFail(&state, @"Out of memory");
+      }
+    }
+    [arena release];
+  }
+
+  if (result == nil && error) {
+    *error = [NSError errorWithDomain:FBArenaParserErrorDomain
+                                 code:1
+                             userInfo:[NSDictionary dictionaryWithObject:state.failure
+                                                                  forKey:NSLocalizedDescriptionKey]];
+  }
+  return result;
+}
+
+FBJSONNode* FBArenaNodeForKey(FBJSONNode* dictionary, const char* key, size_t length)
+{
+  if (dictionary->type != kNodeDictionary) {
+    return NULL;
+  }
+  // from the end, so a repeated key has its last value, as SBJsonParser would
+  FBJSONNode* children = dictionary->value.children;
+  for (unsigned int i = dictionary->length; i > 0; i--) {
+    FBJSONNode* candidate = &children[2 * (i - 1)];
+    if (candidate->length == length && memcmp(candidate->value.text, key, length) == 0) {
+      return &children[2 * (i - 1) + 1];
+    }
+  }
+  return NULL;
+}
+
+NSString* FBArenaCopyString(FBJSONNode* node)
+{
+  if (node->type != kNodeString && node->type != kNodeASCIIString && node->type != kNodeNumber) {
+    return nil;
+  }
+  id string = (id)CFStringCreateWithBytes(NULL, (const UInt8*)node->value.text, node->length,
+                                          kCFStringEncodingUTF8, false);
+  return string ? [string autorelease] : @"";
+}
+
+id FBArenaCopyObject(FBJSONNode* node)
+{
+  switch (node->type) {
+    case kNodeNull:
+      return [NSNull null];
+    case kNodeFalse:
+      return [NSNumber numberWithBool:NO];
+    case kNodeTrue:
+      return [NSNumber numberWithBool:YES];
+    case kNodeNumber:
+      return [NSDecimalNumber decimalNumberWithString:FBArenaCopyString(node)];
+    case kNodeString:
+    case kNodeASCIIString:
+      return [NSMutableString stringWithString:FBArenaCopyString(node)];
+    case kNodeArray: {
+      NSMutableArray* array = [NSMutableArray arrayWithCapacity:node->length];
+      for (unsigned int i = 0; i < node->length; i++) {
+        [array addObject:FBArenaCopyObject(&node->value.children[i])];
+      }
+      return array;
+    }
+    case kNodeDictionary: {
+      NSMutableDictionary* dictionary = [NSMutableDictionary dictionaryWithCapacity:node->length];
+      for (unsigned int i = 0; i < node->length; i++) {
+        [dictionary setObject:FBArenaCopyObject(&node->value.children[2 * i + 1])
+                       forKey:FBArenaCopyString(&node->value.children[2 * i])];
+      }
+      return dictionary;
+    }
+  }
+  return nil;
+}
+
+
+@implementation FBArenaParser
+
++ (id)objectWithUTF8String:(const char*)bytes error:(NSError**)error
+{
+  return [self objectWithUTF8String:bytes projection:nil error:error];
+}
+
++ (id)objectWithUTF8String:(const char*)bytes
+                projection:(FBProjection*)projection
+                     error:(NSError**)error
+{
+  FBJSONNode* root;
+  FBArena* arena = FBArenaParse(bytes, projection, &root, error);
+  return arena ? FBObjectForNode(arena, root) : nil;
+}
+
+@end
+
+
+static FBProjectionNode* FBProjectionNodeCreate(NSDictionary* tree)
+{
+  FBProjectionNode* node = malloc(sizeof(FBProjectionNode));
+  node->count = [tree count];
+  node->keys  = calloc(MAX(node->count, 1), sizeof(FBProjectionKey));
+
+  NSArray* names = [tree allKeys];
+  for (int i = 0; i < [names count]; i++) {
+    NSString* name = [names objectAtIndex:i];
+    const char* utf8 = [name UTF8String];
+    FBProjectionKey* key = &node->keys[i];
+    key->length = strlen(utf8);
+    key->name   = malloc(MAX(key->length, 1));
+    memcpy(key->name, utf8, key->length);
+
+    id subtree = [tree objectForKey:name];
+    key->child = (subtree == [NSNull null]) ? NULL : FBProjectionNodeCreate(subtree);
+  }
+  return node;
+}
+
+static void FBProjectionNodeFree(FBProjectionNode* node)
+{
+  for (unsigned int i = 0; i < node->count; i++) {
+    free(node->keys[i].name);
+    if (node->keys[i].child) {
+      FBProjectionNodeFree(node->keys[i].child);
+    }
+  }
+  free(node->keys);
+  free(node);
+}
+
+
+@implementation FBProjection
+
++ (FBProjection*)projectionWithKeyPaths:(NSArray*)paths
+{
+  return [[[FBProjection alloc] initWithKeyPaths:paths] autorelease];
+}
+
++ (FBProjection*)projectionWithString:(NSString*)expression
+{
+  NSArray* parts = [expression componentsSeparatedByString:@","];
+  NSMutableArray* paths = [NSMutableArray arrayWithCapacity:[parts count]];
+  NSCharacterSet* whitespace = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+  for (int i = 0; i < [parts count]; i++) {
+    NSString* path = [[parts objectAtIndex:i] stringByTrimmingCharactersInSet:whitespace];
+    if ([path length] > 0) {
+      [paths addObject:path];
+    }
+  }
+  return [self projectionWithKeyPaths:paths];
+}
+
+- (id)initWithKeyPaths:(NSArray*)paths
+{
+  if (self = [super init]) {
+    keyPaths = [paths copy];
+
+    // a tree of key to subtree, or to NSNull where the whole value is kept
+    NSMutableDictionary* tree = [NSMutableDictionary dictionary];
+    for (int i = 0; i < [keyPaths count]; i++) {
+      NSArray* components = [[keyPaths objectAtIndex:i] componentsSeparatedByString:@"."];
+      NSMutableDictionary* level = tree;
+      for (int j = 0; j < [components count] && level; j++) {
+        NSString* component = [components objectAtIndex:j];
+        id subtree = [level objectForKey:component];
+        if (j == [components count] - 1) {
+          [level setObject:[NSNull null] forKey:component];
+        } else if (subtree == [NSNull null]) {
+          // a shorter path already keeps all of this
+          level = nil;
+        } else {
+          if (subtree == nil) {
+            subtree = [NSMutableDictionary dictionary];
+            [level setObject:subtree forKey:component];
+          }
+          level = subtree;
+        }
+      }
+    }
+    root = FBProjectionNodeCreate(tree);
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  FBProjectionNodeFree(root);
+  [keyPaths release];
+  [super dealloc];
+}
+
+- (NSArray*)keyPaths
+{
+  return keyPaths;
+}
+
+- (NSString*)description
+{
+  return [keyPaths componentsJoinedByString:@", "];
+}
+
+#pragma mark Private Methods
+- (FBProjectionNode*)rootNode
+{
+  return root;
+}
+
+@end
+
+
+@implementation FBArena
+
+- (id)initWithCapacity:(size_t)capacity
+{
+  if (self = [super init]) {
+    CFAllocatorContext context = {0, self, NULL, NULL, NULL, NULL, NULL, FBReleaseArena, NULL};
+    textDeallocator = CFAllocatorCreate(NULL, &context);
+
+    blocks = malloc(sizeof(FBArenaBlock) + MAX(capacity, kMinBlockSize));
+    if (blocks) {
+      blocks->next     = NULL;
+      blocks->used     = 0;
+      blocks->capacity = MAX(capacity, kMinBlockSize);
+    }
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  while (blocks) {
+    FBArenaBlock* next = blocks->next;
+    free(blocks);
+    blocks = next;
+  }
+  CFRelease(textDeallocator);
+  [super dealloc];
+}
+
+@end
+
+
+@implementation FBArenaDictionary
+
+- (id)initWithArena:(FBArena*)anArena node:(FBJSONNode*)aNode
+{
+  if (self = [super init]) {
+    arena = [anArena retain];
+    node  = aNode;
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [arena release];
+  [super dealloc];
+}
+
+- (NSUInteger)count
+{
+  return node->length;
+}
+
+- (id)objectForKey:(id)key
+{
+  if (![key isKindOfClass:[NSString class]]) {
+    return nil;
+  }
+
+  char buffer[256];
+  const char* utf8 = CFStringGetCStringPtr((CFStringRef)key, kCFStringEncodingUTF8);
+  if (utf8 == NULL) {
+    utf8 = CFStringGetCString((CFStringRef)key, buffer, sizeof(buffer), kCFStringEncodingUTF8)
+      ? buffer : [key UTF8String];
+  }
+  FBJSONNode* value = FBArenaNodeForKey(node, utf8, strlen(utf8));
+  return value ? FBObjectForNode(arena, value) : nil;
+}
+
+- (NSEnumerator*)keyEnumerator
+{
+  return [[[FBArenaKeyEnumerator alloc] initWithArena:arena node:node] autorelease];
+}
+
+- (id)copyWithZone:(NSZone*)zone
+{
+  return [self retain];
+}
+
+@end
+
+
+@implementation FBArenaArray
+
+- (id)initWithArena:(FBArena*)anArena node:(FBJSONNode*)aNode
+{
+  if (self = [super init]) {
+    arena = [anArena retain];
+    node  = aNode;
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [arena release];
+  [super dealloc];
+}
+
+- (NSUInteger)count
+{
+  return node->length;
+}
+
+- (id)objectAtIndex:(NSUInteger)index
+{
+  if (index >= node->length) {
+    [NSException raise:NSRangeException
+                format:@"Index %lu beyond count %u", (unsigned long)index, node->length];
+  }
+  return FBObjectForNode(arena, &node->value.children[index]);
+}
+
+- (id)copyWithZone:(NSZone*)zone
+{
+  return [self retain];
+}
+
+@end
+
+
+@implementation FBArenaKeyEnumerator
+
+- (id)initWithArena:(FBArena*)anArena node:(FBJSONNode*)aNode
+{
+  if (self = [super init]) {
+    arena = [anArena retain];
+    node  = aNode;
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [arena release];
+  [super dealloc];
+}
+
+- (id)nextObject
+{
+  if (index >= node->length) {
+    return nil;
+  }
+  return FBObjectForNode(arena, &node->value.children[2 * index++]);
+}
+
+@end
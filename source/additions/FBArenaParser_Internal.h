@@ -0,0 +1,60 @@
+//
+//  FBArenaParser_Internal.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBArenaParser.h"
+
+enum {
+  kNodeNull = 0,
+  kNodeFalse,
+  kNodeTrue,
+  kNodeNumber,
+  kNodeString,
+  kNodeASCIIString,
+  kNodeArray,
+  kNodeDictionary
+};
+
+
+/*
+ * A parsed value. Strings and numbers keep their text, containers their
+ * elements; a dictionary's alternate between key and value.
+ */
+typedef struct FBJSONNode {
+  unsigned int type;
+  unsigned int length;
+  union {
+    const char*        text;
+    struct FBJSONNode* children;
+  } value;
+} FBJSONNode;
+
+@class FBArena;
+
+
+/*!
+ * Parses bytes, returning the autoreleased arena which holds the result and
+ * setting root to its top node, or returning nil and setting error.
+ */
+FBArena* FBArenaParse(const char* bytes, FBProjection* projection,
+                      FBJSONNode** root, NSError** error);
+
+/*!
+ * The value for key in a dictionary node, or NULL.
+ */
+FBJSONNode* FBArenaNodeForKey(FBJSONNode* dictionary, const char* key, size_t length);
+
+/*!
+ * The text of a string or number node as a string which doesn't depend on
+ * the arena, or nil for any other node.
+ */
+NSString* FBArenaCopyString(FBJSONNode* node);
+
+/*!
+ * A node as the objects SBJsonParser would have made of it, which don't
+ * depend on the arena.
+ */
+id FBArenaCopyObject(FBJSONNode* node);
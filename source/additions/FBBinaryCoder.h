@@ -0,0 +1,63 @@
+//
+//  FBBinaryCoder.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+extern NSString* const FBBinaryErrorDomain;
+
+enum {
+  FBBinaryUnsupportedError = 1,
+  FBBinaryCorruptError
+};
+
+
+/*!
+ * @class FBBinaryCoder
+ *
+ * Encodes the objects the JSON parser produces (dictionaries, arrays,
+ * strings, numbers, booleans and null) in a compact binary form, for keeping
+ * API results around without the cost of parsing them again.
+ *
+ * Containers are prefixed with their count, integers are written as
+ * varints, and each distinct dictionary key is written once and referred to
+ * by its index afterwards, which is where most of the saving on FQL results
+ * comes from. Decoded ASCII strings point into the encoded data rather than
+ * copying it, and keep it alive for as long as they do.
+ */
+@interface FBBinaryCoder : NSObject {
+}
+
++ (NSData*)dataWithObject:(id)object error:(NSError**)error;
+
+/*!
+ * Containers are decoded as mutable, as the JSON parser returns them.
+ */
++ (id)objectWithData:(NSData*)data error:(NSError**)error;
+
+@end
+
+
+@interface NSObject (FBBinary)
+
+/*!
+ * Returns the receiver encoded with FBBinaryCoder, or nil if it contains an
+ * object that can't be encoded.
+ */
+- (NSData*)binaryRepresentation;
+
+@end
+
+
+@interface NSData (FBBinary)
+
+/*!
+ * Returns the object encoded in the receiver by -binaryRepresentation, or nil
+ * if it is corrupt.
+ */
+- (id)binaryValue;
+
+@end
@@ -0,0 +1,552 @@
+//
+//  FBBinaryCoder.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBBinaryCoder.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// "FBB" and a version byte, then a single object
+#define kBinaryMagic "FBB"
+#define kBinaryVersion 1
+#define kHeaderLength 4
+#define kMaxVarintLength 10
+#define kMaxDepth 512
+
+enum {
+  kTagNull = 0,
+  kTagFalse,
+  kTagTrue,
+  kTagInteger,
+  kTagDouble,
+  kTagDecimal,
+  kTagString,
+  kTagKeyDefinition,
+  kTagKeyReference,
+  kTagArray,
+  kTagDictionary
+};
+
+NSString* const FBBinaryErrorDomain = @"FBBinaryErrorDomain";
+
+
+typedef struct {
+  unsigned char*         bytes;
+  size_t                 length;
+  size_t                 capacity;
+  BOOL                   failed;
+  CFMutableDictionaryRef keys;      // key -> its index
+} FBBinaryWriter;
+
+typedef struct {
+  const unsigned char* cursor;
+  const unsigned char* end;
+  CFMutableArrayRef    keys;
+  NSData*              source;
+  CFAllocatorRef       sourceDeallocator;
+  NSString*            failure;
+} FBBinaryReader;
+
+
+static NSError* FBBinaryError(NSInteger code, NSString* message)
+{
+  return [NSError errorWithDomain:FBBinaryErrorDomain
+                             code:code
+                         userInfo:[NSDictionary dictionaryWithObject:message
+                                                              forKey:NSLocalizedDescriptionKey]];
+}
+
+#pragma mark Writing
+static BOOL FBWriterReserve(FBBinaryWriter* w, size_t extra)
+{
+  if (w->failed) {
+    return NO;
+  }
+  if (w->length + extra <= w->capacity) {
+    return YES;
+  }
+  size_t capacity = MAX(w->capacity * 2, w->length + extra);
+  unsigned char* bytes = realloc(w->bytes, capacity);
+  if (bytes == NULL) {
+    w->failed = YES;
+    return NO;
+  }
+  w->bytes    = bytes;
+  w->capacity = capacity;
+  return YES;
+}
+
+static size_t FBVarintLength(uint64_t value)
+{
+  size_t length = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    length++;
+  }
+  return length;
+}
+
+static size_t FBPutVarint(unsigned char* bytes, uint64_t value)
+{
+  size_t length = 0;
+  while (value >= 0x80) {
+    bytes[length++] = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  bytes[length++] = (unsigned char)value;
+  return length;
+}
+
+static void FBWriteTag(FBBinaryWriter* w, unsigned char tag)
+{
+  if (FBWriterReserve(w, 1)) {
+    w->bytes[w->length++] = tag;
+  }
+}
+
+static void FBWriteTagAndVarint(FBBinaryWriter* w, unsigned char tag, uint64_t value)
+{
+  if (FBWriterReserve(w, 1 + kMaxVarintLength)) {
+    w->bytes[w->length++] = tag;
+    w->length += FBPutVarint(w->bytes + w->length, value);
+  }
+}
+
+static void FBWriteString(FBBinaryWriter* w, unsigned char tag, CFStringRef string)
+{
+  CFIndex length = CFStringGetLength(string);
+  CFIndex maxBytes = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8);
+  if (!FBWriterReserve(w, 1 + kMaxVarintLength + maxBytes)) {
+    return;
+  }
+  w->bytes[w->length++] = tag;
+
+  // convert past the longest prefix, then slide it down to meet the real one
+  unsigned char* body = w->bytes + w->length + kMaxVarintLength;
+  CFIndex used = 0;
+  CFStringGetBytes(string, CFRangeMake(0, length), kCFStringEncodingUTF8, 0, false,
+                   body, maxBytes, &used);
+  size_t prefixLength = FBVarintLength(used);
+  memmove(w->bytes + w->length + prefixLength, body, used);
+  FBPutVarint(w->bytes + w->length, used);
+  w->length += prefixLength + used;
+}
+
+static void FBWriteDouble(FBBinaryWriter* w, double value)
+{
+  if (FBWriterReserve(w, 1 + sizeof(uint64_t))) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    w->bytes[w->length++] = kTagDouble;
+    for (int i = 0; i < 8; i++) {
+      w->bytes[w->length++] = (unsigned char)(bits >> (8 * i));
+    }
+  }
+}
+
+static void FBWriteInteger(FBBinaryWriter* w, long long value)
+{
+  // zigzag, so small negative numbers stay small
+  uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+  FBWriteTagAndVarint(w, kTagInteger, zigzag);
+}
+
+static void FBWriteNumber(FBBinaryWriter* w, NSNumber* number)
+{
+  // the JSON parser gives back decimal numbers, which are whole more often
+  // than not, and uids don't fit in a double
+  if ([number isKindOfClass:[NSDecimalNumber class]]) {
+    NSString* string = [number stringValue];
+    NSString* digits = [string hasPrefix:@"-"] ? [string substringFromIndex:1] : string;
+    if ([digits length] > 0 && [digits length] < 19 &&
+        [digits rangeOfCharacterFromSet:[[NSCharacterSet decimalDigitCharacterSet] invertedSet]].location == NSNotFound) {
+      FBWriteInteger(w, [number longLongValue]);
+    } else {
+      FBWriteString(w, kTagDecimal, (CFStringRef)string);
+    }
+    return;
+  }
+
+  switch (*[number objCType]) {
+    case 'c':
+      FBWriteTag(w, [number boolValue] ? kTagTrue : kTagFalse);
+      break;
+    case 'f':
+    case 'd':
+      FBWriteDouble(w, [number doubleValue]);
+      break;
+    case 'L':
+    case 'Q':
+      if ([number unsignedLongLongValue] > LLONG_MAX) {
+        FBWriteDouble(w, [number doubleValue]);
+        break;
+      }
+      // fall through
+    default:
+      FBWriteInteger(w, [number longLongValue]);
+      break;
+  }
+}
+
+static void FBWriteKey(FBBinaryWriter* w, NSString* key)
+{
+  const void* index;
+  if (CFDictionaryGetValueIfPresent(w->keys, key, &index)) {
+    FBWriteTagAndVarint(w, kTagKeyReference, (uintptr_t)index);
+  } else {
+    CFDictionarySetValue(w->keys, key, (const void*)(uintptr_t)CFDictionaryGetCount(w->keys));
+    FBWriteString(w, kTagKeyDefinition, (CFStringRef)key);
+  }
+}
+
+static BOOL FBWriteObject(FBBinaryWriter* w, id object, int depth, NSError** error)
+{
+  if (depth > kMaxDepth) {
+    if (error) {
+      *error = FBBinaryError(FBBinaryUnsupportedError, @"Nested too deeply");
+    }
+    return NO;
+  }
+
+  if ([object isKindOfClass:[NSString class]]) {
+    FBWriteString(w, kTagString, (CFStringRef)object);
+  } else if ([object isKindOfClass:[NSNumber class]]) {
+    FBWriteNumber(w, object);
+  } else if ([object isKindOfClass:[NSDictionary class]]) {
+    FBWriteTagAndVarint(w, kTagDictionary, [object count]);
+    NSEnumerator* enumerator = [object keyEnumerator];
+    id key;
+    while ((key = [enumerator nextObject])) {
+      if (![key isKindOfClass:[NSString class]]) {
+        if (error) {
+          *error = FBBinaryError(FBBinaryUnsupportedError, @"Dictionary key is not a string");
+        }
+        return NO;
+      }
+      FBWriteKey(w, key);
+      if (!FBWriteObject(w, [object objectForKey:key], depth + 1, error)) {
+        return NO;
+      }
+    }
+  } else if ([object isKindOfClass:[NSArray class]]) {
+    FBWriteTagAndVarint(w, kTagArray, [object count]);
+    for (int i = 0; i < [object count]; i++) {
+      if (!FBWriteObject(w, [object objectAtIndex:i], depth + 1, error)) {
+        return NO;
+      }
+    }
+  } else if ([object isKindOfClass:[NSNull class]]) {
+    FBWriteTag(w, kTagNull);
+  } else {
+    if (error) {
+      *error = FBBinaryError(FBBinaryUnsupportedError,
+                             [NSString stringWithFormat:@"Can't encode a %@", [object class]]);
+    }
+    return NO;
+  }
+
+  if (w->failed) {
+    if (error) {
+      *error = FBBinaryError(FBBinaryUnsupportedError, @"Out of memory");
+    }
+    return NO;
+  }
+  return YES;
+}
+
+#pragma mark Reading
+/*
+ * Strings which point into the source data hold a retain on it, given back
+ * here when the string is done with the bytes.
+ */
+static void FBReleaseSource(void* bytes, void* info)
+{
+  CFRelease((CFTypeRef)info);
+}
+
+static BOOL FBReadVarint(FBBinaryReader* r, uint64_t* value)
+{
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && r->cursor < r->end; shift += 7) {
+    unsigned char byte = *r->cursor++;
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return YES;
+    }
+  }
+  r->failure = @"Bad varint";
+  return NO;
+}
+
+/*
+ * Read functions return retained objects, or nil with failure set.
+ */
+static id FBReadStringBody(FBBinaryReader* r)
+{
+  uint64_t length;
+  if (!FBReadVarint(r, &length)) {
+    return nil;
+  }
+  if (length > (uint64_t)(r->end - r->cursor)) {
+    r->failure = @"String runs past the end";
+    return nil;
+  }
+  const unsigned char* bytes = r->cursor;
+  r->cursor += length;
+
+  BOOL isASCII = YES;
+  for (uint64_t i = 0; i < length && isASCII; i++) {
+    isASCII = (bytes[i] & 0x80) == 0;
+  }
+
+  // ascii is stored as is, so can be left where it is; anything else would
+  // be converted, and copied anyway
+  if (isASCII && length > 0) {
+    CFRetain((CFTypeRef)r->source);
+    return (id)CFStringCreateWithBytesNoCopy(NULL, bytes, (CFIndex)length, kCFStringEncodingASCII,
+                                             false, r->sourceDeallocator);
+  }
+  id string = (id)CFStringCreateWithBytes(NULL, bytes, (CFIndex)length, kCFStringEncodingUTF8, false);
+  if (string == nil) {
+    r->failure = @"String is not UTF-8";
+  }
+  return string;
+}
+
+static id FBReadKey(FBBinaryReader* r)
+{
+  if (r->cursor >= r->end) {
+    r->failure = @"Ends early";
+    return nil;
+  }
+
+  unsigned char tag = *r->cursor++;
+  if (tag == kTagKeyDefinition) {
+    id key = FBReadStringBody(r);
+    if (key) {
+      CFArrayAppendValue(r->keys, key);
+    }
+    return key;
+  } else if (tag == kTagKeyReference) {
+    uint64_t index;
+    if (!FBReadVarint(r, &index)) {
+      return nil;
+    }
+    if (index >= (uint64_t)CFArrayGetCount(r->keys)) {
+      r->failure = @"Key refers past the string table";
+      return nil;
+    }
+    return [(id)CFArrayGetValueAtIndex(r->keys, (CFIndex)index) retain];
+  }
+  r->failure = @"Dictionary key is not a string";
+  return nil;
+}
+
+static BOOL FBReadCount(FBBinaryReader* r, uint64_t* count)
+{
+  if (!FBReadVarint(r, count)) {
+    return NO;
+  }
+  // every element takes at least a byte
+  if (*count > (uint64_t)(r->end - r->cursor)) {
+    r->failure = @"Container runs past the end";
+    return NO;
+  }
+  return YES;
+}
+
+static id FBReadObject(FBBinaryReader* r, int depth)
+{
+  if (depth > kMaxDepth) {
+    r->failure = @"Nested too deeply";
+    return nil;
+  }
+  if (r->cursor >= r->end) {
+    r->failure = @"Ends early";
+    return nil;
+  }
+
+  unsigned char tag = *r->cursor++;
+  switch (tag) {
+    case kTagNull:
+      return [[NSNull null] retain];
+    case kTagFalse:
+      return [[NSNumber numberWithBool:NO] retain];
+    case kTagTrue:
+      return [[NSNumber numberWithBool:YES] retain];
+    case kTagInteger: {
+      uint64_t zigzag;
+      if (!FBReadVarint(r, &zigzag)) {
+        return nil;
+      }
+      long long value = (long long)((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+      return [[NSNumber alloc] initWithLongLong:value];
+    }
+    case kTagDouble: {
+      if (r->end - r->cursor < 8) {
+        r->failure = @"Ends early";
+        return nil;
+      }
+      uint64_t bits = 0;
+      for (int i = 0; i < 8; i++) {
+        bits |= (uint64_t)r->cursor[i] << (8 * i);
+      }
+      r->cursor += 8;
+      double value;
+      memcpy(&value, &bits, sizeof(value));
+      return [[NSNumber alloc] initWithDouble:value];
+    }
+    case kTagDecimal: {
+      NSString* string = FBReadStringBody(r);
+      if (string == nil) {
+        return nil;
+      }
+      NSDecimalNumber* number = [[NSDecimalNumber alloc] initWithString:string];
+      [string release];
+      return number;
+    }
+    case kTagString:
+      return FBReadStringBody(r);
+    case kTagArray: {
+      uint64_t count;
+      if (!FBReadCount(r, &count)) {
+        return nil;
+      }
+      NSMutableArray* array = [[NSMutableArray alloc] initWithCapacity:(NSUInteger)count];
+      for (uint64_t i = 0; i < count; i++) {
+        id element = FBReadObject(r, depth + 1);
+        if (element == nil) {
+          [array release];
+          return nil;
+        }
+        [array addObject:element];
+        [element release];
+      }
+      return array;
+    }
+    case kTagDictionary: {
+      uint64_t count;
+      if (!FBReadCount(r, &count)) {
+        return nil;
+      }
+      NSMutableDictionary* dictionary = [[NSMutableDictionary alloc] initWithCapacity:(NSUInteger)count];
+      for (uint64_t i = 0; i < count; i++) {
+        id key = FBReadKey(r);
+        id value = key ? FBReadObject(r, depth + 1) : nil;
+        if (value == nil) {
+          [key release];
+          [dictionary release];
+          return nil;
+        }
+        [dictionary setObject:value forKey:key];
+        [key release];
+        [value release];
+      }
+      return dictionary;
+    }
+  }
+
+  r->failure = [NSString stringWithFormat:@"Unknown tag %d", tag];
+  return nil;
+}
+
+
+@implementation FBBinaryCoder
+
++ (NSData*)dataWithObject:(id)object error:(NSError**)error
+{
+  FBBinaryWriter writer;
+  memset(&writer, 0, sizeof(writer));
+  writer.keys = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+
+  FBWriterReserve(&writer, 256);
+  if (FBWriterReserve(&writer, kHeaderLength)) {
+    memcpy(writer.bytes, kBinaryMagic, 3);
+    writer.bytes[3] = kBinaryVersion;
+    writer.length = kHeaderLength;
+  }
+  BOOL written = FBWriteObject(&writer, object, 0, error);
+  CFRelease(writer.keys);
+
+  if (!written) {
+    free(writer.bytes);
+    return nil;
+  }
+  return [NSData dataWithBytesNoCopy:writer.bytes length:writer.length freeWhenDone:YES];
+}
+
++ (id)objectWithData:(NSData*)data error:(NSError**)error
+{
+  if ([data length] < kHeaderLength ||
+      memcmp([data bytes], kBinaryMagic, 3) != 0 ||
+      ((const unsigned char*)[data bytes])[3] != kBinaryVersion) {
+    if (error) {
+      *error = FBBinaryError(FBBinaryCorruptError, @"Not binary encoded, or from another version");
+    }
+    return nil;
+  }
+
+  FBBinaryReader reader;
+  memset(&reader, 0, sizeof(reader));
+  // decoded strings point into it, so it mustn't change under them
+  reader.source = [data copy];
+  reader.cursor = (const unsigned char*)[reader.source bytes] + kHeaderLength;
+  reader.end    = (const unsigned char*)[reader.source bytes] + [reader.source length];
+  reader.keys   = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
+
+  CFAllocatorContext context = {0, reader.source, NULL, NULL, NULL, NULL, NULL, FBReleaseSource, NULL};
+  reader.sourceDeallocator = CFAllocatorCreate(NULL, &context);
+
+  id object = FBReadObject(&reader, 0);
+  if (object && reader.cursor != reader.end) {
+    reader.failure = @"Trailing bytes after the object";
+    [object release];
+    object = nil;
+  }
+
+  if (object == nil && error) {
+    *error = FBBinaryError(FBBinaryCorruptError, reader.failure);
+  }
+  CFRelease(reader.sourceDeallocator);
+  CFRelease(reader.keys);
+  [reader.source release];
+  return [object autorelease];
+}
+
+@end
+
+
+@implementation NSObject (FBBinary)
+
+- (NSData*)binaryRepresentation
+{
+  NSError* error = nil;
+  NSData* data = [FBBinaryCoder dataWithObject:self error:&error];
+  if (!data) {
+    NSLog(@"-binaryRepresentation failed: %@", [error localizedDescription]);
+  }
+  return data;
+}
+
+@end
+
+
+@implementation NSData (FBBinary)
+
+- (id)binaryValue
+{
+  NSError* error = nil;
+  id object = [FBBinaryCoder objectWithData:self error:&error];
+  if (!object) {
+    NSLog(@"-binaryValue failed: %@", [error localizedDescription]);
+  }
+  return object;
+}
+
+@end
@@ -82,6 +82,11 @@
 // don't use - exists for backwards compatibility with 2.1.x only. Will be removed in 2.3.
 @interface SBJsonParser (Private)
 - (id)fragmentWithString:(id)repr;
+
+/**
+ @brief Parses NUL-terminated UTF8 bytes without copying them into an NSString first.
+ */
+- (id)fragmentWithUTF8String:(const char *)bytes;
 @end
 
 
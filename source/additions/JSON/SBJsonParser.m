@@ -79,8 +79,19 @@ static char ctrl[0x22];
         return nil;
     }
 
+    return [self fragmentWithUTF8String:[repr UTF8String]];
+}
+
+- (id)fragmentWithUTF8String:(const char *)bytes {
+    [self clearErrorTrace];
+
+    if (!bytes) {
+        [self addErrorWithCode:EINPUT description:@"Input was 'nil'"];
+        return nil;
+    }
+
     depth = 0;
-    c = [repr UTF8String];
+    c = bytes;
 
     id o;
     if (![self scanValue:&o]) {
@@ -93,7 +104,7 @@ static char ctrl[0x22];
         return nil;
     }
 
-    NSAssert1(o, @"Should have a valid object from %@", repr);
+    NSAssert1(o, @"Should have a valid object from %s", bytes);
     return o;
 }
 
@@ -13,4 +13,6 @@
 
 - (NSString*)md5;
 
+- (NSData*)gzipData;
+
 @end
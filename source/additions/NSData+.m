@@ -8,6 +8,10 @@
 
 #import "NSData+.h"
 #include <openssl/md5.h>
+#include <zlib.h>
+
+// gzip header and trailer rather than zlib's
+#define kGzipWindowBits (MAX_WBITS + 16)
 
 
 @implementation NSData (FBCocoa)
@@ -28,4 +32,29 @@
   return result;
 }
 
+- (NSData*)gzipData
+{
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                   kGzipWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return nil;
+  }
+
+  NSMutableData* result = [NSMutableData dataWithLength:deflateBound(&stream, [self length]) + 18];
+  stream.next_in   = (Bytef*)[self bytes];
+  stream.avail_in  = [self length];
+  stream.next_out  = [result mutableBytes];
+  stream.avail_out = [result length];
+
+  int status = deflate(&stream, Z_FINISH);
+  deflateEnd(&stream);
+  if (status != Z_STREAM_END) {
+    return nil;
+  }
+
+  [result setLength:stream.total_out];
+  return result;
+}
+
 @end
@@ -8,7 +8,7 @@
 
 #import "FBBatchRequest.h"
 #import "FBCocoa.h"
-#import "JSON.h"
+#import "FBTracer.h"
 
 @interface FBMethodRequest (Internal)
 
@@ -19,6 +19,10 @@
 
 - (void)evaluateResponse:(id)json;
 
+- (id)resultForUTF8String:(const char*)bytes;
+
+- (void)markFinished;
+
 @end
 
 
@@ -65,23 +69,28 @@
 
 - (void)success:(id)json
 {
-  SBJsonParser* jsonParser = [SBJsonParser new];
+  FB_TRACE_START(fanOut);
   int index = 0;
   NSString* subJsonString;
   for (int i = 0; i < [json count]; i++) {
     subJsonString = [json objectAtIndex:i];
-    id subJson = [jsonParser fragmentWithString:subJsonString];
-    if (!subJson) {
-      NSError* jsonError = [NSString stringWithFormat:@"JSON Parsing error: %@", [jsonParser errorTrace]];
-      [[requests objectAtIndex:index] failure:[NSError errorWithDomain:kFBErrorDomainKey
-                                                                  code:FBAPIUnknownError
-                                                              userInfo:[NSDictionary dictionaryWithObject:jsonError
-                                                                                                   forKey:kFBErrorMessageKey]]];
+    if ([[requests objectAtIndex:index] isFinished]) {
+      // cancelled while the batch was out, its part isn't wanted
+      index++;
+      continue;
+    }
+    [[requests objectAtIndex:index] markFinished];
+    FB_TRACE(FBTraceLinked, [requests objectAtIndex:index], self, nil);
+    // parsed by the request it answers, which knows what to keep
+    id subJson = [[requests objectAtIndex:index] resultForUTF8String:[subJsonString UTF8String]];
+    if ([subJson isKindOfClass:[NSError class]]) {
+      [[requests objectAtIndex:index] failure:subJson];
+      subJson = nil;
     }
     [[requests objectAtIndex:index] evaluateResponse:subJson];
     index++;
   }
-  [jsonParser release];
+  FB_TRACE_SPAN(FBTraceFannedOut, self, nil, nil, fanOut);
 }
 
 - (void)failure:(NSError*)err
@@ -89,6 +98,10 @@
   FBMethodRequest* req;
   for (int i = 0; i < [requests count]; i++) {
     req = [requests objectAtIndex:i];
+    if ([req isFinished]) {
+      continue;
+    }
+    [req markFinished];
     [req failure:err];
   }
 }
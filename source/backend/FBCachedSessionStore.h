@@ -0,0 +1,64 @@
+//
+//  FBCachedSessionStore.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "FBSessionStore.h"
+
+
+/*!
+ * @class FBCachedSessionStore
+ *
+ * Keeps sessions in memory in front of a slower store. Each key is read from
+ * the backing store at most once; after that, reads are answered from
+ * memory. Writes are applied in memory straight away and written behind on a
+ * background thread, with several writes to a key in quick succession
+ * saved only once. Writes still queued when the application terminates are
+ * finished before it quits.
+ *
+ * A read of a key which is still being loaded waits for that load rather
+ * than starting another, so prefetching a key early keeps the first read
+ * from blocking.
+ */
+@interface FBCachedSessionStore : NSObject <FBSessionStore> {
+  id<FBSessionStore>   backingStore;
+  NSMutableDictionary* sessions;
+  NSMutableSet*        loadingKeys;
+  NSMutableDictionary* pendingWrites;
+  BOOL                 isWriteScheduled;
+  NSCondition*         condition;
+  NSOperationQueue*    writeQueue;
+}
+
+/*!
+ * The store FBConnect keeps its session in; unless set, a cache in front of
+ * the default keychain store. To keep sessions in a file instead, set this
+ * before creating an FBConnect:
+ *
+ * [FBCachedSessionStore setDefaultStore:
+ *   [[[FBCachedSessionStore alloc] initWithStore:fileStore] autorelease]];
+ */
++ (FBCachedSessionStore*)defaultStore;
++ (void)setDefaultStore:(FBCachedSessionStore*)aStore;
+
+- (id)initWithStore:(id<FBSessionStore>)aStore;
+
+- (id<FBSessionStore>)backingStore;
+
+/*!
+ * Starts loading the session for key in the background. Prefetches from
+ * every store are loaded one at a time, on a single shared queue.
+ */
+- (void)prefetchSessionForKey:(NSString*)key;
+
+/*!
+ * Waits until every write so far has reached the backing store. Called when
+ * the application terminates, or for the default store in headless builds,
+ * when the process exits.
+ */
+- (void)synchronize;
+
+@end
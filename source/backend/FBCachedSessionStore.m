@@ -0,0 +1,246 @@
+//
+//  FBCachedSessionStore.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBCachedSessionStore.h"
+#ifndef FB_HEADLESS
+  #import <Cocoa/Cocoa.h>
+  #import "FBKeychainSessionStore.h"
+#else
+  #include <stdlib.h>
+#endif
+
+
+@interface FBCachedSessionStore (Private)
+
++ (NSOperationQueue*)prefetchQueue;
+- (void)loadSessionForKey:(NSString*)key;
+- (void)writePendingSessions;
+- (void)applicationWillTerminate:(NSNotification*)notification;
+
+@end
+
+
+static FBCachedSessionStore* defaultStore = nil;
+
+#ifdef FB_HEADLESS
+// there's no application to say it's terminating, so the default store is
+// flushed as the process exits
+static void FBSynchronizeDefaultStore(void)
+{
+  NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+  @synchronized([FBCachedSessionStore class]) {
+    [defaultStore synchronize];
+  }
+  [pool release];
+}
+#endif
+
+
+@implementation FBCachedSessionStore
+
++ (void)initialize
+{
+#ifdef FB_HEADLESS
+  if (self == [FBCachedSessionStore class]) {
+    atexit(FBSynchronizeDefaultStore);
+  }
+#endif
+}
+
++ (FBCachedSessionStore*)defaultStore
+{
+  @synchronized(self) {
+    if (!defaultStore) {
+#ifdef FB_HEADLESS
+      // there's no keychain, so sessions only last the process unless a store is set
+      defaultStore = [[FBCachedSessionStore alloc] initWithStore:nil];
+#else
+      defaultStore = [[FBCachedSessionStore alloc] initWithStore:[FBKeychainSessionStore defaultStore]];
+#endif
+    }
+  }
+  return defaultStore;
+}
+
++ (void)setDefaultStore:(FBCachedSessionStore*)aStore
+{
+  @synchronized(self) {
+    [aStore retain];
+    [defaultStore release];
+    defaultStore = aStore;
+  }
+}
+
+- (id)initWithStore:(id<FBSessionStore>)aStore
+{
+  if (self = [super init]) {
+    backingStore  = [aStore retain];
+    sessions      = [[NSMutableDictionary alloc] init];
+    loadingKeys   = [[NSMutableSet alloc] init];
+    pendingWrites = [[NSMutableDictionary alloc] init];
+    condition     = [[NSCondition alloc] init];
+
+    // one writer, so writes reach the store in order
+    writeQueue = [[NSOperationQueue alloc] init];
+    [writeQueue setMaxConcurrentOperationCount:1];
+
+#ifndef FB_HEADLESS
+    // a login or logout just before quitting must still be saved
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(applicationWillTerminate:)
+                                                 name:NSApplicationWillTerminateNotification
+                                               object:nil];
+#endif
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [writeQueue waitUntilAllOperationsAreFinished];
+
+  [backingStore  release];
+  [sessions      release];
+  [loadingKeys   release];
+  [pendingWrites release];
+  [condition     release];
+  [writeQueue    release];
+  [super dealloc];
+}
+
+- (id<FBSessionStore>)backingStore
+{
+  return backingStore;
+}
+
+- (NSDictionary*)sessionForKey:(NSString*)key
+{
+  [condition lock];
+  while ([loadingKeys containsObject:key]) {
+    [condition wait];
+  }
+  id session = [sessions objectForKey:key];
+  [condition unlock];
+
+  if (session == nil) {
+    [self loadSessionForKey:key];
+    [condition lock];
+    session = [sessions objectForKey:key];
+    [condition unlock];
+  }
+
+  return (session == [NSNull null]) ? nil : [[session retain] autorelease];
+}
+
+- (void)setSession:(NSDictionary*)session forKey:(NSString*)key
+{
+  id value = session ? (id)[[session copy] autorelease] : (id)[NSNull null];
+
+  [condition lock];
+  [sessions setObject:value forKey:key];
+  [pendingWrites setObject:value forKey:key];
+  BOOL scheduleWrite = !isWriteScheduled;
+  isWriteScheduled = YES;
+  [condition unlock];
+
+  if (scheduleWrite) {
+    NSInvocationOperation* operation =
+      [[NSInvocationOperation alloc] initWithTarget:self
+                                           selector:@selector(writePendingSessions)
+                                             object:nil];
+    [writeQueue addOperation:operation];
+    [operation release];
+  }
+}
+
+- (void)prefetchSessionForKey:(NSString*)key
+{
+  NSInvocationOperation* operation =
+    [[NSInvocationOperation alloc] initWithTarget:self
+                                         selector:@selector(loadSessionForKey:)
+                                           object:key];
+  [[FBCachedSessionStore prefetchQueue] addOperation:operation];
+  [operation release];
+}
+
+- (void)synchronize
+{
+  [writeQueue waitUntilAllOperationsAreFinished];
+}
+
+#pragma mark Private Methods
++ (NSOperationQueue*)prefetchQueue
+{
+  // shared by every store, so each session prefetched doesn't cost a thread
+  static NSOperationQueue* prefetchQueue = nil;
+  @synchronized(self) {
+    if (!prefetchQueue) {
+      prefetchQueue = [[NSOperationQueue alloc] init];
+      [prefetchQueue setMaxConcurrentOperationCount:1];
+    }
+  }
+  return prefetchQueue;
+}
+
+- (void)loadSessionForKey:(NSString*)key
+{
+  NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+  // someone else is already loading it, or it's here
+  [condition lock];
+  BOOL shouldLoad = ![loadingKeys containsObject:key] && [sessions objectForKey:key] == nil;
+  if (shouldLoad) {
+    [loadingKeys addObject:key];
+  }
+  [condition unlock];
+
+  if (shouldLoad) {
+    NSDictionary* session = [backingStore sessionForKey:key];
+
+    [condition lock];
+    // a write while we were loading is newer than what we read
+    if ([sessions objectForKey:key] == nil) {
+      [sessions setObject:(session ? (id)session : (id)[NSNull null]) forKey:key];
+    }
+    [loadingKeys removeObject:key];
+    [condition broadcast];
+    [condition unlock];
+  } else {
+    [condition lock];
+    while ([loadingKeys containsObject:key]) {
+      [condition wait];
+    }
+    [condition unlock];
+  }
+
+  [pool release];
+}
+
+- (void)writePendingSessions
+{
+  [condition lock];
+  NSDictionary* writes = [[pendingWrites copy] autorelease];
+  [pendingWrites removeAllObjects];
+  isWriteScheduled = NO;
+  [condition unlock];
+
+  NSEnumerator* enumerator = [writes keyEnumerator];
+  NSString* key;
+  while ((key = [enumerator nextObject])) {
+    id session = [writes objectForKey:key];
+    [backingStore setSession:(session == [NSNull null] ? nil : session) forKey:key];
+  }
+}
+
+#pragma mark Callbacks
+- (void)applicationWillTerminate:(NSNotification*)notification
+{
+  [self synchronize];
+}
+
+@end
@@ -16,6 +16,8 @@
   id userData;
   id response;
   NSError* error;
+
+  unsigned long traceID;
 }
 
 - (id)initWithTarget:(id)tar
@@ -24,6 +26,11 @@
 - (void)success:(id)json;
 - (void)failure:(NSError*)err;
 
+/*!
+ * Calls the target back, once the response or error is set.
+ */
+- (void)notifyTarget;
+
 - (id)userData;
 - (void)setUserData:(id)data;
 
@@ -33,4 +40,6 @@
 - (NSError*)error;
 - (void)setError:(NSError*)aError;
 
+- (unsigned long)traceID;
+
 @end
@@ -7,6 +7,7 @@
 //
 
 #import "FBCallback.h"
+#import "FBTracer.h"
 
 
 @implementation FBCallback
@@ -15,8 +16,9 @@
             selector:(SEL)sel
 {
   if (self = [super init]) {
-    target = tar;
-    method = sel;
+    target  = tar;
+    method  = sel;
+    traceID = FBTraceNextID();
   }
   return self;
 }
@@ -32,13 +34,20 @@
 - (void)success:(id)json
 {
   [self setResponse:json];
-  DELEGATE(target, method);
+  [self notifyTarget];
 }
 
 - (void)failure:(NSError*)err
 {
   [self setError:err];
+  [self notifyTarget];
+}
+
+- (void)notifyTarget
+{
+  FB_TRACE_START(delivery);
   DELEGATE(target, method);
+  FB_TRACE_SPAN(FBTraceDelivered, self, nil, nil, delivery);
 }
 
 - (id)userData
@@ -77,4 +86,9 @@
   error = aError;
 }
 
+- (unsigned long)traceID
+{
+  return traceID;
+}
+
 @end
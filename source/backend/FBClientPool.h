@@ -0,0 +1,126 @@
+//
+//  FBClientPool.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#import "FBTransport.h"
+
+@class FBConnect;
+@class FBPooledClient;
+@class FBResponseCache;
+
+
+/*!
+ * @class FBClientPool
+ *
+ * Makes API calls on behalf of many users at once, such as from a service
+ * keeping thousands of accounts in sync. Each user's session is an
+ * FBPooledClient; the clients share one transport, one response memory
+ * budget, one response cache and one set of parser threads.
+ *
+ * Clients with calls waiting take turns, one call each, so a busy client
+ * can't starve the others. At most maxConcurrentRequests calls are in flight
+ * across the pool, and no client sends more than requestsPerSecond.
+ *
+ * Pooled clients never show a login window: sessions are expected to have
+ * been obtained elsewhere, and calls made with a bad session simply fail.
+ */
+@interface FBClientPool : NSObject {
+  FBConnect*           connect;
+  NSMutableDictionary* clients;
+  NSMutableArray*      readyClients;
+  NSRecursiveLock*     lock;
+
+  NSUInteger           maxConcurrentRequests;
+  NSUInteger           requestsInFlight;
+  double               requestsPerSecond;
+  BOOL                 isPumpScheduled;
+
+  FBResponseCache*     responseCache;
+  NSSet*               cachedMethods;
+  NSTimeInterval       cacheLifetime;
+
+  NSOperationQueue*    parserQueue;
+}
+
++ (FBClientPool*)poolWithAPIKey:(NSString*)key;
+
+/*!
+ * Used to sign calls for clients which don't have a session secret.
+ */
+- (void)setSecret:(NSString*)secret;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Clients
+
+/*!
+ * Adds a client for a user's session, replacing any client for the same uid.
+ * A nil secret signs calls with the application secret.
+ */
+- (FBPooledClient*)addClientWithUid:(NSString*)uid
+                         sessionKey:(NSString*)sessionKey
+                             secret:(NSString*)sessionSecret;
+
+- (FBPooledClient*)clientForUid:(NSString*)uid;
+
+/*!
+ * Removes a client. Its queued calls fail, and its cached responses are
+ * forgotten.
+ */
+- (void)removeClientForUid:(NSString*)uid;
+
+- (NSUInteger)clientCount;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Shared resources
+
+- (void)setTransport:(id<FBTransport>)aTransport;
+- (id<FBTransport>)transport;
+
+/*!
+ * The REST server calls are sent to, as with FBConnect's setRESTURL:.
+ */
+- (void)setRESTURL:(NSString*)url;
+- (NSString*)restURL;
+
+/*!
+ * 16 by default.
+ */
+- (void)setMaxConcurrentRequests:(NSUInteger)max;
+- (NSUInteger)maxConcurrentRequests;
+
+/*!
+ * The most calls per second each client may send, with bursts of up to a
+ * second's worth. 0, the default, means no limit.
+ */
+- (void)setRequestsPerSecond:(double)rate;
+- (double)requestsPerSecond;
+
+/*!
+ * Successful responses to these methods are cached per client for
+ * cacheLifetime seconds (60 by default), and repeated calls answered from
+ * the cache without being sent. Nothing is cached by default.
+ */
+- (void)setCachedMethods:(NSSet*)methods;
+- (NSSet*)cachedMethods;
+- (void)setCacheLifetime:(NSTimeInterval)seconds;
+- (NSTimeInterval)cacheLifetime;
+- (FBResponseCache*)responseCache;
+
+/*!
+ * The number of threads responses are parsed on, 2 by default.
+ */
+- (void)setParserThreadCount:(NSUInteger)count;
+- (NSUInteger)parserThreadCount;
+
+/*!
+ * The number of calls sent and not yet answered.
+ */
+- (NSUInteger)requestsInFlight;
+
+@end
@@ -0,0 +1,534 @@
+//
+//  FBClientPool.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBClientPool.h"
+#import "FBCocoa.h"
+#import "FBConnect_Internal.h"
+#import "FBMethodRequest.h"
+#import "FBNetworkThread.h"
+#import "FBPooledClient.h"
+#import "FBResponseCache.h"
+
+#define kDefaultMaxConcurrentRequests 16
+#define kDefaultCacheLifetime 60.0
+#define kDefaultParserThreadCount 2
+
+
+@class FBPooledRequest;
+
+@interface FBClientPool (Private)
+
+- (id)initWithAPIKey:(NSString*)key;
+
+- (FBConnect*)connect;
+
+- (void)schedulePump;
+
+- (void)pumpRequests;
+
+- (BOOL)removeQueuedRequest:(FBPooledRequest*)request
+                     client:(FBPooledClient*)client;
+
+- (void)pooledRequestFinished;
+
+@end
+
+
+@interface FBPooledClient (FBClientPool)
+
+- (id)initWithPool:(FBClientPool*)aPool
+               uid:(NSString*)aUid
+        sessionKey:(NSString*)aKey
+            secret:(NSString*)aSecret;
+
+- (NSString*)sessionKey;
+- (NSString*)sessionSecret;
+- (void)invalidate;
+- (BOOL)isValid;
+- (BOOL)enqueueRequest:(id)request;
+- (id)dequeueRequest;
+- (BOOL)removeRequest:(id)request;
+- (NSArray*)removeAllRequests;
+- (NSTimeInterval)takeRequestTokenAtRate:(double)rate;
+
+@end
+
+
+@interface FBMethodRequest (FBPooledRequest)
+
+- (id)initWithRequest:(NSString*)requestString
+               parent:(FBConnect*)parent
+               target:(id)tar
+             selector:(SEL)sel;
+
+- (void)completeWithResult:(id)result;
+- (void)deliverResult:(id)result;
+- (void)deliverCachedResponse:(id)json;
+
+@end
+
+
+/*
+ * A call made by a pooled client, signed with the client's session. It is
+ * never replayed or hedged, as the pool's connect has no session to renew.
+ */
+@interface FBPooledRequest : FBMethodRequest {
+  FBClientPool*   pool;
+  FBPooledClient* client;
+  NSString*       cacheKey;
+}
+
+- (id)initWithMethod:(NSString*)method
+           arguments:(NSDictionary*)args
+              client:(FBPooledClient*)aClient
+                pool:(FBClientPool*)aPool
+            cacheKey:(NSString*)key
+              target:(id)tar
+            selector:(SEL)sel;
+
+- (void)failWithError:(NSError*)err;
+
+@end
+
+
+@implementation FBClientPool
+
++ (FBClientPool*)poolWithAPIKey:(NSString*)key
+{
+  return [[[self alloc] initWithAPIKey:key] autorelease];
+}
+
+- (id)initWithAPIKey:(NSString*)key
+{
+  if (!(self = [super init])) {
+    return nil;
+  }
+
+  clients      = [[NSMutableDictionary alloc] init];
+  readyClients = [[NSMutableArray alloc] init];
+  lock         = [[NSRecursiveLock alloc] init];
+
+  maxConcurrentRequests = kDefaultMaxConcurrentRequests;
+
+  responseCache = [[FBResponseCache alloc] init];
+  cachedMethods = [[NSSet alloc] init];
+  cacheLifetime = kDefaultCacheLifetime;
+
+  parserQueue = [[NSOperationQueue alloc] init];
+  [parserQueue setMaxConcurrentOperationCount:kDefaultParserThreadCount];
+
+  // never logged in, only used for its transport and budgets
+  connect = [[FBConnect sessionWithAPIKey:key delegate:nil] retain];
+  [connect setParserQueue:parserQueue];
+
+  return self;
+}
+
+- (void)dealloc
+{
+  // clients may outlive us
+  NSArray* allClients = [clients allValues];
+  for (int i = 0; i < [allClients count]; i++) {
+    [[allClients objectAtIndex:i] invalidate];
+  }
+
+  [connect       release];
+  [clients       release];
+  [readyClients  release];
+  [lock          release];
+  [responseCache release];
+  [cachedMethods release];
+  [parserQueue   release];
+  [super dealloc];
+}
+
+- (void)setSecret:(NSString*)secret
+{
+  [connect setSecret:secret];
+}
+
+- (FBPooledClient*)addClientWithUid:(NSString*)uid
+                         sessionKey:(NSString*)sessionKey
+                             secret:(NSString*)sessionSecret
+{
+  [self removeClientForUid:uid];
+
+  FBPooledClient* client = [[FBPooledClient alloc] initWithPool:self
+                                                            uid:uid
+                                                     sessionKey:sessionKey
+                                                         secret:sessionSecret];
+  [lock lock];
+  [clients setObject:client forKey:uid];
+  [lock unlock];
+  return [client autorelease];
+}
+
+- (FBPooledClient*)clientForUid:(NSString*)uid
+{
+  [lock lock];
+  FBPooledClient* client = [[[clients objectForKey:uid] retain] autorelease];
+  [lock unlock];
+  return client;
+}
+
+- (void)removeClientForUid:(NSString*)uid
+{
+  if (uid == nil) {
+    return;
+  }
+
+  [lock lock];
+  FBPooledClient* client = [[[clients objectForKey:uid] retain] autorelease];
+  NSArray* queued = nil;
+  if (client) {
+    [clients removeObjectForKey:uid];
+    [readyClients removeObjectIdenticalTo:client];
+    queued = [client removeAllRequests];
+    [client invalidate];
+  }
+  [lock unlock];
+
+  [responseCache removePartition:uid];
+
+  NSError* err = [NSError errorWithDomain:kFBErrorDomainKey
+                                     code:FBAPIUnknownError
+                                 userInfo:[NSDictionary dictionaryWithObject:@"Client removed from pool"
+                                                                      forKey:kFBErrorMessageKey]];
+  for (int i = 0; i < [queued count]; i++) {
+    [[queued objectAtIndex:i] failWithError:err];
+  }
+}
+
+- (NSUInteger)clientCount
+{
+  [lock lock];
+  NSUInteger count = [clients count];
+  [lock unlock];
+  return count;
+}
+
+- (void)setTransport:(id<FBTransport>)aTransport
+{
+  [connect setTransport:aTransport];
+}
+
+- (id<FBTransport>)transport
+{
+  return [connect transport];
+}
+
+- (void)setRESTURL:(NSString*)url
+{
+  [connect setRESTURL:url];
+}
+
+- (NSString*)restURL
+{
+  return [connect restURL];
+}
+
+- (void)setMaxConcurrentRequests:(NSUInteger)max
+{
+  [lock lock];
+  maxConcurrentRequests = MAX(max, 1);
+  [lock unlock];
+  [self schedulePump];
+}
+
+- (NSUInteger)maxConcurrentRequests
+{
+  return maxConcurrentRequests;
+}
+
+- (void)setRequestsPerSecond:(double)rate
+{
+  [lock lock];
+  requestsPerSecond = MAX(0.0, rate);
+  [lock unlock];
+  [self schedulePump];
+}
+
+- (double)requestsPerSecond
+{
+  return requestsPerSecond;
+}
+
+- (void)setCachedMethods:(NSSet*)methods
+{
+  NSMutableSet* lowercaseMethods = [NSMutableSet setWithCapacity:[methods count]];
+  NSEnumerator* enumerator = [methods objectEnumerator];
+  NSString* cachedMethod;
+  while ((cachedMethod = [enumerator nextObject])) {
+    [lowercaseMethods addObject:[cachedMethod lowercaseString]];
+  }
+  [lock lock];
+  [cachedMethods release];
+  cachedMethods = [lowercaseMethods copy];
+  [lock unlock];
+}
+
+- (NSSet*)cachedMethods
+{
+  [lock lock];
+  NSSet* methods = [[cachedMethods retain] autorelease];
+  [lock unlock];
+  return methods;
+}
+
+- (void)setCacheLifetime:(NSTimeInterval)seconds
+{
+  cacheLifetime = seconds;
+}
+
+- (NSTimeInterval)cacheLifetime
+{
+  return cacheLifetime;
+}
+
+- (FBResponseCache*)responseCache
+{
+  return responseCache;
+}
+
+- (void)setParserThreadCount:(NSUInteger)count
+{
+  [parserQueue setMaxConcurrentOperationCount:MAX(count, 1)];
+}
+
+- (NSUInteger)parserThreadCount
+{
+  return [parserQueue maxConcurrentOperationCount];
+}
+
+- (NSUInteger)requestsInFlight
+{
+  [lock lock];
+  NSUInteger count = requestsInFlight;
+  [lock unlock];
+  return count;
+}
+
+#pragma mark Callbacks
+- (id<FBRequest>)client:(FBPooledClient*)client
+             callMethod:(NSString*)method
+          withArguments:(NSDictionary*)dict
+                 target:(id)target
+               selector:(SEL)selector
+{
+  NSString* cacheKey = nil;
+  [lock lock];
+  if ([cachedMethods containsObject:[method lowercaseString]]) {
+    cacheKey = [FBResponseCache keyForMethod:method arguments:dict];
+  }
+  [lock unlock];
+
+  FBPooledRequest* request = [[FBPooledRequest alloc] initWithMethod:method
+                                                           arguments:dict
+                                                              client:client
+                                                                pool:self
+                                                            cacheKey:cacheKey
+                                                              target:target
+                                                            selector:selector];
+  [request autorelease];
+
+  id cachedResponse = nil;
+  if (cacheKey) {
+    cachedResponse = [responseCache responseForKey:cacheKey
+                                         partition:[client uid]
+                                            maxAge:cacheLifetime];
+  }
+  if (cachedResponse) {
+    [request deliverCachedResponse:cachedResponse];
+    return request;
+  }
+
+  [lock lock];
+  BOOL queued = [client isValid];
+  if (queued && [client enqueueRequest:request]) {
+    // wait for a turn behind the other clients with calls waiting
+    [readyClients addObject:client];
+  }
+  [lock unlock];
+
+  if (!queued) {
+    [request failWithError:[NSError errorWithDomain:kFBErrorDomainKey
+                                               code:FBAPIUnknownError
+                                           userInfo:[NSDictionary dictionaryWithObject:@"Client removed from pool"
+                                                                                forKey:kFBErrorMessageKey]]];
+    return request;
+  }
+
+  [self schedulePump];
+  return request;
+}
+
+#pragma mark Private Methods
+- (FBConnect*)connect
+{
+  return connect;
+}
+
+- (void)schedulePump
+{
+  [lock lock];
+  BOOL wasScheduled = isPumpScheduled;
+  isPumpScheduled = YES;
+  [lock unlock];
+
+  if (!wasScheduled) {
+    [[FBNetworkThread sharedThread] performSelector:@selector(pumpRequests)
+                                             target:self
+                                         withObject:nil];
+  }
+}
+
+- (void)pumpRequests
+{
+  NSMutableArray* startingRequests = [NSMutableArray array];
+  NSMutableArray* limitedClients = [NSMutableArray array];
+  NSTimeInterval retryDelay = 0;
+
+  [lock lock];
+  isPumpScheduled = NO;
+
+  // one call from each client in turn, skipping those over their rate
+  while (requestsInFlight < maxConcurrentRequests && [readyClients count] > 0) {
+    FBPooledClient* client = [[[readyClients objectAtIndex:0] retain] autorelease];
+    [readyClients removeObjectAtIndex:0];
+
+    NSTimeInterval delay = [client takeRequestTokenAtRate:requestsPerSecond];
+    if (delay > 0) {
+      [limitedClients addObject:client];
+      retryDelay = (retryDelay == 0) ? delay : MIN(retryDelay, delay);
+      continue;
+    }
+
+    FBPooledRequest* request = [client dequeueRequest];
+    if (request == nil) {
+      continue;
+    }
+    [startingRequests addObject:request];
+    requestsInFlight++;
+
+    if ([client queuedRequestCount] > 0) {
+      [readyClients addObject:client];
+    }
+  }
+  [readyClients addObjectsFromArray:limitedClients];
+  [lock unlock];
+
+  if (retryDelay > 0) {
+    [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                             selector:@selector(schedulePump)
+                                               object:nil];
+    [self performSelector:@selector(schedulePump) withObject:nil afterDelay:retryDelay];
+  }
+
+  // held back like any other request while responses fill the budget
+  for (int i = 0; i < [startingRequests count]; i++) {
+    [connect startRequest:[startingRequests objectAtIndex:i]];
+  }
+}
+
+- (BOOL)removeQueuedRequest:(FBPooledRequest*)request
+                     client:(FBPooledClient*)client
+{
+  [lock lock];
+  BOOL removed = [client removeRequest:request];
+  if (removed && [client queuedRequestCount] == 0) {
+    [readyClients removeObjectIdenticalTo:client];
+  }
+  [lock unlock];
+  return removed;
+}
+
+- (void)pooledRequestFinished
+{
+  [lock lock];
+  if (requestsInFlight > 0) {
+    requestsInFlight--;
+  }
+  [lock unlock];
+  [self schedulePump];
+}
+
+@end
+
+
+@implementation FBPooledRequest
+
+- (id)initWithMethod:(NSString*)method
+           arguments:(NSDictionary*)args
+              client:(FBPooledClient*)aClient
+                pool:(FBClientPool*)aPool
+            cacheKey:(NSString*)key
+              target:(id)tar
+            selector:(SEL)sel
+{
+  NSString* requestString = [[aPool connect] getRequestStringForMethod:method
+                                                             arguments:args
+                                                            sessionKey:[aClient sessionKey]
+                                                                secret:[aClient sessionSecret]];
+  if (self = [super initWithRequest:requestString
+                             parent:[aPool connect]
+                             target:tar
+                           selector:sel]) {
+    methodName = [method retain];
+    arguments  = [args retain];
+    pool       = [aPool retain];
+    client     = [aClient retain];
+    cacheKey   = [key retain];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [pool     release];
+  [client   release];
+  [cacheKey release];
+  [super dealloc];
+}
+
+- (BOOL)canReplay
+{
+  return NO;
+}
+
+- (void)cancel
+{
+  // a call still waiting its turn is never sent
+  if ([pool removeQueuedRequest:self client:client]) {
+    [self failWithError:[NSError errorWithDomain:kFBErrorDomainKey
+                                            code:FBAPIUnknownError
+                                        userInfo:[NSDictionary dictionaryWithObject:@"Request Cancelled"
+                                                                             forKey:kFBErrorMessageKey]]];
+    return;
+  }
+  [super cancel];
+}
+
+- (void)failWithError:(NSError*)err
+{
+  requestFinished = YES;
+  [self failure:err];
+}
+
+- (void)completeWithResult:(id)result
+{
+  if (cacheKey && ![result isKindOfClass:[NSError class]] &&
+      !([result isKindOfClass:[NSDictionary class]] && [result objectForKey:@"error_code"] != nil)) {
+    [[pool responseCache] setResponse:result forKey:cacheKey partition:[client uid]];
+  }
+
+  // we may be released as soon as the result is delivered
+  FBClientPool* requestPool = [[pool retain] autorelease];
+  [super completeWithResult:result];
+  [requestPool pooledRequestFinished];
+}
+
+@end
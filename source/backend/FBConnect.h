@@ -7,6 +7,7 @@
 
 #import <Cocoa/Cocoa.h>
 #import "FBRequest.h"
+#import "FBTransport.h"
 
 #define kFBErrorDomainKey @"kFBErrorDomainKey"
 #define kFBErrorMessageKey @"kFBErrorMessageKey"
@@ -16,6 +17,16 @@
 @class FBSessionState;
 @class FBWebViewWindowController;
 @class FBCallback;
+@class FBMethodRequest;
+@class FBLiveQuery;
+@class FBPoll;
+@class FBPollScheduler;
+@class FBLatencyTracker;
+@class FBProjection;
+@class FBRowSchema;
+@class FBTableStore;
+@class FBSharedResponseCache;
+@class FBResponseCache;
 
 
 /*!
@@ -29,6 +40,14 @@
 - (void)facebookConnectLoggedIn:(FBConnect*)connect withError:(NSError*)err;
 - (void)facebookConnectLoggedOut:(FBConnect*)connect withError:(NSError*)err;
 
+@optional
+
+/*!
+ * With coalesced completions, sent after the targets of the requests which
+ * completed together have been called back, in the order they completed.
+ */
+- (void)facebookConnect:(FBConnect*)connect completedRequests:(NSArray*)requests;
+
 @end
 
 
@@ -37,6 +56,11 @@
  *
  * FBConnect handles all transactions with the Facebook API: logging in and
  * sending FQL queries.
+ *
+ * API methods may be called from any thread. Requests are sent from a
+ * dedicated network thread; the target of a request made on the main thread
+ * is called back on the main thread, otherwise on the network thread. Logging
+ * in, logging out and requesting permissions must happen on the main thread.
  */
 @interface FBConnect : NSObject {
   NSString*       sandbox; // for debugging only
@@ -52,11 +76,66 @@
   NSSet*          optionalPermissions;
   NSMutableSet*   requestedPermissions;
 
-  BOOL            isBatch;
-  NSMutableArray* pendingBatchRequests;
+  NSRecursiveLock* stateLock;
+  NSString*       batchContextKey;
+
+  BOOL            isRefreshingSession;
+  NSMutableArray* parkedRequests;
+
+  BOOL            usesOptimisticLogin;
+  BOOL            isValidatingOptimistically;
+  BOOL            isBuildingOptimisticBatch;
+  int             nestedBatchStart;
+  NSMutableSet*   unvalidatedRequests;
 
   FBCallback*     permissionCallback;
 
+  FBPollScheduler* pollScheduler;
+
+  id<FBTransport> transport;
+  NSString*       restServerURL;
+  BOOL            compressesUploads;
+
+  unsigned long long wireByteCount;
+  unsigned long long decodedByteCount;
+
+  NSUInteger         responseMemoryThreshold;
+  unsigned long long maxResponseSize;
+  NSUInteger         responseMemoryBudget;
+  NSUInteger         responseMemoryInUse;
+  NSMutableArray*    deferredRequests;
+
+  FBLatencyTracker*  latencyTracker;
+  NSSet*             hedgedMethods;
+  double             hedgeBudget;
+  double             hedgeTokens;
+
+  NSOperationQueue*  parserQueue;
+  BOOL               usesArenaParsing;
+  FBTableStore*      tableStore;
+
+  BOOL               coalescesCompletions;
+  NSTimeInterval     completionInterval;
+  NSTimeInterval     lastCompletionDelivery;
+  NSMutableArray*    completedRequests;
+
+  FBSharedResponseCache* sharedResponseCache;
+  NSSet*             sharedCachedMethods;
+  NSTimeInterval     sharedCacheLifetime;
+
+  NSMutableDictionary* warmQueries;
+  FBResponseCache*   warmResponses;
+  NSMutableArray*    prefetchRequests;
+  NSUInteger         prefetchCount;
+  BOOL               prefetchYielded;
+  BOOL               isPrefetching;
+  NSTimeInterval     lastForegroundRequest;
+
+  NSMutableDictionary* requestGroups;
+  NSMutableDictionary* groupsByRequest;
+  NSMutableDictionary* supersedingRequests;
+  NSMutableDictionary* supersedeKeysByRequest;
+
   FBWebViewWindowController* windowController;
 }
 
@@ -106,11 +185,28 @@
  * It's highly recommended to add "offline_access" to your optionalPermissions
  * to allow infinite sessions.
  *
+ * A session which expires can only be renewed by logging in again, so the
+ * login window is shown when it actually expires, never earlier. Requests
+ * made after that are held until the user has logged in again and then
+ * sent, or fail if the login doesn't complete.
+ *
  * http://wiki.developers.facebook.com/index.php/Extended_application_permission
  */
 - (void)loginWithRequiredPermissions:(NSSet*)req
                  optionalPermissions:(NSSet*)opt;
 
+/*!
+ * When set, a valid session cached from a previous launch is reported as
+ * logged in immediately, before it has been validated with Facebook. Requests
+ * made from -facebookConnectLoggedIn:withError: are sent in the same
+ * batch.run as the validation calls. If validation fails, their results are
+ * discarded and they are sent again once the user has logged in again.
+ *
+ * Note that -hasPermission: may not be accurate until validation completes.
+ */
+- (void)setUsesOptimisticLogin:(BOOL)optimistic;
+- (BOOL)usesOptimisticLogin;
+
 /*!
  * Logs out the current session. If a user defaults key for storing persistent
  * sessions has been set, this method clears the stored session, if any.
@@ -154,6 +250,161 @@
 ////////////////////////////////////////////////////////////////////////////////
 // Calling API Methods
 
+/*!
+ * The transport API requests are sent over. Defaults to the shared
+ * FBHTTPTransport; set an FBLoopbackTransport to run without a network.
+ */
+- (void)setTransport:(id<FBTransport>)aTransport;
+- (id<FBTransport>)transport;
+
+/*!
+ * The REST server API methods are called on, such as a local stub server
+ * for testing. nil, the default, is Facebook's own.
+ */
+- (void)setRESTURL:(NSString*)url;
+- (NSString*)restURL;
+
+/*!
+ * When set, large POST bodies (photo uploads) are sent gzipped. Responses are
+ * always requested with gzip or deflate encoding. Off by default, as only
+ * some servers accept compressed requests.
+ */
+- (void)setCompressesUploads:(BOOL)compress;
+- (BOOL)compressesUploads;
+
+/*!
+ * The total size of all responses as they were sent over the network.
+ */
+- (unsigned long long)wireByteCount;
+
+/*!
+ * The total size of all responses after decompression.
+ */
+- (unsigned long long)decodedByteCount;
+
+/*!
+ * A response larger than this many bytes (1MB by default) is written to a
+ * temporary file as it arrives rather than held in memory, and the file is
+ * memory mapped to be parsed.
+ */
+- (void)setResponseMemoryThreshold:(NSUInteger)bytes;
+- (NSUInteger)responseMemoryThreshold;
+
+/*!
+ * A request whose response grows past this many bytes (256MB by default) is
+ * cancelled and fails with an error. 0 means no limit.
+ */
+- (void)setMaxResponseSize:(unsigned long long)bytes;
+- (unsigned long long)maxResponseSize;
+
+/*!
+ * The most memory (8MB by default) all in flight responses may use together.
+ * Once it is used up, further responses go to disk. A new request is not sent
+ * until earlier ones have given back enough for a response of up to the
+ * response memory threshold.
+ */
+- (void)setResponseMemoryBudget:(NSUInteger)bytes;
+- (NSUInteger)responseMemoryBudget;
+- (NSUInteger)responseMemoryInUse;
+
+/*!
+ * Calls to these methods, which must be safe to repeat, are hedged: if a
+ * call takes longer than 95% of recent calls to the same method, it is sent
+ * again and whichever response arrives first is used. Nothing is hedged by
+ * default. For example, users.getLoggedInUser or notifications.get.
+ */
+- (void)setHedgedMethods:(NSSet*)methods;
+- (NSSet*)hedgedMethods;
+
+/*!
+ * Hedges sent are limited to this fraction of hedgeable calls, 0.05 by
+ * default, so hedging adds at most that much load.
+ */
+- (void)setHedgeBudget:(double)fraction;
+- (double)hedgeBudget;
+
+/*!
+ * Recent latencies of each API method.
+ */
+- (FBLatencyTracker*)latencyTracker;
+
+/*!
+ * When set, responses are parsed by operations on this queue rather than on
+ * the network thread, so a large response doesn't hold up the others. Not
+ * set by default.
+ */
+- (void)setParserQueue:(NSOperationQueue*)queue;
+- (NSOperationQueue*)parserQueue;
+
+/*!
+ * When set, responses are parsed with FBArenaParser: each result is held in
+ * a few large blocks and freed in one go, rather than as an object per
+ * value. Results are then read-only. Off by default.
+ */
+- (void)setUsesArenaParsing:(BOOL)arena;
+- (BOOL)usesArenaParsing;
+
+/*!
+ * When set, FQL queries are answered from this store as far as they can be,
+ * and only the rest are sent; the rows fetched are kept in it. Queries with
+ * a projection or row schema always go to the server. The store is emptied
+ * on logout. Not set by default.
+ */
+- (void)setTableStore:(FBTableStore*)store;
+- (FBTableStore*)tableStore;
+
+/*!
+ * When set, the targets of requests completing on the main thread are
+ * called back together, in the order the requests completed, on the next
+ * turn of the run loop, and the delegate is then sent
+ * facebookConnect:completedRequests:. A burst of completions, such as the
+ * calls of a batch, is then handled in one go. Off by default.
+ */
+- (void)setCoalescesCompletions:(BOOL)coalesce;
+- (BOOL)coalescesCompletions;
+
+/*!
+ * The least time between coalesced deliveries, such as 1.0 / 60 to deliver
+ * at most once a frame. 0, the default, delivers every turn of the run loop.
+ */
+- (void)setCompletionInterval:(NSTimeInterval)interval;
+- (NSTimeInterval)completionInterval;
+
+/*!
+ * When set, successful responses to sharedCachedMethods (fql.query and
+ * fql.multiquery by default) are kept in the cache, and calls are answered
+ * from it for sharedCacheLifetime seconds (60 by default) without being
+ * sent. Any FBConnect with the same API key and session can answer from
+ * responses another fetched, in this process or another one which opened
+ * the same cache file. Calls with a projection or row schema always go to
+ * the server. This session's responses are removed on logout. Not set by
+ * default.
+ */
+- (void)setSharedResponseCache:(FBSharedResponseCache*)cache;
+- (FBSharedResponseCache*)sharedResponseCache;
+- (void)setSharedCachedMethods:(NSSet*)methods;
+- (NSSet*)sharedCachedMethods;
+- (void)setSharedCacheLifetime:(NSTimeInterval)seconds;
+- (NSTimeInterval)sharedCacheLifetime;
+
+/*!
+ * Declares an FQL query the application will want as soon as it has logged
+ * in, and how old its rows may be. After logging in, and again before their
+ * rows go stale, the warm queries are sent together in one batch.run once
+ * the run loop is idle, and the same queries made with fqlQuery: are then
+ * answered without being sent. A prefetch gives way to any other request:
+ * it is cancelled and tried again once things are quiet.
+ */
+- (void)addWarmQuery:(NSString*)query maxAge:(NSTimeInterval)maxAge;
+- (void)removeWarmQuery:(NSString*)query;
+- (NSDictionary*)warmQueries;
+
+/*!
+ * Fetches the warm queries which are stale next time the run loop is idle.
+ * Called after logging in.
+ */
+- (void)prefetchWarmQueries;
+
 /*!
  * Sends an API request with a particular method.
  */
@@ -195,6 +446,100 @@
                         target:(id)target
                       selector:(SEL)selector;
 
+/*!
+ * As the methods above, but only the parts of the response on projection's
+ * key paths are parsed, and the rest is skipped; see FBProjection. For a
+ * multiquery, the projection applies to the rows of each query.
+ */
+- (id<FBRequest>)callMethod:(NSString*)method
+              withArguments:(NSDictionary*)dict
+                 projection:(FBProjection*)projection
+                     target:(id)target
+                   selector:(SEL)selector;
+
+- (id<FBRequest>)fqlQuery:(NSString*)query
+               projection:(FBProjection*)projection
+                   target:(id)target
+                 selector:(SEL)selector;
+
+- (id<FBRequest>)fqlMultiquery:(NSDictionary*)queries
+                    projection:(FBProjection*)projection
+                        target:(id)target
+                      selector:(SEL)selector;
+
+/*!
+ * Sends an FQL query whose rows are decoded straight into instances of the
+ * schema's model class; the response is an array of them. See FBRowSchema.
+ */
+- (id<FBRequest>)fqlQuery:(NSString*)query
+                rowSchema:(FBRowSchema*)schema
+                   target:(id)target
+                 selector:(SEL)selector;
+
+/*!
+ * Sends an FQL.multiquery, decoding the rows of each query with the schema
+ * for its name in schemas. Queries without a schema are parsed as usual.
+ */
+- (id<FBRequest>)fqlMultiquery:(NSDictionary*)queries
+                    rowSchemas:(NSDictionary*)schemas
+                        target:(id)target
+                      selector:(SEL)selector;
+
+/*!
+ * Sends a large FQL query as a series of pages of pageSize rows each, keeping
+ * up to pipelineDepth pages in flight at once. The selector is called on
+ * target once per page, in order, with the page's rows as the response; the
+ * request's -isFinished is YES on the last call. Cancelling the returned
+ * request stops any further pages from being fetched.
+ *
+ * The query must not already have a LIMIT clause, and paged queries cannot
+ * be part of a batch; either raises an exception.
+ */
+- (id<FBRequest>)fqlQuery:(NSString*)query
+                 pageSize:(NSUInteger)pageSize
+            pipelineDepth:(NSUInteger)pipelineDepth
+                   target:(id)target
+                 selector:(SEL)selector;
+
+/*!
+ * Creates a live query for an FQL query you intend to run repeatedly. Each
+ * call to -refresh on the result sends the query and compares the rows with
+ * the previous result, matching rows by keyColumn. The selector is called on
+ * target only when rows were added, removed or changed; see FBLiveQuery.
+ */
+- (FBLiveQuery*)liveQuery:(NSString*)query
+                keyColumn:(NSString*)keyColumn
+                   target:(id)target
+                 selector:(SEL)selector;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Polling
+
+/*!
+ * Polls an FQL query. The interval between polls starts at min seconds and
+ * drifts towards max seconds while the result stays the same, shrinking again
+ * when it changes. The selector is called on target with the FBPoll only
+ * when the result has changed or the poll failed. Polls due at around the
+ * same time share a single batch.run.
+ */
+- (FBPoll*)pollQuery:(NSString*)query
+         minInterval:(NSTimeInterval)min
+         maxInterval:(NSTimeInterval)max
+              target:(id)target
+            selector:(SEL)selector;
+
+/*!
+ * Stops polling a query registered with pollQuery:...
+ */
+- (void)stopPoll:(FBPoll*)poll;
+
+/*!
+ * The scheduler running this session's polls. See FBPollScheduler for
+ * statistics about calls made and saved.
+ */
+- (FBPollScheduler*)pollScheduler;
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // API Method Batch requests
@@ -214,11 +559,15 @@
  * [connectSession callMethod:@"Stream.publish" ...];
  * [connectSession callMethod:@"Stream.get" ...];
  * [connectSession sendBatch];
+ *
+ * A batch belongs to the thread which started it: calls made on other threads
+ * meanwhile are sent as usual, and each thread may build its own batch.
  */
 - (void)startBatch;
 
 /*!
- * @returns YES if startBatch has been called and sendBatch has not
+ * @returns YES if startBatch has been called on this thread and sendBatch
+ * has not
  */
 - (BOOL)pendingBatch;
 
@@ -232,4 +581,35 @@
  */
 - (id<FBRequest>)sendBatch;
 
+
+////////////////////////////////////////////////////////////////////////////////
+// Request groups
+
+/*!
+ * Adds a request to a group, such as the view it was made for, so the
+ * group's requests can be cancelled together. A group may be any object; it
+ * is compared by identity, and retained until the last of its requests has
+ * called back or the group is cancelled. A request which never finishes on
+ * its own, such as a live query, keeps its group until it is cancelled. A
+ * request is in at most one group, the last it was added to.
+ */
+- (void)addRequest:(id<FBRequest>)request toGroup:(id)group;
+
+/*!
+ * Cancels the group's outstanding requests, and forgets the group. Those not
+ * yet sent, such as the calls of a batch not yet sent, never are.
+ */
+- (void)cancelRequestGroup:(id)group;
+
+- (NSArray*)outstandingRequestsInGroup:(id)group;
+
+/*!
+ * Makes request the latest with key, cancelling the one before it if that
+ * is still outstanding, such as the last search as the user types. If its
+ * response has arrived but is still waiting to be parsed, it is dropped
+ * without being parsed. The key is forgotten once its latest request has
+ * called back.
+ */
+- (void)setSupersedeKey:(NSString*)key forRequest:(id<FBRequest>)request;
+
 @end
@@ -8,16 +8,31 @@
 #import "FBConnect.h"
 #import "FBConnect_Internal.h"
 #import "FBCocoa.h"
+#import "FBArenaParser.h"
 #import "FBCallback.h"
 #import "FBMethodRequest.h"
 #import "FBBatchRequest.h"
 #import "FBMultiqueryRequest.h"
-#import "FBWebViewWindowController.h"
+#import "FBPagedQueryRequest.h"
+#import "FBLiveQuery.h"
+#import "FBPoll.h"
+#import "FBRowSchema.h"
+#import "FBTableQueryRequest.h"
+#import "FBTableStore.h"
+#import "FBResponseCache.h"
+#import "FBSharedResponseCache.h"
+#import "FBPollScheduler.h"
+#import "FBHTTPTransport.h"
+#import "FBLatencyTracker.h"
+#import "FBNetworkThread.h"
 #import "FBSessionState.h"
 #import "JSON.h"
 #import "NSData+.h"
-#import "NSImage+.h"
 #import "NSString+.h"
+#ifndef FB_HEADLESS
+  #import "FBWebViewWindowController.h"
+  #import "NSImage+.h"
+#endif
 
 // end points
 #define kRESTServerURL @"http://api.%@facebook.com/restserver.php"
@@ -29,6 +44,47 @@
 // session key
 #define kSessionKey @"FBUser"
 
+// batch.run accepts at most 20 methods
+#define kMaxBatchSize 20
+
+// response memory limits
+#define kDefaultResponseMemoryThreshold (1024 * 1024)
+#define kDefaultMaxResponseSize (256ULL * 1024 * 1024)
+#define kDefaultResponseMemoryBudget (8 * 1024 * 1024)
+
+// hedge calls slower than this fraction of recent ones
+#define kHedgePercentile 0.95
+#define kDefaultHedgeBudget 0.05
+#define kMaxHedgeTokens 2.0
+
+#define kDefaultSharedCacheLifetime 60.0
+
+// posted to ourselves, when the run loop is idle, to send the warm queries
+#define kPrefetchNotification @"FBConnectPrefetchWarmQueries"
+
+// prefetch only once no other request has been made for this long
+#define kPrefetchQuietPeriod 1.0
+
+
+static BOOL FBRequestIsOutstanding(id<FBRequest> request)
+{
+  // those which can't tell, such as live queries, are kept until cancelled
+  return ![request respondsToSelector:@selector(isFinished)] || ![(id)request isFinished];
+}
+
+
+@interface FBMethodRequest (Internal)
+
+- (void)notifyTargetNow;
+
+- (void)setSharedCacheKey:(NSString*)key partition:(NSString*)partition;
+
+- (void)deliverCachedResponse:(id)json;
+
+- (void)markCancelled;
+
+@end
+
 
 @interface FBConnect (Private)
 
@@ -38,14 +94,66 @@
 
 - (void)validateSession;
 
+- (void)validateSessionOptimistically;
+
 - (void)refreshSession;
 
+- (void)beginSessionRefresh;
+
+- (void)scheduleSessionRenewal;
+
+- (BOOL)sessionNeedsRenewal;
+
+- (void)replayParkedRequests;
+
+- (void)failParkedRequestsWithError:(NSError*)err;
+
+- (NSMutableArray*)pendingBatchRequests;
+
+- (void)setPendingBatchRequests:(NSMutableArray*)requests;
+
+- (void)dispatchRequest:(FBMethodRequest*)request;
+
+- (void)startRequest:(FBMethodRequest*)request;
+
+- (void)startDeferredRequests;
+
+- (BOOL)hasRoomForResponse;
+
+- (void)deliverCompletedRequests;
+
+- (void)removeRequestFromGroup:(id<FBRequest>)request;
+
+- (void)forgetRequestGroup:(NSValue*)groupKey;
+
+- (void)removeSupersedeKeyOfRequest:(id<FBRequest>)request;
+
+- (NSString*)cachePartition;
+
+- (BOOL)answerFromCache:(FBMethodRequest*)request;
+
+- (void)sendWarmQueries:(NSNotification*)notification;
+
+- (void)yieldToForegroundRequest;
+
+- (void)cancelPrefetch;
+
+- (void)schedulePrefetchAfterDelay:(NSTimeInterval)delay;
+
+- (NSTimeInterval)warmQueryRefreshInterval;
+
 - (NSString*)getPreferedFBLocale;
 
 - (NSDictionary*)completeArgumentsForMethod:(NSString*)method
                                   arguments:(NSDictionary*)dict;
 
-- (NSString*)sigForArguments:(NSDictionary*)dict;
+- (NSDictionary*)completeArgumentsForMethod:(NSString*)method
+                                  arguments:(NSDictionary*)dict
+                                 sessionKey:(NSString*)sessionKey
+                                     secret:(NSString*)secret;
+
+- (NSString*)sigForArguments:(NSDictionary*)dict
+                      secret:(NSString*)secret;
 
 - (NSString*)getRequestStringForMethod:(NSString*)method
                              arguments:(NSDictionary*)dict;
@@ -54,7 +162,9 @@
                    arguments:(NSDictionary*)dict
                        files:(NSArray*)files;
 
+#ifndef FB_HEADLESS
 - (void)complainAboutRequiredPermissions:(NSSet*)lackingPermissions;
+#endif
 
 // url functions
 - (void)setSandbox:(NSString*)box;
@@ -92,12 +202,46 @@
   isConnecting  = NO;
 
   requestedPermissions = [[NSMutableSet alloc] init];
+  parkedRequests       = [[NSMutableArray alloc] init];
+  unvalidatedRequests  = [[NSMutableSet alloc] init];
+  nestedBatchStart     = -1;
+  stateLock            = [[NSRecursiveLock alloc] init];
+  batchContextKey      = [[NSString alloc] initWithFormat:@"FBConnectBatch %p", self];
+  transport            = [[FBHTTPTransport sharedTransport] retain];
+
+  responseMemoryThreshold = kDefaultResponseMemoryThreshold;
+  maxResponseSize         = kDefaultMaxResponseSize;
+  responseMemoryBudget    = kDefaultResponseMemoryBudget;
+  deferredRequests        = [[NSMutableArray alloc] init];
+
+  latencyTracker = [[FBLatencyTracker alloc] init];
+  hedgedMethods  = [[NSSet alloc] init];
+  hedgeBudget    = kDefaultHedgeBudget;
+
+  sharedCachedMethods = [[NSSet alloc] initWithObjects:@"fql.query", @"fql.multiquery", nil];
+  sharedCacheLifetime = kDefaultSharedCacheLifetime;
+
+  requestGroups          = [[NSMutableDictionary alloc] init];
+  groupsByRequest        = [[NSMutableDictionary alloc] init];
+  supersedingRequests    = [[NSMutableDictionary alloc] init];
+  supersedeKeysByRequest = [[NSMutableDictionary alloc] init];
+
+  warmQueries   = [[NSMutableDictionary alloc] init];
+  warmResponses = [[FBResponseCache alloc] init];
+  prefetchRequests = [[NSMutableArray alloc] init];
+  [[NSNotificationCenter defaultCenter] addObserver:self
+                                           selector:@selector(sendWarmQueries:)
+                                               name:kPrefetchNotification
+                                             object:self];
 
   return self;
 }
 
 - (void)dealloc
 {
+  [NSObject cancelPreviousPerformRequestsWithTarget:self];
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+
   [sandbox release];
 
   [APIKey       release];
@@ -109,6 +253,36 @@
   [requestedPermissions release];
 
   [permissionCallback release];
+  [parkedRequests     release];
+  [unvalidatedRequests release];
+
+  [pollScheduler invalidate];
+  [pollScheduler release];
+
+  [transport release];
+  [restServerURL release];
+  [deferredRequests release];
+  [latencyTracker release];
+  [hedgedMethods release];
+  [parserQueue release];
+  [tableStore release];
+  [completedRequests release];
+  [sharedResponseCache release];
+  [sharedCachedMethods release];
+  [warmQueries release];
+  [warmResponses release];
+  [prefetchRequests release];
+  NSArray* groupKeys = [requestGroups allKeys];
+  for (int i = 0; i < [groupKeys count]; i++) {
+    [[[groupKeys objectAtIndex:i] nonretainedObjectValue] release];
+  }
+  [requestGroups release];
+  [groupsByRequest release];
+  [supersedingRequests release];
+  [supersedeKeysByRequest release];
+
+  [stateLock release];
+  [batchContextKey release];
 
   [super dealloc];
 }
@@ -131,6 +305,12 @@
 
 - (NSString*)restURL
 {
+  [stateLock lock];
+  NSString* url = [[restServerURL retain] autorelease];
+  [stateLock unlock];
+  if (url) {
+    return url;
+  }
   return [NSString stringWithFormat:kRESTServerURL, sandbox];
 }
 
@@ -170,12 +350,25 @@
   return isConnecting;
 }
 
+- (void)setUsesOptimisticLogin:(BOOL)optimistic
+{
+  usesOptimisticLogin = optimistic;
+}
+
+- (BOOL)usesOptimisticLogin
+{
+  return usesOptimisticLogin;
+}
+
 - (NSString*)uid
 {
-  if (![sessionState isValid]) {
-    return nil;
+  [stateLock lock];
+  NSString* uid = nil;
+  if ([sessionState isValid]) {
+    uid = [[[sessionState uid] retain] autorelease];
   }
-  return [sessionState uid];
+  [stateLock unlock];
+  return uid;
 }
 
 - (void)loginWithRequiredPermissions:(NSSet*)req
@@ -198,260 +391,1359 @@
     [requestedPermissions unionSet:optionalPermissions];
   }
 
-  if ([sessionState isValid]) {
-    [self validateSession];
-  } else {
-    [self promptLogin];
+  if ([sessionState isValid] && usesOptimisticLogin) {
+    [self validateSessionOptimistically];
+  } else if ([sessionState isValid]) {
+    [self validateSession];
+  } else {
+    [self promptLogin];
+  }
+}
+
+- (void)promptLogin
+{
+#ifdef FB_HEADLESS
+  // without a window to log in with there's no way to get a session
+  NSError* err = [NSError errorWithDomain:kFBErrorDomainKey code:FBAPIUnknownError userInfo:nil];
+  [self failParkedRequestsWithError:err];
+  [delegate facebookConnectLoggedIn:self withError:err];
+#else
+  // if a window exists, focus it.
+  if (windowController) {
+    [windowController focus];
+    return;
+  }
+
+  isConnecting = YES;
+
+  NSMutableDictionary* loginParams = [[NSMutableDictionary alloc] init];
+  NSString* permissionsString = [[requestedPermissions allObjects] componentsJoinedByString:@","];
+  [loginParams setObject:permissionsString          forKey:@"req_perms"];
+  [loginParams setObject:APIKey                     forKey:@"api_key"];
+  [loginParams setObject:[self getPreferedFBLocale] forKey:@"locale"];
+
+  // adding this parameter keeps us from reading Safari's cookie when
+  // performing a login for the first time. Sessions are still cached and
+  // persistant so subsequent application launches will use their own
+  // session cookie and not Safari's
+  [loginParams setObject:@"true" forKey:@"skipcookie"];
+
+  windowController =
+  [[FBWebViewWindowController alloc] initWithConnect:self
+                                             rootURL:[self loginURL]
+                                              target:self
+                                            selector:@selector(loginWindowClosed)];
+  [windowController showWithParams:loginParams];
+#endif
+}
+
+- (void)requestPermissions:(NSSet*)perms
+                    target:(id)target
+                  selector:(SEL)selector
+{
+#ifdef FB_HEADLESS
+  FBCallback* callback = [[[FBCallback alloc] initWithTarget:target selector:selector] autorelease];
+  [callback failure:[NSError errorWithDomain:kFBErrorDomainKey code:FBAPIUnknownError userInfo:nil]];
+#else
+  // if a window exists, focus it.
+  if (windowController) {
+    [windowController focus];
+    return;
+  }
+
+  // store the callback
+  if (permissionCallback) {
+    [permissionCallback release];
+  }
+  permissionCallback = [[FBCallback alloc] initWithTarget:target
+                                                 selector:selector];
+
+  NSMutableDictionary* loginParams = [[NSMutableDictionary alloc] init];
+  NSString* permissionsString = [[perms allObjects] componentsJoinedByString:@","];
+  [loginParams setObject:permissionsString          forKey:@"ext_perm"];
+  [loginParams setObject:APIKey                     forKey:@"api_key"];
+  [loginParams setObject:[sessionState key]         forKey:@"session_key"];
+  [loginParams setObject:[self getPreferedFBLocale] forKey:@"locale"];
+
+  // adding this parameter keeps us from reading Safari's cookie when
+  // performing a login for the first time. Sessions are still cached and
+  // persistant so subsequent application launches will use their own
+  // session cookie and not Safari's
+  [loginParams setObject:@"true" forKey:@"skipcookie"];
+
+  windowController =
+  [[FBWebViewWindowController alloc] initWithConnect:self
+                                             rootURL:[self permissionsURL]
+                                              target:self
+                                            selector:@selector(permissionWindowClosed)];
+  [windowController showWithParams:loginParams];
+#endif
+}
+
+- (void)logout
+{
+  [stateLock lock];
+  isRefreshingSession = NO;
+  [stateLock unlock];
+  [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                           selector:@selector(renewSession)
+                                             object:nil];
+  [self cancelPrefetch];
+  [self failParkedRequestsWithError:[NSError errorWithDomain:kFBErrorDomainKey
+                                                        code:FBAPIUnknownError
+                                                    userInfo:[NSDictionary dictionaryWithObject:@"Logged out"
+                                                                                         forKey:kFBErrorMessageKey]]];
+
+  [self callMethod:@"auth.expireSession"
+     withArguments:nil
+            target:self
+          selector:@selector(expireSessionResponseComplete:)];
+  [stateLock lock];
+  [sharedResponseCache removePartition:[self cachePartition]];
+  [warmResponses removeAllResponses];
+  [sessionState clear];
+  isLoggedIn = NO;
+  isConnecting = NO;
+  [tableStore removeAllRows];
+  [stateLock unlock];
+}
+
+- (void)validateSession
+{
+  isConnecting = YES;
+
+  [self startBatch];
+
+  [self fqlQuery:[NSString stringWithFormat:@"SELECT %@ FROM permissions WHERE uid = %@",
+                  [[requestedPermissions allObjects] componentsJoinedByString:@","], [self uid]]
+          target:self
+        selector:@selector(gotGrantedPermissions:)];
+
+  [self callMethod:@"users.getLoggedInUser"
+     withArguments:nil
+            target:self
+          selector:@selector(gotLoggedInUser:)];
+
+  [self sendBatch];
+}
+
+- (void)validateSessionOptimistically
+{
+  // same calls as validateSession, but don't send them yet
+  [self startBatch];
+
+  [self fqlQuery:[NSString stringWithFormat:@"SELECT %@ FROM permissions WHERE uid = %@",
+                  [[requestedPermissions allObjects] componentsJoinedByString:@","], [self uid]]
+          target:self
+        selector:@selector(gotGrantedPermissions:)];
+
+  [self callMethod:@"users.getLoggedInUser"
+     withArguments:nil
+            target:self
+          selector:@selector(gotLoggedInUser:)];
+  NSMutableArray* batch = [[[self pendingBatchRequests] retain] autorelease];
+  int validationCount = [batch count];
+
+  // trust the cached session for now, so whatever the delegate asks for
+  // rides along in the same batch.run as the validation calls
+  isLoggedIn = YES;
+  isConnecting = NO;
+  isValidatingOptimistically = YES;
+  isBuildingOptimisticBatch = YES;
+  [self prefetchWarmQueries];
+  [delegate facebookConnectLoggedIn:self withError:nil];
+  isBuildingOptimisticBatch = NO;
+  nestedBatchStart = -1;
+
+  // anything past the batch.run limit waits until we know the session is good
+  [stateLock lock];
+  if ([batch count] > kMaxBatchSize) {
+    NSRange overflow = NSMakeRange(kMaxBatchSize, [batch count] - kMaxBatchSize);
+    [parkedRequests addObjectsFromArray:[batch subarrayWithRange:overflow]];
+    [batch removeObjectsInRange:overflow];
+  }
+  NSRange unvalidated = NSMakeRange(validationCount, [batch count] - validationCount);
+  [unvalidatedRequests addObjectsFromArray:[batch subarrayWithRange:unvalidated]];
+  [stateLock unlock];
+
+  [self sendBatch];
+}
+
+- (void)refreshSession
+{
+  NSLog(@"refreshing session");
+  [stateLock lock];
+  isLoggedIn = NO;
+  isConnecting = YES;
+  isRefreshingSession = YES;
+  [sessionState invalidate];
+  [stateLock unlock];
+  [self loginWithRequiredPermissions:requiredPermissions
+                 optionalPermissions:optionalPermissions];
+}
+
+- (void)beginSessionRefresh
+{
+  // requests arriving from here on are parked until the refresh completes
+  [stateLock lock];
+  BOOL wasRefreshing = isRefreshingSession;
+  isRefreshingSession = YES;
+  [stateLock unlock];
+  if (wasRefreshing) {
+    return;
+  }
+
+  // the login window can only be shown from the main thread
+  [self performSelectorOnMainThread:@selector(refreshSession)
+                         withObject:nil
+                      waitUntilDone:NO];
+}
+
+- (void)renewSession
+{
+  if (isLoggedIn && [self sessionNeedsRenewal]) {
+    [self beginSessionRefresh];
+  } else {
+    [self scheduleSessionRenewal];
+  }
+}
+
+- (void)scheduleSessionRenewal
+{
+  [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                           selector:@selector(renewSession)
+                                             object:nil];
+  if (![sessionState expires] || [sessionState isInfinite]) {
+    return;
+  }
+
+  // renewing means a login window, which mustn't appear while the session
+  // still works, so wait for it to actually expire
+  NSTimeInterval delay = [[sessionState expires] timeIntervalSinceNow];
+  [self performSelector:@selector(renewSession)
+             withObject:nil
+             afterDelay:MAX(0.0, delay)];
+}
+
+- (BOOL)sessionNeedsRenewal
+{
+  if (![sessionState expires] || [sessionState isInfinite]) {
+    return NO;
+  }
+  return [[sessionState expires] timeIntervalSinceNow] <= 0;
+}
+
+- (void)replayParkedRequests
+{
+  [stateLock lock];
+  isRefreshingSession = NO;
+  NSArray* requests = [parkedRequests autorelease];
+  parkedRequests = [[NSMutableArray alloc] init];
+  [stateLock unlock];
+
+  for (int i = 0; i < [requests count]; i++) {
+    [[requests objectAtIndex:i] replay];
+  }
+}
+
+- (void)failParkedRequestsWithError:(NSError*)err
+{
+  [stateLock lock];
+  isRefreshingSession = NO;
+  NSArray* requests = [parkedRequests autorelease];
+  parkedRequests = [[NSMutableArray alloc] init];
+  [stateLock unlock];
+
+  for (int i = 0; i < [requests count]; i++) {
+    // cancelled before it was parked, so cancel has answered it
+    if ([[requests objectAtIndex:i] isCancelled]) {
+      continue;
+    }
+    [(FBCallback*)[requests objectAtIndex:i] failure:err];
+  }
+}
+
+- (BOOL)hasPermission:(NSString *)perm
+{
+  [stateLock lock];
+  BOOL hasPermission = [sessionState hasPermission:perm];
+  [stateLock unlock];
+  return hasPermission;
+}
+
+//==============================================================================
+//==============================================================================
+//==============================================================================
+
+#pragma mark Connect Methods
+- (void)setTransport:(id<FBTransport>)aTransport
+{
+  [stateLock lock];
+  [aTransport retain];
+  [transport release];
+  transport = aTransport ? aTransport : [[FBHTTPTransport sharedTransport] retain];
+  [stateLock unlock];
+}
+
+- (id<FBTransport>)transport
+{
+  [stateLock lock];
+  id<FBTransport> currentTransport = [[transport retain] autorelease];
+  [stateLock unlock];
+  return currentTransport;
+}
+
+- (void)setRESTURL:(NSString*)url
+{
+  [stateLock lock];
+  [restServerURL release];
+  restServerURL = [url copy];
+  [stateLock unlock];
+}
+
+- (void)setCompressesUploads:(BOOL)compress
+{
+  compressesUploads = compress;
+}
+
+- (BOOL)compressesUploads
+{
+  return compressesUploads;
+}
+
+- (unsigned long long)wireByteCount
+{
+  [stateLock lock];
+  unsigned long long count = wireByteCount;
+  [stateLock unlock];
+  return count;
+}
+
+- (unsigned long long)decodedByteCount
+{
+  [stateLock lock];
+  unsigned long long count = decodedByteCount;
+  [stateLock unlock];
+  return count;
+}
+
+- (void)setResponseMemoryThreshold:(NSUInteger)bytes
+{
+  responseMemoryThreshold = bytes;
+}
+
+- (NSUInteger)responseMemoryThreshold
+{
+  return responseMemoryThreshold;
+}
+
+- (void)setMaxResponseSize:(unsigned long long)bytes
+{
+  maxResponseSize = bytes;
+}
+
+- (unsigned long long)maxResponseSize
+{
+  return maxResponseSize;
+}
+
+- (void)setResponseMemoryBudget:(NSUInteger)bytes
+{
+  responseMemoryBudget = bytes;
+  [self startDeferredRequests];
+}
+
+- (NSUInteger)responseMemoryBudget
+{
+  return responseMemoryBudget;
+}
+
+- (NSUInteger)responseMemoryInUse
+{
+  [stateLock lock];
+  NSUInteger inUse = responseMemoryInUse;
+  [stateLock unlock];
+  return inUse;
+}
+
+- (void)setHedgedMethods:(NSSet*)methods
+{
+  NSMutableSet* lowercaseMethods = [NSMutableSet setWithCapacity:[methods count]];
+  NSEnumerator* enumerator = [methods objectEnumerator];
+  NSString* hedgedMethod;
+  while ((hedgedMethod = [enumerator nextObject])) {
+    [lowercaseMethods addObject:[hedgedMethod lowercaseString]];
+  }
+  [stateLock lock];
+  [hedgedMethods release];
+  hedgedMethods = [lowercaseMethods copy];
+  [stateLock unlock];
+}
+
+- (NSSet*)hedgedMethods
+{
+  [stateLock lock];
+  NSSet* methods = [[hedgedMethods retain] autorelease];
+  [stateLock unlock];
+  return methods;
+}
+
+- (void)setHedgeBudget:(double)fraction
+{
+  hedgeBudget = MAX(0.0, fraction);
+}
+
+- (double)hedgeBudget
+{
+  return hedgeBudget;
+}
+
+- (FBLatencyTracker*)latencyTracker
+{
+  return latencyTracker;
+}
+
+- (void)setParserQueue:(NSOperationQueue*)queue
+{
+  [stateLock lock];
+  [queue retain];
+  [parserQueue release];
+  parserQueue = queue;
+  [stateLock unlock];
+}
+
+- (NSOperationQueue*)parserQueue
+{
+  [stateLock lock];
+  NSOperationQueue* queue = [[parserQueue retain] autorelease];
+  [stateLock unlock];
+  return queue;
+}
+
+- (void)setUsesArenaParsing:(BOOL)arena
+{
+  usesArenaParsing = arena;
+}
+
+- (BOOL)usesArenaParsing
+{
+  return usesArenaParsing;
+}
+
+- (void)setTableStore:(FBTableStore*)store
+{
+  [stateLock lock];
+  [store retain];
+  [tableStore release];
+  tableStore = store;
+  [stateLock unlock];
+}
+
+- (FBTableStore*)tableStore
+{
+  [stateLock lock];
+  FBTableStore* store = [[tableStore retain] autorelease];
+  [stateLock unlock];
+  return store;
+}
+
+- (void)setCoalescesCompletions:(BOOL)coalesce
+{
+  coalescesCompletions = coalesce;
+}
+
+- (BOOL)coalescesCompletions
+{
+  return coalescesCompletions;
+}
+
+- (void)setCompletionInterval:(NSTimeInterval)interval
+{
+  completionInterval = MAX(0.0, interval);
+}
+
+- (NSTimeInterval)completionInterval
+{
+  return completionInterval;
+}
+
+- (void)setSharedResponseCache:(FBSharedResponseCache*)cache
+{
+  [stateLock lock];
+  [cache retain];
+  [sharedResponseCache release];
+  sharedResponseCache = cache;
+  [stateLock unlock];
+}
+
+- (FBSharedResponseCache*)sharedResponseCache
+{
+  [stateLock lock];
+  FBSharedResponseCache* cache = [[sharedResponseCache retain] autorelease];
+  [stateLock unlock];
+  return cache;
+}
+
+- (void)setSharedCachedMethods:(NSSet*)methods
+{
+  NSMutableSet* lowercaseMethods = [NSMutableSet setWithCapacity:[methods count]];
+  NSEnumerator* enumerator = [methods objectEnumerator];
+  NSString* cachedMethod;
+  while ((cachedMethod = [enumerator nextObject])) {
+    [lowercaseMethods addObject:[cachedMethod lowercaseString]];
+  }
+  [stateLock lock];
+  [sharedCachedMethods release];
+  sharedCachedMethods = [lowercaseMethods copy];
+  [stateLock unlock];
+}
+
+- (NSSet*)sharedCachedMethods
+{
+  [stateLock lock];
+  NSSet* methods = [[sharedCachedMethods retain] autorelease];
+  [stateLock unlock];
+  return methods;
+}
+
+- (void)setSharedCacheLifetime:(NSTimeInterval)seconds
+{
+  sharedCacheLifetime = MAX(0.0, seconds);
+}
+
+- (NSTimeInterval)sharedCacheLifetime
+{
+  return sharedCacheLifetime;
+}
+
+- (void)addWarmQuery:(NSString*)query maxAge:(NSTimeInterval)maxAge
+{
+  [stateLock lock];
+  [warmQueries setObject:[NSNumber numberWithDouble:MAX(0.0, maxAge)] forKey:query];
+  BOOL loggedIn = isLoggedIn;
+  [stateLock unlock];
+
+  if (loggedIn) {
+    [self prefetchWarmQueries];
+  }
+}
+
+- (void)removeWarmQuery:(NSString*)query
+{
+  [stateLock lock];
+  [warmQueries removeObjectForKey:query];
+  [stateLock unlock];
+}
+
+- (NSDictionary*)warmQueries
+{
+  [stateLock lock];
+  NSDictionary* queries = [[warmQueries copy] autorelease];
+  [stateLock unlock];
+  return queries;
+}
+
+- (void)prefetchWarmQueries
+{
+  if (![NSThread isMainThread]) {
+    [self performSelectorOnMainThread:@selector(prefetchWarmQueries)
+                           withObject:nil
+                        waitUntilDone:NO];
+    return;
+  }
+
+  // posted once the run loop has nothing else to do, however often asked
+  NSNotification* notification = [NSNotification notificationWithName:kPrefetchNotification object:self];
+  [[NSNotificationQueue defaultQueue] enqueueNotification:notification
+                                             postingStyle:NSPostWhenIdle
+                                             coalesceMask:NSNotificationCoalescingOnName | NSNotificationCoalescingOnSender
+                                                 forModes:nil];
+}
+
+- (id<FBRequest>)callMethod:(NSString *)method
+              withArguments:(NSDictionary *)dict
+                     target:(id)target
+                   selector:(SEL)selector
+{
+  return [self callMethod:method
+            withArguments:dict
+               projection:nil
+                   target:target
+                 selector:selector];
+}
+
+- (id<FBRequest>)callMethod:(NSString*)method
+              withArguments:(NSDictionary*)dict
+                 projection:(FBProjection*)projection
+                     target:(id)target
+                   selector:(SEL)selector
+{
+  FBMethodRequest* request = [FBMethodRequest requestWithMethod:method
+                                                      arguments:dict
+                                                         parent:self
+                                                         target:target
+                                                       selector:selector];
+  [request setProjection:projection];
+  [self dispatchRequest:request];
+  return request;
+}
+
+- (id<FBRequest>)callMethod:(NSString*)method
+              withArguments:(NSDictionary*)dict
+                  withFiles:(NSArray*)files
+                     target:(id)target
+                   selector:(SEL)selector
+{
+  [self yieldToForegroundRequest];
+  NSData* postData = [self postDataForMethod:method
+                                   arguments:dict
+                                       files:files];
+  FBMethodRequest* request = [FBMethodRequest requestWithData:postData
+                                                       parent:self
+                                                       target:target
+                                                     selector:selector];
+  if ([self pendingBatch]) {
+    [NSException raise:@"Post request during batch"
+                format:@"Cannot perform a facebook method request with files after startBatch"];
+  } else {
+    [self startRequest:request];
+  }
+  return request;
+}
+
+- (id<FBRequest>)fqlQuery:(NSString*)query
+                   target:(id)target
+                 selector:(SEL)selector
+{
+  return [self fqlQuery:query
+             projection:nil
+                 target:target
+               selector:selector];
+}
+
+- (id<FBRequest>)fqlQuery:(NSString*)query
+               projection:(FBProjection*)projection
+                   target:(id)target
+                 selector:(SEL)selector
+{
+  FBTableStore* store = projection ? nil : [self tableStore];
+  NSString* remoteQuery = nil;
+  NSArray* localRows = [store rowsForQuery:query remoteQuery:&remoteQuery];
+  if (localRows) {
+    FBTableQueryRequest* request = [FBTableQueryRequest requestWithQuery:remoteQuery
+                                                               localRows:localRows
+                                                                   store:store
+                                                                  parent:self
+                                                                  target:target
+                                                                selector:selector];
+    if (remoteQuery) {
+      [self dispatchRequest:request];
+    } else {
+      [request deliverLocalRows];
+    }
+    return request;
+  }
+
+  return [self callMethod:@"fql.query"
+            withArguments:[NSDictionary dictionaryWithObject:query forKey:@"query"]
+               projection:projection
+                   target:target
+                 selector:selector];
+}
+
+- (id<FBRequest>)fqlMultiquery:(NSDictionary*)queries
+                        target:(id)target
+                      selector:(SEL)selector
+{
+  return [self fqlMultiquery:queries
+                  projection:nil
+                      target:target
+                    selector:selector];
+}
+
+- (id<FBRequest>)fqlMultiquery:(NSDictionary*)queries
+                    projection:(FBProjection*)projection
+                        target:(id)target
+                      selector:(SEL)selector
+{
+  NSDictionary* arguments = [NSDictionary dictionaryWithObject:[queries JSONRepresentation] forKey:@"queries"];
+  FBMethodRequest* request = [FBMultiqueryRequest requestWithMethod:@"fql.multiquery"
+                                                          arguments:arguments
+                                                             parent:self
+                                                             target:target
+                                                           selector:selector];
+  [request setProjection:projection];
+  [self dispatchRequest:request];
+  return request;
+}
+
+- (id<FBRequest>)fqlQuery:(NSString*)query
+                rowSchema:(FBRowSchema*)schema
+                   target:(id)target
+                 selector:(SEL)selector
+{
+  FBMethodRequest* request = [FBMethodRequest requestWithMethod:@"fql.query"
+                                                      arguments:[NSDictionary dictionaryWithObject:query forKey:@"query"]
+                                                         parent:self
+                                                         target:target
+                                                       selector:selector];
+  [request setRowSchema:schema];
+  [self dispatchRequest:request];
+  return request;
+}
+
+- (id<FBRequest>)fqlMultiquery:(NSDictionary*)queries
+                    rowSchemas:(NSDictionary*)schemas
+                        target:(id)target
+                      selector:(SEL)selector
+{
+  NSDictionary* arguments = [NSDictionary dictionaryWithObject:[queries JSONRepresentation] forKey:@"queries"];
+  FBMultiqueryRequest* request = (FBMultiqueryRequest*)
+    [FBMultiqueryRequest requestWithMethod:@"fql.multiquery"
+                                 arguments:arguments
+                                    parent:self
+                                    target:target
+                                  selector:selector];
+  [request setRowSchemas:schemas];
+
+  // one projection covers every query, so only skip columns if none needs them
+  NSMutableSet* columns = [NSMutableSet set];
+  NSArray* names = [queries allKeys];
+  for (int i = 0; i < [names count]; i++) {
+    FBRowSchema* schema = [schemas objectForKey:[names objectAtIndex:i]];
+    if (schema == nil) {
+      columns = nil;
+      break;
+    }
+    [columns addObjectsFromArray:[[schema projection] keyPaths]];
+  }
+  if (columns) {
+    [request setProjection:[FBProjection projectionWithKeyPaths:[columns allObjects]]];
+  }
+
+  [self dispatchRequest:request];
+  return request;
+}
+
+- (id<FBRequest>)fqlQuery:(NSString*)query
+                 pageSize:(NSUInteger)pageSize
+            pipelineDepth:(NSUInteger)pipelineDepth
+                   target:(id)target
+                 selector:(SEL)selector
+{
+  if ([self pendingBatch]) {
+    [NSException raise:@"Paged query during batch"
+                format:@"Cannot perform a paged facebook query after startBatch"];
+  }
+
+  FBPagedQueryRequest* request = [FBPagedQueryRequest requestWithQuery:query
+                                                              pageSize:pageSize
+                                                         pipelineDepth:pipelineDepth
+                                                                parent:self
+                                                                target:target
+                                                              selector:selector];
+  [request start];
+  return request;
+}
+
+- (FBLiveQuery*)liveQuery:(NSString*)query
+                keyColumn:(NSString*)keyColumn
+                   target:(id)target
+                 selector:(SEL)selector
+{
+  return [FBLiveQuery liveQueryWithQuery:query
+                               keyColumn:keyColumn
+                                  parent:self
+                                  target:target
+                                selector:selector];
+}
+
+- (FBPoll*)pollQuery:(NSString*)query
+         minInterval:(NSTimeInterval)min
+         maxInterval:(NSTimeInterval)max
+              target:(id)target
+            selector:(SEL)selector
+{
+  return [[self pollScheduler] addQuery:query
+                            minInterval:min
+                            maxInterval:max
+                                 target:target
+                               selector:selector];
+}
+
+- (void)stopPoll:(FBPoll*)poll
+{
+  [pollScheduler removePoll:poll];
+}
+
+- (FBPollScheduler*)pollScheduler
+{
+  [stateLock lock];
+  if (!pollScheduler) {
+    pollScheduler = [[FBPollScheduler alloc] initWithConnect:self];
+  }
+  [stateLock unlock];
+  return pollScheduler;
+}
+
+
+- (void)startBatch
+{
+  NSMutableArray* batch = [self pendingBatchRequests];
+  if (batch && isBuildingOptimisticBatch && [NSThread isMainThread] && nestedBatchStart < 0) {
+    // the delegate's batch joins the login batch
+    nestedBatchStart = [batch count];
+    return;
+  }
+  if (batch) {
+    [NSException raise:@"Batch Request exception"
+                format:@"Cannot startBatch while there is a pendingBatch"];
+    return;
+  }
+  [self setPendingBatchRequests:[NSMutableArray array]];
+}
+
+- (BOOL)pendingBatch
+{
+  // if start has been called and send hasnt yet
+  return [self pendingBatchRequests] != nil;
+}
+
+- (void)cancelBatch
+{
+  if (nestedBatchStart >= 0 && [NSThread isMainThread]) {
+    NSMutableArray* batch = [self pendingBatchRequests];
+    NSRange nested = NSMakeRange(nestedBatchStart, [batch count] - nestedBatchStart);
+    [batch removeObjectsInRange:nested];
+    nestedBatchStart = -1;
+    return;
+  }
+  [self setPendingBatchRequests:nil];
+}
+
+- (id<FBRequest>)sendBatch
+{
+  if (nestedBatchStart >= 0 && [NSThread isMainThread]) {
+    // sent along with the login batch
+    nestedBatchStart = -1;
+    return nil;
+  }
+  NSMutableArray* batch = [[[self pendingBatchRequests] retain] autorelease];
+  if (!batch) {
+    [NSException raise:@"Batch Request exception"
+                format:@"Cannot sendBatch if there is no pendingBatch"];
+    return nil;
+  }
+  [self setPendingBatchRequests:nil];
+
+  // those cancelled while waiting are never sent
+  NSMutableArray* liveBatch = [NSMutableArray arrayWithCapacity:[batch count]];
+  for (int i = 0; i < [batch count]; i++) {
+    if (![[batch objectAtIndex:i] isCancelled]) {
+      [liveBatch addObject:[batch objectAtIndex:i]];
+    }
+  }
+  batch = liveBatch;
+
+  // call batch.run with the results of all the queued methods, using fbbatchrequest
+  FBMethodRequest* request = nil;
+  [stateLock lock];
+  BOOL parkBatch = [batch count] > 0 &&
+    (isRefreshingSession || (isLoggedIn && [self sessionNeedsRenewal]));
+  if (parkBatch) {
+    // each method is replayed on its own once the session has been renewed
+    [parkedRequests addObjectsFromArray:batch];
+  }
+  [stateLock unlock];
+
+  if (parkBatch) {
+    [self beginSessionRefresh];
+  } else if ([batch count] > 0) {
+    NSDictionary* arguments = [NSDictionary dictionaryWithObject:[batch JSONRepresentation] forKey:@"method_feed"];
+    NSString* requestString = [self getRequestStringForMethod:@"batch.run" arguments:arguments];
+    request = [FBBatchRequest requestWithRequest:requestString
+                                        requests:batch
+                                          parent:self];
+
+    // the batch has to arrive in time for all of its methods
+    NSTimeInterval deadline = 0;
+    for (int i = 0; i < [batch count]; i++) {
+      NSTimeInterval methodDeadline = [[batch objectAtIndex:i] deadline];
+      if (methodDeadline > 0 && (deadline == 0 || methodDeadline < deadline)) {
+        deadline = methodDeadline;
+      }
+    }
+    [request setDeadline:deadline];
+    [self startRequest:request];
+  }
+
+  return request;
+}
+
+- (void)addRequest:(id<FBRequest>)request toGroup:(id)group
+{
+  if (request == nil || group == nil) {
+    return;
+  }
+
+  NSValue* groupKey = [NSValue valueWithNonretainedObject:group];
+  [stateLock lock];
+  // one that has already called back would never be taken out again
+  if (FBRequestIsOutstanding(request)) {
+    [self removeRequestFromGroup:request];
+    NSMutableSet* requests = [requestGroups objectForKey:groupKey];
+    if (requests == nil) {
+      // held while it is a key, so its address can't be reused meanwhile
+      [group retain];
+      requests = [NSMutableSet set];
+      [requestGroups setObject:requests forKey:groupKey];
+    }
+    [requests addObject:request];
+    [groupsByRequest setObject:groupKey forKey:[NSValue valueWithNonretainedObject:request]];
+  }
+  [stateLock unlock];
+}
+
+- (void)cancelRequestGroup:(id)group
+{
+  NSValue* groupKey = [NSValue valueWithNonretainedObject:group];
+  [stateLock lock];
+  NSArray* requests = [[requestGroups objectForKey:groupKey] allObjects];
+  [self forgetRequestGroup:groupKey];
+  [stateLock unlock];
+
+  for (int i = 0; i < [requests count]; i++) {
+    if (FBRequestIsOutstanding([requests objectAtIndex:i])) {
+      [[requests objectAtIndex:i] cancel];
+    }
+  }
+}
+
+- (NSArray*)outstandingRequestsInGroup:(id)group
+{
+  NSMutableArray* outstanding = [NSMutableArray array];
+  [stateLock lock];
+  NSArray* requests = [[requestGroups objectForKey:[NSValue valueWithNonretainedObject:group]] allObjects];
+  for (int i = 0; i < [requests count]; i++) {
+    if (FBRequestIsOutstanding([requests objectAtIndex:i])) {
+      [outstanding addObject:[requests objectAtIndex:i]];
+    }
+  }
+  [stateLock unlock];
+  return outstanding;
+}
+
+- (void)setSupersedeKey:(NSString*)key forRequest:(id<FBRequest>)request
+{
+  if (key == nil || request == nil) {
+    return;
+  }
+
+  [stateLock lock];
+  id<FBRequest> superseded = [[[supersedingRequests objectForKey:key] retain] autorelease];
+  if (superseded != nil) {
+    [self removeSupersedeKeyOfRequest:superseded];
+  }
+  [self removeSupersedeKeyOfRequest:request];
+  if (FBRequestIsOutstanding(request)) {
+    [supersedingRequests setObject:request forKey:key];
+    [supersedeKeysByRequest setObject:key forKey:[NSValue valueWithNonretainedObject:request]];
+  }
+  [stateLock unlock];
+
+  if (superseded != request && FBRequestIsOutstanding(superseded)) {
+    [superseded cancel];
+  }
+}
+
+//==============================================================================
+//==============================================================================
+//==============================================================================
+
+- (NSMutableArray*)pendingBatchRequests
+{
+  return [[[NSThread currentThread] threadDictionary] objectForKey:batchContextKey];
+}
+
+- (void)setPendingBatchRequests:(NSMutableArray*)requests
+{
+  NSMutableDictionary* threadDictionary = [[NSThread currentThread] threadDictionary];
+  if (requests) {
+    [threadDictionary setObject:requests forKey:batchContextKey];
+  } else {
+    [threadDictionary removeObjectForKey:batchContextKey];
+  }
+}
+
+- (void)dispatchRequest:(FBMethodRequest*)request
+{
+  if ([self answerFromCache:request]) {
+    return;
+  }
+  [self yieldToForegroundRequest];
+
+  NSMutableArray* batch = [self pendingBatchRequests];
+  if (batch) {
+    [batch addObject:request];
+    return;
+  }
+
+  [stateLock lock];
+  BOOL parkRequest = [request canReplay] &&
+    (isRefreshingSession || (isLoggedIn && [self sessionNeedsRenewal]));
+  if (parkRequest) {
+    [parkedRequests addObject:request];
+  }
+  [stateLock unlock];
+
+  if (parkRequest) {
+    [self beginSessionRefresh];
+  } else {
+    [self startRequest:request];
+  }
+}
+
+- (void)startRequest:(FBMethodRequest*)request
+{
+  [stateLock lock];
+  BOOL deferRequest = ![self hasRoomForResponse];
+  if (deferRequest) {
+    // wait for the responses in flight to give back some memory
+    [deferredRequests addObject:request];
+  }
+  [stateLock unlock];
+
+  if (!deferRequest) {
+    [request start];
   }
 }
 
-- (void)promptLogin
+- (NSString*)cachePartition
 {
-  // if a window exists, focus it.
-  if (windowController) {
-    [windowController focus];
-    return;
+  // one user's session can't read another's responses. Partitions are
+  // written to the shared cache's file, so the session key is only ever
+  // there as part of a digest.
+  [stateLock lock];
+  NSString* partition = APIKey;
+  if ([sessionState isValid]) {
+    NSString* session = [NSString stringWithFormat:@"%@ %@ %@", APIKey, [sessionState uid], [sessionState key]];
+    partition = [[session dataUsingEncoding:NSUTF8StringEncoding] md5];
   }
+  [stateLock unlock];
+  return partition;
+}
 
-  isConnecting = YES;
+- (BOOL)answerFromCache:(FBMethodRequest*)request
+{
+  NSString* method = [[request method] lowercaseString];
+  if (method == nil || [request projection] || [request rowSchema]) {
+    return NO;
+  }
 
-  NSMutableDictionary* loginParams = [[NSMutableDictionary alloc] init];
-  NSString* permissionsString = [[requestedPermissions allObjects] componentsJoinedByString:@","];
-  [loginParams setObject:permissionsString          forKey:@"req_perms"];
-  [loginParams setObject:APIKey                     forKey:@"api_key"];
-  [loginParams setObject:[self getPreferedFBLocale] forKey:@"locale"];
+  [stateLock lock];
+  NSNumber* warmAge = nil;
+  if ([method isEqualToString:@"fql.query"] && !(isPrefetching && [NSThread isMainThread])) {
+    warmAge = [[[warmQueries objectForKey:[[request arguments] objectForKey:@"query"]] retain] autorelease];
+  }
+  FBSharedResponseCache* cache = nil;
+  if ([sharedCachedMethods containsObject:method]) {
+    cache = [[sharedResponseCache retain] autorelease];
+  }
+  [stateLock unlock];
+  if (warmAge == nil && cache == nil) {
+    return NO;
+  }
 
-  // adding this parameter keeps us from reading Safari's cookie when
-  // performing a login for the first time. Sessions are still cached and
-  // persistant so subsequent application launches will use their own
-  // session cookie and not Safari's
-  [loginParams setObject:@"true" forKey:@"skipcookie"];
+  NSString* key = [FBResponseCache keyForMethod:[request method] arguments:[request arguments]];
+  NSString* partition = [self cachePartition];
+  id response = nil;
+  if (warmAge) {
+    response = [warmResponses responseForKey:key partition:partition maxAge:[warmAge doubleValue]];
+  }
+  if (response == nil) {
+    response = [cache responseForKey:key partition:partition maxAge:sharedCacheLifetime];
+  }
+  if (response) {
+    [request deliverCachedResponse:response];
+    return YES;
+  }
 
-  windowController =
-  [[FBWebViewWindowController alloc] initWithConnect:self
-                                             rootURL:[self loginURL]
-                                              target:self
-                                            selector:@selector(loginWindowClosed)];
-  [windowController showWithParams:loginParams];
+  // whoever fetches it first, this process or another, shares it
+  if (cache) {
+    [request setSharedCacheKey:key partition:partition];
+  }
+  return NO;
 }
 
-- (void)requestPermissions:(NSSet*)perms
-                    target:(id)target
-                  selector:(SEL)selector
+- (void)sendWarmQueries:(NSNotification*)notification
 {
-  // if a window exists, focus it.
-  if (windowController) {
-    [windowController focus];
+  [stateLock lock];
+  BOOL canPrefetch = isLoggedIn && prefetchCount == 0 && [warmQueries count] > 0;
+  NSTimeInterval sinceForeground = [NSDate timeIntervalSinceReferenceDate] - lastForegroundRequest;
+  NSDictionary* queries = [[warmQueries copy] autorelease];
+  [stateLock unlock];
+  if (!canPrefetch) {
     return;
   }
-
-  // store the callback
-  if (permissionCallback) {
-    [permissionCallback release];
+  if (sinceForeground < kPrefetchQuietPeriod || [self pendingBatch]) {
+    // give way, and try again once things have settled down
+    [self schedulePrefetchAfterDelay:kPrefetchQuietPeriod];
+    return;
   }
-  permissionCallback = [[FBCallback alloc] initWithTarget:target
-                                                 selector:selector];
-
-  NSMutableDictionary* loginParams = [[NSMutableDictionary alloc] init];
-  NSString* permissionsString = [[perms allObjects] componentsJoinedByString:@","];
-  [loginParams setObject:permissionsString          forKey:@"ext_perm"];
-  [loginParams setObject:APIKey                     forKey:@"api_key"];
-  [loginParams setObject:[sessionState key]         forKey:@"session_key"];
-  [loginParams setObject:[self getPreferedFBLocale] forKey:@"locale"];
 
-  // adding this parameter keeps us from reading Safari's cookie when
-  // performing a login for the first time. Sessions are still cached and
-  // persistant so subsequent application launches will use their own
-  // session cookie and not Safari's
-  [loginParams setObject:@"true" forKey:@"skipcookie"];
+  // fetch whatever would be stale by the next check
+  NSTimeInterval refreshInterval = [self warmQueryRefreshInterval];
+  NSString* partition = [self cachePartition];
+  NSMutableArray* staleQueries = [NSMutableArray array];
+  NSArray* allQueries = [queries allKeys];
+  for (int i = 0; i < [allQueries count]; i++) {
+    NSString* query = [allQueries objectAtIndex:i];
+    NSString* key = [FBResponseCache keyForMethod:@"fql.query"
+                                        arguments:[NSDictionary dictionaryWithObject:query forKey:@"query"]];
+    NSTimeInterval maxAge = [[queries objectForKey:query] doubleValue];
+    if (![warmResponses responseForKey:key partition:partition maxAge:maxAge - refreshInterval]) {
+      [staleQueries addObject:query];
+    }
+  }
+  if ([staleQueries count] == 0) {
+    [self schedulePrefetchAfterDelay:refreshInterval];
+    return;
+  }
 
-  windowController =
-  [[FBWebViewWindowController alloc] initWithConnect:self
-                                             rootURL:[self permissionsURL]
-                                              target:self
-                                            selector:@selector(permissionWindowClosed)];
-  [windowController showWithParams:loginParams];
-}
+  [stateLock lock];
+  prefetchCount   = [staleQueries count];
+  prefetchYielded = NO;
+  [stateLock unlock];
+
+  // sent in as few batches as batch.run allows, and not counted as traffic
+  // to give way to
+  NSMutableArray* batches = [NSMutableArray array];
+  isPrefetching = YES;
+  for (int first = 0; first < [staleQueries count]; first += kMaxBatchSize) {
+    [self startBatch];
+    for (int i = first; i < MIN(first + kMaxBatchSize, [staleQueries count]); i++) {
+      NSString* query = [staleQueries objectAtIndex:i];
+      id<FBRequest> request = [self fqlQuery:query
+                                      target:self
+                                    selector:@selector(prefetchedWarmQuery:)];
+      [request setUserData:query];
+    }
+    id batch = [self sendBatch];
+    if (batch) {
+      [batches addObject:batch];
+    }
+  }
+  isPrefetching = NO;
 
-- (void)logout
-{
-  [self callMethod:@"auth.expireSession"
-     withArguments:nil
-            target:self
-          selector:@selector(expireSessionResponseComplete:)];
-  [sessionState clear];
-  isLoggedIn = NO;
-  isConnecting = NO;
+  [stateLock lock];
+  [prefetchRequests setArray:batches];
+  [stateLock unlock];
 }
 
-- (void)validateSession
+- (void)yieldToForegroundRequest
 {
-  isConnecting = YES;
-
-  [self startBatch];
-
-  [self fqlQuery:[NSString stringWithFormat:@"SELECT %@ FROM permissions WHERE uid = %@",
-                  [[requestedPermissions allObjects] componentsJoinedByString:@","], [self uid]]
-          target:self
-        selector:@selector(gotGrantedPermissions:)];
+  if (isPrefetching && [NSThread isMainThread]) {
+    // one of the prefetches
+    return;
+  }
 
-  [self callMethod:@"users.getLoggedInUser"
-     withArguments:nil
-            target:self
-          selector:@selector(gotLoggedInUser:)];
+  [stateLock lock];
+  lastForegroundRequest = [NSDate timeIntervalSinceReferenceDate];
+  NSArray* prefetches = [[prefetchRequests copy] autorelease];
+  if ([prefetches count] > 0) {
+    prefetchYielded = YES;
+  }
+  [stateLock unlock];
 
-  [self sendBatch];
+  [prefetches makeObjectsPerformSelector:@selector(cancel)];
 }
 
-- (void)refreshSession
+- (void)cancelPrefetch
 {
-  NSLog(@"refreshing session");
-  isLoggedIn = NO;
-  isConnecting = YES;
-  [sessionState invalidate];
-  [self loginWithRequiredPermissions:requiredPermissions
-                 optionalPermissions:optionalPermissions];
+  [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                           selector:@selector(prefetchWarmQueries)
+                                             object:nil];
+  [stateLock lock];
+  NSArray* prefetches = [[prefetchRequests copy] autorelease];
+  [stateLock unlock];
+  [prefetches makeObjectsPerformSelector:@selector(cancel)];
 }
 
-- (BOOL)hasPermission:(NSString *)perm
+- (void)schedulePrefetchAfterDelay:(NSTimeInterval)delay
 {
-  return [sessionState hasPermission:perm];
+  [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                           selector:@selector(prefetchWarmQueries)
+                                             object:nil];
+  [self performSelector:@selector(prefetchWarmQueries)
+             withObject:nil
+             afterDelay:delay];
 }
 
-//==============================================================================
-//==============================================================================
-//==============================================================================
-
-#pragma mark Connect Methods
-- (id<FBRequest>)callMethod:(NSString *)method
-              withArguments:(NSDictionary *)dict
-                     target:(id)target
-                   selector:(SEL)selector
+- (NSTimeInterval)warmQueryRefreshInterval
 {
-  NSString *requestString = [self getRequestStringForMethod:method arguments:dict];
-  FBMethodRequest* request = [FBMethodRequest requestWithRequest:requestString
-                                                          parent:self
-                                                          target:target
-                                                        selector:selector];
-  if ([self pendingBatch]) {
-    [pendingBatchRequests addObject:request];
-  } else {
-    [request start];
+  // half the shortest max age, so none goes stale between checks
+  [stateLock lock];
+  NSTimeInterval shortest = 0;
+  NSEnumerator* enumerator = [warmQueries objectEnumerator];
+  NSNumber* maxAge;
+  while ((maxAge = [enumerator nextObject])) {
+    if (shortest == 0 || [maxAge doubleValue] < shortest) {
+      shortest = [maxAge doubleValue];
+    }
   }
-  return request;
+  [stateLock unlock];
+  return MAX(kPrefetchQuietPeriod, shortest / 2);
 }
 
-- (id<FBRequest>)callMethod:(NSString*)method
-              withArguments:(NSDictionary*)dict
-                  withFiles:(NSArray*)files
-                     target:(id)target
-                   selector:(SEL)selector
+- (void)startDeferredRequests
 {
-  NSData* postData = [self postDataForMethod:method
-                                   arguments:dict
-                                       files:files];
-  FBMethodRequest* request = [FBMethodRequest requestWithData:postData
-                                                       parent:self
-                                                       target:target
-                                                     selector:selector];
-  if ([self pendingBatch]) {
-    [NSException raise:@"Post request during batch"
-                format:@"Cannot perform a facebook method request with files after startBatch"];
-  } else {
+  while (YES) {
+    [stateLock lock];
+    FBMethodRequest* request = nil;
+    if ([deferredRequests count] > 0 && [self hasRoomForResponse]) {
+      request = [[[deferredRequests objectAtIndex:0] retain] autorelease];
+      [deferredRequests removeObjectAtIndex:0];
+    }
+    [stateLock unlock];
+
+    if (request == nil) {
+      return;
+    }
     [request start];
   }
-  return request;
 }
 
-- (id<FBRequest>)fqlQuery:(NSString*)query
-                   target:(id)target
-                 selector:(SEL)selector
+- (BOOL)hasRoomForResponse
 {
-  return [self callMethod:@"fql.query"
-            withArguments:[NSDictionary dictionaryWithObject:query forKey:@"query"]
-                   target:target
-                 selector:selector];
+  // a response only goes to disk once it outgrows the threshold, so that is
+  // what each request may yet hold. With nothing held, there's nothing to
+  // wait for.
+  return responseMemoryInUse == 0 ||
+    responseMemoryInUse + responseMemoryThreshold <= responseMemoryBudget;
 }
 
-- (id<FBRequest>)fqlMultiquery:(NSDictionary*)queries
-                        target:(id)target
-                      selector:(SEL)selector
+#pragma mark Callbacks
+- (BOOL)reserveResponseMemory:(NSUInteger)bytes
 {
-  NSDictionary* arguments = [NSDictionary dictionaryWithObject:[queries JSONRepresentation] forKey:@"queries"];
-  NSString* requestString = [self getRequestStringForMethod:@"fql.multiquery" arguments:arguments];
-
-  FBMethodRequest* request = [FBMultiqueryRequest requestWithRequest:requestString
-                                                              parent:self
-                                                              target:target
-                                                            selector:selector];
-  if ([self pendingBatch]) {
-    [pendingBatchRequests addObject:request];
-  } else {
-    [request start];
+  [stateLock lock];
+  BOOL reserved = responseMemoryInUse + bytes <= responseMemoryBudget;
+  if (reserved) {
+    responseMemoryInUse += bytes;
   }
-  return request;
+  [stateLock unlock];
+  return reserved;
 }
 
-
-- (void)startBatch
+- (void)releaseResponseMemory:(NSUInteger)bytes
 {
-  if (isBatch) {
-    [NSException raise:@"Batch Request exception"
-                format:@"Cannot startBatch while there is a pendingBatch"];
+  if (bytes == 0) {
     return;
   }
-  isBatch = YES;
-  pendingBatchRequests = [[NSMutableArray alloc] init];
+  [stateLock lock];
+  responseMemoryInUse -= MIN(bytes, responseMemoryInUse);
+  [stateLock unlock];
+  [self startDeferredRequests];
 }
 
-- (BOOL)pendingBatch
+- (NSTimeInterval)hedgeDelayForRequest:(FBMethodRequest*)query
 {
-  // if start has been called and send hasnt yet
-  return isBatch;
+  NSString* queryMethod = [[query method] lowercaseString];
+  [stateLock lock];
+  BOOL hedged = queryMethod != nil && [hedgedMethods containsObject:queryMethod];
+  if (hedged) {
+    // every hedgeable call earns a fraction of a hedge
+    hedgeTokens = MIN(kMaxHedgeTokens, hedgeTokens + hedgeBudget);
+  }
+  [stateLock unlock];
+
+  if (!hedged) {
+    return 0;
+  }
+  return [latencyTracker latencyAtPercentile:kHedgePercentile forMethod:queryMethod];
 }
 
-- (void)cancelBatch
+- (BOOL)spendHedgeToken
 {
-  isBatch = NO;
-  [pendingBatchRequests release];
-  pendingBatchRequests = nil;
+  [stateLock lock];
+  BOOL spent = hedgeTokens >= 1.0;
+  if (spent) {
+    hedgeTokens -= 1.0;
+  }
+  [stateLock unlock];
+  return spent;
 }
 
-- (id<FBRequest>)sendBatch
+- (BOOL)queueCompletedRequest:(FBMethodRequest*)request
 {
-  if (!isBatch) {
-    [NSException raise:@"Batch Request exception"
-                format:@"Cannot sendBatch if there is no pendingBatch"];
-    return nil;
+  // only ever on the main thread; those completing after coalescing is
+  // turned off still wait their turn
+  if (!coalescesCompletions && [completedRequests count] == 0) {
+    return NO;
   }
-  isBatch = NO;
 
-  // call batch.run with the results of all the queued methods, using fbbatchrequest
-  FBMethodRequest* request;
-  if ([pendingBatchRequests count] > 0) {
-    NSDictionary* arguments = [NSDictionary dictionaryWithObject:[pendingBatchRequests JSONRepresentation] forKey:@"method_feed"];
-    NSString* requestString = [self getRequestStringForMethod:@"batch.run" arguments:arguments];
-    request = [FBBatchRequest requestWithRequest:requestString
-                                        requests:pendingBatchRequests
-                                          parent:self];
-    [request start];
+  if (completedRequests == nil) {
+    completedRequests = [[NSMutableArray alloc] init];
+  }
+  [completedRequests addObject:request];
+  if ([completedRequests count] == 1) {
+    NSTimeInterval sinceLast = [NSDate timeIntervalSinceReferenceDate] - lastCompletionDelivery;
+    [self performSelector:@selector(deliverCompletedRequests)
+               withObject:nil
+               afterDelay:MAX(0.0, completionInterval - sinceLast)
+                  inModes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
   }
+  return YES;
+}
 
-  [pendingBatchRequests release];
-  pendingBatchRequests = nil;
+- (void)deliverCompletedRequests
+{
+  lastCompletionDelivery = [NSDate timeIntervalSinceReferenceDate];
 
-  return request;
+  // anything completing during the callbacks goes out next time
+  NSArray* requests = completedRequests;
+  completedRequests = nil;
+  for (int i = 0; i < [requests count]; i++) {
+    [[requests objectAtIndex:i] notifyTargetNow];
+  }
+  if ([delegate respondsToSelector:@selector(facebookConnect:completedRequests:)]) {
+    [delegate facebookConnect:self completedRequests:requests];
+  }
+  [requests release];
 }
 
-//==============================================================================
-//==============================================================================
-//==============================================================================
+- (void)receivedWireBytes:(unsigned long long)wire
+             decodedBytes:(unsigned long long)decoded
+{
+  [stateLock lock];
+  wireByteCount    += wire;
+  decodedByteCount += decoded;
+  [stateLock unlock];
+}
 
-#pragma mark Callbacks
-- (void)failedQuery:(FBMethodRequest *)query withError:(NSError *)err
+- (BOOL)shouldParkQuery:(FBMethodRequest*)query
+{
+  [stateLock lock];
+  BOOL parkQuery = NO;
+  if ([unvalidatedRequests containsObject:query]) {
+    [[query retain] autorelease];
+    [unvalidatedRequests removeObject:query];
+
+    // the optimistic session turned out to be bad, this result can't be trusted
+    if (isRefreshingSession && [query canReplay] && ![query isCancelled]) {
+      [parkedRequests addObject:query];
+      parkQuery = YES;
+    }
+  }
+  [stateLock unlock];
+  return parkQuery;
+}
+
+- (BOOL)failedQuery:(FBMethodRequest *)query withError:(NSError *)err
 {
   int errorCode = [err code];
-  if ([sessionState exists] && isLoggedIn &&
+  [stateLock lock];
+  BOOL parkQuery = NO;
+  if ([sessionState exists] && (isLoggedIn || isRefreshingSession) &&
       (errorCode == FBParamSessionKeyError ||
        errorCode == FBPermissionError ||
        errorCode == FBSessionExpiredError ||
@@ -460,9 +1752,39 @@
        errorCode == FBSessionRequiredForSecretError)) {
     // We were using a session key that we'd saved as permanent, and got
     // back an error saying it was invalid. Throw away the saved session
-    // data and start a login from scratch.
-    [self performSelector:@selector(refreshSession) withObject:nil afterDelay:0.0];
+    // data and start a login from scratch, holding on to the request so it
+    // can be sent again once we have a new session.
+    [self beginSessionRefresh];
+    if ([query canReplay] && ![query isCancelled]) {
+      [parkedRequests addObject:query];
+      parkQuery = YES;
+    }
+  }
+  [stateLock unlock];
+  return parkQuery;
+}
+
+- (BOOL)cancelledQuery:(FBMethodRequest*)query
+{
+  // marked under the lock, so the parked requests are either taken off the
+  // list here or replayed or failed knowing they were cancelled
+  [stateLock lock];
+  [query markCancelled];
+  NSUInteger index = [parkedRequests indexOfObjectIdenticalTo:query];
+  if (index != NSNotFound) {
+    [[query retain] autorelease];
+    [parkedRequests removeObjectAtIndex:index];
   }
+  [stateLock unlock];
+  return index != NSNotFound;
+}
+
+- (void)completedRequest:(id<FBRequest>)request
+{
+  [stateLock lock];
+  [self removeRequestFromGroup:request];
+  [self removeSupersedeKeyOfRequest:request];
+  [stateLock unlock];
 }
 
 - (void)gotGrantedPermissions:(id<FBRequest>)req
@@ -475,21 +1797,35 @@
 
   NSEnumerator *enumerator = [response keyEnumerator];
   NSString* perm;
+  [stateLock lock];
   while ((perm = [enumerator nextObject])) {
     if ([[response objectForKey:perm] intValue] != 0) {
       [sessionState addPermission:perm];
     }
   }
+  [stateLock unlock];
 }
 
 - (void)gotLoggedInUser:(id<FBRequest>)req
 {
+  BOOL wasOptimistic = isValidatingOptimistically;
+  isValidatingOptimistically = NO;
+
   if ([req error]) {
     if ([[req error] code] > 0) {
       // fb error, bad login
+      if (wasOptimistic) {
+        [stateLock lock];
+        isLoggedIn = NO;
+        isRefreshingSession = YES;
+        [stateLock unlock];
+      }
       [self promptLogin];
     } else {
       // net error, retry
+      [stateLock lock];
+      [unvalidatedRequests removeAllObjects];
+      [stateLock unlock];
       [self performSelector:@selector(validateSession)
                  withObject:nil
                  afterDelay:60.0];
@@ -514,8 +1850,17 @@
   if (needsNewPermissions) {
     [self promptLogin];
   } else if ([[[req response] stringValue] isEqualToString:[self uid]]) {
+    [stateLock lock];
+    BOOL wasLoggedIn = isLoggedIn;
     isLoggedIn = YES;
-    [delegate facebookConnectLoggedIn:self withError:nil];
+    [unvalidatedRequests removeAllObjects];
+    [stateLock unlock];
+    [self scheduleSessionRenewal];
+    [self replayParkedRequests];
+    if (!wasLoggedIn) {
+      [self prefetchWarmQueries];
+      [delegate facebookConnectLoggedIn:self withError:nil];
+    }
   } else {
     [self refreshSession];
   }
@@ -534,13 +1879,38 @@
   }
 }
 
+- (void)prefetchedWarmQuery:(id<FBRequest>)req
+{
+  if ([req error] == nil && [self isLoggedIn]) {
+    NSDictionary* arguments = [NSDictionary dictionaryWithObject:[req userData] forKey:@"query"];
+    [warmResponses setResponse:[req response]
+                        forKey:[FBResponseCache keyForMethod:@"fql.query" arguments:arguments]
+                     partition:[self cachePartition]];
+  }
+
+  [stateLock lock];
+  BOOL finished = prefetchCount > 0 && --prefetchCount == 0;
+  BOOL yielded = prefetchYielded;
+  if (finished) {
+    [prefetchRequests removeAllObjects];
+  }
+  [stateLock unlock];
+
+  if (finished) {
+    // one cancelled for the sake of another request goes again soon
+    [self schedulePrefetchAfterDelay:(yielded ? kPrefetchQuietPeriod : [self warmQueryRefreshInterval])];
+  }
+}
+
 - (void)expireSessionResponseComplete:(id<FBRequest>)req
 {
   [delegate facebookConnectLoggedOut:self withError:[req error]];
 }
 
+#ifndef FB_HEADLESS
 - (void)loginWindowClosed
 {
+  [stateLock lock];
   isConnecting = NO;
 
   if ([windowController success]) {
@@ -574,15 +1944,20 @@
   } else {
     isLoggedIn = NO;
   }
+  [stateLock unlock];
 
   // release the web window
   [windowController release];
   windowController = nil;
 
   if (isLoggedIn) {
+    [self scheduleSessionRenewal];
+    [self replayParkedRequests];
+    [self prefetchWarmQueries];
     [delegate facebookConnectLoggedIn:self withError:nil];
   } else {
     NSError* err = [NSError errorWithDomain:kFBErrorDomainKey code:FBAPIUnknownError userInfo:nil];
+    [self failParkedRequestsWithError:err];
     [delegate facebookConnectLoggedIn:self withError:err];
   }
 }
@@ -610,7 +1985,9 @@
 {
   NSDictionary* args = [[[windowController lastURL] query] urlDecodeArguments];
   NSArray* acceptedPerms = [[args valueForKey:@"accepted_permissions"] componentsSeparatedByString:@","];
+  [stateLock lock];
   [sessionState addPermissions:acceptedPerms];
+  [stateLock unlock];
 
   // release the web window
   [windowController release];
@@ -621,6 +1998,7 @@
   [permissionCallback release];
   permissionCallback = nil;
 }
+#endif
 
 //==============================================================================
 //==============================================================================
@@ -723,6 +2101,31 @@
 
 - (NSDictionary*)completeArgumentsForMethod:(NSString*)method
                                   arguments:(NSDictionary*)dict
+{
+  // the session key and the secret it's signed with must match
+  [stateLock lock];
+  NSString* sessionKey = nil;
+  NSString* secret = appSecret;
+  if ([sessionState isValid]) {
+    sessionKey = [sessionState key];
+    if ([sessionState secret] != nil) {
+      secret = [sessionState secret];
+    }
+  }
+  [[sessionKey retain] autorelease];
+  [[secret retain] autorelease];
+  [stateLock unlock];
+
+  return [self completeArgumentsForMethod:method
+                                arguments:dict
+                               sessionKey:sessionKey
+                                   secret:secret];
+}
+
+- (NSDictionary*)completeArgumentsForMethod:(NSString*)method
+                                  arguments:(NSDictionary*)dict
+                                 sessionKey:(NSString*)sessionKey
+                                     secret:(NSString*)secret
 {
   NSMutableDictionary* args;
   if (dict) {
@@ -737,16 +2140,17 @@
   [args setObject:@"true" forKey:@"ss"];
   [args setObject:[[NSNumber numberWithLong:time(NULL)] stringValue]
            forKey:@"call_id"];
-  if ([sessionState isValid]) {
-    [args setObject:[sessionState key] forKey:@"session_key"];
+  if (sessionKey) {
+    [args setObject:sessionKey forKey:@"session_key"];
   }
 
-  [args setObject:[self sigForArguments:args] forKey:@"sig"];
+  [args setObject:[self sigForArguments:args secret:secret] forKey:@"sig"];
 
   return args;
 }
 
 - (NSString*)sigForArguments:(NSDictionary*)dict
+                      secret:(NSString*)secret
 {
   NSArray* sortedKeys = [[dict allKeys] sortedArrayUsingSelector:@selector(caseInsensitiveCompare:)];
   NSMutableString* args = [NSMutableString string];
@@ -761,10 +2165,8 @@
     }
   }
 
-  if ([sessionState isValid] && [sessionState secret] != nil) {
-    [args appendString:[sessionState secret]];
-  } else if (appSecret != nil) {
-    [args appendString:appSecret];
+  if (secret != nil) {
+    [args appendString:secret];
   }
 
   return [[args dataUsingEncoding:NSUTF8StringEncoding] md5];
@@ -778,6 +2180,18 @@
   return [NSString urlEncodeArguments:args];
 }
 
+- (NSString*)getRequestStringForMethod:(NSString*)method
+                             arguments:(NSDictionary*)dict
+                            sessionKey:(NSString*)sessionKey
+                                secret:(NSString*)secret
+{
+  NSDictionary* args = [self completeArgumentsForMethod:method
+                                              arguments:dict
+                                             sessionKey:sessionKey
+                                                 secret:(secret ? secret : appSecret)];
+  return [NSString urlEncodeArguments:args];
+}
+
 - (NSData*)postDataForMethod:(NSString*)method
                    arguments:(NSDictionary*)dict
                        files:(NSArray*)files
@@ -801,6 +2215,7 @@
   }
 
   // add files
+#ifndef FB_HEADLESS
   for (int i = 0; i < [files count]; i++) {
 
     // image type
@@ -820,8 +2235,59 @@
       [postBody appendData:endLine];
     }
   }
+#endif
 
   return postBody;
 }
 
+- (void)removeRequestFromGroup:(id<FBRequest>)request
+{
+  // called with the state lock held
+  NSValue* requestKey = [NSValue valueWithNonretainedObject:request];
+  NSValue* groupKey = [groupsByRequest objectForKey:requestKey];
+  if (groupKey == nil) {
+    return;
+  }
+  [[groupKey retain] autorelease];
+  [groupsByRequest removeObjectForKey:requestKey];
+
+  NSMutableSet* requests = [requestGroups objectForKey:groupKey];
+  [[request retain] autorelease];
+  [requests removeObject:request];
+  if ([requests count] == 0) {
+    [self forgetRequestGroup:groupKey];
+  }
+}
+
+- (void)forgetRequestGroup:(NSValue*)groupKey
+{
+  // called with the state lock held
+  NSArray* requests = [[requestGroups objectForKey:groupKey] allObjects];
+  if (requests == nil) {
+    return;
+  }
+  for (int i = 0; i < [requests count]; i++) {
+    [groupsByRequest removeObjectForKey:[NSValue valueWithNonretainedObject:[requests objectAtIndex:i]]];
+  }
+  [requestGroups removeObjectForKey:groupKey];
+
+  // let go of it once we're out of the lock, its dealloc may cancel more
+  [[groupKey nonretainedObjectValue] autorelease];
+}
+
+- (void)removeSupersedeKeyOfRequest:(id<FBRequest>)request
+{
+  // called with the state lock held
+  NSValue* requestKey = [NSValue valueWithNonretainedObject:request];
+  NSString* key = [supersedeKeysByRequest objectForKey:requestKey];
+  if (key == nil) {
+    return;
+  }
+  if ([supersedingRequests objectForKey:key] == request) {
+    [[request retain] autorelease];
+    [supersedingRequests removeObjectForKey:key];
+  }
+  [supersedeKeysByRequest removeObjectForKey:requestKey];
+}
+
 @end
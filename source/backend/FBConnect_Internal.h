@@ -22,4 +22,22 @@
 
 - (NSString*)loginSuccessURL;
 
+- (NSString*)getRequestStringForMethod:(NSString*)method
+                             arguments:(NSDictionary*)dict;
+
+/*!
+ * Signs a call for a session other than this connect's own. A nil secret
+ * signs with the application secret.
+ */
+- (NSString*)getRequestStringForMethod:(NSString*)method
+                             arguments:(NSDictionary*)dict
+                            sessionKey:(NSString*)sessionKey
+                                secret:(NSString*)secret;
+
+/*!
+ * Starts a request now, or once the responses in flight leave room for it
+ * under the response memory budget.
+ */
+- (void)startRequest:(FBMethodRequest*)request;
+
 @end
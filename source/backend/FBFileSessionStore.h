@@ -0,0 +1,39 @@
+//
+//  FBFileSessionStore.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "FBSessionStore.h"
+
+
+/*!
+ * @class FBFileSessionStore
+ *
+ * Keeps every session in a single file, encrypted with AES-256 and
+ * authenticated with HMAC-SHA256 under keys derived from a passphrase. For
+ * systems without a keychain, such as Linux servers. The file is memory
+ * mapped to be read, and replaced atomically when written.
+ *
+ * A file which can't be decrypted, whether corrupt or written with another
+ * passphrase, is moved aside to <path>.unreadable so it isn't lost, and the
+ * store starts empty. If it can't be moved, nothing is written over it.
+ */
+@interface FBFileSessionStore : NSObject <FBSessionStore> {
+  NSString*            path;
+  NSData*              passphrase;
+  NSMutableDictionary* sessions;
+  NSData*              salt;
+  NSData*              derivedKeys;
+  NSLock*              lock;
+  BOOL                 isReadOnly;
+}
+
+- (id)initWithPath:(NSString*)aPath
+        passphrase:(NSString*)aPassphrase;
+
+- (NSString*)path;
+
+@end
@@ -0,0 +1,354 @@
+//
+//  FBFileSessionStore.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBFileSessionStore.h"
+#import "JSON.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#ifdef __APPLE__
+  // the system's OpenSSL predates SHA-256 and EVP_CIPHER_CTX_new
+  #include <CommonCrypto/CommonCryptor.h>
+  #include <CommonCrypto/CommonHMAC.h>
+#else
+  #include <openssl/hmac.h>
+#endif
+
+// magic, version, salt and iv, then the ciphertext, then its mac
+#define kFileMagic "FBSS"
+#define kFileVersion 1
+#define kSaltLength 16
+#define kIVLength 16
+#define kKeyLength 32
+#define kMACLength 32
+#define kBlockLength 16
+#define kHeaderLength (4 + 4 + kSaltLength + kIVLength)
+#define kKeyIterations 10000
+
+
+/*
+ * Derives the encryption key followed by the mac key.
+ */
+static int FBDeriveKeys(const char* pass, int passLength,
+                        const unsigned char* salt, unsigned char* keys)
+{
+  return PKCS5_PBKDF2_HMAC_SHA1(pass, passLength, salt, kSaltLength,
+                                kKeyIterations, 2 * kKeyLength, keys);
+}
+
+/*
+ * HMAC-SHA256 of data under the mac key.
+ */
+static void FBMACData(const unsigned char* keys, const unsigned char* data, size_t length,
+                      unsigned char* mac)
+{
+#ifdef __APPLE__
+  CCHmac(kCCHmacAlgSHA256, keys + kKeyLength, kKeyLength, data, length, mac);
+#else
+  unsigned int macLength = kMACLength;
+  HMAC(EVP_sha256(), keys + kKeyLength, kKeyLength, data, length, mac, &macLength);
+#endif
+}
+
+/*
+ * AES-256-CBC with PKCS#7 padding under the encryption key. out must have
+ * room for length plus a block.
+ */
+static int FBCryptData(int encrypt, const unsigned char* keys, const unsigned char* iv,
+                       const unsigned char* in, size_t length,
+                       unsigned char* out, size_t* outLength)
+{
+#ifdef __APPLE__
+  return CCCrypt(encrypt ? kCCEncrypt : kCCDecrypt, kCCAlgorithmAES128, kCCOptionPKCS7Padding,
+                 keys, kCCKeySizeAES256, iv, in, length,
+                 out, length + kBlockLength, outLength) == kCCSuccess;
+#else
+  int updateLength = 0;
+  int finalLength = 0;
+  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+  int ok = ctx != NULL &&
+    EVP_CipherInit_ex(ctx, EVP_aes_256_cbc(), NULL, keys, iv, encrypt) == 1 &&
+    EVP_CipherUpdate(ctx, out, &updateLength, in, (int)length) == 1 &&
+    EVP_CipherFinal_ex(ctx, out + updateLength, &finalLength) == 1;
+  EVP_CIPHER_CTX_free(ctx);
+  *outLength = updateLength + finalLength;
+  return ok;
+#endif
+}
+
+/*
+ * Returns a malloced file image holding plaintext, or NULL.
+ */
+static unsigned char* FBSealData(const unsigned char* keys, const unsigned char* salt,
+                                 const unsigned char* plain, size_t plainLength,
+                                 size_t* fileLength)
+{
+  size_t capacity = kHeaderLength + plainLength + kBlockLength + kMACLength;
+  unsigned char* file = malloc(capacity);
+  if (file == NULL) {
+    return NULL;
+  }
+
+  memcpy(file, kFileMagic, 4);
+  file[4] = 0; file[5] = 0; file[6] = 0; file[7] = kFileVersion;
+  memcpy(file + 8, salt, kSaltLength);
+  unsigned char* iv = file + 8 + kSaltLength;
+  if (RAND_bytes(iv, kIVLength) != 1) {
+    free(file);
+    return NULL;
+  }
+
+  size_t cipherLength = 0;
+  if (!FBCryptData(1, keys, iv, plain, plainLength, file + kHeaderLength, &cipherLength)) {
+    free(file);
+    return NULL;
+  }
+
+  size_t sealedLength = kHeaderLength + cipherLength;
+  FBMACData(keys, file, sealedLength, file + sealedLength);
+
+  *fileLength = sealedLength + kMACLength;
+  return file;
+}
+
+/*
+ * Returns the malloced, NUL terminated plaintext of a file image, or NULL if
+ * it has been tampered with or the keys are wrong.
+ */
+static unsigned char* FBOpenData(const unsigned char* keys,
+                                 const unsigned char* file, size_t fileLength,
+                                 size_t* plainLength)
+{
+  if (fileLength < kHeaderLength + kMACLength) {
+    return NULL;
+  }
+
+  size_t sealedLength = fileLength - kMACLength;
+  unsigned char mac[kMACLength];
+  FBMACData(keys, file, sealedLength, mac);
+
+  // compare every byte, so the time taken says nothing about the mac
+  unsigned char difference = 0;
+  for (int i = 0; i < kMACLength; i++) {
+    difference |= mac[i] ^ file[sealedLength + i];
+  }
+  if (difference != 0) {
+    return NULL;
+  }
+
+  size_t cipherLength = sealedLength - kHeaderLength;
+  unsigned char* plain = malloc(cipherLength + kBlockLength + 1);
+  if (plain == NULL) {
+    return NULL;
+  }
+
+  if (!FBCryptData(0, keys, file + 8 + kSaltLength, file + kHeaderLength, cipherLength,
+                   plain, plainLength)) {
+    free(plain);
+    return NULL;
+  }
+  plain[*plainLength] = '\0';
+  return plain;
+}
+
+
+@interface FBFileSessionStore (Private)
+
+- (void)loadSessions;
+- (void)moveUnreadableFileAside;
+- (void)saveSessions;
+- (BOOL)deriveKeysWithSalt:(NSData*)aSalt;
+
+@end
+
+
+@implementation FBFileSessionStore
+
+- (id)initWithPath:(NSString*)aPath
+        passphrase:(NSString*)aPassphrase
+{
+  if (self = [super init]) {
+    path       = [aPath copy];
+    passphrase = [[aPassphrase dataUsingEncoding:NSUTF8StringEncoding] retain];
+    lock       = [[NSLock alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [path        release];
+  [passphrase  release];
+  [sessions    release];
+  [salt        release];
+  [derivedKeys release];
+  [lock        release];
+  [super dealloc];
+}
+
+- (NSString*)path
+{
+  return path;
+}
+
+- (NSDictionary*)sessionForKey:(NSString*)key
+{
+  [lock lock];
+  [self loadSessions];
+  NSDictionary* session = [[[sessions objectForKey:key] retain] autorelease];
+  [lock unlock];
+  return session;
+}
+
+- (void)setSession:(NSDictionary*)session forKey:(NSString*)key
+{
+  [lock lock];
+  [self loadSessions];
+  if (session) {
+    [sessions setObject:session forKey:key];
+  } else {
+    [sessions removeObjectForKey:key];
+  }
+  [self saveSessions];
+  [lock unlock];
+}
+
+#pragma mark Private Methods
+- (void)loadSessions
+{
+  if (sessions) {
+    return;
+  }
+  sessions = [[NSMutableDictionary alloc] init];
+
+  int fd = open([path fileSystemRepresentation], O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat info;
+  void* mapped = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && info.st_size >= kHeaderLength + kMACLength) {
+    mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    [self moveUnreadableFileAside];
+    return;
+  }
+
+  const unsigned char* file = mapped;
+  unsigned char* plain = NULL;
+  size_t plainLength = 0;
+  if (memcmp(file, kFileMagic, 4) == 0 && file[7] == kFileVersion &&
+      [self deriveKeysWithSalt:[NSData dataWithBytes:file + 8 length:kSaltLength]]) {
+    plain = FBOpenData([derivedKeys bytes], file, info.st_size, &plainLength);
+  }
+  munmap(mapped, info.st_size);
+
+  if (plain == NULL) {
+    [self moveUnreadableFileAside];
+    return;
+  }
+  NSDictionary* stored = [[NSString stringWithUTF8String:(const char*)plain] JSONValue];
+  memset(plain, 0, plainLength);
+  free(plain);
+  if ([stored isKindOfClass:[NSDictionary class]]) {
+    [sessions addEntriesFromDictionary:stored];
+  }
+}
+
+- (void)moveUnreadableFileAside
+{
+  // its salt belongs to a file we can't read, the next one gets its own
+  [salt release];
+  salt = nil;
+  [derivedKeys release];
+  derivedKeys = nil;
+
+  NSString* asidePath = [path stringByAppendingString:@".unreadable"];
+  if (rename([path fileSystemRepresentation], [asidePath fileSystemRepresentation]) == 0) {
+    NSLog(@"Could not read sessions from %@, moved it to %@", path, asidePath);
+  } else {
+    NSLog(@"Could not read sessions from %@, leaving it alone", path);
+    isReadOnly = YES;
+  }
+}
+
+- (void)saveSessions
+{
+  if (isReadOnly) {
+    // better to forget a session than every session in the unreadable file
+    NSLog(@"Not writing sessions over %@", path);
+    return;
+  }
+
+  if (salt == nil) {
+    unsigned char newSalt[kSaltLength];
+    if (RAND_bytes(newSalt, kSaltLength) != 1 ||
+        ![self deriveKeysWithSalt:[NSData dataWithBytes:newSalt length:kSaltLength]]) {
+      NSLog(@"Could not create a key for %@", path);
+      return;
+    }
+  }
+
+  NSData* plain = [[sessions JSONRepresentation] dataUsingEncoding:NSUTF8StringEncoding];
+  size_t fileLength = 0;
+  unsigned char* file = FBSealData([derivedKeys bytes], [salt bytes],
+                                   [plain bytes], [plain length], &fileLength);
+  if (file == NULL) {
+    NSLog(@"Could not encrypt sessions for %@", path);
+    return;
+  }
+
+  // write beside the old file, then swap it in
+  NSString* tempPath = [path stringByAppendingString:@".tmp"];
+  int fd = open([tempPath fileSystemRepresentation], O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  BOOL written = fd >= 0;
+  size_t offset = 0;
+  while (written && offset < fileLength) {
+    ssize_t count = write(fd, file + offset, fileLength - offset);
+    if (count < 0) {
+      written = NO;
+    } else {
+      offset += count;
+    }
+  }
+  if (fd >= 0) {
+    written = written && fsync(fd) == 0;
+    close(fd);
+  }
+  free(file);
+
+  if (!written || rename([tempPath fileSystemRepresentation], [path fileSystemRepresentation]) != 0) {
+    NSLog(@"Could not write sessions to %@", path);
+    unlink([tempPath fileSystemRepresentation]);
+  }
+}
+
+- (BOOL)deriveKeysWithSalt:(NSData*)aSalt
+{
+  if (derivedKeys && [salt isEqualToData:aSalt]) {
+    return YES;
+  }
+
+  // slow on purpose, so only done once per salt
+  NSMutableData* keys = [NSMutableData dataWithLength:2 * kKeyLength];
+  if (!FBDeriveKeys([passphrase bytes], [passphrase length], [aSalt bytes], [keys mutableBytes])) {
+    return NO;
+  }
+  [salt release];
+  salt = [aSalt copy];
+  [derivedKeys release];
+  derivedKeys = [keys copy];
+  return YES;
+}
+
+@end
@@ -0,0 +1,36 @@
+//
+//  FBHTTPTransport.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#import "FBTransport.h"
+
+
+/*!
+ * @class FBHTTPTransport
+ *
+ * The default transport. Requests are sent over at most maxConnections
+ * keep-alive HTTP/1.1 connections at a time, so the same few sockets to the
+ * REST server are reused rather than a new one being opened per request.
+ * Requests beyond that wait in order for a connection to become free.
+ */
+@interface FBHTTPTransport : NSObject <FBTransport> {
+  NSUInteger      maxConnections;
+  NSMutableArray* activeConnections;
+  NSMutableArray* waitingConnections;
+}
+
++ (FBHTTPTransport*)sharedTransport;
+
+- (NSUInteger)maxConnections;
+
+/*!
+ * May be called from any thread. Connections waiting for a free slot are
+ * started on the network thread.
+ */
+- (void)setMaxConnections:(NSUInteger)max;
+
+@end
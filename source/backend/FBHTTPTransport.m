@@ -0,0 +1,219 @@
+//
+//  FBHTTPTransport.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBHTTPTransport.h"
+#import "FBNetworkThread.h"
+
+#define kDefaultMaxConnections 4
+
+
+@class FBHTTPTransportConnection;
+
+@interface FBHTTPTransport (Private)
+
+- (void)connectionFinished:(FBHTTPTransportConnection*)conn;
+- (void)startWaitingConnections;
+
+@end
+
+
+/*
+ * Sits between NSURLConnection and the transport's delegate, so the transport
+ * knows when a connection slot frees up.
+ */
+@interface FBHTTPTransportConnection : NSObject <FBTransportConnection> {
+  FBHTTPTransport* transport;
+  NSURLRequest*    request;
+  id               delegate;
+  NSURLConnection* connection;
+  BOOL             finished;
+}
+
+- (id)initWithTransport:(FBHTTPTransport*)aTransport
+                request:(NSURLRequest*)aRequest
+               delegate:(id)aDelegate;
+
+- (void)start;
+
+@end
+
+
+@implementation NSURLConnection (FBTransportConnection)
+@end
+
+
+@implementation FBHTTPTransport
+
++ (FBHTTPTransport*)sharedTransport
+{
+  static FBHTTPTransport* sharedTransport = nil;
+  @synchronized(self) {
+    if (!sharedTransport) {
+      sharedTransport = [[FBHTTPTransport alloc] init];
+    }
+  }
+  return sharedTransport;
+}
+
+- (id)init
+{
+  if (self = [super init]) {
+    maxConnections     = kDefaultMaxConnections;
+    activeConnections  = [[NSMutableArray alloc] init];
+    waitingConnections = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [activeConnections  release];
+  [waitingConnections release];
+  [super dealloc];
+}
+
+- (NSUInteger)maxConnections
+{
+  return maxConnections;
+}
+
+- (void)setMaxConnections:(NSUInteger)max
+{
+  maxConnections = MAX(max, 1);
+
+  // the connections are only ever touched on the network thread
+  FBNetworkThread* networkThread = [FBNetworkThread sharedThread];
+  if ([networkThread isCurrentThread]) {
+    [self startWaitingConnections];
+  } else {
+    [networkThread performSelector:@selector(startWaitingConnections) target:self withObject:nil];
+  }
+}
+
+- (id<FBTransportConnection>)connectionWithRequest:(NSURLRequest*)request
+                                          delegate:(id)delegate
+{
+  NSMutableURLRequest* req = [[request mutableCopy] autorelease];
+  [req setValue:@"keep-alive" forHTTPHeaderField:@"Connection"];
+
+  FBHTTPTransportConnection* conn =
+    [[FBHTTPTransportConnection alloc] initWithTransport:self
+                                                 request:req
+                                                delegate:delegate];
+  [waitingConnections addObject:conn];
+  [self startWaitingConnections];
+  return [conn autorelease];
+}
+
+- (BOOL)decodesContentEncoding
+{
+  return YES;
+}
+
+#pragma mark Private Methods
+- (void)connectionFinished:(FBHTTPTransportConnection*)conn
+{
+  [activeConnections removeObjectIdenticalTo:conn];
+  [waitingConnections removeObjectIdenticalTo:conn];
+  [self startWaitingConnections];
+}
+
+- (void)startWaitingConnections
+{
+  while ([activeConnections count] < maxConnections && [waitingConnections count] > 0) {
+    FBHTTPTransportConnection* conn = [waitingConnections objectAtIndex:0];
+    [activeConnections addObject:conn];
+    [waitingConnections removeObjectAtIndex:0];
+    [conn start];
+  }
+}
+
+@end
+
+
+@implementation FBHTTPTransportConnection
+
+- (id)initWithTransport:(FBHTTPTransport*)aTransport
+                request:(NSURLRequest*)aRequest
+               delegate:(id)aDelegate
+{
+  if (self = [super init]) {
+    transport = [aTransport retain];
+    request   = [aRequest retain];
+    delegate  = [aDelegate retain];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [transport  release];
+  [request    release];
+  [delegate   release];
+  [connection release];
+  [super dealloc];
+}
+
+- (void)start
+{
+  connection = [[NSURLConnection alloc] initWithRequest:request delegate:self];
+}
+
+- (void)finish
+{
+  if (finished) {
+    return;
+  }
+  finished = YES;
+
+  // the transport may be holding the last reference to us
+  [[self retain] autorelease];
+  [transport connectionFinished:self];
+  [delegate autorelease];
+  delegate = nil;
+}
+
+- (void)cancel
+{
+  [connection cancel];
+  [self finish];
+}
+
+- (void)connection:(NSURLConnection*)conn didReceiveResponse:(NSURLResponse*)response
+{
+  if ([delegate respondsToSelector:@selector(connection:didReceiveResponse:)]) {
+    [delegate connection:self didReceiveResponse:response];
+  }
+}
+
+- (void)connection:(NSURLConnection*)conn didReceiveData:(NSData*)data
+{
+  [delegate connection:self didReceiveData:data];
+}
+
+- (NSCachedURLResponse*)connection:(NSURLConnection*)conn
+                 willCacheResponse:(NSCachedURLResponse*)cachedResponse
+{
+  // API responses are never worth caching
+  return nil;
+}
+
+- (void)connectionDidFinishLoading:(NSURLConnection*)conn
+{
+  id target = [[delegate retain] autorelease];
+  [self finish];
+  [target connectionDidFinishLoading:self];
+}
+
+- (void)connection:(NSURLConnection*)conn didFailWithError:(NSError*)err
+{
+  id target = [[delegate retain] autorelease];
+  [self finish];
+  [target connection:self didFailWithError:err];
+}
+
+@end
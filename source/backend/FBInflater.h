@@ -0,0 +1,35 @@
+//
+//  FBInflater.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#include <zlib.h>
+
+
+/*!
+ * @class FBInflater
+ *
+ * Decompresses a gzip or deflate encoded response as it arrives, so that only
+ * the decoded bytes are kept.
+ */
+@interface FBInflater : NSObject {
+  z_stream stream;
+  BOOL     isRaw;
+  BOOL     finished;
+}
+
+/*!
+ * Inflates the next chunk of compressed data, appending the output to buffer.
+ * Returns NO if the data is not a valid compressed stream.
+ */
+- (BOOL)inflateData:(NSData*)data intoBuffer:(NSMutableData*)buffer;
+
+/*!
+ * YES once the end of the compressed stream has been seen.
+ */
+- (BOOL)isFinished;
+
+@end
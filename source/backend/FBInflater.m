@@ -0,0 +1,85 @@
+//
+//  FBInflater.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBInflater.h"
+
+#define kInflateChunkSize 16384
+
+// detect a gzip or zlib header automatically
+#define kAutoDetectWindowBits (MAX_WBITS + 32)
+
+
+@implementation FBInflater
+
+- (id)init
+{
+  if (self = [super init]) {
+    if (inflateInit2(&stream, kAutoDetectWindowBits) != Z_OK) {
+      [self release];
+      return nil;
+    }
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  inflateEnd(&stream);
+  [super dealloc];
+}
+
+- (BOOL)inflateData:(NSData*)data intoBuffer:(NSMutableData*)buffer
+{
+  if (finished) {
+    return YES;
+  }
+
+  unsigned char chunk[kInflateChunkSize];
+  stream.next_in  = (Bytef*)[data bytes];
+  stream.avail_in = [data length];
+
+  do {
+    stream.next_out  = chunk;
+    stream.avail_out = kInflateChunkSize;
+
+    int status = inflate(&stream, Z_NO_FLUSH);
+
+    // some servers send "deflate" without the zlib header
+    if (status == Z_DATA_ERROR && !isRaw && stream.total_out == 0) {
+      inflateEnd(&stream);
+      if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        return NO;
+      }
+      isRaw = YES;
+      stream.next_in  = (Bytef*)[data bytes];
+      stream.avail_in = [data length];
+      continue;
+    }
+
+    if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+      return NO;
+    }
+
+    [buffer appendBytes:chunk length:kInflateChunkSize - stream.avail_out];
+
+    if (status == Z_STREAM_END) {
+      finished = YES;
+    } else if (status == Z_BUF_ERROR) {
+      // needs more input
+      break;
+    }
+  } while (!finished && (stream.avail_in > 0 || stream.avail_out == 0));
+
+  return YES;
+}
+
+- (BOOL)isFinished
+{
+  return finished;
+}
+
+@end
@@ -0,0 +1,31 @@
+//
+//  FBKeychainSessionStore.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#import "FBSessionStore.h"
+
+
+/*!
+ * @class FBKeychainSessionStore
+ *
+ * Keeps sessions in the user's keychain as generic passwords, one per key.
+ * Each keychain item is only searched for once.
+ */
+@interface FBKeychainSessionStore : NSObject <FBSessionStore> {
+  NSString*            service;
+  NSMutableDictionary* items;
+  NSLock*              lock;
+}
+
+/*!
+ * The store used by FBConnect, under the service "Facebook Notifier Login".
+ */
++ (FBKeychainSessionStore*)defaultStore;
+
+- (id)initWithService:(NSString*)aService;
+
+@end
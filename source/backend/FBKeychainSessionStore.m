@@ -0,0 +1,99 @@
+//
+//  FBKeychainSessionStore.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBKeychainSessionStore.h"
+#import "JSON.h"
+#import "EMKeychainItem.h"
+#import "EMKeychainProxy.h"
+
+#define kFacebookDesktopService @"Facebook Notifier Login"
+
+
+@interface FBKeychainSessionStore (Private)
+
+- (EMGenericKeychainItem*)itemForKey:(NSString*)key;
+
+@end
+
+
+@implementation FBKeychainSessionStore
+
++ (FBKeychainSessionStore*)defaultStore
+{
+  static FBKeychainSessionStore* defaultStore = nil;
+  @synchronized(self) {
+    if (!defaultStore) {
+      defaultStore = [[FBKeychainSessionStore alloc] initWithService:kFacebookDesktopService];
+    }
+  }
+  return defaultStore;
+}
+
+- (id)initWithService:(NSString*)aService
+{
+  if (self = [super init]) {
+    service = [aService copy];
+    items   = [[NSMutableDictionary alloc] init];
+    lock    = [[NSLock alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [service release];
+  [items   release];
+  [lock    release];
+  [super dealloc];
+}
+
+- (NSDictionary*)sessionForKey:(NSString*)key
+{
+  [lock lock];
+  NSString* password = [[[[self itemForKey:key] password] retain] autorelease];
+  [lock unlock];
+
+  if ([password length] == 0) {
+    return nil;
+  }
+  return [password JSONValue];
+}
+
+- (void)setSession:(NSDictionary*)session forKey:(NSString*)key
+{
+  [lock lock];
+  EMGenericKeychainItem* item = [self itemForKey:key];
+  if (session == nil) {
+    // emptied rather than deleted, as it always has been
+    [item setPassword:@""];
+  } else if (item) {
+    [item setPassword:[session JSONRepresentation]];
+  } else {
+    item = [[EMKeychainProxy sharedProxy] addGenericKeychainItemForService:service
+                                                              withUsername:key
+                                                                  password:[session JSONRepresentation]];
+    if (item) {
+      [items setObject:item forKey:key];
+    }
+  }
+  [lock unlock];
+}
+
+#pragma mark Private Methods
+- (EMGenericKeychainItem*)itemForKey:(NSString*)key
+{
+  id item = [items objectForKey:key];
+  if (item == nil) {
+    item = [[EMKeychainProxy sharedProxy] genericKeychainItemForService:service
+                                                           withUsername:key];
+    // remember misses too, we'll add the item ourselves
+    [items setObject:(item ? item : [NSNull null]) forKey:key];
+  }
+  return (item == [NSNull null]) ? nil : item;
+}
+
+@end
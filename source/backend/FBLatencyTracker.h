@@ -0,0 +1,34 @@
+//
+//  FBLatencyTracker.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+
+/*!
+ * @class FBLatencyTracker
+ *
+ * Remembers how long recent calls to each API method took to complete.
+ * Safe to use from any thread.
+ */
+@interface FBLatencyTracker : NSObject {
+  NSMutableDictionary* samples;
+  NSMutableDictionary* nextSample;
+  NSLock*              lock;
+}
+
+- (void)recordLatency:(NSTimeInterval)latency forMethod:(NSString*)method;
+
+/*!
+ * The latency below which the given fraction (0.95 for the p95) of recent
+ * calls to method completed, or 0 if too few calls have been seen to say.
+ */
+- (NSTimeInterval)latencyAtPercentile:(double)percentile
+                            forMethod:(NSString*)method;
+
+- (NSUInteger)sampleCountForMethod:(NSString*)method;
+
+@end
@@ -0,0 +1,92 @@
+//
+//  FBLatencyTracker.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBLatencyTracker.h"
+
+// only the most recent calls to each method are kept
+#define kMaxLatencySamples 200
+
+// percentiles of fewer calls than this aren't worth acting on
+#define kMinLatencySamples 20
+
+
+@implementation FBLatencyTracker
+
+- (id)init
+{
+  if (self = [super init]) {
+    samples    = [[NSMutableDictionary alloc] init];
+    nextSample = [[NSMutableDictionary alloc] init];
+    lock       = [[NSLock alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [samples    release];
+  [nextSample release];
+  [lock       release];
+  [super dealloc];
+}
+
+- (void)recordLatency:(NSTimeInterval)latency forMethod:(NSString*)method
+{
+  if (method == nil) {
+    return;
+  }
+  method = [method lowercaseString];
+
+  [lock lock];
+  NSMutableArray* methodSamples = [samples objectForKey:method];
+  if (methodSamples == nil) {
+    methodSamples = [NSMutableArray arrayWithCapacity:kMaxLatencySamples];
+    [samples setObject:methodSamples forKey:method];
+  }
+
+  NSNumber* sample = [NSNumber numberWithDouble:latency];
+  if ([methodSamples count] < kMaxLatencySamples) {
+    [methodSamples addObject:sample];
+    [lock unlock];
+    return;
+  }
+
+  // overwrite the oldest
+  NSUInteger next = [[nextSample objectForKey:method] unsignedIntValue];
+  [methodSamples replaceObjectAtIndex:next withObject:sample];
+  [nextSample setObject:[NSNumber numberWithUnsignedInt:(next + 1) % kMaxLatencySamples]
+                 forKey:method];
+  [lock unlock];
+}
+
+- (NSTimeInterval)latencyAtPercentile:(double)percentile
+                            forMethod:(NSString*)method
+{
+  [lock lock];
+  NSArray* methodSamples = [samples objectForKey:[method lowercaseString]];
+  NSArray* sorted = nil;
+  if ([methodSamples count] >= kMinLatencySamples) {
+    sorted = [methodSamples sortedArrayUsingSelector:@selector(compare:)];
+  }
+  [lock unlock];
+
+  if (sorted == nil) {
+    return 0;
+  }
+  NSUInteger index = MIN([sorted count] - 1, (NSUInteger)(percentile * [sorted count]));
+  return [[sorted objectAtIndex:index] doubleValue];
+}
+
+- (NSUInteger)sampleCountForMethod:(NSString*)method
+{
+  [lock lock];
+  NSUInteger count = [[samples objectForKey:[method lowercaseString]] count];
+  [lock unlock];
+  return count;
+}
+
+@end
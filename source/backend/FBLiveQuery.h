@@ -0,0 +1,80 @@
+//
+//  FBLiveQuery.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#import "FBCallback.h"
+
+@class FBConnect;
+
+
+/*!
+ * @class FBLiveQuery
+ *
+ * An FQL query which is expected to be run over and over. The previous result
+ * set is kept, indexed by keyColumn, and each new result is compared against
+ * it in the background, on one queue shared by every live query. The target
+ * is only called when something has changed, and can look at just the added,
+ * removed and changed rows. Like the requests it makes, it calls back on the
+ * main thread if refreshed there, otherwise on the network thread.
+ */
+@interface FBLiveQuery : FBCallback {
+  FBConnect*    parentConnect;
+  NSString*     query;
+  NSString*     keyColumn;
+
+  NSDictionary* rowsByKey;
+  NSArray*      rows;
+  NSString*     resultDigest;
+
+  NSArray*      addedRows;
+  NSArray*      removedRows;
+  NSArray*      changedRows;
+
+  id            pendingRequest;
+  BOOL          isDiffing;
+  BOOL          isCancelled;
+  BOOL          deliversOnMainThread;
+}
+
++ (FBLiveQuery*)liveQueryWithQuery:(NSString*)aQuery
+                         keyColumn:(NSString*)aKeyColumn
+                            parent:(FBConnect*)parent
+                            target:(id)tar
+                          selector:(SEL)sel;
+
+/*!
+ * Sends the query again. Does nothing if the previous refresh is still being
+ * fetched or compared.
+ */
+- (void)refresh;
+
+/*!
+ * Stops any refresh in progress. No further callbacks will be made.
+ */
+- (void)cancel;
+
+/*!
+ * The full current result set, in the order the server returned it.
+ */
+- (NSArray*)rows;
+
+/*!
+ * Rows whose key was not in the previous result set.
+ */
+- (NSArray*)addedRows;
+
+/*!
+ * Rows from the previous result set whose key is no longer present.
+ */
+- (NSArray*)removedRows;
+
+/*!
+ * Rows whose key was present before but whose contents have changed.
+ */
+- (NSArray*)changedRows;
+
+@end
@@ -0,0 +1,270 @@
+//
+//  FBLiveQuery.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBLiveQuery.h"
+#import "FBConnect.h"
+#import "FBRequest.h"
+#import "FBNetworkThread.h"
+#import "JSON.h"
+#import "NSData+.h"
+
+#define kDeltaDigestKey   @"digest"
+#define kDeltaRowsKey     @"rows"
+#define kDeltaIndexKey    @"index"
+#define kDeltaAddedKey    @"added"
+#define kDeltaRemovedKey  @"removed"
+#define kDeltaChangedKey  @"changed"
+
+
+@interface FBLiveQuery (Private)
+
+- (id)initWithQuery:(NSString*)aQuery
+          keyColumn:(NSString*)aKeyColumn
+             parent:(FBConnect*)parent
+             target:(id)tar
+           selector:(SEL)sel;
+
++ (NSOperationQueue*)diffQueue;
+
+- (void)computeDelta:(NSArray*)newRows;
+- (void)postDelta:(NSDictionary*)delta;
+- (void)deliverDelta:(NSDictionary*)delta;
+
+@end
+
+
+@implementation FBLiveQuery
+
++ (FBLiveQuery*)liveQueryWithQuery:(NSString*)aQuery
+                         keyColumn:(NSString*)aKeyColumn
+                            parent:(FBConnect*)parent
+                            target:(id)tar
+                          selector:(SEL)sel
+{
+  return [[[FBLiveQuery alloc] initWithQuery:aQuery
+                                   keyColumn:aKeyColumn
+                                      parent:parent
+                                      target:tar
+                                    selector:sel] autorelease];
+}
+
+- (id)initWithQuery:(NSString*)aQuery
+          keyColumn:(NSString*)aKeyColumn
+             parent:(FBConnect*)parent
+             target:(id)tar
+           selector:(SEL)sel
+{
+  if (self = [super initWithTarget:tar selector:sel]) {
+    parentConnect = [parent retain];
+    query         = [aQuery retain];
+    keyColumn     = [aKeyColumn retain];
+    rowsByKey     = [[NSDictionary alloc] init];
+    rows          = [[NSArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [parentConnect  release];
+  [query          release];
+  [keyColumn      release];
+  [rowsByKey      release];
+  [rows           release];
+  [resultDigest   release];
+  [addedRows      release];
+  [removedRows    release];
+  [changedRows    release];
+  [pendingRequest release];
+  [super dealloc];
+}
+
+- (void)refresh
+{
+  if (isCancelled || pendingRequest || isDiffing) {
+    return;
+  }
+  pendingRequest = [[parentConnect fqlQuery:query
+                                     target:self
+                                   selector:@selector(gotRows:)] retain];
+}
+
+- (void)cancel
+{
+  isCancelled = YES;
+  [pendingRequest cancel];
+  [pendingRequest release];
+  pendingRequest = nil;
+}
+
+- (NSArray*)rows
+{
+  return rows;
+}
+
+- (NSArray*)addedRows
+{
+  return addedRows;
+}
+
+- (NSArray*)removedRows
+{
+  return removedRows;
+}
+
+- (NSArray*)changedRows
+{
+  return changedRows;
+}
+
+#pragma mark Callbacks
+- (void)gotRows:(id<FBRequest>)req
+{
+  if (req != pendingRequest) {
+    return;
+  }
+  [pendingRequest autorelease];
+  pendingRequest = nil;
+
+  if ([req error]) {
+    [self failure:[req error]];
+    return;
+  }
+
+  // FQL returns an empty object rather than an empty array
+  NSArray* newRows = [req response];
+  if (![newRows isKindOfClass:[NSArray class]]) {
+    newRows = [NSArray array];
+  }
+
+  // the delta comes back on the thread the rows did, as the request's would
+  isDiffing = YES;
+  deliversOnMainThread = [NSThread isMainThread];
+  NSInvocationOperation* operation =
+    [[NSInvocationOperation alloc] initWithTarget:self
+                                         selector:@selector(computeDelta:)
+                                           object:newRows];
+  [[FBLiveQuery diffQueue] addOperation:operation];
+  [operation release];
+}
+
+#pragma mark Private Methods
++ (NSOperationQueue*)diffQueue
+{
+  // one background thread diffs the results of every live query in turn
+  static NSOperationQueue* diffQueue = nil;
+  @synchronized(self) {
+    if (!diffQueue) {
+      diffQueue = [[NSOperationQueue alloc] init];
+      [diffQueue setMaxConcurrentOperationCount:1];
+    }
+  }
+  return diffQueue;
+}
+
+- (void)computeDelta:(NSArray*)newRows
+{
+  NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+  // identical results need no further work, and no callback
+  NSString* digest = [[[newRows JSONRepresentation] dataUsingEncoding:NSUTF8StringEncoding] md5];
+  if ([digest isEqualToString:resultDigest]) {
+    [self postDelta:nil];
+    [pool release];
+    return;
+  }
+
+  NSMutableDictionary* index = [NSMutableDictionary dictionaryWithCapacity:[newRows count]];
+  NSMutableArray* added   = [NSMutableArray array];
+  NSMutableArray* changed = [NSMutableArray array];
+  NSMutableArray* removed = [NSMutableArray array];
+
+  NSDictionary* row;
+  for (int i = 0; i < [newRows count]; i++) {
+    row = [newRows objectAtIndex:i];
+    id key = [row objectForKey:keyColumn];
+    if (key == nil) {
+      continue;
+    }
+    key = [key description];
+    [index setObject:row forKey:key];
+
+    NSDictionary* oldRow = [rowsByKey objectForKey:key];
+    if (oldRow == nil) {
+      [added addObject:row];
+    } else if (![oldRow isEqual:row]) {
+      [changed addObject:row];
+    }
+  }
+
+  NSEnumerator* enumerator = [rowsByKey keyEnumerator];
+  NSString* key;
+  while ((key = [enumerator nextObject])) {
+    if ([index objectForKey:key] == nil) {
+      [removed addObject:[rowsByKey objectForKey:key]];
+    }
+  }
+
+  NSDictionary* delta = [NSDictionary dictionaryWithObjectsAndKeys:
+                         digest,  kDeltaDigestKey,
+                         newRows, kDeltaRowsKey,
+                         index,   kDeltaIndexKey,
+                         added,   kDeltaAddedKey,
+                         removed, kDeltaRemovedKey,
+                         changed, kDeltaChangedKey,
+                         nil];
+  [self postDelta:delta];
+  [pool release];
+}
+
+- (void)postDelta:(NSDictionary*)delta
+{
+  if (deliversOnMainThread) {
+    [self performSelectorOnMainThread:@selector(deliverDelta:)
+                           withObject:delta
+                        waitUntilDone:NO];
+  } else {
+    [[FBNetworkThread sharedThread] performSelector:@selector(deliverDelta:)
+                                             target:self
+                                         withObject:delta];
+  }
+}
+
+- (void)deliverDelta:(NSDictionary*)delta
+{
+  isDiffing = NO;
+  if (isCancelled || delta == nil) {
+    return;
+  }
+
+  [resultDigest release];
+  [rows         release];
+  [rowsByKey    release];
+  [addedRows    release];
+  [removedRows  release];
+  [changedRows  release];
+
+  resultDigest = [[delta objectForKey:kDeltaDigestKey]  retain];
+  rows         = [[delta objectForKey:kDeltaRowsKey]    retain];
+  rowsByKey    = [[delta objectForKey:kDeltaIndexKey]   retain];
+  addedRows    = [[delta objectForKey:kDeltaAddedKey]   retain];
+  removedRows  = [[delta objectForKey:kDeltaRemovedKey] retain];
+  changedRows  = [[delta objectForKey:kDeltaChangedKey] retain];
+
+  // a different digest with identical keyed rows is not worth a callback
+  if ([addedRows count] == 0 && [removedRows count] == 0 && [changedRows count] == 0) {
+    return;
+  }
+  [self setError:nil];
+  [self success:rows];
+}
+
+- (NSString*)description {
+  return query;
+}
+
+@end
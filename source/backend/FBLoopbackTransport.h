@@ -0,0 +1,76 @@
+//
+//  FBLoopbackTransport.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#import "FBTransport.h"
+
+@class FBLoopbackTransport;
+
+
+/*!
+ * @protocol FBLoopbackResponder
+ * Generates responses for a loopback transport. Return an NSString to be sent
+ * as the raw response body, or any other object to be sent as its JSON
+ * representation. Returning nil responds with an unknown method error.
+ */
+@protocol FBLoopbackResponder <NSObject>
+
+- (id)loopbackTransport:(FBLoopbackTransport*)transport
+      responseForMethod:(NSString*)method
+              arguments:(NSDictionary*)arguments;
+
+@end
+
+
+/*!
+ * @class FBLoopbackTransport
+ *
+ * A transport which never touches the network. Each API method is answered
+ * from a canned response or by a responder, after an optional latency, on the
+ * current run loop. batch.run is unpacked and each method in its method_feed
+ * answered in turn, so batches behave as they would against Facebook.
+ *
+ * Arguments are read from the query string; multipart POST requests (file
+ * uploads) are answered as though they had no arguments.
+ */
+@interface FBLoopbackTransport : NSObject <FBTransport> {
+  NSMutableDictionary*   responses;
+  id<FBLoopbackResponder> responder;
+  NSTimeInterval         latency;
+  BOOL                   compressesResponses;
+  unsigned long          requestCount;
+}
+
+/*!
+ * Answers every call to method with response.
+ */
+- (void)setResponse:(id)response forMethod:(NSString*)method;
+
+/*!
+ * Asked for methods which have no canned response. Not retained.
+ */
+- (void)setResponder:(id<FBLoopbackResponder>)aResponder;
+
+/*!
+ * Seconds to wait before answering each request, 0 by default.
+ */
+- (void)setLatency:(NSTimeInterval)seconds;
+- (NSTimeInterval)latency;
+
+/*!
+ * When set, responses to requests which accept gzip are sent gzipped and
+ * delivered in pieces, as they would arrive from a compressing server.
+ */
+- (void)setCompressesResponses:(BOOL)compress;
+- (BOOL)compressesResponses;
+
+/*!
+ * The number of HTTP requests answered so far.
+ */
+- (unsigned long)requestCount;
+
+@end
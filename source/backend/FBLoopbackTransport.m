@@ -0,0 +1,334 @@
+//
+//  FBLoopbackTransport.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBLoopbackTransport.h"
+#import "FBCocoa.h"
+#import "JSON.h"
+#import "NSData+.h"
+#import "NSString+.h"
+
+// compressed responses are delivered in pieces of this size
+#define kLoopbackChunkSize 16384
+
+
+@interface FBLoopbackTransport (Internal)
+
+- (id<FBTransportConnection>)connectionWithURL:(NSURL*)url
+                                          body:(NSData*)body
+                               contentEncoding:(NSString*)encoding
+                                         error:(NSError*)error
+                                      delegate:(id)delegate
+                                    afterDelay:(NSTimeInterval)delay;
+
+@end
+
+@interface FBLoopbackTransport (Private)
+
+- (NSString*)responseForMethod:(NSString*)method
+                     arguments:(NSDictionary*)args;
+
+- (NSString*)responseForBatch:(NSDictionary*)args;
+
+@end
+
+
+/*
+ * NSHTTPURLResponse can't be created with headers before 10.7.
+ */
+@interface FBLoopbackResponse : NSHTTPURLResponse {
+  NSDictionary* headers;
+}
+
+- (id)initWithURL:(NSURL*)aURL
+             body:(NSData*)body
+  contentEncoding:(NSString*)encoding;
+
+@end
+
+
+/*
+ * A request waiting to be answered by the loopback transport, or failed if
+ * it has an error.
+ */
+@interface FBLoopbackConnection : NSObject <FBTransportConnection> {
+  NSURL*    url;
+  NSData*   body;
+  NSString* contentEncoding;
+  NSError*  error;
+  id        delegate;
+}
+
+- (id)initWithURL:(NSURL*)aURL
+             body:(NSData*)aBody
+  contentEncoding:(NSString*)encoding
+            error:(NSError*)anError
+         delegate:(id)aDelegate;
+
+- (void)deliver;
+
+@end
+
+
+@implementation FBLoopbackTransport
+
+- (id)init
+{
+  if (self = [super init]) {
+    responses = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [responses release];
+  [super dealloc];
+}
+
+- (void)setResponse:(id)response forMethod:(NSString*)method
+{
+  if (response) {
+    [responses setObject:response forKey:[method lowercaseString]];
+  } else {
+    [responses removeObjectForKey:[method lowercaseString]];
+  }
+}
+
+- (void)setResponder:(id<FBLoopbackResponder>)aResponder
+{
+  responder = aResponder;
+}
+
+- (void)setLatency:(NSTimeInterval)seconds
+{
+  latency = seconds;
+}
+
+- (NSTimeInterval)latency
+{
+  return latency;
+}
+
+- (void)setCompressesResponses:(BOOL)compress
+{
+  compressesResponses = compress;
+}
+
+- (BOOL)compressesResponses
+{
+  return compressesResponses;
+}
+
+- (BOOL)decodesContentEncoding
+{
+  return NO;
+}
+
+- (unsigned long)requestCount
+{
+  return requestCount;
+}
+
+- (id<FBTransportConnection>)connectionWithRequest:(NSURLRequest*)request
+                                          delegate:(id)delegate
+{
+  requestCount++;
+
+  NSDictionary* args = [[[request URL] query] urlDecodeArguments];
+  NSString* method = [args objectForKey:@"method"];
+  NSString* response;
+  if ([[method lowercaseString] isEqualToString:@"batch.run"]) {
+    response = [self responseForBatch:args];
+  } else {
+    response = [self responseForMethod:method arguments:args];
+  }
+
+  NSData* body = [response dataUsingEncoding:NSUTF8StringEncoding];
+  NSString* encoding = nil;
+  NSString* accepted = [request valueForHTTPHeaderField:@"Accept-Encoding"];
+  if (compressesResponses && accepted && [accepted containsString:@"gzip"]) {
+    body = [body gzipData];
+    encoding = @"gzip";
+  }
+
+  return [self connectionWithURL:[request URL]
+                            body:body
+                 contentEncoding:encoding
+                           error:nil
+                        delegate:delegate
+                      afterDelay:latency];
+}
+
+- (id<FBTransportConnection>)connectionWithURL:(NSURL*)url
+                                          body:(NSData*)body
+                               contentEncoding:(NSString*)encoding
+                                         error:(NSError*)error
+                                      delegate:(id)delegate
+                                    afterDelay:(NSTimeInterval)delay
+{
+  FBLoopbackConnection* conn =
+    [[FBLoopbackConnection alloc] initWithURL:url
+                                         body:body
+                              contentEncoding:encoding
+                                        error:error
+                                     delegate:delegate];
+  [conn performSelector:@selector(deliver) withObject:nil afterDelay:delay];
+  return [conn autorelease];
+}
+
+#pragma mark Private Methods
+- (NSString*)responseForMethod:(NSString*)method
+                     arguments:(NSDictionary*)args
+{
+  id response = nil;
+  if (method) {
+    response = [responses objectForKey:[method lowercaseString]];
+    if (response == nil) {
+      response = [responder loopbackTransport:self
+                            responseForMethod:method
+                                    arguments:args];
+    }
+  }
+
+  if (response == nil) {
+    response = [NSDictionary dictionaryWithObjectsAndKeys:
+                [NSNumber numberWithInt:FBAPIMethodError], @"error_code",
+                @"Unknown method", @"error_msg",
+                nil];
+  }
+
+  if ([response isKindOfClass:[NSString class]]) {
+    return response;
+  }
+  return [response JSONFragment];
+}
+
+- (NSString*)responseForBatch:(NSDictionary*)args
+{
+  NSArray* feed = [[args objectForKey:@"method_feed"] JSONValue];
+  NSMutableArray* results = [NSMutableArray arrayWithCapacity:[feed count]];
+  for (int i = 0; i < [feed count]; i++) {
+    NSDictionary* subArgs = [[feed objectAtIndex:i] urlDecodeArguments];
+    [results addObject:[self responseForMethod:[subArgs objectForKey:@"method"]
+                                     arguments:subArgs]];
+  }
+  return [results JSONRepresentation];
+}
+
+@end
+
+
+@implementation FBLoopbackResponse
+
+- (id)initWithURL:(NSURL*)aURL
+             body:(NSData*)body
+  contentEncoding:(NSString*)encoding
+{
+  if (self = [super initWithURL:aURL
+                       MIMEType:@"application/json"
+          expectedContentLength:[body length]
+               textEncodingName:@"utf-8"]) {
+    NSMutableDictionary* fields = [NSMutableDictionary dictionary];
+    [fields setObject:@"application/json; charset=utf-8" forKey:@"Content-Type"];
+    [fields setObject:[NSString stringWithFormat:@"%lu", (unsigned long)[body length]]
+               forKey:@"Content-Length"];
+    if (encoding) {
+      [fields setObject:encoding forKey:@"Content-Encoding"];
+    }
+    headers = [fields retain];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [headers release];
+  [super dealloc];
+}
+
+- (NSInteger)statusCode
+{
+  return 200;
+}
+
+- (NSDictionary*)allHeaderFields
+{
+  return headers;
+}
+
+@end
+
+
+@implementation FBLoopbackConnection
+
+- (id)initWithURL:(NSURL*)aURL
+             body:(NSData*)aBody
+  contentEncoding:(NSString*)encoding
+            error:(NSError*)anError
+         delegate:(id)aDelegate
+{
+  if (self = [super init]) {
+    url             = [aURL retain];
+    body            = [aBody retain];
+    contentEncoding = [encoding retain];
+    error           = [anError retain];
+    delegate        = [aDelegate retain];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [url             release];
+  [body            release];
+  [contentEncoding release];
+  [error           release];
+  [delegate        release];
+  [super dealloc];
+}
+
+- (void)cancel
+{
+  [NSObject cancelPreviousPerformRequestsWithTarget:self];
+  [delegate release];
+  delegate = nil;
+}
+
+- (void)deliver
+{
+  // the delegate may cancel us from any of its callbacks
+  [[self retain] autorelease];
+
+  if (error) {
+    id target = [[delegate retain] autorelease];
+    [delegate release];
+    delegate = nil;
+    [target connection:self didFailWithError:error];
+    return;
+  }
+
+  if ([delegate respondsToSelector:@selector(connection:didReceiveResponse:)]) {
+    FBLoopbackResponse* response = [[FBLoopbackResponse alloc] initWithURL:url
+                                                                      body:body
+                                                           contentEncoding:contentEncoding];
+    [delegate connection:self didReceiveResponse:response];
+    [response release];
+  }
+
+  NSUInteger chunkSize = contentEncoding ? kLoopbackChunkSize : [body length];
+  for (NSUInteger offset = 0; delegate && offset < [body length]; offset += chunkSize) {
+    NSRange range = NSMakeRange(offset, MIN(chunkSize, [body length] - offset));
+    [delegate connection:self didReceiveData:[body subdataWithRange:range]];
+  }
+
+  id target = [[delegate retain] autorelease];
+  [delegate release];
+  delegate = nil;
+  [target connectionDidFinishLoading:self];
+}
+
+@end
@@ -10,17 +10,46 @@
 #import "FBConnect.h"
 #import "FBCallback.h"
 #import "FBRequest.h"
+#import "FBTransport.h"
+
+@class FBInflater;
+@class FBProjection;
+@class FBRowSchema;
+@class FBResponseBuffer;
 
 
 @interface FBMethodRequest : FBCallback <FBRequest> {
   BOOL requestStarted;
   BOOL requestFinished;
+  BOOL isCancelled;
 
+  NSString* methodName;
+  NSDictionary* arguments;
   NSString* request;
   NSData* data;
-  NSMutableData* responseBuffer;
+  FBResponseBuffer* responseBuffer;
   FBConnect* parentConnect;
-  NSURLConnection* connection;
+  id<FBTransportConnection> connection;
+
+  FBInflater* inflater;
+  NSMutableData* inflateBuffer;
+  long long expectedWireByteCount;
+  unsigned long long wireByteCount;
+  unsigned long long decodedByteCount;
+
+  NSTimeInterval deadline;
+  NSTimeInterval startTime;
+  FBMethodRequest* hedge;
+  BOOL isHedge;
+
+  BOOL deliversOnMainThread;
+
+  FBProjection* projection;
+  FBProjection* parseProjection;
+  FBRowSchema* rowSchema;
+
+  NSString* sharedCacheKey;
+  NSString* sharedCachePartition;
 }
 
 + (FBMethodRequest*)requestWithRequest:(NSString*)requestString
@@ -28,11 +57,86 @@
                                 target:(id)tar
                               selector:(SEL)sel;
 
++ (FBMethodRequest*)requestWithMethod:(NSString*)method
+                            arguments:(NSDictionary*)args
+                               parent:(FBConnect*)parent
+                               target:(id)tar
+                             selector:(SEL)sel;
+
 + (FBMethodRequest*)requestWithData:(NSData*)postData
                              parent:(FBConnect*)parent
                              target:(id)tar
                            selector:(SEL)sel;
 
+/*!
+ * Sends the request on the network thread. The response is delivered on the
+ * main thread if the request was created there, otherwise on the network
+ * thread.
+ */
 - (void)start;
 
+/*!
+ * YES once the request has been answered, failed or been cancelled.
+ */
+- (BOOL)isFinished;
+
+/*!
+ * YES once cancel has been called. A request cancelled before it was sent,
+ * such as one in a batch not yet sent, never is.
+ */
+- (BOOL)isCancelled;
+
+/*!
+ * The HTTP request which -start hands to the parent's transport.
+ */
+- (NSURLRequest*)urlRequest;
+
+/*!
+ * The size of the response as it was sent, which is smaller than
+ * decodedByteCount when the server compressed it.
+ */
+- (unsigned long long)wireByteCount;
+
+/*!
+ * The size of the response handed to the JSON parser.
+ */
+- (unsigned long long)decodedByteCount;
+
+/*!
+ * The API method this request calls, if it was created with one.
+ */
+- (NSString*)method;
+
+/*!
+ * The arguments the method is called with, before being signed.
+ */
+- (NSDictionary*)arguments;
+
+/*!
+ * When set, only these parts of the response are parsed, with FBArenaParser,
+ * and the rest is skipped. Must be set before the request is started.
+ */
+- (void)setProjection:(FBProjection*)aProjection;
+- (FBProjection*)projection;
+
+/*!
+ * When set, the rows of an FQL response are decoded straight into objects
+ * of the schema's model class, and the response is an array of them. Unless
+ * a projection is set, only the schema's columns are parsed. Must be set
+ * before the request is started.
+ */
+- (void)setRowSchema:(FBRowSchema*)schema;
+- (FBRowSchema*)rowSchema;
+
+/*!
+ * YES if the request can be signed again and resent, which requires that it
+ * was created from a method and arguments rather than prebuilt post data.
+ */
+- (BOOL)canReplay;
+
+/*!
+ * Signs the request again with the parent's current session and sends it.
+ */
+- (void)replay;
+
 @end
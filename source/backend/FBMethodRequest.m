@@ -8,8 +8,20 @@
 
 #import "FBMethodRequest.h"
 #import "FBCocoa.h"
+#import "FBArenaParser.h"
 #import "FBConnect_Internal.h"
+#import "FBInflater.h"
+#import "FBLatencyTracker.h"
+#import "FBNetworkThread.h"
+#import "FBResponseBuffer.h"
+#import "FBRowSchema.h"
+#import "FBSharedResponseCache.h"
+#import "FBTracer.h"
 #import "JSON.h"
+#import "NSData+.h"
+
+// only compress uploads large enough to be worth it
+#define kMinCompressedUploadSize 4096
 
 
 @interface FBMethodRequest (Internal)
@@ -19,6 +31,12 @@
               target:(id)tar
             selector:(SEL)sel;
 
+- (id)initWithMethod:(NSString*)method
+           arguments:(NSDictionary*)args
+              parent:(FBConnect*)parent
+              target:(id)tar
+            selector:(SEL)sel;
+
 - (id)initWithData:(NSData*)postData
             parent:(FBConnect*)parent
             target:(id)tar
@@ -26,22 +44,72 @@
 
 - (void)evaluateResponse:(id)json;
 
+- (id)resultForUTF8String:(const char*)bytes;
+
+- (NSArray*)keyPathsForProjection:(FBProjection*)aProjection;
+
+- (BOOL)usesArenaParser;
+
+- (id)arenaResultForUTF8String:(const char*)bytes error:(NSError**)error;
+
+- (void)notifyTargetNow;
+
+- (void)setSharedCacheKey:(NSString*)key partition:(NSString*)partition;
+
+- (void)deliverCachedResponse:(id)json;
+
+- (void)markFinished;
+
+- (void)markCancelled;
+
 @end
 
 @interface FBMethodRequest (Private)
 
 - (NSError*)errorForResponse:(id)json;
 - (NSError*)errorForException:(NSException*)exception;
-- (void)finished;
+- (void)resetResponse;
+- (void)discardResponse;
+- (void)appendResponseData:(NSData*)aData;
+- (void)abortWithMessage:(NSString*)message;
+- (void)scheduleTimers;
+- (void)scheduleDeadline;
+- (void)deadlineChanged;
+- (void)cancelTimers;
+- (void)setIsHedge:(BOOL)hedging;
+- (id)resultForResponseBuffer:(FBResponseBuffer*)buffer;
+- (void)parseResponseBuffer:(FBResponseBuffer*)buffer;
+- (void)parsedResult:(id)result;
+- (void)completeWithResult:(id)result;
+- (void)deliverResult:(id)result;
 
 @end
 
 
 @interface FBConnect (FBRequestResults)
 
-- (void)failedQuery:(FBMethodRequest*)query
+- (BOOL)failedQuery:(FBMethodRequest*)query
           withError:(NSError*)err;
 
+- (BOOL)shouldParkQuery:(FBMethodRequest*)query;
+
+- (BOOL)cancelledQuery:(FBMethodRequest*)query;
+
+- (void)completedRequest:(id<FBRequest>)request;
+
+- (void)receivedWireBytes:(unsigned long long)wire
+             decodedBytes:(unsigned long long)decoded;
+
+- (BOOL)reserveResponseMemory:(NSUInteger)bytes;
+
+- (void)releaseResponseMemory:(NSUInteger)bytes;
+
+- (NSTimeInterval)hedgeDelayForRequest:(FBMethodRequest*)query;
+
+- (BOOL)spendHedgeToken;
+
+- (BOOL)queueCompletedRequest:(FBMethodRequest*)request;
+
 @end
 
 
@@ -58,6 +126,19 @@
                                           selector:sel] autorelease];
 }
 
++ (FBMethodRequest*)requestWithMethod:(NSString*)method
+                            arguments:(NSDictionary*)args
+                               parent:(FBConnect*)parent
+                               target:(id)tar
+                             selector:(SEL)sel
+{
+  return [[[self alloc] initWithMethod:method
+                             arguments:args
+                                parent:parent
+                                target:tar
+                              selector:sel] autorelease];
+}
+
 + (FBMethodRequest*)requestWithData:(NSData*)postData
                              parent:(FBConnect*)parent
                              target:(id)tar
@@ -79,7 +160,29 @@
     requestFinished = NO;
     parentConnect   = [parent retain];
     request         = [requestString retain];
-    responseBuffer  = [[NSMutableData alloc] init];
+    responseBuffer  = [[FBResponseBuffer alloc] init];
+    deliversOnMainThread = [NSThread isMainThread];
+    FB_TRACE(FBTraceQueued, self, nil, nil);
+  }
+  return self;
+}
+
+- (id)initWithMethod:(NSString*)method
+           arguments:(NSDictionary*)args
+              parent:(FBConnect*)parent
+              target:(id)tar
+            selector:(SEL)sel
+{
+  FB_TRACE_START(signing);
+  NSString* requestString = [parent getRequestStringForMethod:method
+                                                    arguments:args];
+  if (self = [self initWithRequest:requestString
+                            parent:parent
+                            target:tar
+                          selector:sel]) {
+    methodName = [method retain];
+    arguments  = [args retain];
+    FB_TRACE_SPAN(FBTraceSigned, self, nil, method, signing);
   }
   return self;
 }
@@ -94,24 +197,52 @@
     requestFinished = NO;
     parentConnect   = [parent retain];
     data            = [postData retain];
-    responseBuffer  = [[NSMutableData alloc] init];
+    responseBuffer  = [[FBResponseBuffer alloc] init];
+    deliversOnMainThread = [NSThread isMainThread];
+    FB_TRACE(FBTraceQueued, self, nil, nil);
   }
   return self;
 }
 
 - (void)dealloc
 {
+  [self discardResponse];
+
+  [methodName release];
+  [arguments release];
   [request release];
   [data release];
   [responseBuffer release];
   [parentConnect release];
   [connection release];
+  [inflater release];
+  [inflateBuffer release];
+  [hedge release];
+  if (isHedge) {
+    [target release];
+  }
+  [projection release];
+  [parseProjection release];
+  [rowSchema release];
+  [sharedCacheKey release];
+  [sharedCachePartition release];
 
   [super dealloc];
 }
 
 - (void)start
 {
+  // everything which touches the connection happens on the network thread
+  FBNetworkThread* networkThread = [FBNetworkThread sharedThread];
+  if (![networkThread isCurrentThread]) {
+    [networkThread performSelector:@selector(start) target:self withObject:nil];
+    return;
+  }
+
+  if (isCancelled) {
+    // cancelled on its way here, it's answered by -cancel
+    return;
+  }
   if (requestStarted) {
     NSLog(@"can't start the same request twice");
     return;
@@ -119,62 +250,206 @@
   requestStarted = YES;
   [self retain];
   @try {
-    NSURL* url;
-    if (request) {
-      url = [NSURL URLWithString:[NSString stringWithFormat:@"%@?%@", [parentConnect restURL], request]];
-    } else {
-      url = [NSURL URLWithString:[parentConnect restURL]];
-    }
-
-    #ifdef NSURLRequestReloadIgnoringLocalCacheData
-      NSURLRequestCachePolicy policy = NSURLRequestReloadIgnoringLocalCacheData;
-    #else
-      NSURLRequestCachePolicy policy = NSURLRequestUseProtocolCachePolicy;
-    #endif
-
-    NSMutableURLRequest* req = [NSMutableURLRequest requestWithURL:url
-                                                       cachePolicy:policy
-                                                   timeoutInterval:kRequestTimeout];
-    if (data) {
-      [req setHTTPBody:data];
-      [req setHTTPMethod:@"POST"];
-      NSString* contentType =
-        [NSString stringWithFormat:@"multipart/form-data; boundary=%@",
-                                   kPostFormDataBoundary];
-      [req addValue:contentType forHTTPHeaderField:@"Content-Type"];
-    } else {
-      [req setHTTPMethod:@"GET"];
-      [req addValue:@"application/x-www-form-urlencoded" forHTTPHeaderField:@"Content-type"];
-    }
-    [req setValue:@"FBConnect/0.3 (OS X)" forHTTPHeaderField:@"User-Agent"];
-
     if (connection) {
       [connection cancel];
       [connection release];
       connection = nil;
     }
-    connection = [[NSURLConnection alloc] initWithRequest:req delegate:self];
+    FB_TRACE_START(sending);
+    connection = [[[parentConnect transport] connectionWithRequest:[self urlRequest]
+                                                          delegate:self] retain];
+    startTime = [NSDate timeIntervalSinceReferenceDate];
+    FB_TRACE_SPAN(FBTraceSent, self, nil, methodName, sending);
+    [self scheduleTimers];
   } @catch (NSException* exception) {
-    [self failure:[self errorForException:exception]];
-    [self finished];
+    [self completeWithResult:[self errorForException:exception]];
   }
 }
 
-- (void)finished
+- (NSURLRequest*)urlRequest
 {
-  requestFinished = YES;
+  NSURL* url;
+  if (request) {
+    url = [NSURL URLWithString:[NSString stringWithFormat:@"%@?%@", [parentConnect restURL], request]];
+  } else {
+    url = [NSURL URLWithString:[parentConnect restURL]];
+  }
 
-  // peace!
-  [self release];
+  #ifdef NSURLRequestReloadIgnoringLocalCacheData
+    NSURLRequestCachePolicy policy = NSURLRequestReloadIgnoringLocalCacheData;
+  #else
+    NSURLRequestCachePolicy policy = NSURLRequestUseProtocolCachePolicy;
+  #endif
+
+  NSTimeInterval timeout = kRequestTimeout;
+  if (deadline > 0) {
+    timeout = MIN(deadline, timeout);
+  }
+
+  NSMutableURLRequest* req = [NSMutableURLRequest requestWithURL:url
+                                                     cachePolicy:policy
+                                                 timeoutInterval:timeout];
+  if (data) {
+    NSData* body = nil;
+    if ([parentConnect compressesUploads] && [data length] >= kMinCompressedUploadSize) {
+      body = [data gzipData];
+    }
+    if (body) {
+      [req setValue:@"gzip" forHTTPHeaderField:@"Content-Encoding"];
+    } else {
+      body = data;
+    }
+    [req setHTTPBody:body];
+    [req setHTTPMethod:@"POST"];
+    NSString* contentType =
+      [NSString stringWithFormat:@"multipart/form-data; boundary=%@",
+                                 kPostFormDataBoundary];
+    [req addValue:contentType forHTTPHeaderField:@"Content-Type"];
+  } else {
+    [req setHTTPMethod:@"GET"];
+    [req addValue:@"application/x-www-form-urlencoded" forHTTPHeaderField:@"Content-type"];
+  }
+  [req setValue:@"FBConnect/0.3 (OS X)" forHTTPHeaderField:@"User-Agent"];
+  [req setValue:@"gzip, deflate" forHTTPHeaderField:@"Accept-Encoding"];
+  return req;
 }
 
 - (void)retry
 {
+  FBNetworkThread* networkThread = [FBNetworkThread sharedThread];
+  if (![networkThread isCurrentThread]) {
+    [networkThread performSelector:@selector(retry) target:self withObject:nil];
+    return;
+  }
+
   // if it hasn't started, it's probably part of a batch or something, don't retry!
   if (!requestStarted) {
     return;
   }
 
+  requestStarted  = NO;
+  requestFinished = NO;
+  [self resetResponse];
+  [self start];
+}
+
+- (void)setDeadline:(NSTimeInterval)seconds
+{
+  deadline = seconds;
+
+  // usually set just after the request was sent
+  FBNetworkThread* networkThread = [FBNetworkThread sharedThread];
+  if (![networkThread isCurrentThread]) {
+    [networkThread performSelector:@selector(deadlineChanged) target:self withObject:nil];
+  } else {
+    [self deadlineChanged];
+  }
+}
+
+- (NSTimeInterval)deadline
+{
+  return deadline;
+}
+
+- (unsigned long long)wireByteCount
+{
+  return wireByteCount;
+}
+
+- (unsigned long long)decodedByteCount
+{
+  return decodedByteCount;
+}
+
+- (BOOL)isFinished
+{
+  return requestFinished;
+}
+
+- (BOOL)isCancelled
+{
+  return isCancelled;
+}
+
+- (NSString*)method
+{
+  return methodName;
+}
+
+- (NSDictionary*)arguments
+{
+  return arguments;
+}
+
+- (void)setProjection:(FBProjection*)aProjection
+{
+  [aProjection retain];
+  [projection release];
+  projection = aProjection;
+
+  // errors have to be recognisable whatever was asked for
+  [parseProjection release];
+  parseProjection = nil;
+  if (projection) {
+    NSArray* errorKeys = [NSArray arrayWithObjects:@"error_code", @"error_msg", nil];
+    NSArray* keyPaths = [[self keyPathsForProjection:projection] arrayByAddingObjectsFromArray:errorKeys];
+    parseProjection = [[FBProjection alloc] initWithKeyPaths:keyPaths];
+  }
+}
+
+- (FBProjection*)projection
+{
+  return projection;
+}
+
+- (void)setRowSchema:(FBRowSchema*)schema
+{
+  [schema retain];
+  [rowSchema release];
+  rowSchema = schema;
+
+  if (projection == nil) {
+    [self setProjection:[rowSchema projection]];
+  }
+}
+
+- (FBRowSchema*)rowSchema
+{
+  return rowSchema;
+}
+
+- (BOOL)canReplay
+{
+  return methodName != nil && data == nil;
+}
+
+- (void)replay
+{
+  if (![self canReplay]) {
+    return;
+  }
+
+  FBNetworkThread* networkThread = [FBNetworkThread sharedThread];
+  if (![networkThread isCurrentThread]) {
+    [networkThread performSelector:@selector(replay) target:self withObject:nil];
+    return;
+  }
+
+  if (isCancelled) {
+    // one that was never sent is answered by cancel, but one parked after
+    // its answer came back was cancelled too late to be taken off the list
+    if (requestStarted) {
+      [self retain];
+      [self abortWithMessage:@"Request Cancelled"];
+    }
+    return;
+  }
+
+  [request release];
+  request = [[parentConnect getRequestStringForMethod:methodName
+                                            arguments:arguments] retain];
+  [self setError:nil];
+  [self resetResponse];
   requestStarted  = NO;
   requestFinished = NO;
   [self start];
@@ -182,48 +457,133 @@
 
 - (void)cancel
 {
+  // noted straight away, under the connect's lock, so a start already on
+  // its way to the network thread sends nothing and a parked request is
+  // answered exactly once
+  if (!isCancelled && [parentConnect cancelledQuery:self]) {
+    // parked for a new session, nothing else will answer it now
+    [self retain];
+    [[FBNetworkThread sharedThread] performSelector:@selector(abortWithMessage:)
+                                             target:self
+                                         withObject:@"Request Cancelled"];
+    return;
+  }
+  isCancelled = YES;
+
+  FBNetworkThread* networkThread = [FBNetworkThread sharedThread];
+  if (![networkThread isCurrentThread]) {
+    [networkThread performSelector:@selector(cancel) target:self withObject:nil];
+    return;
+  }
+
   // if we've already finished, it's too late.
   if (requestFinished) {
     return;
   }
 
+  if (!requestStarted) {
+    // released once delivered, as though it had been sent
+    [self retain];
+  }
   [connection cancel];
-  [self failure:[NSError errorWithDomain:kFBErrorDomainKey
-                                    code:FBAPIUnknownError
-                                userInfo:[NSDictionary dictionaryWithObject:@"Request Cancelled"
-                                                                     forKey:kFBErrorMessageKey]]];
-  requestFinished = YES;
-  [self finished];
+  [self completeWithResult:[NSError errorWithDomain:kFBErrorDomainKey
+                                               code:FBAPIUnknownError
+                                           userInfo:[NSDictionary dictionaryWithObject:@"Request Cancelled"
+                                                                                forKey:kFBErrorMessageKey]]];
 }
 
-- (void)connection:(NSURLConnection*)connection didReceiveData:(NSData*)aData
+- (void)connection:(id)conn didReceiveResponse:(NSURLResponse*)response
 {
-  [responseBuffer appendData:aData];
+  // sent again after a redirect, start over
+  [self resetResponse];
+
+  if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+    return;
+  }
+
+  NSString* encoding = [[(NSHTTPURLResponse*)response allHeaderFields] objectForKey:@"Content-Encoding"];
+  encoding = [encoding lowercaseString];
+  if (![encoding isEqualToString:@"gzip"] && ![encoding isEqualToString:@"deflate"]) {
+    return;
+  }
+
+  if ([[parentConnect transport] decodesContentEncoding]) {
+    // we only see the decoded bytes, take the wire size from the headers
+    expectedWireByteCount = [response expectedContentLength];
+  } else {
+    inflater = [[FBInflater alloc] init];
+  }
 }
 
-- (void)connectionDidFinishLoading:(NSURLConnection*)connection
+- (void)connection:(id)conn didReceiveData:(NSData*)aData
 {
-  NSString* jsonString = [[NSString alloc] initWithData:responseBuffer encoding:NSUTF8StringEncoding];
-  SBJsonParser* jsonParser = [SBJsonParser new];
-  id json = [jsonParser fragmentWithString:jsonString];
-  [jsonString release];
-  if (!json) {
-    NSError* jsonError = [NSString stringWithFormat:@"JSON Parsing error: %@", [jsonParser errorTrace]];
-    [self failure:[NSError errorWithDomain:kFBErrorDomainKey
-                                      code:FBAPIUnknownError
-                                  userInfo:[NSDictionary dictionaryWithObject:jsonError
-                                                                       forKey:kFBErrorMessageKey]]];
-  } else {
-    [self evaluateResponse:json];
+  if (requestFinished) {
+    return;
   }
-  [jsonParser release];
 
-  // peace!
-  [self finished];
+  if (wireByteCount == 0) {
+    FB_TRACE(FBTraceFirstByte, self, nil, nil);
+  }
+  wireByteCount += [aData length];
+  if (inflater == nil) {
+    [self appendResponseData:aData];
+    return;
+  }
+
+  if (inflateBuffer == nil) {
+    inflateBuffer = [[NSMutableData alloc] init];
+  }
+  [inflateBuffer setLength:0];
+  if (![inflater inflateData:aData intoBuffer:inflateBuffer]) {
+    [self abortWithMessage:@"Could not decompress response"];
+    return;
+  }
+  [self appendResponseData:inflateBuffer];
+}
+
+- (void)connectionDidFinishLoading:(id)conn
+{
+  if (requestFinished) {
+    return;
+  }
+
+  if (expectedWireByteCount > 0) {
+    wireByteCount = expectedWireByteCount;
+  }
+  decodedByteCount = [responseBuffer length];
+  [parentConnect receivedWireBytes:wireByteCount decodedBytes:decodedByteCount];
+  [[parentConnect latencyTracker] recordLatency:[NSDate timeIntervalSinceReferenceDate] - startTime
+                                      forMethod:methodName];
+  [inflater release];
+  inflater = nil;
+  [inflateBuffer release];
+  inflateBuffer = nil;
+
+  NSOperationQueue* parserQueue = [parentConnect parserQueue];
+  if (parserQueue) {
+    // the parser takes the body, we may still be cancelled meanwhile
+    FBResponseBuffer* body = responseBuffer;
+    responseBuffer = [[FBResponseBuffer alloc] init];
+    NSInvocationOperation* operation =
+      [[NSInvocationOperation alloc] initWithTarget:self
+                                           selector:@selector(parseResponseBuffer:)
+                                             object:body];
+    [parserQueue addOperation:operation];
+    [operation release];
+    [body release];
+    return;
+  }
+
+  [self completeWithResult:[self resultForResponseBuffer:responseBuffer]];
 }
 
 - (void)evaluateResponse:(id)json
 {
+  if ([parentConnect shouldParkQuery:self]) {
+    // this result came from an unvalidated session, it will be replayed
+    return;
+  }
+
   if (json == nil ||
       ([json isKindOfClass:[NSDictionary class]] &&
        [json objectForKey:@"error_code"] != nil) ||
@@ -231,23 +591,355 @@
     ) {
     [self failure:[self errorForResponse:json]];
   } else {
+    if (sharedCacheKey) {
+      [[parentConnect sharedResponseCache] setResponse:json
+                                                forKey:sharedCacheKey
+                                             partition:sharedCachePartition];
+    }
     [self success:json];
   }
 }
 
-- (void)connection:(NSURLConnection*)connection didFailWithError:(NSError*)err
+- (void)setSharedCacheKey:(NSString*)key partition:(NSString*)partition
+{
+  [key retain];
+  [sharedCacheKey release];
+  sharedCacheKey = key;
+  [partition retain];
+  [sharedCachePartition release];
+  sharedCachePartition = partition;
+}
+
+- (void)markFinished
+{
+  requestFinished = YES;
+}
+
+- (void)markCancelled
+{
+  isCancelled = YES;
+}
+
+- (void)deliverCachedResponse:(id)json
+{
+  requestStarted  = YES;
+  requestFinished = YES;
+
+  // released once delivered, as though it had been sent
+  [self retain];
+  if (deliversOnMainThread) {
+    [self performSelectorOnMainThread:@selector(deliverResult:)
+                           withObject:json
+                        waitUntilDone:NO];
+  } else {
+    [[FBNetworkThread sharedThread] performSelector:@selector(deliverResult:)
+                                             target:self
+                                         withObject:json];
+  }
+}
+
+- (id)resultForUTF8String:(const char*)bytes
 {
-  [self failure:err];
-  [self finished];
+  if (isHedge) {
+    // parsed just as the original would parse its own response
+    return [target resultForUTF8String:bytes];
+  }
+
+  id json;
+  NSString* jsonError = nil;
+  if ([self usesArenaParser]) {
+    NSError* parseError = nil;
+    json = [self arenaResultForUTF8String:bytes error:&parseError];
+    if (!json) {
+      jsonError = [NSString stringWithFormat:@"JSON Parsing error: %@", [parseError localizedDescription]];
+    }
+  } else {
+    SBJsonParser* jsonParser = [SBJsonParser new];
+    json = [jsonParser fragmentWithUTF8String:bytes];
+    if (!json) {
+      jsonError = [NSString stringWithFormat:@"JSON Parsing error: %@", [jsonParser errorTrace]];
+    }
+    [jsonParser release];
+  }
+
+  if (!json) {
+    json = [NSError errorWithDomain:kFBErrorDomainKey
+                               code:FBAPIUnknownError
+                           userInfo:[NSDictionary dictionaryWithObject:jsonError
+                                                                forKey:kFBErrorMessageKey]];
+  }
+  return json;
+}
+
+- (NSArray*)keyPathsForProjection:(FBProjection*)aProjection
+{
+  return [aProjection keyPaths];
+}
+
+- (BOOL)usesArenaParser
+{
+  return parseProjection || rowSchema || [parentConnect usesArenaParsing];
+}
+
+- (id)arenaResultForUTF8String:(const char*)bytes error:(NSError**)error
+{
+  if (rowSchema) {
+    return [rowSchema resultWithUTF8String:bytes projection:parseProjection error:error];
+  }
+  return [FBArenaParser objectWithUTF8String:bytes projection:parseProjection error:error];
+}
+
+- (void)connection:(id)conn didFailWithError:(NSError*)err
+{
+  if (requestFinished) {
+    return;
+  }
+  [self completeWithResult:err];
 }
 
 - (void)failure:(NSError*)err
 {
-  [parentConnect failedQuery:self withError:err];
+  if (!isHedge && [parentConnect failedQuery:self withError:err]) {
+    // the connect is renewing the session and will replay us afterwards
+    return;
+  }
   [super failure:err];
 }
 
+- (void)notifyTarget
+{
+  // with coalesced completions, the connect calls the target back later
+  if (deliversOnMainThread && [NSThread isMainThread] &&
+      [parentConnect queueCompletedRequest:self]) {
+    return;
+  }
+  [self notifyTargetNow];
+}
+
+- (void)notifyTargetNow
+{
+  // out of its group first, however it was answered, batched or not
+  [parentConnect completedRequest:self];
+  [super notifyTarget];
+}
+
+#pragma mark Callbacks
+- (void)deadlineExpired
+{
+  if (requestFinished) {
+    return;
+  }
+  [self abortWithMessage:@"Request deadline exceeded"];
+}
+
+- (void)sendHedge
+{
+  if (requestFinished || hedge || ![parentConnect spendHedgeToken]) {
+    return;
+  }
+
+  // a plain request, so the response comes back to us untouched
+  hedge = [[FBMethodRequest alloc] initWithMethod:methodName
+                                        arguments:arguments
+                                           parent:parentConnect
+                                           target:self
+                                         selector:@selector(hedgeCompleted:)];
+  [hedge setIsHedge:YES];
+  FB_TRACE(FBTraceLinked, hedge, self, nil);
+  [hedge start];
+}
+
+- (void)hedgeCompleted:(FBMethodRequest*)req
+{
+  // if the hedge failed, the original may still succeed
+  if (req != hedge || requestFinished || [req error]) {
+    return;
+  }
+
+  // we took at least this long
+  [[parentConnect latencyTracker] recordLatency:[NSDate timeIntervalSinceReferenceDate] - startTime
+                                      forMethod:methodName];
+
+  // the hedge is still finishing up, don't cancel it under itself
+  [hedge autorelease];
+  hedge = nil;
+
+  [connection cancel];
+  [self completeWithResult:[req response]];
+}
+
 #pragma mark Private Methods
+- (void)scheduleTimers
+{
+  [self cancelTimers];
+  [self scheduleDeadline];
+
+  if (!isHedge && [self canReplay]) {
+    NSTimeInterval hedgeDelay = [parentConnect hedgeDelayForRequest:self];
+    if (hedgeDelay > 0) {
+      [self performSelector:@selector(sendHedge) withObject:nil afterDelay:hedgeDelay];
+    }
+  }
+}
+
+- (void)deadlineChanged
+{
+  if (requestStarted && !requestFinished) {
+    [self scheduleDeadline];
+  }
+}
+
+- (void)scheduleDeadline
+{
+  [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                           selector:@selector(deadlineExpired)
+                                             object:nil];
+  if (deadline > 0) {
+    NSTimeInterval elapsed = [NSDate timeIntervalSinceReferenceDate] - startTime;
+    [self performSelector:@selector(deadlineExpired)
+               withObject:nil
+               afterDelay:MAX(0.0, deadline - elapsed)];
+  }
+}
+
+- (void)cancelTimers
+{
+  [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                           selector:@selector(deadlineExpired)
+                                             object:nil];
+  [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                           selector:@selector(sendHedge)
+                                             object:nil];
+}
+
+- (void)setIsHedge:(BOOL)hedging
+{
+  // a hedge parses with its original's settings, which has to outlive it
+  if (hedging && !isHedge) {
+    [target retain];
+  }
+  isHedge = hedging;
+}
+
+- (void)resetResponse
+{
+  [self discardResponse];
+  [inflater release];
+  inflater              = nil;
+  expectedWireByteCount = 0;
+  wireByteCount         = 0;
+  decodedByteCount      = 0;
+}
+
+- (void)discardResponse
+{
+  [parentConnect releaseResponseMemory:[responseBuffer memoryUsage]];
+  [responseBuffer reset];
+}
+
+- (void)appendResponseData:(NSData*)aData
+{
+  unsigned long long maxSize = [parentConnect maxResponseSize];
+  if (maxSize > 0 && [responseBuffer length] + [aData length] > maxSize) {
+    [self abortWithMessage:[NSString stringWithFormat:@"Response is larger than the %llu byte limit", maxSize]];
+    return;
+  }
+
+  // past our own threshold, or with every other response using up the
+  // budget, keep the rest of this response on disk
+  if (![responseBuffer isOnDisk] &&
+      ([responseBuffer length] + [aData length] > [parentConnect responseMemoryThreshold] ||
+       ![parentConnect reserveResponseMemory:[aData length]])) {
+    NSUInteger held = [responseBuffer memoryUsage];
+    if (![responseBuffer spillToDisk]) {
+      [self abortWithMessage:@"Could not write response to disk"];
+      return;
+    }
+    [parentConnect releaseResponseMemory:held];
+  }
+
+  if (![responseBuffer appendData:aData]) {
+    [self abortWithMessage:@"Could not write response to disk"];
+  }
+}
+
+- (void)abortWithMessage:(NSString*)message
+{
+  [connection cancel];
+  [self completeWithResult:[NSError errorWithDomain:kFBErrorDomainKey
+                                               code:FBAPIUnknownError
+                                           userInfo:[NSDictionary dictionaryWithObject:message
+                                                                                forKey:kFBErrorMessageKey]]];
+}
+
+- (id)resultForResponseBuffer:(FBResponseBuffer*)buffer
+{
+  // parse straight from the buffer, which may be a mapped file
+  FB_TRACE_START(parsing);
+  id result = [self resultForUTF8String:[[buffer data] bytes]];
+  FB_TRACE_SPAN(FBTraceParsed, self, nil, methodName, parsing);
+  return result;
+}
+
+- (void)parseResponseBuffer:(FBResponseBuffer*)buffer
+{
+  if (isCancelled || requestFinished) {
+    // no one wants it any more, don't bother parsing it
+    [parentConnect releaseResponseMemory:[buffer memoryUsage]];
+    [buffer reset];
+    return;
+  }
+
+  id result = [self resultForResponseBuffer:buffer];
+  [parentConnect releaseResponseMemory:[buffer memoryUsage]];
+  [buffer reset];
+
+  [[FBNetworkThread sharedThread] performSelector:@selector(parsedResult:)
+                                           target:self
+                                       withObject:result];
+}
+
+- (void)parsedResult:(id)result
+{
+  // cancelled or timed out while being parsed
+  if (requestFinished) {
+    return;
+  }
+  [self completeWithResult:result];
+}
+
+- (void)completeWithResult:(id)result
+{
+  requestFinished = YES;
+  [self discardResponse];
+  [self cancelTimers];
+
+  // whichever finished first, the other isn't needed
+  [hedge cancel];
+  [hedge release];
+  hedge = nil;
+
+  if (deliversOnMainThread) {
+    [self performSelectorOnMainThread:@selector(deliverResult:)
+                           withObject:result
+                        waitUntilDone:NO];
+  } else {
+    [self deliverResult:result];
+  }
+}
+
+- (void)deliverResult:(id)result
+{
+  if ([result isKindOfClass:[NSError class]]) {
+    [self failure:result];
+  } else {
+    [self evaluateResponse:result];
+  }
+
+  // peace!
+  [self release];
+}
+
 - (NSError*)errorForResponse:(id)json
 {
   if (json == nil ||
@@ -10,11 +10,27 @@
 #import "FBMethodRequest.h"
 
 
-@interface FBMultiqueryRequest : FBMethodRequest
+/*!
+ * @class FBMultiqueryRequest
+ *
+ * A projection set on a multiquery applies to the rows of each query's
+ * result.
+ */
+@interface FBMultiqueryRequest : FBMethodRequest {
+  NSDictionary* rowSchemas;
+}
 
 + (FBMultiqueryRequest*)requestWithRequest:(NSString*)requestString
                                     parent:(FBConnect*)parent
                                     target:(id)tar
                                   selector:(SEL)sel;
 
+/*!
+ * FBRowSchemas by query name. The rows of those queries are decoded into
+ * model objects; other queries' rows are left as dictionaries. Must be set
+ * before the request is started.
+ */
+- (void)setRowSchemas:(NSDictionary*)schemas;
+- (NSDictionary*)rowSchemas;
+
 @end
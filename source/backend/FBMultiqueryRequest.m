@@ -7,6 +7,9 @@
 //
 
 #import "FBMultiqueryRequest.h"
+#import "FBArenaParser.h"
+#import "FBRowSchema.h"
+#import "FBTracer.h"
 
 
 @interface FBMultiqueryRequest (Private)
@@ -19,6 +22,17 @@
 @end
 
 
+@interface FBMethodRequest (Internal)
+
+- (NSArray*)keyPathsForProjection:(FBProjection*)aProjection;
+
+- (BOOL)usesArenaParser;
+
+- (id)arenaResultForUTF8String:(const char*)bytes error:(NSError**)error;
+
+@end
+
+
 @implementation FBMultiqueryRequest
 
 + (FBMultiqueryRequest*)requestWithRequest:(NSString*)requestString
@@ -32,9 +46,27 @@
                                               selector:sel] autorelease];
 }
 
+- (void)dealloc
+{
+  [rowSchemas release];
+  [super dealloc];
+}
+
+- (void)setRowSchemas:(NSDictionary*)schemas
+{
+  [rowSchemas release];
+  rowSchemas = [schemas copy];
+}
+
+- (NSDictionary*)rowSchemas
+{
+  return rowSchemas;
+}
+
 - (void)success:(id)json
 {
   // convert the json response into a dictionary
+  FB_TRACE_START(fanOut);
   NSMutableDictionary* multiqueryResponse = [[NSMutableDictionary alloc] init];
   NSDictionary* result;
   for (int i = 0; i < [json count]; i++) {
@@ -42,9 +74,37 @@
     [multiqueryResponse setObject:[result objectForKey:@"fql_result_set"]
                            forKey:[result objectForKey:@"name"]];
   }
+  FB_TRACE_SPAN(FBTraceFannedOut, self, nil, nil, fanOut);
 
   [super success:multiqueryResponse];
   [multiqueryResponse release];
 }
 
+- (NSArray*)keyPathsForProjection:(FBProjection*)aProjection
+{
+  // each query's rows are under fql_result_set, beside its name
+  NSArray* rowPaths = [aProjection keyPaths];
+  NSMutableArray* paths = [NSMutableArray arrayWithObject:@"name"];
+  for (int i = 0; i < [rowPaths count]; i++) {
+    [paths addObject:[@"fql_result_set." stringByAppendingString:[rowPaths objectAtIndex:i]]];
+  }
+  return paths;
+}
+
+- (BOOL)usesArenaParser
+{
+  return rowSchemas || [super usesArenaParser];
+}
+
+- (id)arenaResultForUTF8String:(const char*)bytes error:(NSError**)error
+{
+  if (rowSchemas) {
+    return [FBRowSchema multiqueryResultWithUTF8String:bytes
+                                               schemas:rowSchemas
+                                            projection:parseProjection
+                                                 error:error];
+  }
+  return [super arenaResultForUTF8String:bytes error:error];
+}
+
 @end
@@ -0,0 +1,40 @@
+//
+//  FBNetworkThread.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+
+/*!
+ * @class FBNetworkThread
+ *
+ * A thread with its own run loop, on which every request is sent and its
+ * response read and parsed. Work is handed to it through a lock-free queue,
+ * so submitting a request never blocks the calling thread. The thread is
+ * woken by a run loop source, or in headless builds, where NSRunLoop doesn't
+ * service those, by performSelector:onThread:.
+ */
+@interface FBNetworkThread : NSObject {
+  NSThread*          thread;
+  CFRunLoopRef       runLoop;
+  CFRunLoopSourceRef source;
+  void* volatile     submissions;
+  NSConditionLock*   startupLock;
+}
+
++ (FBNetworkThread*)sharedThread;
+
+- (BOOL)isCurrentThread;
+
+/*!
+ * Calls selector on target with object on the network thread, in the order
+ * submitted. Target and object are retained until then.
+ */
+- (void)performSelector:(SEL)selector
+                 target:(id)target
+             withObject:(id)object;
+
+@end
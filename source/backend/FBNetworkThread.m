@@ -0,0 +1,175 @@
+//
+//  FBNetworkThread.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBNetworkThread.h"
+#import "FBTracer.h"
+#ifdef __APPLE__
+  #include <libkern/OSAtomic.h>
+#else
+  #define OSAtomicCompareAndSwapPtrBarrier(old, new, ptr) __sync_bool_compare_and_swap(ptr, old, new)
+#endif
+
+enum {
+  FBNetworkThreadStarting,
+  FBNetworkThreadRunning
+};
+
+
+typedef struct FBSubmission {
+  struct FBSubmission* next;
+  id                   target;
+  SEL                  selector;
+  id                   object;
+} FBSubmission;
+
+
+@interface FBNetworkThread (Private)
+
+- (void)runThread:(id)object;
+- (void)drainSubmissions;
+
+@end
+
+
+#ifndef FB_HEADLESS
+static void FBNetworkThreadPerform(void* info)
+{
+  [(FBNetworkThread*)info drainSubmissions];
+}
+#endif
+
+
+@implementation FBNetworkThread
+
++ (FBNetworkThread*)sharedThread
+{
+  static FBNetworkThread* sharedThread = nil;
+  @synchronized(self) {
+    if (!sharedThread) {
+      sharedThread = [[FBNetworkThread alloc] init];
+    }
+  }
+  return sharedThread;
+}
+
+- (id)init
+{
+  if (self = [super init]) {
+    startupLock = [[NSConditionLock alloc] initWithCondition:FBNetworkThreadStarting];
+    [NSThread detachNewThreadSelector:@selector(runThread:)
+                             toTarget:self
+                           withObject:nil];
+
+    // don't hand out the thread until its run loop can take work
+    [startupLock lockWhenCondition:FBNetworkThreadRunning];
+    [startupLock unlock];
+  }
+  return self;
+}
+
+- (BOOL)isCurrentThread
+{
+  return [NSThread currentThread] == thread;
+}
+
+- (void)performSelector:(SEL)selector
+                 target:(id)target
+             withObject:(id)object
+{
+  FBSubmission* submission = malloc(sizeof(FBSubmission));
+  submission->target   = [target retain];
+  submission->selector = selector;
+  submission->object   = [object retain];
+
+  FBSubmission* head;
+  do {
+    head = submissions;
+    submission->next = head;
+  } while (!OSAtomicCompareAndSwapPtrBarrier(head, submission, &submissions));
+
+  // the queue was empty, so nothing has woken the thread yet
+  if (head == NULL) {
+#ifdef FB_HEADLESS
+    // GNUstep's NSRunLoop doesn't service CFRunLoop sources
+    [self performSelector:@selector(drainSubmissions)
+                 onThread:thread
+               withObject:nil
+            waitUntilDone:NO];
+#else
+    CFRunLoopSourceSignal(source);
+    CFRunLoopWakeUp(runLoop);
+#endif
+  }
+}
+
+#pragma mark Private Methods
+- (void)runThread:(id)object
+{
+  NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+  [startupLock lock];
+  thread  = [NSThread currentThread];
+  FBTraceNameThread("FBNetworkThread");
+#ifdef FB_HEADLESS
+  // with no input sources the run loop would return straight away
+  [[NSRunLoop currentRunLoop] addPort:[NSPort port] forMode:NSDefaultRunLoopMode];
+#else
+  runLoop = CFRunLoopGetCurrent();
+
+  CFRunLoopSourceContext context;
+  memset(&context, 0, sizeof(context));
+  context.info    = self;
+  context.perform = FBNetworkThreadPerform;
+  source = CFRunLoopSourceCreate(NULL, 0, &context);
+  CFRunLoopAddSource(runLoop, source, kCFRunLoopDefaultMode);
+#endif
+  [startupLock unlockWithCondition:FBNetworkThreadRunning];
+
+  [pool release];
+
+  while (YES) {
+    pool = [[NSAutoreleasePool alloc] init];
+    [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+                             beforeDate:[NSDate distantFuture]];
+    [pool release];
+  }
+}
+
+- (void)drainSubmissions
+{
+  // take everything submitted so far in one go
+  FBSubmission* head;
+  do {
+    head = submissions;
+  } while (!OSAtomicCompareAndSwapPtrBarrier(head, NULL, &submissions));
+
+  // the queue is a stack, newest first, put it back in submission order
+  FBSubmission* ordered = NULL;
+  while (head) {
+    FBSubmission* next = head->next;
+    head->next = ordered;
+    ordered = head;
+    head = next;
+  }
+
+  while (ordered) {
+    FBSubmission* next = ordered->next;
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    @try {
+      [ordered->target performSelector:ordered->selector withObject:ordered->object];
+    } @catch (NSException* exception) {
+      NSLog(@"Caught %@: %@ on the network thread", [exception name], [exception reason]);
+    }
+    [ordered->target release];
+    [ordered->object release];
+    free(ordered);
+    [pool release];
+    ordered = next;
+  }
+}
+
+@end
@@ -0,0 +1,62 @@
+//
+//  FBPagedQueryRequest.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#import "FBCallback.h"
+#import "FBRequest.h"
+
+@class FBConnect;
+
+
+/*!
+ * @class FBPagedQueryRequest
+ *
+ * Splits a large FQL query into LIMIT windows of pageSize rows, keeping up to
+ * pipelineDepth pages in flight at once. Pages are delivered to the target in
+ * order, one callback per page, with the page's rows as the response. The
+ * final callback has isFinished set, or an error if any page failed.
+ */
+@interface FBPagedQueryRequest : FBCallback <FBRequest> {
+  FBConnect*           parentConnect;
+  NSString*            query;
+  NSUInteger           pageSize;
+  NSUInteger           pipelineDepth;
+
+  NSUInteger           nextPageToRequest;
+  NSUInteger           nextPageToDeliver;
+  NSUInteger           lastPage;
+  NSMutableDictionary* pagesInFlight;
+  NSMutableDictionary* pagesLoaded;
+  NSTimeInterval       deadline;
+
+  BOOL requestStarted;
+  BOOL requestFinished;
+}
+
+/*!
+ * Raises an NSInvalidArgumentException if aQuery already has a LIMIT clause.
+ */
++ (FBPagedQueryRequest*)requestWithQuery:(NSString*)aQuery
+                                pageSize:(NSUInteger)size
+                           pipelineDepth:(NSUInteger)depth
+                                  parent:(FBConnect*)parent
+                                  target:(id)tar
+                                selector:(SEL)sel;
+
+- (void)start;
+
+/*!
+ * Index of the page most recently delivered, starting at zero.
+ */
+- (NSUInteger)page;
+
+/*!
+ * YES once the last page has been delivered, or the request failed.
+ */
+- (BOOL)isFinished;
+
+@end
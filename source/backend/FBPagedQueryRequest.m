@@ -0,0 +1,303 @@
+//
+//  FBPagedQueryRequest.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBPagedQueryRequest.h"
+#import "FBConnect.h"
+#import "FBCocoa.h"
+#import "FBTracer.h"
+#include <ctype.h>
+#include <strings.h>
+
+
+/*
+ * Whether query has a LIMIT keyword outside of any quoted string.
+ */
+static BOOL FBQueryHasLimit(NSString* query)
+{
+  const char* sql = [query UTF8String];
+  char quote = 0;
+  for (const char* c = sql; *c; c++) {
+    if (quote) {
+      if (*c == '\\' && c[1]) {
+        c++;
+      } else if (*c == quote) {
+        quote = 0;
+      }
+    } else if (*c == '\'' || *c == '"') {
+      quote = *c;
+    } else if ((c == sql || (!isalnum((unsigned char)c[-1]) && c[-1] != '_')) &&
+               strncasecmp(c, "limit", 5) == 0 &&
+               !isalnum((unsigned char)c[5]) && c[5] != '_') {
+      return YES;
+    }
+  }
+  return NO;
+}
+
+@interface FBConnect (FBRequestResults)
+
+- (void)completedRequest:(id<FBRequest>)request;
+
+@end
+
+
+@interface FBPagedQueryRequest (Private)
+
+- (id)initWithQuery:(NSString*)aQuery
+           pageSize:(NSUInteger)size
+      pipelineDepth:(NSUInteger)depth
+             parent:(FBConnect*)parent
+             target:(id)tar
+           selector:(SEL)sel;
+
+- (void)requestMorePages;
+- (void)deliverLoadedPages;
+- (void)cancelPagesFrom:(NSUInteger)firstPage;
+- (void)finishWithError:(NSError*)err;
+
+@end
+
+
+@implementation FBPagedQueryRequest
+
++ (FBPagedQueryRequest*)requestWithQuery:(NSString*)aQuery
+                                pageSize:(NSUInteger)size
+                           pipelineDepth:(NSUInteger)depth
+                                  parent:(FBConnect*)parent
+                                  target:(id)tar
+                                selector:(SEL)sel
+{
+  return [[[FBPagedQueryRequest alloc] initWithQuery:aQuery
+                                            pageSize:size
+                                       pipelineDepth:depth
+                                              parent:parent
+                                              target:tar
+                                            selector:sel] autorelease];
+}
+
+- (id)initWithQuery:(NSString*)aQuery
+           pageSize:(NSUInteger)size
+      pipelineDepth:(NSUInteger)depth
+             parent:(FBConnect*)parent
+             target:(id)tar
+           selector:(SEL)sel
+{
+  // each page is the query with a LIMIT of its own added
+  if (FBQueryHasLimit(aQuery)) {
+    [self release];
+    [NSException raise:NSInvalidArgumentException
+                format:@"Cannot page a query which already has a LIMIT clause: %@", aQuery];
+  }
+
+  if (self = [super initWithTarget:tar selector:sel]) {
+    parentConnect     = [parent retain];
+    query             = [aQuery retain];
+    pageSize          = MAX(size, 1);
+    pipelineDepth     = MAX(depth, 1);
+    nextPageToRequest = 0;
+    nextPageToDeliver = 0;
+    lastPage          = NSNotFound;
+    pagesInFlight     = [[NSMutableDictionary alloc] init];
+    pagesLoaded       = [[NSMutableDictionary alloc] init];
+    requestStarted    = NO;
+    requestFinished   = NO;
+    FB_TRACE(FBTraceQueued, self, nil, nil);
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [parentConnect release];
+  [query         release];
+  [pagesInFlight release];
+  [pagesLoaded   release];
+  [super dealloc];
+}
+
+- (void)start
+{
+  if (requestStarted) {
+    NSLog(@"can't start the same request twice");
+    return;
+  }
+  requestStarted = YES;
+  [self retain];
+  [self requestMorePages];
+}
+
+- (NSUInteger)page
+{
+  return nextPageToDeliver > 0 ? nextPageToDeliver - 1 : 0;
+}
+
+- (BOOL)isFinished
+{
+  return requestFinished;
+}
+
+- (void)retry
+{
+  if (!requestStarted || requestFinished) {
+    return;
+  }
+
+  // throw away anything we haven't delivered yet and start again from there
+  [self cancelPagesFrom:0];
+  [pagesLoaded removeAllObjects];
+  nextPageToRequest = nextPageToDeliver;
+  [self requestMorePages];
+}
+
+- (void)setDeadline:(NSTimeInterval)seconds
+{
+  // applies to each page, those already in flight included
+  deadline = seconds;
+  NSArray* pages = [pagesInFlight allValues];
+  for (int i = 0; i < [pages count]; i++) {
+    [[pages objectAtIndex:i] setDeadline:deadline];
+  }
+}
+
+- (NSTimeInterval)deadline
+{
+  return deadline;
+}
+
+- (void)cancel
+{
+  // if we've already finished, it's too late.
+  if (!requestStarted || requestFinished) {
+    return;
+  }
+
+  [self finishWithError:[NSError errorWithDomain:kFBErrorDomainKey
+                                            code:FBAPIUnknownError
+                                        userInfo:[NSDictionary dictionaryWithObject:@"Request Cancelled"
+                                                                             forKey:kFBErrorMessageKey]]];
+}
+
+#pragma mark Callbacks
+- (void)pageLoaded:(id<FBRequest>)pageRequest
+{
+  NSNumber* pageNumber = [pageRequest userData];
+
+  // ignore pages from a cancel or an earlier attempt
+  if (requestFinished || pageNumber == nil ||
+      [pagesInFlight objectForKey:pageNumber] != pageRequest) {
+    return;
+  }
+
+  // delivering a page may cause the target to cancel us
+  [[self retain] autorelease];
+  [[pageRequest retain] autorelease];
+  [pagesInFlight removeObjectForKey:pageNumber];
+
+  if ([pageRequest error]) {
+    [self finishWithError:[pageRequest error]];
+    return;
+  }
+
+  // FQL returns an empty object rather than an empty array
+  NSArray* rows = [pageRequest response];
+  if (![rows isKindOfClass:[NSArray class]]) {
+    rows = [NSArray array];
+  }
+
+  // a short page is the last one, anything requested beyond it is wasted
+  NSUInteger pageIndex = [pageNumber unsignedIntegerValue];
+  if ([rows count] < pageSize && pageIndex < lastPage) {
+    lastPage = pageIndex;
+    [self cancelPagesFrom:lastPage + 1];
+  }
+
+  [pagesLoaded setObject:rows forKey:pageNumber];
+  [self deliverLoadedPages];
+  [self requestMorePages];
+}
+
+#pragma mark Private Methods
+- (void)requestMorePages
+{
+  while (!requestFinished &&
+         [pagesInFlight count] < pipelineDepth &&
+         nextPageToRequest <= lastPage) {
+    NSString* pageQuery = [NSString stringWithFormat:@"%@ LIMIT %lu,%lu", query,
+                           (unsigned long)(nextPageToRequest * pageSize),
+                           (unsigned long)pageSize];
+    NSNumber* pageNumber = [NSNumber numberWithUnsignedInteger:nextPageToRequest];
+    nextPageToRequest++;
+
+    id<FBRequest> pageRequest = [parentConnect fqlQuery:pageQuery
+                                                 target:self
+                                               selector:@selector(pageLoaded:)];
+    FB_TRACE(FBTraceLinked, (FBCallback*)pageRequest, self, nil);
+    [pageRequest setUserData:pageNumber];
+    [pageRequest setDeadline:deadline];
+    [pagesInFlight setObject:pageRequest forKey:pageNumber];
+
+    // the request may have failed before it ever got to the network
+    if ([pageRequest error]) {
+      [self pageLoaded:pageRequest];
+    }
+  }
+}
+
+- (void)deliverLoadedPages
+{
+  while (!requestFinished) {
+    NSNumber* pageNumber = [NSNumber numberWithUnsignedInteger:nextPageToDeliver];
+    NSArray* rows = [pagesLoaded objectForKey:pageNumber];
+    if (rows == nil) {
+      return;
+    }
+    [[rows retain] autorelease];
+    [pagesLoaded removeObjectForKey:pageNumber];
+
+    if (nextPageToDeliver++ == lastPage) {
+      requestFinished = YES;
+      [parentConnect completedRequest:self];
+      [self success:rows];
+
+      // peace!
+      [self release];
+      return;
+    }
+    [self success:rows];
+  }
+}
+
+- (void)cancelPagesFrom:(NSUInteger)firstPage
+{
+  NSArray* pages = [pagesInFlight allKeys];
+  for (int i = 0; i < [pages count]; i++) {
+    NSNumber* pageNumber = [pages objectAtIndex:i];
+    if ([pageNumber unsignedIntegerValue] >= firstPage) {
+      id<FBRequest> pageRequest = [[pagesInFlight objectForKey:pageNumber] retain];
+      [pagesInFlight removeObjectForKey:pageNumber];
+      [pageRequest cancel];
+      [pageRequest release];
+    }
+  }
+}
+
+- (void)finishWithError:(NSError*)err
+{
+  requestFinished = YES;
+  [self cancelPagesFrom:0];
+  [parentConnect completedRequest:self];
+  [self failure:err];
+
+  // peace!
+  [self release];
+}
+
+- (NSString*)description {
+  return query;
+}
+
+@end
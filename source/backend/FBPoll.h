@@ -0,0 +1,63 @@
+//
+//  FBPoll.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#import "FBCallback.h"
+
+
+/*!
+ * @class FBPoll
+ *
+ * An FQL query registered with an FBPollScheduler. The poll's interval moves
+ * between its minimum and maximum depending on how often the result actually
+ * changes. The target is only called when the result differs from the last
+ * one, or when a poll fails.
+ */
+@interface FBPoll : FBCallback {
+  NSString*      query;
+  NSTimeInterval minInterval;
+  NSTimeInterval maxInterval;
+  NSTimeInterval interval;
+
+  NSDate*        nextPollDate;
+  NSDate*        lastPollDate;
+  NSString*      resultDigest;
+  BOOL           isPolling;
+}
+
+- (id)initWithQuery:(NSString*)aQuery
+        minInterval:(NSTimeInterval)min
+        maxInterval:(NSTimeInterval)max
+             target:(id)tar
+           selector:(SEL)sel;
+
+- (NSString*)query;
+
+- (NSTimeInterval)minInterval;
+- (NSTimeInterval)maxInterval;
+
+/*!
+ * The current interval between polls, before any global rate limit backoff.
+ */
+- (NSTimeInterval)interval;
+
+- (NSDate*)nextPollDate;
+- (void)setNextPollDate:(NSDate*)date;
+
+- (NSDate*)lastPollDate;
+- (void)setLastPollDate:(NSDate*)date;
+
+- (BOOL)isPolling;
+- (void)setIsPolling:(BOOL)polling;
+
+/*!
+ * Records a new result, adjusting the interval. Returns YES if the result
+ * differs from the previous one.
+ */
+- (BOOL)updateWithResult:(id)result;
+
+@end
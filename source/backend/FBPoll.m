@@ -0,0 +1,119 @@
+//
+//  FBPoll.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBPoll.h"
+#import "JSON.h"
+#import "NSData+.h"
+
+// how quickly the interval reacts to changing and unchanging results
+#define kPollSpeedUpFactor 0.5
+#define kPollSlowDownFactor 1.5
+
+
+@implementation FBPoll
+
+- (id)initWithQuery:(NSString*)aQuery
+        minInterval:(NSTimeInterval)min
+        maxInterval:(NSTimeInterval)max
+             target:(id)tar
+           selector:(SEL)sel
+{
+  if (self = [super initWithTarget:tar selector:sel]) {
+    query        = [aQuery retain];
+    minInterval  = min;
+    maxInterval  = MAX(min, max);
+    interval     = minInterval;
+    nextPollDate = [[NSDate date] retain];
+    isPolling    = NO;
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [query        release];
+  [nextPollDate release];
+  [lastPollDate release];
+  [resultDigest release];
+  [super dealloc];
+}
+
+- (NSString*)query
+{
+  return query;
+}
+
+- (NSTimeInterval)minInterval
+{
+  return minInterval;
+}
+
+- (NSTimeInterval)maxInterval
+{
+  return maxInterval;
+}
+
+- (NSTimeInterval)interval
+{
+  return interval;
+}
+
+- (NSDate*)nextPollDate
+{
+  return nextPollDate;
+}
+
+- (void)setNextPollDate:(NSDate*)date
+{
+  [date retain];
+  [nextPollDate release];
+  nextPollDate = date;
+}
+
+- (NSDate*)lastPollDate
+{
+  return lastPollDate;
+}
+
+- (void)setLastPollDate:(NSDate*)date
+{
+  [date retain];
+  [lastPollDate release];
+  lastPollDate = date;
+}
+
+- (BOOL)isPolling
+{
+  return isPolling;
+}
+
+- (void)setIsPolling:(BOOL)polling
+{
+  isPolling = polling;
+}
+
+- (BOOL)updateWithResult:(id)result
+{
+  NSString* digest = [[[result JSONRepresentation] dataUsingEncoding:NSUTF8StringEncoding] md5];
+  BOOL changed = ![digest isEqualToString:resultDigest];
+
+  if (changed) {
+    interval = MAX(minInterval, interval * kPollSpeedUpFactor);
+    [digest retain];
+    [resultDigest release];
+    resultDigest = digest;
+  } else {
+    interval = MIN(maxInterval, interval * kPollSlowDownFactor);
+  }
+  return changed;
+}
+
+- (NSString*)description {
+  return query;
+}
+
+@end
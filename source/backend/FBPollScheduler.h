@@ -0,0 +1,69 @@
+//
+//  FBPollScheduler.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+@class FBConnect;
+@class FBPoll;
+
+
+/*!
+ * @class FBPollScheduler
+ *
+ * Runs registered FQL polls on behalf of an FBConnect. Each poll's interval
+ * adapts to how often its result changes, polls which fall due close together
+ * are sent in a single batch.run, and all polling slows down when Facebook
+ * reports that we are making too many calls.
+ */
+@interface FBPollScheduler : NSObject {
+  FBConnect*      parentConnect;
+  NSMutableArray* polls;
+  NSTimer*        timer;
+
+  double          backoffMultiplier;
+  NSTimeInterval  lastBackoffTime;
+
+  unsigned long   pollsSent;
+  unsigned long   requestsSent;
+  unsigned long   unchangedResults;
+  unsigned long   rateLimitErrors;
+  double          pollsSavedByAdapting;
+}
+
+- (id)initWithConnect:(FBConnect*)connect;
+
+/*!
+ * Registers an FQL query to be polled no more often than every min seconds and
+ * no less often than every max seconds. The first poll is sent right away.
+ */
+- (FBPoll*)addQuery:(NSString*)query
+        minInterval:(NSTimeInterval)min
+        maxInterval:(NSTimeInterval)max
+             target:(id)target
+           selector:(SEL)selector;
+
+- (void)removePoll:(FBPoll*)poll;
+
+/*!
+ * Stops all polling. Must be called before the parent FBConnect is released.
+ */
+- (void)invalidate;
+
+/*!
+ * The factor currently applied to every poll interval due to rate limiting.
+ */
+- (double)backoffMultiplier;
+
+/*!
+ * Counters describing how much work the scheduler has done and avoided:
+ * "polls" sent, HTTP "requests" made, "unchanged" results not delivered,
+ * "rateLimitErrors" seen, "savedByBatching" and "savedByAdapting" calls
+ * compared to polling every query separately at its minimum interval.
+ */
+- (NSDictionary*)statistics;
+
+@end
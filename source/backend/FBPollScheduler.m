@@ -0,0 +1,268 @@
+//
+//  FBPollScheduler.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBPollScheduler.h"
+#import "FBPoll.h"
+#import "FBConnect.h"
+#import "FBCocoa.h"
+
+// a poll may be sent this fraction of its interval early to share a batch
+#define kPollAlignmentFraction 0.25
+
+// batch.run accepts at most 20 methods
+#define kPollMaxBatchSize 20
+
+// rate limit backoff
+#define kPollMaxBackoff 32.0
+#define kPollBackoffRecovery 0.75
+#define kPollBackoffHoldTime 1.0
+
+// if the application is building a batch, try again shortly
+#define kPollBusyRetryDelay 1.0
+
+
+@interface FBPollScheduler (Private)
+
+- (void)reschedule;
+- (void)scheduleTimerWithInterval:(NSTimeInterval)interval;
+- (void)sendPolls:(NSArray*)duePolls;
+- (void)backOff;
+
+@end
+
+
+@implementation FBPollScheduler
+
+- (id)initWithConnect:(FBConnect*)connect
+{
+  if (self = [super init]) {
+    // not retained, the connect owns us
+    parentConnect     = connect;
+    polls             = [[NSMutableArray alloc] init];
+    backoffMultiplier = 1.0;
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [timer invalidate];
+  [timer release];
+  [polls release];
+  [super dealloc];
+}
+
+- (FBPoll*)addQuery:(NSString*)query
+        minInterval:(NSTimeInterval)min
+        maxInterval:(NSTimeInterval)max
+             target:(id)target
+           selector:(SEL)selector
+{
+  FBPoll* poll = [[FBPoll alloc] initWithQuery:query
+                                   minInterval:min
+                                   maxInterval:max
+                                        target:target
+                                      selector:selector];
+  [polls addObject:poll];
+  [poll release];
+  [self reschedule];
+  return poll;
+}
+
+- (void)removePoll:(FBPoll*)poll
+{
+  [polls removeObjectIdenticalTo:poll];
+  [self reschedule];
+}
+
+- (void)invalidate
+{
+  [timer invalidate];
+  [timer release];
+  timer = nil;
+  [polls removeAllObjects];
+  parentConnect = nil;
+}
+
+- (double)backoffMultiplier
+{
+  return backoffMultiplier;
+}
+
+- (NSDictionary*)statistics
+{
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [NSNumber numberWithUnsignedLong:pollsSent],                    @"polls",
+          [NSNumber numberWithUnsignedLong:requestsSent],                 @"requests",
+          [NSNumber numberWithUnsignedLong:unchangedResults],             @"unchanged",
+          [NSNumber numberWithUnsignedLong:rateLimitErrors],              @"rateLimitErrors",
+          [NSNumber numberWithUnsignedLong:pollsSent - requestsSent],     @"savedByBatching",
+          [NSNumber numberWithUnsignedLong:(unsigned long)pollsSavedByAdapting], @"savedByAdapting",
+          nil];
+}
+
+#pragma mark Callbacks
+- (void)pollTimerFired:(NSTimer*)aTimer
+{
+  [timer release];
+  timer = nil;
+
+  if (parentConnect == nil) {
+    return;
+  }
+
+  // don't interfere with a batch the application is building
+  if ([parentConnect pendingBatch]) {
+    [self scheduleTimerWithInterval:kPollBusyRetryDelay];
+    return;
+  }
+
+  // gather everything that is due, or nearly due
+  NSDate* now = [NSDate date];
+  NSMutableArray* duePolls = [NSMutableArray array];
+  FBPoll* poll;
+  for (int i = 0; i < [polls count]; i++) {
+    poll = [polls objectAtIndex:i];
+    if ([poll isPolling]) {
+      continue;
+    }
+    NSTimeInterval early = [poll interval] * backoffMultiplier * kPollAlignmentFraction;
+    if ([[poll nextPollDate] timeIntervalSinceDate:now] <= early) {
+      [duePolls addObject:poll];
+    }
+  }
+
+  for (int i = 0; i < [duePolls count]; i += kPollMaxBatchSize) {
+    NSRange range = NSMakeRange(i, MIN(kPollMaxBatchSize, [duePolls count] - i));
+    [self sendPolls:[duePolls subarrayWithRange:range]];
+  }
+
+  [self reschedule];
+}
+
+- (void)pollCompleted:(id<FBRequest>)req
+{
+  FBPoll* poll = [[[req userData] retain] autorelease];
+  [poll setIsPolling:NO];
+
+  // removed while in flight
+  if ([polls indexOfObjectIdenticalTo:poll] == NSNotFound) {
+    return;
+  }
+
+  NSError* err = [req error];
+  if (err) {
+    if ([err code] == FBAPITooManyCallsError || [err code] == FBAPIRateError) {
+      [self backOff];
+    }
+    [poll setNextPollDate:[NSDate dateWithTimeIntervalSinceNow:[poll interval] * backoffMultiplier]];
+    [poll failure:err];
+  } else {
+    backoffMultiplier = MAX(1.0, backoffMultiplier * kPollBackoffRecovery);
+    BOOL changed = [poll updateWithResult:[req response]];
+    [poll setNextPollDate:[NSDate dateWithTimeIntervalSinceNow:[poll interval] * backoffMultiplier]];
+    if (changed) {
+      [poll setError:nil];
+      [poll success:[req response]];
+    } else {
+      unchangedResults++;
+    }
+  }
+
+  [self reschedule];
+}
+
+#pragma mark Private Methods
+- (void)reschedule
+{
+  [timer invalidate];
+  [timer release];
+  timer = nil;
+
+  NSDate* earliest = nil;
+  FBPoll* poll;
+  for (int i = 0; i < [polls count]; i++) {
+    poll = [polls objectAtIndex:i];
+    if (![poll isPolling] &&
+        (earliest == nil || [[poll nextPollDate] compare:earliest] == NSOrderedAscending)) {
+      earliest = [poll nextPollDate];
+    }
+  }
+
+  if (earliest) {
+    [self scheduleTimerWithInterval:MAX(0.0, [earliest timeIntervalSinceNow])];
+  }
+}
+
+- (void)scheduleTimerWithInterval:(NSTimeInterval)interval
+{
+  [timer invalidate];
+  [timer release];
+  timer = [[NSTimer scheduledTimerWithTimeInterval:interval
+                                            target:self
+                                          selector:@selector(pollTimerFired:)
+                                          userInfo:nil
+                                           repeats:NO] retain];
+}
+
+- (void)sendPolls:(NSArray*)duePolls
+{
+  BOOL useBatch = [duePolls count] > 1;
+  if (useBatch) {
+    [parentConnect startBatch];
+  }
+
+  NSDate* now = [NSDate date];
+  FBPoll* poll;
+  for (int i = 0; i < [duePolls count]; i++) {
+    poll = [duePolls objectAtIndex:i];
+
+    // count the polls a fixed timer at the minimum interval would have sent
+    if ([poll lastPollDate] && [poll minInterval] > 0) {
+      NSTimeInterval elapsed = [now timeIntervalSinceDate:[poll lastPollDate]];
+      pollsSavedByAdapting += MAX(0.0, elapsed / [poll minInterval] - 1.0);
+    }
+    [poll setLastPollDate:now];
+    [poll setIsPolling:YES];
+
+    id<FBRequest> req = [parentConnect fqlQuery:[poll query]
+                                         target:self
+                                       selector:@selector(pollCompleted:)];
+    [req setUserData:poll];
+    pollsSent++;
+  }
+
+  if (useBatch) {
+    [parentConnect sendBatch];
+  }
+  requestsSent++;
+}
+
+- (void)backOff
+{
+  rateLimitErrors++;
+
+  // every poll in a failed batch reports the same error, only count it once
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  if (now - lastBackoffTime < kPollBackoffHoldTime) {
+    return;
+  }
+  lastBackoffTime = now;
+  backoffMultiplier = MIN(kPollMaxBackoff, backoffMultiplier * 2.0);
+
+  // push back everything which was about to go out
+  FBPoll* poll;
+  for (int i = 0; i < [polls count]; i++) {
+    poll = [polls objectAtIndex:i];
+    NSDate* later = [NSDate dateWithTimeIntervalSinceNow:[poll interval] * backoffMultiplier];
+    if (![poll isPolling] && [[poll nextPollDate] compare:later] == NSOrderedAscending) {
+      [poll setNextPollDate:later];
+    }
+  }
+}
+
+@end
@@ -0,0 +1,50 @@
+//
+//  FBPooledClient.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#import "FBRequest.h"
+
+@class FBClientPool;
+
+
+/*!
+ * @class FBPooledClient
+ *
+ * One user's session within an FBClientPool. A client holds only its session
+ * and its place in the pool's queue, so an idle client costs a few hundred
+ * bytes; everything else is shared through the pool.
+ *
+ * Calls are queued until the pool has a free connection and the client's
+ * rate allows. A call cancelled while queued is never sent.
+ */
+@interface FBPooledClient : NSObject {
+  FBClientPool*   pool;
+  NSString*       uid;
+  NSString*       sessionKey;
+  NSString*       sessionSecret;
+  NSMutableArray* queuedRequests;
+  double          rateTokens;
+  NSTimeInterval  lastRateRefill;
+}
+
+- (NSString*)uid;
+
+/*!
+ * The number of calls waiting to be sent.
+ */
+- (NSUInteger)queuedRequestCount;
+
+- (id<FBRequest>)callMethod:(NSString*)method
+              withArguments:(NSDictionary*)dict
+                     target:(id)target
+                   selector:(SEL)selector;
+
+- (id<FBRequest>)fqlQuery:(NSString*)query
+                   target:(id)target
+                 selector:(SEL)selector;
+
+@end
@@ -0,0 +1,168 @@
+//
+//  FBPooledClient.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBPooledClient.h"
+#import "FBClientPool.h"
+
+
+@interface FBClientPool (FBPooledClient)
+
+- (id<FBRequest>)client:(FBPooledClient*)client
+             callMethod:(NSString*)method
+          withArguments:(NSDictionary*)dict
+                 target:(id)target
+               selector:(SEL)selector;
+
+@end
+
+
+@implementation FBPooledClient
+
+- (id)initWithPool:(FBClientPool*)aPool
+               uid:(NSString*)aUid
+        sessionKey:(NSString*)aKey
+            secret:(NSString*)aSecret
+{
+  if (self = [super init]) {
+    pool          = aPool;
+    uid           = [aUid copy];
+    sessionKey    = [aKey copy];
+    sessionSecret = [aSecret copy];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [uid            release];
+  [sessionKey     release];
+  [sessionSecret  release];
+  [queuedRequests release];
+  [super dealloc];
+}
+
+- (NSString*)uid
+{
+  return uid;
+}
+
+- (NSString*)sessionKey
+{
+  return sessionKey;
+}
+
+- (NSString*)sessionSecret
+{
+  return sessionSecret;
+}
+
+- (NSUInteger)queuedRequestCount
+{
+  return [queuedRequests count];
+}
+
+- (id<FBRequest>)callMethod:(NSString*)method
+              withArguments:(NSDictionary*)dict
+                     target:(id)target
+                   selector:(SEL)selector
+{
+  return [pool client:self
+           callMethod:method
+        withArguments:dict
+               target:target
+             selector:selector];
+}
+
+- (id<FBRequest>)fqlQuery:(NSString*)query
+                   target:(id)target
+                 selector:(SEL)selector
+{
+  return [self callMethod:@"fql.query"
+            withArguments:[NSDictionary dictionaryWithObject:query forKey:@"query"]
+                   target:target
+                 selector:selector];
+}
+
+#pragma mark Pool Methods
+// these are only called by the pool, with its lock held
+
+- (void)invalidate
+{
+  pool = nil;
+}
+
+- (BOOL)isValid
+{
+  return pool != nil;
+}
+
+- (BOOL)enqueueRequest:(id)request
+{
+  // the queue is only kept while there's something in it
+  BOOL wasIdle = [queuedRequests count] == 0;
+  if (queuedRequests == nil) {
+    queuedRequests = [[NSMutableArray alloc] init];
+  }
+  [queuedRequests addObject:request];
+  return wasIdle;
+}
+
+- (id)dequeueRequest
+{
+  if ([queuedRequests count] == 0) {
+    return nil;
+  }
+  id request = [[[queuedRequests objectAtIndex:0] retain] autorelease];
+  [queuedRequests removeObjectAtIndex:0];
+  if ([queuedRequests count] == 0) {
+    [queuedRequests release];
+    queuedRequests = nil;
+  }
+  return request;
+}
+
+- (BOOL)removeRequest:(id)request
+{
+  if ([queuedRequests indexOfObjectIdenticalTo:request] == NSNotFound) {
+    return NO;
+  }
+  [[request retain] autorelease];
+  [queuedRequests removeObjectIdenticalTo:request];
+  if ([queuedRequests count] == 0) {
+    [queuedRequests release];
+    queuedRequests = nil;
+  }
+  return YES;
+}
+
+- (NSArray*)removeAllRequests
+{
+  NSArray* requests = queuedRequests ? [queuedRequests autorelease] : [NSArray array];
+  queuedRequests = nil;
+  return requests;
+}
+
+- (NSTimeInterval)takeRequestTokenAtRate:(double)rate
+{
+  if (rate <= 0) {
+    return 0;
+  }
+
+  // a token bucket allowing bursts of up to a second's worth of calls
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  double burst = MAX(1.0, rate);
+  rateTokens = MIN(burst, rateTokens + (now - lastRateRefill) * rate);
+  lastRateRefill = now;
+
+  if (rateTokens < 1.0) {
+    return (1.0 - rateTokens) / rate;
+  }
+  rateTokens -= 1.0;
+  return 0;
+}
+
+@end
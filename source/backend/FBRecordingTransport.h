@@ -0,0 +1,40 @@
+//
+//  FBRecordingTransport.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#import "FBTransport.h"
+
+@class FBTrafficLog;
+
+
+/*!
+ * @class FBRecordingTransport
+ *
+ * Sends requests over another transport, writing each one's method,
+ * arguments, timings and response to a traffic log as it finishes. Install
+ * it in front of an FBConnect's transport to capture a workload for
+ * FBTrafficReplay:
+ *
+ *   FBTrafficLog* log = [[FBTrafficLog alloc] initWithPath:path error:&err];
+ *   [connect setTransport:[[[FBRecordingTransport alloc]
+ *                           initWithTransport:[connect transport] log:log] autorelease]];
+ *
+ * File uploads are recorded without their arguments, which are in the body.
+ * Cancelled requests aren't recorded.
+ */
+@interface FBRecordingTransport : NSObject <FBTransport> {
+  id<FBTransport> transport;
+  FBTrafficLog*   log;
+  NSTimeInterval  startTime;
+}
+
+- (id)initWithTransport:(id<FBTransport>)aTransport log:(FBTrafficLog*)aLog;
+
+- (id<FBTransport>)transport;
+- (FBTrafficLog*)log;
+
+@end
@@ -0,0 +1,193 @@
+//
+//  FBRecordingTransport.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBRecordingTransport.h"
+#import "FBTrafficLog.h"
+#import "NSString+.h"
+
+
+/*
+ * Stands between a request and the connection carrying it, noting what
+ * happens on the way past.
+ */
+@interface FBRecordingConnection : NSObject <FBTransportConnection> {
+  id<FBTransportConnection> connection;
+  id                        delegate;
+  FBTrafficLog*             log;
+  NSMutableDictionary*      record;
+  NSMutableData*            body;
+  NSTimeInterval            startTime;
+  BOOL                      recordsEncoding;
+}
+
+- (id)initWithRequest:(NSURLRequest*)request
+            transport:(id<FBTransport>)transport
+             delegate:(id)aDelegate
+                  log:(FBTrafficLog*)aLog
+                start:(NSTimeInterval)start;
+
+@end
+
+
+@implementation FBRecordingTransport
+
+- (id)initWithTransport:(id<FBTransport>)aTransport log:(FBTrafficLog*)aLog
+{
+  if (self = [super init]) {
+    transport = [aTransport retain];
+    log       = [aLog retain];
+    startTime = [NSDate timeIntervalSinceReferenceDate];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [transport release];
+  [log release];
+  [super dealloc];
+}
+
+- (id<FBTransport>)transport
+{
+  return transport;
+}
+
+- (FBTrafficLog*)log
+{
+  return log;
+}
+
+- (BOOL)decodesContentEncoding
+{
+  return [transport decodesContentEncoding];
+}
+
+- (id<FBTransportConnection>)connectionWithRequest:(NSURLRequest*)request
+                                          delegate:(id)delegate
+{
+  FBRecordingConnection* conn =
+    [[FBRecordingConnection alloc] initWithRequest:request
+                                         transport:transport
+                                          delegate:delegate
+                                               log:log
+                                             start:[NSDate timeIntervalSinceReferenceDate] - startTime];
+  return [conn autorelease];
+}
+
+@end
+
+
+@implementation FBRecordingConnection
+
+- (id)initWithRequest:(NSURLRequest*)request
+            transport:(id<FBTransport>)transport
+             delegate:(id)aDelegate
+                  log:(FBTrafficLog*)aLog
+                start:(NSTimeInterval)start
+{
+  if (self = [super init]) {
+    delegate  = [aDelegate retain];
+    log       = [aLog retain];
+    body      = [[NSMutableData alloc] init];
+    startTime = [NSDate timeIntervalSinceReferenceDate];
+
+    // an encoded body is only replayable with its encoding
+    recordsEncoding = ![transport decodesContentEncoding];
+
+    record = [[NSMutableDictionary alloc] init];
+    [record setObject:[NSNumber numberWithDouble:start] forKey:kFBTrafficStartKey];
+    if (![[request HTTPMethod] isEqualToString:@"POST"]) {
+      NSDictionary* arguments = [[[request URL] query] urlDecodeArguments];
+      if ([arguments objectForKey:@"method"]) {
+        [record setObject:[arguments objectForKey:@"method"] forKey:kFBTrafficMethodKey];
+      }
+      [record setObject:arguments forKey:kFBTrafficArgumentsKey];
+    }
+
+    connection = [[transport connectionWithRequest:request delegate:self] retain];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [connection release];
+  [delegate release];
+  [log release];
+  [record release];
+  [body release];
+  [super dealloc];
+}
+
+- (void)cancel
+{
+  [connection cancel];
+  [delegate release];
+  delegate = nil;
+}
+
+- (void)connection:(id)conn didReceiveResponse:(NSURLResponse*)response
+{
+  [record setObject:[NSNumber numberWithDouble:[NSDate timeIntervalSinceReferenceDate] - startTime]
+             forKey:kFBTrafficResponseDelayKey];
+  if ([response isKindOfClass:[NSHTTPURLResponse class]]) {
+    NSHTTPURLResponse* httpResponse = (NSHTTPURLResponse*)response;
+    [record setObject:[NSNumber numberWithInt:(int)[httpResponse statusCode]]
+               forKey:kFBTrafficStatusCodeKey];
+    NSString* encoding = [[httpResponse allHeaderFields] objectForKey:@"Content-Encoding"];
+    if (recordsEncoding && encoding) {
+      [record setObject:encoding forKey:kFBTrafficContentEncodingKey];
+    }
+  }
+
+  if ([delegate respondsToSelector:@selector(connection:didReceiveResponse:)]) {
+    [delegate connection:self didReceiveResponse:response];
+  }
+}
+
+- (void)connection:(id)conn didReceiveData:(NSData*)data
+{
+  if ([record objectForKey:kFBTrafficFirstByteDelayKey] == nil) {
+    [record setObject:[NSNumber numberWithDouble:[NSDate timeIntervalSinceReferenceDate] - startTime]
+               forKey:kFBTrafficFirstByteDelayKey];
+  }
+  [body appendData:data];
+  [delegate connection:self didReceiveData:data];
+}
+
+- (void)connectionDidFinishLoading:(id)conn
+{
+  [record setObject:[NSNumber numberWithDouble:[NSDate timeIntervalSinceReferenceDate] - startTime]
+             forKey:kFBTrafficDurationKey];
+  [record setObject:body forKey:kFBTrafficBodyKey];
+  if (delegate) {
+    [log appendRecord:record];
+  }
+
+  id target = [[delegate retain] autorelease];
+  [delegate release];
+  delegate = nil;
+  [target connectionDidFinishLoading:self];
+}
+
+- (void)connection:(id)conn didFailWithError:(NSError*)error
+{
+  [record setObject:[NSNumber numberWithDouble:[NSDate timeIntervalSinceReferenceDate] - startTime]
+             forKey:kFBTrafficDurationKey];
+  [record setObject:[error localizedDescription] forKey:kFBTrafficErrorKey];
+  if (delegate) {
+    [log appendRecord:record];
+  }
+
+  id target = [[delegate retain] autorelease];
+  [delegate release];
+  delegate = nil;
+  [target connection:self didFailWithError:error];
+}
+
+@end
@@ -0,0 +1,46 @@
+//
+//  FBReplayTransport.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#import "FBLoopbackTransport.h"
+
+
+/*!
+ * @class FBReplayTransport
+ *
+ * A loopback transport which answers each request with the response
+ * recorded for the same call in a traffic log, taking as long as the
+ * original did, scaled by speed. Calls are matched by method and the
+ * caller's arguments, so requests signed afresh still find their records;
+ * repeats of a call are answered by its records in the order they were
+ * captured, the last one answering any beyond them. Requests with no record
+ * are answered as an FBLoopbackTransport would.
+ */
+@interface FBReplayTransport : FBLoopbackTransport {
+  NSMutableDictionary* recordsByKey;
+  double               speed;
+  unsigned long        missCount;
+}
+
+/*!
+ * Records as read by +[FBTrafficLog recordsWithContentsOfFile:error:].
+ */
+- (id)initWithRecords:(NSArray*)records;
+
+/*!
+ * 1 by default, answering at the recorded pace. 2 answers twice as fast;
+ * 0 answers without waiting at all.
+ */
+- (void)setSpeed:(double)factor;
+- (double)speed;
+
+/*!
+ * The number of requests which had no record.
+ */
+- (unsigned long)missCount;
+
+@end
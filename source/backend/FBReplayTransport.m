@@ -0,0 +1,111 @@
+//
+//  FBReplayTransport.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBReplayTransport.h"
+#import "FBConnect.h"
+#import "FBCocoa.h"
+#import "FBTrafficLog.h"
+#import "NSString+.h"
+
+
+@interface FBLoopbackTransport (Internal)
+
+- (id<FBTransportConnection>)connectionWithURL:(NSURL*)url
+                                          body:(NSData*)body
+                               contentEncoding:(NSString*)encoding
+                                         error:(NSError*)error
+                                      delegate:(id)delegate
+                                    afterDelay:(NSTimeInterval)delay;
+
+@end
+
+
+@implementation FBReplayTransport
+
+- (id)initWithRecords:(NSArray*)records
+{
+  if (self = [super init]) {
+    speed        = 1;
+    recordsByKey = [[NSMutableDictionary alloc] init];
+    for (int i = 0; i < [records count]; i++) {
+      NSDictionary* record = [records objectAtIndex:i];
+      NSString* method = [record objectForKey:kFBTrafficMethodKey];
+      if (method == nil) {
+        continue;
+      }
+      NSString* key = [FBTrafficLog keyForMethod:method
+                                       arguments:[record objectForKey:kFBTrafficArgumentsKey]];
+      NSMutableArray* matches = [recordsByKey objectForKey:key];
+      if (matches == nil) {
+        matches = [NSMutableArray array];
+        [recordsByKey setObject:matches forKey:key];
+      }
+      [matches addObject:record];
+    }
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [recordsByKey release];
+  [super dealloc];
+}
+
+- (void)setSpeed:(double)factor
+{
+  speed = MAX(0.0, factor);
+}
+
+- (double)speed
+{
+  return speed;
+}
+
+- (unsigned long)missCount
+{
+  return missCount;
+}
+
+- (id<FBTransportConnection>)connectionWithRequest:(NSURLRequest*)request
+                                          delegate:(id)delegate
+{
+  NSDictionary* args = [[[request URL] query] urlDecodeArguments];
+  NSString* key = [FBTrafficLog keyForMethod:[args objectForKey:@"method"] arguments:args];
+  NSMutableArray* matches = [recordsByKey objectForKey:key];
+  if ([matches count] == 0) {
+    missCount++;
+    return [super connectionWithRequest:request delegate:delegate];
+  }
+
+  NSDictionary* record = [[[matches objectAtIndex:0] retain] autorelease];
+  if ([matches count] > 1) {
+    [matches removeObjectAtIndex:0];
+  }
+  requestCount++;
+
+  NSError* error = nil;
+  if ([record objectForKey:kFBTrafficErrorKey]) {
+    error = [NSError errorWithDomain:kFBErrorDomainKey
+                                code:FBAPIUnknownError
+                            userInfo:[NSDictionary dictionaryWithObject:[record objectForKey:kFBTrafficErrorKey]
+                                                                 forKey:kFBErrorMessageKey]];
+  }
+  NSTimeInterval delay = 0;
+  if (speed > 0) {
+    delay = [[record objectForKey:kFBTrafficDurationKey] doubleValue] / speed;
+  }
+
+  return [self connectionWithURL:[request URL]
+                            body:[record objectForKey:kFBTrafficBodyKey]
+                 contentEncoding:[record objectForKey:kFBTrafficContentEncodingKey]
+                           error:error
+                        delegate:delegate
+                      afterDelay:delay];
+}
+
+@end
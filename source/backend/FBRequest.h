@@ -17,10 +17,20 @@
 - (void)retry;
 
 /*!
- * Cancel the in progress request
+ * Cancel the in progress request. One which hasn't been sent yet never is,
+ * and one held back while the session is renewed isn't sent again. Either
+ * way it fails with a "Request Cancelled" error.
  */
 - (void)cancel;
 
+/*!
+ * Fails the request with an error if it hasn't completed this many seconds
+ * after it was sent. The default, 0, waits for the network to time out. A
+ * batch is given the shortest deadline of the requests within it.
+ */
+- (void)setDeadline:(NSTimeInterval)seconds;
+- (NSTimeInterval)deadline;
+
 /*!
  * The API response to this request, given it is successful
  */
@@ -0,0 +1,57 @@
+//
+//  FBResponseBuffer.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+
+/*!
+ * @class FBResponseBuffer
+ *
+ * Collects the body of a response. It is kept in memory until -spillToDisk
+ * is called, after which everything is written to an unlinked temporary file
+ * which is memory mapped again for parsing.
+ */
+@interface FBResponseBuffer : NSObject {
+  NSMutableData*     memory;
+  int                fd;
+  void*              mapped;
+  unsigned long long mappedLength;
+  unsigned long long length;
+  BOOL               terminated;
+}
+
+/*!
+ * Returns NO if the data could not be written to disk.
+ */
+- (BOOL)appendData:(NSData*)data;
+
+/*!
+ * Moves the bytes received so far to disk; later data is appended there.
+ */
+- (BOOL)spillToDisk;
+- (BOOL)isOnDisk;
+
+- (unsigned long long)length;
+
+/*!
+ * The number of bytes of the response held in memory.
+ */
+- (NSUInteger)memoryUsage;
+
+/*!
+ * The contents of the buffer, followed by a NUL byte which is not included in
+ * the data's length. Only valid until the buffer is changed or released.
+ * Returns nil if the file could not be mapped.
+ */
+- (NSData*)data;
+
+/*!
+ * Empties the buffer and removes any file.
+ */
+- (void)reset;
+
+@end
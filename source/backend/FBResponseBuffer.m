@@ -0,0 +1,174 @@
+//
+//  FBResponseBuffer.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBResponseBuffer.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+@interface FBResponseBuffer (Private)
+
+- (BOOL)writeBytes:(const void*)bytes length:(NSUInteger)len;
+- (void)unmap;
+
+@end
+
+
+@implementation FBResponseBuffer
+
+- (id)init
+{
+  if (self = [super init]) {
+    memory = [[NSMutableData alloc] init];
+    fd     = -1;
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [self reset];
+  [memory release];
+  [super dealloc];
+}
+
+- (BOOL)appendData:(NSData*)data
+{
+  if (terminated) {
+    [self unmap];
+    if (fd < 0) {
+      [memory setLength:length];
+    } else if (ftruncate(fd, length) != 0 || lseek(fd, 0, SEEK_END) < 0) {
+      return NO;
+    }
+    terminated = NO;
+  }
+
+  if (fd < 0) {
+    [memory appendData:data];
+  } else if (![self writeBytes:[data bytes] length:[data length]]) {
+    return NO;
+  }
+  length += [data length];
+  return YES;
+}
+
+- (BOOL)spillToDisk
+{
+  if (fd >= 0) {
+    return YES;
+  }
+
+  NSString* pattern = [NSTemporaryDirectory() stringByAppendingPathComponent:@"FBCocoa.XXXXXX"];
+  char* path = strdup([pattern fileSystemRepresentation]);
+  fd = mkstemp(path);
+  if (fd >= 0) {
+    // nothing to clean up if we crash
+    unlink(path);
+  }
+  free(path);
+  if (fd < 0) {
+    return NO;
+  }
+
+  if (![self writeBytes:[memory bytes] length:(terminated ? length : [memory length])]) {
+    close(fd);
+    fd = -1;
+    return NO;
+  }
+  terminated = NO;
+  [memory setLength:0];
+  return YES;
+}
+
+- (BOOL)isOnDisk
+{
+  return fd >= 0;
+}
+
+- (unsigned long long)length
+{
+  return length;
+}
+
+- (NSUInteger)memoryUsage
+{
+  return fd < 0 ? length : 0;
+}
+
+- (NSData*)data
+{
+  if (fd < 0) {
+    if (!terminated) {
+      [memory appendBytes:"\0" length:1];
+      terminated = YES;
+    }
+    return [NSData dataWithBytesNoCopy:[memory mutableBytes]
+                                length:length
+                          freeWhenDone:NO];
+  }
+
+  if (!terminated) {
+    if (![self writeBytes:"\0" length:1]) {
+      return nil;
+    }
+    terminated = YES;
+  }
+  if (!mapped) {
+    mappedLength = length + 1;
+    mapped = mmap(NULL, mappedLength, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      mapped = NULL;
+      return nil;
+    }
+  }
+  return [NSData dataWithBytesNoCopy:mapped
+                              length:length
+                        freeWhenDone:NO];
+}
+
+- (void)reset
+{
+  [self unmap];
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  [memory setLength:0];
+  length     = 0;
+  terminated = NO;
+}
+
+#pragma mark Private Methods
+- (BOOL)writeBytes:(const void*)bytes length:(NSUInteger)len
+{
+  const char* next = bytes;
+  while (len > 0) {
+    ssize_t written = write(fd, next, len);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return NO;
+    }
+    next += written;
+    len  -= written;
+  }
+  return YES;
+}
+
+- (void)unmap
+{
+  if (mapped) {
+    munmap(mapped, mappedLength);
+    mapped = NULL;
+  }
+}
+
+@end
@@ -0,0 +1,57 @@
+//
+//  FBResponseCache.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+
+/*!
+ * @class FBResponseCache
+ *
+ * Remembers recent API responses, partitioned so one user's responses are
+ * never returned for another's calls, and so a user's responses can be
+ * dropped together. Each partition keeps at most maxResponsesPerPartition
+ * responses, forgetting the oldest first. Safe to use from any thread.
+ *
+ * Cached responses are shared between callers and must not be modified.
+ */
+@interface FBResponseCache : NSObject {
+  NSMutableDictionary* partitions;
+  NSUInteger           maxResponsesPerPartition;
+  NSLock*              lock;
+}
+
+/*!
+ * A key identifying a call by its method and arguments, ignoring the
+ * order the arguments were given in.
+ */
++ (NSString*)keyForMethod:(NSString*)method
+                arguments:(NSDictionary*)arguments;
+
+/*!
+ * 32 by default.
+ */
+- (void)setMaxResponsesPerPartition:(NSUInteger)max;
+- (NSUInteger)maxResponsesPerPartition;
+
+/*!
+ * Returns nil if there is no response for key, or it is older than maxAge
+ * seconds.
+ */
+- (id)responseForKey:(NSString*)key
+           partition:(NSString*)partition
+              maxAge:(NSTimeInterval)maxAge;
+
+- (void)setResponse:(id)response
+             forKey:(NSString*)key
+          partition:(NSString*)partition;
+
+- (void)removePartition:(NSString*)partition;
+- (void)removeAllResponses;
+
+- (NSUInteger)partitionCount;
+
+@end
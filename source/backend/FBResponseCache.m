@@ -0,0 +1,155 @@
+//
+//  FBResponseCache.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBResponseCache.h"
+
+#define kDefaultMaxResponsesPerPartition 32
+
+
+/*
+ * A response and when it was stored.
+ */
+@interface FBResponseCacheEntry : NSObject {
+@public
+  id             response;
+  NSTimeInterval storedAt;
+}
+@end
+
+@implementation FBResponseCacheEntry
+
+- (void)dealloc
+{
+  [response release];
+  [super dealloc];
+}
+
+@end
+
+
+@implementation FBResponseCache
+
++ (NSString*)keyForMethod:(NSString*)method
+                arguments:(NSDictionary*)arguments
+{
+  NSMutableString* key = [NSMutableString stringWithString:[method lowercaseString]];
+  NSArray* sortedKeys = [[arguments allKeys] sortedArrayUsingSelector:@selector(compare:)];
+  for (int i = 0; i < [sortedKeys count]; i++) {
+    NSString* argument = [sortedKeys objectAtIndex:i];
+    [key appendFormat:@"&%@=%@", argument, [arguments objectForKey:argument]];
+  }
+  return key;
+}
+
+- (id)init
+{
+  if (self = [super init]) {
+    partitions               = [[NSMutableDictionary alloc] init];
+    maxResponsesPerPartition = kDefaultMaxResponsesPerPartition;
+    lock                     = [[NSLock alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [partitions release];
+  [lock       release];
+  [super dealloc];
+}
+
+- (void)setMaxResponsesPerPartition:(NSUInteger)max
+{
+  maxResponsesPerPartition = MAX(max, 1);
+}
+
+- (NSUInteger)maxResponsesPerPartition
+{
+  return maxResponsesPerPartition;
+}
+
+- (id)responseForKey:(NSString*)key
+           partition:(NSString*)partition
+              maxAge:(NSTimeInterval)maxAge
+{
+  id response = nil;
+  [lock lock];
+  FBResponseCacheEntry* entry =
+    [[partitions objectForKey:(partition ? partition : @"")] objectForKey:key];
+  if (entry && [NSDate timeIntervalSinceReferenceDate] - entry->storedAt <= maxAge) {
+    response = [[entry->response retain] autorelease];
+  }
+  [lock unlock];
+  return response;
+}
+
+- (void)setResponse:(id)response
+             forKey:(NSString*)key
+          partition:(NSString*)partition
+{
+  if (response == nil || key == nil) {
+    return;
+  }
+  if (partition == nil) {
+    partition = @"";
+  }
+
+  FBResponseCacheEntry* entry = [[FBResponseCacheEntry alloc] init];
+  entry->response = [response retain];
+  entry->storedAt = [NSDate timeIntervalSinceReferenceDate];
+
+  [lock lock];
+  NSMutableDictionary* entries = [partitions objectForKey:partition];
+  if (entries == nil) {
+    entries = [NSMutableDictionary dictionary];
+    [partitions setObject:entries forKey:partition];
+  }
+
+  // make room by forgetting the oldest
+  if ([entries objectForKey:key] == nil && [entries count] >= maxResponsesPerPartition) {
+    NSString* oldestKey = nil;
+    NSTimeInterval oldest = 0;
+    NSEnumerator* enumerator = [entries keyEnumerator];
+    NSString* entryKey;
+    while ((entryKey = [enumerator nextObject])) {
+      FBResponseCacheEntry* candidate = [entries objectForKey:entryKey];
+      if (oldestKey == nil || candidate->storedAt < oldest) {
+        oldestKey = entryKey;
+        oldest    = candidate->storedAt;
+      }
+    }
+    [entries removeObjectForKey:oldestKey];
+  }
+  [entries setObject:entry forKey:key];
+  [lock unlock];
+
+  [entry release];
+}
+
+- (void)removePartition:(NSString*)partition
+{
+  [lock lock];
+  [partitions removeObjectForKey:(partition ? partition : @"")];
+  [lock unlock];
+}
+
+- (void)removeAllResponses
+{
+  [lock lock];
+  [partitions removeAllObjects];
+  [lock unlock];
+}
+
+- (NSUInteger)partitionCount
+{
+  [lock lock];
+  NSUInteger count = [partitions count];
+  [lock unlock];
+  return count;
+}
+
+@end
@@ -0,0 +1,88 @@
+//
+//  FBRowSchema.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+@class FBProjection;
+struct FBRowField;
+
+typedef enum {
+  FBFieldString,    // NSString*
+  FBFieldNumber,    // NSNumber*, as an NSDecimalNumber
+  FBFieldInteger,   // long long
+  FBFieldDouble,    // double
+  FBFieldBool,      // BOOL
+  FBFieldObject     // id, arrays and dictionaries as SBJsonParser makes them
+} FBFieldType;
+
+
+/*!
+ * @class FBRowSchema
+ *
+ * Describes how the rows of an FQL result map onto a model class: for each
+ * column, its type and where in the object it goes. A query run with a
+ * schema comes back as an array of model objects, filled in directly from
+ * the response without building a dictionary for each row. Only the
+ * schema's columns are parsed.
+ *
+ * Objects are created with -init and their fields set directly, retained
+ * where they are objects, so the model's -dealloc must release them. A null
+ * or missing column leaves the field as -init left it. Configure a schema
+ * before using it; after that it can be shared between threads.
+ */
+@interface FBRowSchema : NSObject {
+  Class              modelClass;
+  struct FBRowField* fields;
+  unsigned int       fieldCount;
+  FBProjection*      projection;
+}
+
++ (FBRowSchema*)schemaWithClass:(Class)aClass;
+
+- (id)initWithClass:(Class)aClass;
+
+/*!
+ * Maps column onto the named instance variable, whose type must match.
+ */
+- (void)addField:(NSString*)column
+            type:(FBFieldType)type
+            ivar:(NSString*)ivarName;
+
+/*!
+ * Maps column onto whatever lies offset bytes into the object, such as a
+ * member of a struct held in an instance variable.
+ */
+- (void)addField:(NSString*)column
+            type:(FBFieldType)type
+          offset:(ptrdiff_t)offset;
+
+- (Class)modelClass;
+
+/*!
+ * A projection of the schema's columns.
+ */
+- (FBProjection*)projection;
+
+/*!
+ * Decodes an fql.query response into model objects. Anything other than
+ * rows, such as an error, is returned as SBJsonParser would have parsed it.
+ */
+- (id)resultWithUTF8String:(const char*)bytes
+                projection:(FBProjection*)aProjection
+                     error:(NSError**)error;
+
+/*!
+ * Decodes an fql.multiquery response, decoding the rows of each query with
+ * the schema for its name in schemas. Queries without a schema are parsed
+ * as usual.
+ */
++ (id)multiqueryResultWithUTF8String:(const char*)bytes
+                             schemas:(NSDictionary*)schemas
+                          projection:(FBProjection*)aProjection
+                               error:(NSError**)error;
+
+@end
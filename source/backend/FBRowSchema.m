@@ -0,0 +1,272 @@
+//
+//  FBRowSchema.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBRowSchema.h"
+#import "FBArenaParser_Internal.h"
+#include <objc/runtime.h>
+#include <stdlib.h>
+#include <string.h>
+
+// longer than any number worth converting
+#define kMaxScalarLength 64
+
+
+typedef struct FBRowField {
+  char*       column;
+  size_t      length;
+  FBFieldType type;
+  ptrdiff_t   offset;
+} FBRowField;
+
+
+@interface FBRowSchema (Private)
+
+- (NSMutableArray*)objectsForRows:(FBJSONNode*)rows;
+- (id)objectForRow:(FBJSONNode*)row;
+
+@end
+
+
+static void FBSetObjectField(char* slot, id value)
+{
+  id* field = (id*)slot;
+  [value retain];
+  [*field release];
+  *field = value;
+}
+
+/*
+ * Copies a number's text, or a string's (FQL sends some numbers as
+ * strings), to be converted by the C library.
+ */
+static BOOL FBScalarText(FBJSONNode* node, char* text)
+{
+  if ((node->type != kNodeNumber && node->type != kNodeASCIIString) ||
+      node->length >= kMaxScalarLength) {
+    return NO;
+  }
+  memcpy(text, node->value.text, node->length);
+  text[node->length] = '\0';
+  return YES;
+}
+
+static long long FBNodeLongLong(FBJSONNode* node)
+{
+  char text[kMaxScalarLength];
+  if (node->type == kNodeTrue) {
+    return 1;
+  }
+  return FBScalarText(node, text) ? strtoll(text, NULL, 10) : 0;
+}
+
+static double FBNodeDouble(FBJSONNode* node)
+{
+  char text[kMaxScalarLength];
+  if (node->type == kNodeTrue) {
+    return 1;
+  }
+  return FBScalarText(node, text) ? strtod(text, NULL) : 0;
+}
+
+
+@implementation FBRowSchema
+
++ (FBRowSchema*)schemaWithClass:(Class)aClass
+{
+  return [[[FBRowSchema alloc] initWithClass:aClass] autorelease];
+}
+
+- (id)initWithClass:(Class)aClass
+{
+  if (self = [super init]) {
+    modelClass = aClass;
+    projection = [[FBProjection alloc] initWithKeyPaths:[NSArray array]];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  for (unsigned int i = 0; i < fieldCount; i++) {
+    free(fields[i].column);
+  }
+  free(fields);
+  [projection release];
+  [super dealloc];
+}
+
+- (void)addField:(NSString*)column
+            type:(FBFieldType)type
+            ivar:(NSString*)ivarName
+{
+  Ivar ivar = class_getInstanceVariable(modelClass, [ivarName UTF8String]);
+  if (ivar == NULL) {
+    [NSException raise:NSInvalidArgumentException
+                format:@"%@ has no instance variable %@", modelClass, ivarName];
+  }
+
+  char expected;
+  switch (type) {
+    case FBFieldInteger: expected = 'q'; break;
+    case FBFieldDouble:  expected = 'd'; break;
+    case FBFieldBool:    expected = 'c'; break;
+    default:             expected = '@'; break;
+  }
+  if (ivar_getTypeEncoding(ivar)[0] != expected) {
+    [NSException raise:NSInvalidArgumentException
+                format:@"%@ of %@ is not of the type given for %@", ivarName, modelClass, column];
+  }
+
+  [self addField:column type:type offset:ivar_getOffset(ivar)];
+}
+
+- (void)addField:(NSString*)column
+            type:(FBFieldType)type
+          offset:(ptrdiff_t)offset
+{
+  fields = realloc(fields, (fieldCount + 1) * sizeof(FBRowField));
+  FBRowField* field = &fields[fieldCount++];
+  const char* utf8 = [column UTF8String];
+  field->length = strlen(utf8);
+  field->column = malloc(MAX(field->length, 1));
+  memcpy(field->column, utf8, field->length);
+  field->type   = type;
+  field->offset = offset;
+
+  NSArray* columns = [[projection keyPaths] arrayByAddingObject:column];
+  [projection release];
+  projection = [[FBProjection alloc] initWithKeyPaths:columns];
+}
+
+- (Class)modelClass
+{
+  return modelClass;
+}
+
+- (FBProjection*)projection
+{
+  return projection;
+}
+
+- (id)resultWithUTF8String:(const char*)bytes
+                projection:(FBProjection*)aProjection
+                     error:(NSError**)error
+{
+  FBJSONNode* root;
+  if (!FBArenaParse(bytes, aProjection, &root, error)) {
+    return nil;
+  }
+  // an empty result sometimes comes as {}
+  if (root->type == kNodeArray || (root->type == kNodeDictionary && root->length == 0)) {
+    return [self objectsForRows:root];
+  }
+  return FBArenaCopyObject(root);
+}
+
++ (id)multiqueryResultWithUTF8String:(const char*)bytes
+                             schemas:(NSDictionary*)schemas
+                          projection:(FBProjection*)aProjection
+                               error:(NSError**)error
+{
+  FBJSONNode* root;
+  if (!FBArenaParse(bytes, aProjection, &root, error)) {
+    return nil;
+  }
+  if (root->type != kNodeArray) {
+    return FBArenaCopyObject(root);
+  }
+
+  // the same shape as the response, so FBMultiqueryRequest can take it apart
+  NSMutableArray* results = [NSMutableArray arrayWithCapacity:root->length];
+  for (unsigned int i = 0; i < root->length; i++) {
+    FBJSONNode* query = &root->value.children[i];
+    FBJSONNode* nameNode = FBArenaNodeForKey(query, "name", 4);
+    FBJSONNode* rowsNode = FBArenaNodeForKey(query, "fql_result_set", 14);
+    NSString* name = nameNode ? FBArenaCopyString(nameNode) : nil;
+    FBRowSchema* schema = name ? [schemas objectForKey:name] : nil;
+
+    NSMutableDictionary* result = [NSMutableDictionary dictionaryWithCapacity:2];
+    if (name) {
+      [result setObject:name forKey:@"name"];
+    }
+    if (rowsNode) {
+      [result setObject:(schema ? [schema objectsForRows:rowsNode] : FBArenaCopyObject(rowsNode))
+                 forKey:@"fql_result_set"];
+    }
+    [results addObject:result];
+  }
+  return results;
+}
+
+#pragma mark Private Methods
+- (NSMutableArray*)objectsForRows:(FBJSONNode*)rows
+{
+  NSMutableArray* objects = [NSMutableArray arrayWithCapacity:rows->length];
+  if (rows->type != kNodeArray) {
+    return objects;
+  }
+  for (unsigned int i = 0; i < rows->length; i++) {
+    FBJSONNode* row = &rows->value.children[i];
+    if (row->type == kNodeDictionary) {
+      [objects addObject:[self objectForRow:row]];
+    }
+  }
+  return objects;
+}
+
+- (id)objectForRow:(FBJSONNode*)row
+{
+  id object = [[modelClass alloc] init];
+
+  for (unsigned int i = 0; i < row->length; i++) {
+    FBJSONNode* column = &row->value.children[2 * i];
+    FBJSONNode* value  = &row->value.children[2 * i + 1];
+    if (value->type == kNodeNull) {
+      continue;
+    }
+
+    for (unsigned int j = 0; j < fieldCount; j++) {
+      FBRowField* field = &fields[j];
+      if (field->length != column->length ||
+          memcmp(field->column, column->value.text, column->length) != 0) {
+        continue;
+      }
+
+      char* slot = (char*)object + field->offset;
+      switch (field->type) {
+        case FBFieldString:
+          FBSetObjectField(slot, FBArenaCopyString(value));
+          break;
+        case FBFieldNumber:
+          if (value->type == kNodeTrue || value->type == kNodeFalse) {
+            FBSetObjectField(slot, [NSNumber numberWithBool:(value->type == kNodeTrue)]);
+          } else {
+            NSString* text = FBArenaCopyString(value);
+            FBSetObjectField(slot, text ? [NSDecimalNumber decimalNumberWithString:text] : nil);
+          }
+          break;
+        case FBFieldInteger:
+          *(long long*)slot = FBNodeLongLong(value);
+          break;
+        case FBFieldDouble:
+          *(double*)slot = FBNodeDouble(value);
+          break;
+        case FBFieldBool:
+          *(BOOL*)slot = FBNodeDouble(value) != 0;
+          break;
+        case FBFieldObject:
+          FBSetObjectField(slot, FBArenaCopyObject(value));
+          break;
+      }
+      break;
+    }
+  }
+
+  return [object autorelease];
+}
+
+@end
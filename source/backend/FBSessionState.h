@@ -7,9 +7,12 @@
 //
 
 #import <Cocoa/Cocoa.h>
+#import "FBSessionStore.h"
 
 
 @interface FBSessionState : NSObject {
+  id<FBSessionStore> store;
+  BOOL          isLoaded;
   NSString*     keychainKey;
   NSString*     secret;
   NSString*     key;
@@ -21,6 +24,12 @@
 
 - (id)initWithKey:(NSString*)aKey;
 
+/*!
+ * The stored session is loaded from store in the background, and read the
+ * first time it's needed.
+ */
+- (id)initWithKey:(NSString*)aKey store:(id<FBSessionStore>)aStore;
+
 - (NSString*)uid;
 - (void)setUID:(NSString*)aString;
 
@@ -36,6 +45,9 @@
 - (void)addPermissions:(id)perms;
 - (BOOL)hasPermission:(NSString*)perm;
 
+- (NSDate*)expires;
+- (BOOL)isInfinite;
+
 - (void)setWithDictionary:(NSDictionary*)dict;
 
 - (BOOL)exists;
@@ -7,16 +7,14 @@
 //
 
 #import "FBSessionState.h"
-#import "JSON.h"
-#import "EMKeychainItem.h"
-#import "EMKeychainProxy.h"
+#import "FBCachedSessionStore.h"
 
 #define kFBSavedSessionKey @"FBSavedSession"
-#define kFacebookDesktopService @"Facebook Notifier Login"
 
 
 @interface FBSessionState (Private)
 
+- (void)loadIfNeeded;
 - (void)setDictionary:(NSDictionary*)dict;
 
 @end
@@ -25,21 +23,22 @@
 @implementation FBSessionState
 
 - (id)initWithKey:(NSString*)aKey
+{
+  return [self initWithKey:aKey store:[FBCachedSessionStore defaultStore]];
+}
+
+- (id)initWithKey:(NSString*)aKey store:(id<FBSessionStore>)aStore
 {
   if (self = [super init])
   {
+    store       = [aStore retain];
     keychainKey = [aKey retain];
     permissions = [[NSMutableSet alloc] init];
 
-    // read in stored session if it exists
-    EMKeychainItem* keychain =
-      [[EMKeychainProxy sharedProxy] genericKeychainItemForService:kFacebookDesktopService
-                                                      withUsername:keychainKey];
-    if (keychain && [[keychain password] length] > 0) {
-      NSDictionary* dict = [[keychain password] JSONValue];
-      if (dict) {
-        [self setDictionary:dict];
-      }
+    // start reading in the stored session, it'll likely be there by the
+    // time we need it
+    if ([store respondsToSelector:@selector(prefetchSessionForKey:)]) {
+      [(FBCachedSessionStore*)store prefetchSessionForKey:keychainKey];
     }
   }
   return self;
@@ -47,6 +46,7 @@
 
 - (void)dealloc
 {
+  [store       release];
   [keychainKey release];
 
   [secret      release];
@@ -61,11 +61,13 @@
 
 - (NSString*)uid
 {
+  [self loadIfNeeded];
   return uid;
 }
 
 - (void)setUID:(NSString*)aString
 {
+  [self loadIfNeeded];
   [aString retain];
   [uid release];
   uid = aString;
@@ -73,11 +75,13 @@
 
 - (NSString*)key
 {
+  [self loadIfNeeded];
   return key;
 }
 
 - (void)setKey:(NSString*)aString
 {
+  [self loadIfNeeded];
   [aString retain];
   [key release];
   key = aString;
@@ -85,11 +89,13 @@
 
 - (NSString*)secret
 {
+  [self loadIfNeeded];
   return secret;
 }
 
 - (void)setSecret:(NSString*)aString
 {
+  [self loadIfNeeded];
   [aString retain];
   [secret release];
   secret = aString;
@@ -97,11 +103,13 @@
 
 - (NSSet*)permissions
 {
+  [self loadIfNeeded];
   return permissions;
 }
 
 - (void)setPermissions:(id)perms
 {
+  [self loadIfNeeded];
   if ([perms isKindOfClass:[NSArray class]]) {
     [permissions removeAllObjects];
     [permissions addObjectsFromArray:perms];
@@ -113,11 +121,13 @@
 
 - (void)addPermission:(NSString*)perm
 {
+  [self loadIfNeeded];
   [permissions addObject:perm];
 }
 
 - (void)addPermissions:(id)perms
 {
+  [self loadIfNeeded];
   if ([perms isKindOfClass:[NSArray class]]) {
     [permissions addObjectsFromArray:perms];
   } else if ([perms isKindOfClass:[NSSet class]]) {
@@ -127,26 +137,44 @@
 
 - (BOOL)hasPermission:(NSString*)perm
 {
+  [self loadIfNeeded];
   return [permissions containsObject:perm];
 }
 
+- (NSDate*)expires
+{
+  [self loadIfNeeded];
+  return expires;
+}
+
+- (BOOL)isInfinite
+{
+  [self loadIfNeeded];
+  // expires == 0 iff an infinite session has been granted
+  return expires != nil &&
+         [expires compare:[NSDate dateWithTimeIntervalSince1970:0]] == NSOrderedSame;
+}
+
 - (void) setWithDictionary:(NSDictionary*)dict
 {
+  isLoaded = YES;
   [self setDictionary:dict];
 
   // save session forever
-  NSString* pass = [dict JSONRepresentation];
-
-  EMKeychainItem* keychain = [[EMKeychainProxy sharedProxy]
-                              genericKeychainItemForService:kFacebookDesktopService
-                                               withUsername:keychainKey];
-  if (keychain) {
-    [keychain setPassword:pass];
-  } else {
-    [[EMKeychainProxy sharedProxy]
-     addGenericKeychainItemForService:kFacebookDesktopService
-                         withUsername:keychainKey
-                             password:pass];
+  [store setSession:dict forKey:keychainKey];
+}
+
+- (void)loadIfNeeded
+{
+  if (isLoaded) {
+    return;
+  }
+  isLoaded = YES;
+
+  // read in stored session if it exists
+  NSDictionary* dict = [store sessionForKey:keychainKey];
+  if (dict) {
+    [self setDictionary:dict];
   }
 }
 
@@ -172,30 +200,28 @@
 
 - (BOOL)exists
 {
+  [self loadIfNeeded];
   return uid != nil && uid != @"0";
 }
 
 - (BOOL)isValid
 {
-  // expires == 0 iff an infinite session has been granted
   return [self exists] && expires != nil &&
-         ([expires compare:[NSDate dateWithTimeIntervalSince1970:0]] == NSOrderedSame ||
+         ([self isInfinite] ||
           [expires compare:[NSDate date]] == NSOrderedDescending);
 }
 
 - (void)invalidate
 {
+  [self loadIfNeeded];
+  [expires release];
   expires = nil;
 }
 
 - (void)clear
 {
-  EMKeychainItem* keychain = [[EMKeychainProxy sharedProxy]
-                              genericKeychainItemForService:kFacebookDesktopService
-                              withUsername:keychainKey];
-  if (keychain) {
-    [keychain setPassword:@""];
-  }
+  isLoaded = YES;
+  [store setSession:nil forKey:keychainKey];
 
   [uid release];
   uid = nil;
@@ -0,0 +1,29 @@
+//
+//  FBSessionStore.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/*!
+ * @protocol FBSessionStore
+ * Persists session dictionaries, as returned by Facebook's login, under a
+ * key. Stores may block on I/O, and may be called from any thread; put an
+ * FBCachedSessionStore in front of one to keep it off the login path.
+ */
+@protocol FBSessionStore <NSObject>
+
+/*!
+ * The stored session, or nil if there isn't one.
+ */
+- (NSDictionary*)sessionForKey:(NSString*)key;
+
+/*!
+ * Stores session under key, or removes any stored session if it is nil.
+ */
+- (void)setSession:(NSDictionary*)session forKey:(NSString*)key;
+
+@end
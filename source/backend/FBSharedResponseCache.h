@@ -0,0 +1,76 @@
+//
+//  FBSharedResponseCache.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+
+/*!
+ * @class FBSharedResponseCache
+ *
+ * Remembers recent API responses in a memory mapped file, so that every
+ * process on the machine which opens the same file, such as an application
+ * and its menu bar helper, can answer calls from the responses any of them
+ * fetched. Responses are kept already decoded, encoded with FBBinaryCoder,
+ * and partitioned as in FBResponseCache. Keys and partitions are stored in
+ * the file as given, so neither should hold a secret.
+ *
+ * Lookups take no locks. Each slot of the file's index carries a sequence
+ * number which is odd while the slot is being changed, and a lookup which
+ * sees it change while copying a response out retries or misses. Stores are
+ * made by one writer at a time, across processes, under an flock of the
+ * file. The file is a fixed size; once it is full the oldest responses are
+ * overwritten. Safe to use from any thread.
+ */
+@interface FBSharedResponseCache : NSObject {
+  NSString* path;
+  int       fileDescriptor;
+  void*     map;
+  size_t    mapSize;
+  NSLock*   writeLock;
+}
+
+/*!
+ * Caches/FBCocoa/<key>.responses in the user's Library, shared by every
+ * application with the API key.
+ */
++ (NSString*)defaultPathForAPIKey:(NSString*)key;
+
+/*!
+ * Opens the cache at path, creating it size bytes long if it doesn't exist.
+ * An existing cache keeps the size it was created with. Returns nil if the
+ * file can't be opened or mapped.
+ */
++ (FBSharedResponseCache*)cacheWithPath:(NSString*)aPath size:(NSUInteger)size;
+
+- (id)initWithPath:(NSString*)aPath size:(NSUInteger)size;
+
+- (NSString*)path;
+
+/*!
+ * The size of the file.
+ */
+- (NSUInteger)size;
+
+/*!
+ * Returns nil if there is no response for key, or it is older than maxAge
+ * seconds.
+ */
+- (id)responseForKey:(NSString*)key
+           partition:(NSString*)partition
+              maxAge:(NSTimeInterval)maxAge;
+
+/*!
+ * Returns NO if the response can't be encoded, or is too large to cache.
+ */
+- (BOOL)setResponse:(id)response
+             forKey:(NSString*)key
+          partition:(NSString*)partition;
+
+- (void)removePartition:(NSString*)partition;
+- (void)removeAllResponses;
+
+@end
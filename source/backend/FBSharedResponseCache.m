@@ -0,0 +1,401 @@
+//
+//  FBSharedResponseCache.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBSharedResponseCache.h"
+#import "FBBinaryCoder.h"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __APPLE__
+  #include <libkern/OSAtomic.h>
+#else
+  #define OSMemoryBarrier() __sync_synchronize()
+#endif
+
+#define kCacheMagic     0x46424352 // FBCR
+#define kCacheVersion   1
+#define kMinCacheSize   (64 * 1024)
+#define kBytesPerSlot   2048
+#define kMinSlotCount   64
+
+// slots a key may be kept in, from the one its hash falls on
+#define kProbeCount     8
+
+// a lookup racing a store gives up after this many tries
+#define kMaxReadRetries 3
+
+
+/*
+ * The file is a header, then an index of slots, then the responses in a
+ * ring. Slots and the header are only changed under the file lock.
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slotCount;
+  uint32_t reserved;
+  uint64_t dataSize;
+  uint64_t writeOffset;
+} FBSharedCacheHeader;
+
+typedef struct {
+  volatile uint32_t sequence;  // odd while the slot is being changed
+  uint32_t          length;    // of the record, 0 if the slot is empty
+  uint64_t          keyHash;
+  uint64_t          partitionHash;
+  uint64_t          offset;    // of the record, from the start of the ring
+  double            storedAt;
+} FBSharedCacheSlot;
+
+// a record is the key's length, the key, then the encoded response
+typedef uint32_t FBSharedCacheKeyLength;
+
+
+static uint64_t FBSharedCacheHash(NSData* bytes)
+{
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ull;
+  const unsigned char* byte = [bytes bytes];
+  for (NSUInteger i = 0; i < [bytes length]; i++) {
+    hash = (hash ^ byte[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+static NSData* FBSharedCacheKeyData(NSString* key, NSString* partition)
+{
+  return [[NSString stringWithFormat:@"%@\n%@", partition, key] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+static void FBSharedCacheClearSlot(FBSharedCacheSlot* slot)
+{
+  slot->sequence++;
+  OSMemoryBarrier();
+  slot->length = 0;
+  OSMemoryBarrier();
+  slot->sequence++;
+}
+
+
+@interface FBSharedResponseCache (Private)
+
+- (BOOL)openWithSize:(NSUInteger)size;
+- (FBSharedCacheHeader*)header;
+- (FBSharedCacheSlot*)slots;
+- (unsigned char*)ring;
+- (void)lockForWriting;
+- (void)unlockForWriting;
+
+@end
+
+
+@implementation FBSharedResponseCache
+
++ (NSString*)defaultPathForAPIKey:(NSString*)key
+{
+  NSArray* paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+  NSString* directory = [paths count] > 0 ? [paths objectAtIndex:0] : NSTemporaryDirectory();
+  directory = [directory stringByAppendingPathComponent:@"FBCocoa"];
+  return [directory stringByAppendingPathComponent:[key stringByAppendingPathExtension:@"responses"]];
+}
+
++ (FBSharedResponseCache*)cacheWithPath:(NSString*)aPath size:(NSUInteger)size
+{
+  return [[[self alloc] initWithPath:aPath size:size] autorelease];
+}
+
+- (id)initWithPath:(NSString*)aPath size:(NSUInteger)size
+{
+  if (!(self = [super init])) {
+    return nil;
+  }
+
+  path           = [aPath copy];
+  fileDescriptor = -1;
+  writeLock      = [[NSLock alloc] init];
+  if (![self openWithSize:MAX(size, kMinCacheSize)]) {
+    [self release];
+    return nil;
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  if (map) {
+    munmap(map, mapSize);
+  }
+  if (fileDescriptor >= 0) {
+    close(fileDescriptor);
+  }
+  [path release];
+  [writeLock release];
+  [super dealloc];
+}
+
+- (NSString*)path
+{
+  return path;
+}
+
+- (NSUInteger)size
+{
+  return mapSize;
+}
+
+- (id)responseForKey:(NSString*)key
+           partition:(NSString*)partition
+              maxAge:(NSTimeInterval)maxAge
+{
+  if (key == nil) {
+    return nil;
+  }
+  NSData* keyData = FBSharedCacheKeyData(key, partition ? partition : @"");
+  uint64_t keyHash = FBSharedCacheHash(keyData);
+
+  FBSharedCacheHeader* header = [self header];
+  uint32_t slotCount = header->slotCount;
+  uint64_t dataSize  = header->dataSize;
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+
+  for (int probe = 0; probe < kProbeCount; probe++) {
+    FBSharedCacheSlot* slot = &[self slots][(keyHash + probe) % slotCount];
+    for (int attempt = 0; attempt < kMaxReadRetries; attempt++) {
+      uint32_t sequence = slot->sequence;
+      OSMemoryBarrier();
+      if (sequence & 1) {
+        continue;
+      }
+
+      uint32_t length   = slot->length;
+      uint64_t hash     = slot->keyHash;
+      uint64_t offset   = slot->offset;
+      double   storedAt = slot->storedAt;
+      if (length == 0 || hash != keyHash) {
+        break;
+      }
+      if (now - storedAt > maxAge) {
+        return nil;
+      }
+      if (length < sizeof(FBSharedCacheKeyLength) || offset > dataSize || length > dataSize - offset) {
+        // torn, check again
+        continue;
+      }
+
+      NSMutableData* record = [NSMutableData dataWithBytes:[self ring] + offset length:length];
+      OSMemoryBarrier();
+      if (slot->sequence != sequence) {
+        continue;
+      }
+
+      // the hash only narrows it down
+      FBSharedCacheKeyLength keyLength;
+      memcpy(&keyLength, [record bytes], sizeof(keyLength));
+      NSUInteger valueStart = sizeof(keyLength) + keyLength;
+      if (keyLength != [keyData length] || valueStart > length ||
+          memcmp((char*)[record bytes] + sizeof(keyLength), [keyData bytes], keyLength) != 0) {
+        break;
+      }
+      NSData* value = [record subdataWithRange:NSMakeRange(valueStart, length - valueStart)];
+      return [value binaryValue];
+    }
+  }
+  return nil;
+}
+
+- (BOOL)setResponse:(id)response
+             forKey:(NSString*)key
+          partition:(NSString*)partition
+{
+  if (response == nil || key == nil) {
+    return NO;
+  }
+  if (partition == nil) {
+    partition = @"";
+  }
+
+  NSData* value = [response binaryRepresentation];
+  if (value == nil) {
+    return NO;
+  }
+  NSData* keyData = FBSharedCacheKeyData(key, partition);
+  uint64_t keyHash = FBSharedCacheHash(keyData);
+  uint64_t partitionHash = FBSharedCacheHash([partition dataUsingEncoding:NSUTF8StringEncoding]);
+  FBSharedCacheKeyLength keyLength = [keyData length];
+  uint64_t length = sizeof(keyLength) + keyLength + [value length];
+
+  FBSharedCacheHeader* header = [self header];
+  FBSharedCacheSlot* slots = [self slots];
+  if (length > header->dataSize / 4 || length > UINT32_MAX) {
+    return NO;
+  }
+
+  [self lockForWriting];
+
+  // records don't wrap, one that won't fit at the end goes at the start
+  uint64_t offset = header->writeOffset;
+  if (offset > header->dataSize || length > header->dataSize - offset) {
+    offset = 0;
+  }
+
+  // whatever is about to be overwritten goes first, so no lookup copies it
+  // half written without seeing its slot change
+  for (uint32_t i = 0; i < header->slotCount; i++) {
+    FBSharedCacheSlot* slot = &slots[i];
+    if (slot->length > 0 && slot->offset < offset + length && offset < slot->offset + slot->length) {
+      FBSharedCacheClearSlot(slot);
+    }
+  }
+
+  unsigned char* record = [self ring] + offset;
+  memcpy(record, &keyLength, sizeof(keyLength));
+  memcpy(record + sizeof(keyLength), [keyData bytes], keyLength);
+  memcpy(record + sizeof(keyLength) + keyLength, [value bytes], [value length]);
+  header->writeOffset = offset + length;
+
+  // the key's own slot if it has one, otherwise an empty or the oldest one
+  FBSharedCacheSlot* target = NULL;
+  for (int probe = 0; probe < kProbeCount; probe++) {
+    FBSharedCacheSlot* slot = &slots[(keyHash + probe) % header->slotCount];
+    if (slot->length > 0 && slot->keyHash == keyHash) {
+      target = slot;
+      break;
+    }
+    if (target == NULL || (target->length > 0 &&
+                           (slot->length == 0 || slot->storedAt < target->storedAt))) {
+      target = slot;
+    }
+  }
+
+  target->sequence++;
+  OSMemoryBarrier();
+  target->keyHash       = keyHash;
+  target->partitionHash = partitionHash;
+  target->offset        = offset;
+  target->storedAt      = [NSDate timeIntervalSinceReferenceDate];
+  target->length        = length;
+  OSMemoryBarrier();
+  target->sequence++;
+
+  [self unlockForWriting];
+  return YES;
+}
+
+- (void)removePartition:(NSString*)partition
+{
+  uint64_t partitionHash = FBSharedCacheHash([(partition ? partition : @"") dataUsingEncoding:NSUTF8StringEncoding]);
+  FBSharedCacheHeader* header = [self header];
+  FBSharedCacheSlot* slots = [self slots];
+
+  [self lockForWriting];
+  for (uint32_t i = 0; i < header->slotCount; i++) {
+    if (slots[i].length > 0 && slots[i].partitionHash == partitionHash) {
+      FBSharedCacheClearSlot(&slots[i]);
+    }
+  }
+  [self unlockForWriting];
+}
+
+- (void)removeAllResponses
+{
+  FBSharedCacheHeader* header = [self header];
+  FBSharedCacheSlot* slots = [self slots];
+
+  [self lockForWriting];
+  for (uint32_t i = 0; i < header->slotCount; i++) {
+    if (slots[i].length > 0) {
+      FBSharedCacheClearSlot(&slots[i]);
+    }
+  }
+  header->writeOffset = 0;
+  [self unlockForWriting];
+}
+
+#pragma mark Private Methods
+- (BOOL)openWithSize:(NSUInteger)size
+{
+  [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent]
+                            withIntermediateDirectories:YES
+                                             attributes:nil
+                                                  error:NULL];
+  fileDescriptor = open([path fileSystemRepresentation], O_RDWR | O_CREAT, 0600);
+  if (fileDescriptor < 0) {
+    return NO;
+  }
+
+  // whoever gets here first lays the file out
+  flock(fileDescriptor, LOCK_EX);
+  BOOL opened = NO;
+  struct stat info;
+  if (fstat(fileDescriptor, &info) == 0) {
+    FBSharedCacheHeader existing;
+    BOOL valid = info.st_size >= (off_t)sizeof(existing) &&
+      pread(fileDescriptor, &existing, sizeof(existing), 0) == sizeof(existing) &&
+      existing.magic == kCacheMagic &&
+      existing.version == kCacheVersion &&
+      existing.slotCount > 0 &&
+      info.st_size == (off_t)(sizeof(existing) + existing.slotCount * sizeof(FBSharedCacheSlot) +
+                              existing.dataSize);
+
+    if (valid) {
+      mapSize = info.st_size;
+    } else {
+      mapSize = size;
+    }
+    if (valid || (ftruncate(fileDescriptor, 0) == 0 && ftruncate(fileDescriptor, mapSize) == 0)) {
+      map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+      if (map == MAP_FAILED) {
+        map = NULL;
+      }
+    }
+
+    if (map && !valid) {
+      FBSharedCacheHeader* header = map;
+      header->slotCount   = MAX(kMinSlotCount, mapSize / kBytesPerSlot);
+      header->dataSize    = mapSize - sizeof(FBSharedCacheHeader) - header->slotCount * sizeof(FBSharedCacheSlot);
+      header->writeOffset = 0;
+      header->version     = kCacheVersion;
+      OSMemoryBarrier();
+      header->magic       = kCacheMagic;
+    }
+    opened = map != NULL;
+  }
+  flock(fileDescriptor, LOCK_UN);
+  return opened;
+}
+
+- (FBSharedCacheHeader*)header
+{
+  return (FBSharedCacheHeader*)map;
+}
+
+- (FBSharedCacheSlot*)slots
+{
+  return (FBSharedCacheSlot*)((unsigned char*)map + sizeof(FBSharedCacheHeader));
+}
+
+- (unsigned char*)ring
+{
+  return (unsigned char*)([self slots] + [self header]->slotCount);
+}
+
+- (void)lockForWriting
+{
+  // the flock keeps out other processes, and other threads share our file
+  [writeLock lock];
+  flock(fileDescriptor, LOCK_EX);
+}
+
+- (void)unlockForWriting
+{
+  flock(fileDescriptor, LOCK_UN);
+  [writeLock unlock];
+}
+
+@end
@@ -0,0 +1,43 @@
+//
+//  FBTableQueryRequest.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#import "FBMethodRequest.h"
+
+@class FBTableStore;
+
+
+/*!
+ * @class FBTableQueryRequest
+ *
+ * An FQL query answered partly from an FBTableStore. Only the query for the
+ * rows the store was missing is sent; the rows it returns are kept in the
+ * store, and delivered along with the rows the store already had.
+ */
+@interface FBTableQueryRequest : FBMethodRequest {
+  FBTableStore* store;
+  NSString*     remoteQuery;
+  NSArray*      localRows;
+}
+
+/*!
+ * A nil remoteQuery means the store had every row, and the request should be
+ * answered with -deliverLocalRows rather than started.
+ */
++ (FBTableQueryRequest*)requestWithQuery:(NSString*)query
+                               localRows:(NSArray*)rows
+                                   store:(FBTableStore*)aStore
+                                  parent:(FBConnect*)parent
+                                  target:(id)tar
+                                selector:(SEL)sel;
+
+/*!
+ * Delivers the rows from the store as though they'd come from the server.
+ */
+- (void)deliverLocalRows;
+
+@end
@@ -0,0 +1,114 @@
+//
+//  FBTableQueryRequest.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBTableQueryRequest.h"
+#import "FBTableStore.h"
+
+
+@interface FBTableQueryRequest (Private)
+
+- (id)initWithQuery:(NSString*)query
+          localRows:(NSArray*)rows
+              store:(FBTableStore*)aStore
+             parent:(FBConnect*)parent
+             target:(id)tar
+           selector:(SEL)sel;
+
+@end
+
+
+@interface FBMethodRequest (Internal)
+
+- (id)initWithMethod:(NSString*)method
+           arguments:(NSDictionary*)args
+              parent:(FBConnect*)parent
+              target:(id)tar
+            selector:(SEL)sel;
+
+- (id)initWithData:(NSData*)postData
+            parent:(FBConnect*)parent
+            target:(id)tar
+          selector:(SEL)sel;
+
+- (void)deliverCachedResponse:(id)json;
+
+@end
+
+
+@implementation FBTableQueryRequest
+
++ (FBTableQueryRequest*)requestWithQuery:(NSString*)query
+                               localRows:(NSArray*)rows
+                                   store:(FBTableStore*)aStore
+                                  parent:(FBConnect*)parent
+                                  target:(id)tar
+                                selector:(SEL)sel
+{
+  return [[[FBTableQueryRequest alloc] initWithQuery:query
+                                           localRows:rows
+                                               store:aStore
+                                              parent:parent
+                                              target:tar
+                                            selector:sel] autorelease];
+}
+
+- (void)dealloc
+{
+  [store release];
+  [remoteQuery release];
+  [localRows release];
+  [super dealloc];
+}
+
+- (void)deliverLocalRows
+{
+  [self deliverCachedResponse:localRows];
+}
+
+- (void)success:(id)json
+{
+  if (remoteQuery == nil) {
+    [super success:json];
+    return;
+  }
+
+  // an empty result sometimes comes as {}
+  NSArray* remoteRows = [json isKindOfClass:[NSArray class]] ? json : [NSArray array];
+  [store addRows:remoteRows forQuery:remoteQuery];
+  [super success:[localRows arrayByAddingObjectsFromArray:remoteRows]];
+}
+
+#pragma mark Private Methods
+- (id)initWithQuery:(NSString*)query
+          localRows:(NSArray*)rows
+              store:(FBTableStore*)aStore
+             parent:(FBConnect*)parent
+             target:(id)tar
+           selector:(SEL)sel
+{
+  if (query) {
+    self = [super initWithMethod:@"fql.query"
+                       arguments:[NSDictionary dictionaryWithObject:query forKey:@"query"]
+                          parent:parent
+                          target:tar
+                        selector:sel];
+  } else {
+    // nothing will be sent, so there's nothing to sign
+    self = [super initWithData:nil
+                        parent:parent
+                        target:tar
+                      selector:sel];
+  }
+  if (self) {
+    store       = [aStore retain];
+    remoteQuery = [query copy];
+    localRows   = [(rows ? rows : [NSArray array]) retain];
+  }
+  return self;
+}
+
+@end
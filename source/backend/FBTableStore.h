@@ -0,0 +1,72 @@
+//
+//  FBTableStore.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+
+/*!
+ * @class FBTableStore
+ *
+ * Keeps the rows of FQL results by table, so queries for rows already
+ * fetched can be answered without a round trip. Each table is declared with
+ * the column that identifies its rows and any other columns to index, such
+ * as uid1 of the friend table.
+ *
+ * Only queries of the form
+ *
+ *   SELECT cols FROM table WHERE key = value
+ *   SELECT cols FROM table WHERE key IN (value, ...)
+ *
+ * are answered, where key is the primary key or an indexed column. A row
+ * answers for its primary key if it has all the selected columns and was
+ * fetched within maxAge seconds. An indexed column answers only for values
+ * which were themselves the subject of such a query within maxAge, as only
+ * then are all of their rows known.
+ *
+ * Safe to use from any thread. Rows returned are shared and must not be
+ * modified.
+ */
+@interface FBTableStore : NSObject {
+  NSMutableDictionary* tables;
+  NSTimeInterval       maxAge;
+  NSLock*              lock;
+}
+
+/*!
+ * Declares a table, forgetting any rows already kept for it. Rows without a
+ * value for primaryKey are not kept.
+ */
+- (void)addTable:(NSString*)table
+      primaryKey:(NSString*)primaryKey
+  indexedColumns:(NSArray*)columns;
+
+/*!
+ * 300 seconds by default.
+ */
+- (void)setMaxAge:(NSTimeInterval)age;
+- (NSTimeInterval)maxAge;
+
+/*!
+ * Answers as much of query as possible from the rows kept. Returns nil if
+ * query isn't on a declared table, otherwise the rows found, setting
+ * remoteQuery to a query for the rest, or to nil if nothing is missing. A
+ * query the store can't answer comes back whole as remoteQuery.
+ */
+- (NSArray*)rowsForQuery:(NSString*)query
+             remoteQuery:(NSString**)remoteQuery;
+
+/*!
+ * Keeps the rows returned for query, which need not be one the store can
+ * answer. Rows of tables which weren't declared are ignored.
+ */
+- (void)addRows:(NSArray*)rows forQuery:(NSString*)query;
+
+- (void)removeAllRows;
+
+- (NSUInteger)rowCountForTable:(NSString*)table;
+
+@end
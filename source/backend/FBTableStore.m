@@ -0,0 +1,559 @@
+//
+//  FBTableStore.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBTableStore.h"
+
+#define kDefaultMaxAge 300
+
+
+/*
+ * A row and when it was fetched. A row pieced together from results of
+ * different queries is as old as its oldest columns.
+ */
+@interface FBStoredRow : NSObject {
+@public
+  NSMutableDictionary* values;
+  NSTimeInterval       fetchedAt;
+}
+@end
+
+@implementation FBStoredRow
+
+- (void)dealloc
+{
+  [values release];
+  [super dealloc];
+}
+
+@end
+
+
+/*
+ * The primary keys of the rows with one value of an indexed column, and
+ * when they were last all fetched together, if ever.
+ */
+@interface FBIndexEntry : NSObject {
+@public
+  NSMutableSet*  keys;
+  NSTimeInterval completedAt;
+}
+@end
+
+@implementation FBIndexEntry
+
+- (id)init
+{
+  if (self = [super init]) {
+    keys = [[NSMutableSet alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [keys release];
+  [super dealloc];
+}
+
+@end
+
+
+/*
+ * A declared table's rows by primary key, and for each indexed column, its
+ * entries by value.
+ */
+@interface FBStoredTable : NSObject {
+@public
+  NSString*            primaryKey;
+  NSMutableDictionary* rows;
+  NSMutableDictionary* indexes;
+}
+@end
+
+@implementation FBStoredTable
+
+- (void)dealloc
+{
+  [primaryKey release];
+  [rows release];
+  [indexes release];
+  [super dealloc];
+}
+
+@end
+
+
+/*
+ * A query taken apart, with its names in lower case. keyColumn is nil
+ * unless the query is entirely of a form the store understands; values are
+ * as the store keys them, literals as they were written.
+ */
+@interface FBTableQuery : NSObject {
+@public
+  NSArray*  columns;
+  NSString* table;
+  NSString* keyColumn;
+  NSArray*  values;
+  NSArray*  literals;
+}
+
++ (FBTableQuery*)queryWithString:(NSString*)query;
+
+@end
+
+
+static NSString* FBTableValue(id value)
+{
+  if ([value isKindOfClass:[NSString class]]) {
+    return value;
+  }
+  if ([value isKindOfClass:[NSNumber class]]) {
+    return [value stringValue];
+  }
+  return nil;
+}
+
+static NSString* FBScanIdentifier(NSScanner* scanner)
+{
+  static NSCharacterSet* identifierCharacters = nil;
+  if (identifierCharacters == nil) {
+    NSMutableCharacterSet* characters = [NSMutableCharacterSet alphanumericCharacterSet];
+    [characters addCharactersInString:@"_"];
+    identifierCharacters = [characters copy];
+  }
+  NSString* identifier = nil;
+  [scanner scanCharactersFromSet:identifierCharacters intoString:&identifier];
+  return identifier;
+}
+
+/*
+ * Scans a number or a quoted string, returning its value and setting
+ * literal to its text.
+ */
+static NSString* FBScanLiteral(NSScanner* scanner, NSString** literal)
+{
+  static NSCharacterSet* numberCharacters = nil;
+  if (numberCharacters == nil) {
+    numberCharacters = [[NSCharacterSet characterSetWithCharactersInString:@"-+.0123456789"] retain];
+  }
+
+  NSString* value = nil;
+  [scanner scanCharactersFromSet:[scanner charactersToBeSkipped] intoString:NULL];
+  NSUInteger start = [scanner scanLocation];
+  NSString* string = [scanner string];
+  if (start >= [string length]) {
+    return nil;
+  }
+
+  unichar quote = [string characterAtIndex:start];
+  if (quote == '\'' || quote == '"') {
+    NSMutableString* text = [NSMutableString string];
+    NSUInteger i = start + 1;
+    for (; i < [string length]; i++) {
+      unichar c = [string characterAtIndex:i];
+      if (c == quote) {
+        break;
+      }
+      if (c == '\\' && i + 1 < [string length]) {
+        c = [string characterAtIndex:++i];
+      }
+      [text appendFormat:@"%C", c];
+    }
+    if (i >= [string length]) {
+      return nil;
+    }
+    [scanner setScanLocation:i + 1];
+    value = text;
+  } else if (![scanner scanCharactersFromSet:numberCharacters intoString:&value]) {
+    return nil;
+  }
+
+  *literal = [string substringWithRange:NSMakeRange(start, [scanner scanLocation] - start)];
+  return value;
+}
+
+
+@implementation FBTableQuery
+
++ (FBTableQuery*)queryWithString:(NSString*)query
+{
+  NSScanner* scanner = [NSScanner scannerWithString:query];
+  [scanner setCaseSensitive:NO];
+
+  if (![scanner scanString:@"SELECT" intoString:NULL]) {
+    return nil;
+  }
+  NSMutableArray* columns = [NSMutableArray array];
+  do {
+    NSString* column = FBScanIdentifier(scanner);
+    if (column == nil) {
+      return nil;
+    }
+    [columns addObject:[column lowercaseString]];
+  } while ([scanner scanString:@"," intoString:NULL]);
+
+  NSString* table;
+  if (![scanner scanString:@"FROM" intoString:NULL] ||
+      (table = FBScanIdentifier(scanner)) == nil) {
+    return nil;
+  }
+
+  FBTableQuery* parsed = [[[FBTableQuery alloc] init] autorelease];
+  parsed->columns = [columns retain];
+  parsed->table   = [[table lowercaseString] retain];
+
+  // what follows is only understood if it picks out rows by one column
+  NSString* keyColumn;
+  if (![scanner scanString:@"WHERE" intoString:NULL] ||
+      (keyColumn = FBScanIdentifier(scanner)) == nil) {
+    return parsed;
+  }
+
+  NSMutableArray* values   = [NSMutableArray array];
+  NSMutableArray* literals = [NSMutableArray array];
+  NSString* value;
+  NSString* literal;
+  if ([scanner scanString:@"=" intoString:NULL]) {
+    if ((value = FBScanLiteral(scanner, &literal)) == nil) {
+      return parsed;
+    }
+    [values addObject:value];
+    [literals addObject:literal];
+  } else if ([scanner scanString:@"IN" intoString:NULL] &&
+             [scanner scanString:@"(" intoString:NULL]) {
+    do {
+      if ((value = FBScanLiteral(scanner, &literal)) == nil) {
+        return parsed;
+      }
+      [values addObject:value];
+      [literals addObject:literal];
+    } while ([scanner scanString:@"," intoString:NULL]);
+    if (![scanner scanString:@")" intoString:NULL]) {
+      return parsed;
+    }
+  } else {
+    return parsed;
+  }
+
+  [scanner scanString:@";" intoString:NULL];
+  if ([scanner isAtEnd]) {
+    parsed->keyColumn = [[keyColumn lowercaseString] retain];
+    parsed->values    = [values retain];
+    parsed->literals  = [literals retain];
+  }
+  return parsed;
+}
+
+- (void)dealloc
+{
+  [columns release];
+  [table release];
+  [keyColumn release];
+  [values release];
+  [literals release];
+  [super dealloc];
+}
+
+@end
+
+
+@interface FBTableStore (Private)
+
+- (NSDictionary*)rowForKey:(NSString*)key
+                   inTable:(FBStoredTable*)table
+                   columns:(NSArray*)columns
+                     after:(NSTimeInterval)oldest;
+- (void)addRow:(NSDictionary*)row
+       toTable:(FBStoredTable*)table
+            at:(NSTimeInterval)now;
+
+@end
+
+
+@implementation FBTableStore
+
+- (id)init
+{
+  if (self = [super init]) {
+    tables = [[NSMutableDictionary alloc] init];
+    maxAge = kDefaultMaxAge;
+    lock   = [[NSLock alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [tables release];
+  [lock   release];
+  [super dealloc];
+}
+
+- (void)addTable:(NSString*)table
+      primaryKey:(NSString*)primaryKey
+  indexedColumns:(NSArray*)columns
+{
+  FBStoredTable* storedTable = [[FBStoredTable alloc] init];
+  storedTable->primaryKey = [[primaryKey lowercaseString] retain];
+  storedTable->rows       = [[NSMutableDictionary alloc] init];
+  storedTable->indexes    = [[NSMutableDictionary alloc] init];
+  for (int i = 0; i < [columns count]; i++) {
+    [storedTable->indexes setObject:[NSMutableDictionary dictionary]
+                             forKey:[[columns objectAtIndex:i] lowercaseString]];
+  }
+
+  [lock lock];
+  [tables setObject:storedTable forKey:[table lowercaseString]];
+  [lock unlock];
+  [storedTable release];
+}
+
+- (void)setMaxAge:(NSTimeInterval)age
+{
+  maxAge = age;
+}
+
+- (NSTimeInterval)maxAge
+{
+  return maxAge;
+}
+
+- (NSArray*)rowsForQuery:(NSString*)query
+             remoteQuery:(NSString**)remoteQuery
+{
+  FBTableQuery* parsed = [FBTableQuery queryWithString:query];
+  if (parsed == nil) {
+    return nil;
+  }
+  NSString* keyColumn = parsed->keyColumn;
+
+  NSMutableArray* rows = [NSMutableArray array];
+  NSMutableArray* missing = [NSMutableArray array];
+  NSTimeInterval oldest = [NSDate timeIntervalSinceReferenceDate] - maxAge;
+
+  [lock lock];
+  FBStoredTable* table = [tables objectForKey:parsed->table];
+  if (table == nil) {
+    [lock unlock];
+    return nil;
+  }
+  NSDictionary* index = keyColumn ? [table->indexes objectForKey:keyColumn] : nil;
+  if (index == nil && ![keyColumn isEqualToString:table->primaryKey]) {
+    // still worth sending through the store, to keep the rows
+    [lock unlock];
+    *remoteQuery = query;
+    return rows;
+  }
+
+  for (int i = 0; i < [parsed->values count]; i++) {
+    NSString* value = [parsed->values objectAtIndex:i];
+
+    if (index == nil) {
+      NSDictionary* row = [self rowForKey:value
+                                  inTable:table
+                                  columns:parsed->columns
+                                    after:oldest];
+      if (row) {
+        [rows addObject:row];
+      } else {
+        [missing addObject:[parsed->literals objectAtIndex:i]];
+      }
+      continue;
+    }
+
+    // every row with this value is needed, or the value goes to the server
+    FBIndexEntry* entry = [index objectForKey:value];
+    NSMutableArray* entryRows = nil;
+    if (entry && entry->completedAt >= oldest) {
+      entryRows = [NSMutableArray arrayWithCapacity:[entry->keys count]];
+      NSEnumerator* enumerator = [entry->keys objectEnumerator];
+      NSString* key;
+      while ((key = [enumerator nextObject])) {
+        NSDictionary* row = [self rowForKey:key
+                                    inTable:table
+                                    columns:parsed->columns
+                                      after:oldest];
+        if (row == nil) {
+          entryRows = nil;
+          break;
+        }
+        [entryRows addObject:row];
+      }
+    }
+    if (entryRows) {
+      [rows addObjectsFromArray:entryRows];
+    } else {
+      [missing addObject:[parsed->literals objectAtIndex:i]];
+    }
+  }
+  [lock unlock];
+
+  if ([missing count] == 0) {
+    *remoteQuery = nil;
+  } else if ([missing count] == [parsed->values count]) {
+    *remoteQuery = query;
+  } else {
+    *remoteQuery = [NSString stringWithFormat:@"SELECT %@ FROM %@ WHERE %@ IN (%@)",
+                    [parsed->columns componentsJoinedByString:@", "], parsed->table,
+                    parsed->keyColumn, [missing componentsJoinedByString:@", "]];
+  }
+  return rows;
+}
+
+- (void)addRows:(NSArray*)rows forQuery:(NSString*)query
+{
+  if (![rows isKindOfClass:[NSArray class]]) {
+    return;
+  }
+  FBTableQuery* parsed = [FBTableQuery queryWithString:query];
+  if (parsed == nil) {
+    return;
+  }
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+
+  [lock lock];
+  FBStoredTable* table = [tables objectForKey:parsed->table];
+  if (table == nil) {
+    [lock unlock];
+    return;
+  }
+
+  for (int i = 0; i < [rows count]; i++) {
+    [self addRow:[rows objectAtIndex:i] toTable:table at:now];
+  }
+
+  // the rows for each value asked after are now all known
+  NSString* keyColumn = parsed->keyColumn;
+  NSMutableDictionary* index = keyColumn ? [table->indexes objectForKey:keyColumn] : nil;
+  for (int i = 0; index && i < [parsed->values count]; i++) {
+    NSString* value = [parsed->values objectAtIndex:i];
+    FBIndexEntry* entry = [index objectForKey:value];
+    if (entry == nil) {
+      entry = [[[FBIndexEntry alloc] init] autorelease];
+      [index setObject:entry forKey:value];
+    }
+    [entry->keys removeAllObjects];
+    for (int j = 0; j < [rows count]; j++) {
+      NSDictionary* row = [rows objectAtIndex:j];
+      NSString* key = FBTableValue([row objectForKey:table->primaryKey]);
+      if (key && [value isEqualToString:FBTableValue([row objectForKey:keyColumn])]) {
+        [entry->keys addObject:key];
+      }
+    }
+    entry->completedAt = now;
+  }
+  [lock unlock];
+}
+
+- (void)removeAllRows
+{
+  [lock lock];
+  NSEnumerator* enumerator = [tables objectEnumerator];
+  FBStoredTable* table;
+  while ((table = [enumerator nextObject])) {
+    [table->rows removeAllObjects];
+    NSEnumerator* indexEnumerator = [table->indexes objectEnumerator];
+    NSMutableDictionary* index;
+    while ((index = [indexEnumerator nextObject])) {
+      [index removeAllObjects];
+    }
+  }
+  [lock unlock];
+}
+
+- (NSUInteger)rowCountForTable:(NSString*)table
+{
+  [lock lock];
+  FBStoredTable* storedTable = [tables objectForKey:[table lowercaseString]];
+  NSUInteger count = storedTable ? [storedTable->rows count] : 0;
+  [lock unlock];
+  return count;
+}
+
+#pragma mark Private Methods
+- (NSDictionary*)rowForKey:(NSString*)key
+                   inTable:(FBStoredTable*)table
+                   columns:(NSArray*)columns
+                     after:(NSTimeInterval)oldest
+{
+  FBStoredRow* storedRow = [table->rows objectForKey:key];
+  if (storedRow == nil || storedRow->fetchedAt < oldest) {
+    return nil;
+  }
+
+  NSMutableDictionary* row = [NSMutableDictionary dictionaryWithCapacity:[columns count]];
+  for (int i = 0; i < [columns count]; i++) {
+    NSString* column = [columns objectAtIndex:i];
+    id value = [storedRow->values objectForKey:column];
+    if (value == nil) {
+      return nil;
+    }
+    [row setObject:value forKey:column];
+  }
+  return row;
+}
+
+- (void)addRow:(NSDictionary*)row
+       toTable:(FBStoredTable*)table
+            at:(NSTimeInterval)now
+{
+  if (![row isKindOfClass:[NSDictionary class]]) {
+    return;
+  }
+  NSString* key = FBTableValue([row objectForKey:table->primaryKey]);
+  if (key == nil) {
+    return;
+  }
+
+  FBStoredRow* storedRow = [table->rows objectForKey:key];
+  if (storedRow == nil) {
+    storedRow = [[[FBStoredRow alloc] init] autorelease];
+    storedRow->values = [[NSMutableDictionary alloc] init];
+    [table->rows setObject:storedRow forKey:key];
+  }
+
+  // move the row between index entries as its indexed columns change
+  NSEnumerator* enumerator = [table->indexes keyEnumerator];
+  NSString* column;
+  while ((column = [enumerator nextObject])) {
+    NSString* oldValue = FBTableValue([storedRow->values objectForKey:column]);
+    NSString* newValue = FBTableValue([row objectForKey:column]);
+    if (newValue == nil || [newValue isEqualToString:oldValue]) {
+      continue;
+    }
+    NSMutableDictionary* index = [table->indexes objectForKey:column];
+    FBIndexEntry* entry = oldValue ? [index objectForKey:oldValue] : nil;
+    if (entry) {
+      [entry->keys removeObject:key];
+    }
+    entry = [index objectForKey:newValue];
+    if (entry == nil) {
+      entry = [[[FBIndexEntry alloc] init] autorelease];
+      [index setObject:entry forKey:newValue];
+    }
+    [entry->keys addObject:key];
+  }
+
+  // only a row with every column kept is wholly fresh
+  BOOL replacesAll = [storedRow->values count] == 0;
+  if (!replacesAll) {
+    replacesAll = YES;
+    NSEnumerator* columnEnumerator = [storedRow->values keyEnumerator];
+    while ((column = [columnEnumerator nextObject])) {
+      if ([row objectForKey:column] == nil) {
+        replacesAll = NO;
+        break;
+      }
+    }
+  }
+  [storedRow->values addEntriesFromDictionary:row];
+  if (replacesAll) {
+    storedRow->fetchedAt = now;
+  }
+}
+
+@end
@@ -0,0 +1,83 @@
+//
+//  FBTracer.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#include <stdint.h>
+
+typedef enum {
+  FBTraceQueued,     // a request was made
+  FBTraceSigned,     // its arguments were signed and encoded
+  FBTraceSent,       // it was handed to the transport
+  FBTraceFirstByte,  // the first byte of its response arrived
+  FBTraceParsed,     // its response was parsed
+  FBTraceFannedOut,  // its response was handed out to the calls it carried
+  FBTraceLinked,     // it was sent or answered on behalf of parent
+  FBTraceDelivered   // its target was called back
+} FBTraceEvent;
+
+// read without a lock, so not tracing costs a single test
+extern volatile BOOL FBTracing;
+
+uint64_t FBTraceNow(void);
+unsigned long FBTraceNextID(void);
+void FBTraceRecord(FBTraceEvent event, unsigned long request, unsigned long parent,
+                   NSString* name, uint64_t start);
+void FBTraceNameThread(const char* name);
+
+/*
+ * FB_TRACE records an instant, FB_TRACE_SPAN a span which began at a time
+ * taken by FB_TRACE_START. request and parent are FBCallbacks, or nil.
+ */
+#define FB_TRACE_START(var) uint64_t var = FBTracing ? FBTraceNow() : 0
+
+#define FB_TRACE(event, req, par, nm) {if (FBTracing) {\
+FBTraceRecord((event), [(req) traceID], [(par) traceID], (nm), 0);}}
+
+#define FB_TRACE_SPAN(event, req, par, nm, start) {if (FBTracing && (start)) {\
+FBTraceRecord((event), [(req) traceID], [(par) traceID], (nm), (start));}}
+
+
+/*!
+ * @class FBTracer
+ *
+ * Records the timeline of each request, from being made to its target being
+ * called back, and on which thread each step ran, into a fixed size ring
+ * buffer. The calls of a batch.run and a hedge are linked to the request
+ * which carried them.
+ *
+ * Off until started. The trace can be saved as Chrome trace-event JSON, to
+ * be opened in chrome://tracing.
+ */
+@interface FBTracer : NSObject {
+}
+
+/*!
+ * Starts tracing, keeping the last capacity events. Any earlier trace is
+ * discarded.
+ */
++ (void)startWithCapacity:(NSUInteger)capacity;
+
+/*!
+ * Stops tracing, keeping the trace so far.
+ */
++ (void)stop;
+
++ (BOOL)isTracing;
+
+/*!
+ * The number of events kept.
+ */
++ (NSUInteger)eventCount;
+
+/*!
+ * The trace as Chrome trace-event JSON.
+ */
++ (NSData*)chromeTraceData;
+
++ (BOOL)writeChromeTraceToFile:(NSString*)path error:(NSError**)error;
+
+@end
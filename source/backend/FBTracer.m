@@ -0,0 +1,318 @@
+//
+//  FBTracer.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBTracer.h"
+#import "FBConnect.h"
+#import "FBCocoa.h"
+#import "JSON.h"
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __APPLE__
+  #include <libkern/OSAtomic.h>
+  #include <mach/mach_time.h>
+#else
+  #include <time.h>
+  #define OSAtomicIncrement32Barrier(ptr) __sync_add_and_fetch(ptr, 1)
+#endif
+
+#define kMaxNamedThreads 16
+
+
+typedef struct {
+  uint64_t      timestamp;  // ns
+  uint64_t      duration;   // ns, for spans
+  unsigned long thread;
+  unsigned long request;
+  unsigned long parent;
+  FBTraceEvent  event;
+  NSString*     name;
+} FBTraceEntry;
+
+typedef struct {
+  unsigned long thread;
+  const char*   name;
+} FBThreadName;
+
+
+volatile BOOL FBTracing = NO;
+
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static FBTraceEntry*   entries = NULL;
+static NSUInteger      capacity = 0;
+static NSUInteger      nextEntry = 0;
+static NSUInteger      entryCount = 0;
+static uint64_t        traceStart = 0;
+static FBThreadName    threadNames[kMaxNamedThreads];
+static int             threadNameCount = 0;
+static volatile int32_t lastID = 0;
+
+static NSString* const FBTraceStageNames[] = {
+  @"queued", @"sign", @"send", @"first byte", @"parse", @"fan out", @"link", @"deliver"
+};
+
+
+uint64_t FBTraceNow(void)
+{
+#ifdef __APPLE__
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0) {
+    mach_timebase_info(&timebase);
+  }
+  return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+#endif
+}
+
+unsigned long FBTraceNextID(void)
+{
+  return (uint32_t)OSAtomicIncrement32Barrier(&lastID);
+}
+
+static unsigned long FBTraceThread(void)
+{
+  return (unsigned long)pthread_self();
+}
+
+void FBTraceRecord(FBTraceEvent event, unsigned long request, unsigned long parent,
+                   NSString* name, uint64_t start)
+{
+  uint64_t now = FBTraceNow();
+  [name retain];
+
+  pthread_mutex_lock(&traceLock);
+  if (entries == NULL) {
+    pthread_mutex_unlock(&traceLock);
+    [name release];
+    return;
+  }
+  FBTraceEntry* entry = &entries[nextEntry];
+  NSString* overwritten = entry->name;
+  entry->timestamp = start ? start : now;
+  entry->duration  = start ? now - start : 0;
+  entry->thread    = FBTraceThread();
+  entry->request   = request;
+  entry->parent    = parent;
+  entry->event     = event;
+  entry->name      = name;
+  nextEntry  = (nextEntry + 1) % capacity;
+  entryCount = MIN(entryCount + 1, capacity);
+  pthread_mutex_unlock(&traceLock);
+
+  [overwritten release];
+}
+
+void FBTraceNameThread(const char* name)
+{
+  unsigned long thread = FBTraceThread();
+  pthread_mutex_lock(&traceLock);
+  int i;
+  for (i = 0; i < threadNameCount && threadNames[i].thread != thread; i++);
+  if (i < kMaxNamedThreads) {
+    threadNames[i].thread = thread;
+    threadNames[i].name   = name;
+    threadNameCount = MAX(threadNameCount, i + 1);
+  }
+  pthread_mutex_unlock(&traceLock);
+}
+
+
+@interface FBTracer (Private)
+
++ (NSArray*)chromeTraceEvents;
+
+@end
+
+
+@implementation FBTracer
+
++ (void)startWithCapacity:(NSUInteger)eventCapacity
+{
+  if ([NSThread isMainThread]) {
+    FBTraceNameThread("main");
+  }
+
+  FBTraceEntry* newEntries = calloc(MAX(eventCapacity, 1), sizeof(FBTraceEntry));
+  pthread_mutex_lock(&traceLock);
+  FBTraceEntry* oldEntries = entries;
+  NSUInteger oldCapacity = capacity;
+  entries    = newEntries;
+  capacity   = MAX(eventCapacity, 1);
+  nextEntry  = 0;
+  entryCount = 0;
+  traceStart = FBTraceNow();
+  FBTracing  = YES;
+  pthread_mutex_unlock(&traceLock);
+
+  for (NSUInteger i = 0; oldEntries && i < oldCapacity; i++) {
+    [oldEntries[i].name release];
+  }
+  free(oldEntries);
+}
+
++ (void)stop
+{
+  FBTracing = NO;
+}
+
++ (BOOL)isTracing
+{
+  return FBTracing;
+}
+
++ (NSUInteger)eventCount
+{
+  pthread_mutex_lock(&traceLock);
+  NSUInteger count = entryCount;
+  pthread_mutex_unlock(&traceLock);
+  return count;
+}
+
++ (NSData*)chromeTraceData
+{
+  NSDictionary* trace = [NSDictionary dictionaryWithObjectsAndKeys:
+                         [self chromeTraceEvents], @"traceEvents",
+                         @"ns", @"displayTimeUnit",
+                         nil];
+  return [[trace JSONRepresentation] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
++ (BOOL)writeChromeTraceToFile:(NSString*)path error:(NSError**)error
+{
+  if ([[self chromeTraceData] writeToFile:path atomically:YES]) {
+    return YES;
+  }
+  if (error) {
+    *error = [NSError errorWithDomain:kFBErrorDomainKey
+                                 code:FBAPIUnknownError
+                             userInfo:[NSDictionary dictionaryWithObject:[NSString stringWithFormat:@"Can't write to %@", path]
+                                                                  forKey:kFBErrorMessageKey]];
+  }
+  return NO;
+}
+
+#pragma mark Private Methods
++ (NSArray*)chromeTraceEvents
+{
+  // copy the ring out oldest first, so tracing can go on meanwhile
+  pthread_mutex_lock(&traceLock);
+  NSUInteger count = entryCount;
+  FBTraceEntry* copied = malloc(MAX(count, 1) * sizeof(FBTraceEntry));
+  for (NSUInteger i = 0; i < count; i++) {
+    copied[i] = entries[(nextEntry + capacity - count + i) % capacity];
+    [copied[i].name retain];
+  }
+  uint64_t start = traceStart;
+  FBThreadName names[kMaxNamedThreads];
+  int nameCount = threadNameCount;
+  memcpy(names, threadNames, sizeof(names));
+  pthread_mutex_unlock(&traceLock);
+
+  NSNumber* pid = [NSNumber numberWithInt:getpid()];
+  NSMutableArray* events = [NSMutableArray arrayWithCapacity:count + nameCount];
+  for (int i = 0; i < nameCount; i++) {
+    [events addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                       @"thread_name", @"name",
+                       @"M", @"ph",
+                       pid, @"pid",
+                       [NSNumber numberWithUnsignedLong:names[i].thread], @"tid",
+                       [NSDictionary dictionaryWithObject:[NSString stringWithUTF8String:names[i].name]
+                                                   forKey:@"name"], @"args",
+                       nil]];
+  }
+
+  // the children of a batch get a flow arrow from the parent
+  NSMutableSet* linked = [NSMutableSet set];
+  for (NSUInteger i = 0; i < count; i++) {
+    if (copied[i].event == FBTraceLinked) {
+      [linked addObject:[NSNumber numberWithUnsignedLong:copied[i].request]];
+    }
+  }
+
+  for (NSUInteger i = 0; i < count; i++) {
+    FBTraceEntry* entry = &copied[i];
+    NSString* requestID = [NSString stringWithFormat:@"0x%lx", entry->request];
+    NSNumber* tid = [NSNumber numberWithUnsignedLong:entry->thread];
+    NSNumber* ts = [NSNumber numberWithDouble:(entry->timestamp < start ? 0 : entry->timestamp - start) / 1000.0];
+    NSMutableDictionary* args = [NSMutableDictionary dictionaryWithObject:requestID forKey:@"request"];
+    if (entry->parent) {
+      [args setObject:[NSString stringWithFormat:@"0x%lx", entry->parent] forKey:@"parent"];
+    }
+    if (entry->name) {
+      [args setObject:entry->name forKey:@"method"];
+    }
+
+    NSMutableDictionary* event = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                  FBTraceStageNames[entry->event], @"name",
+                                  @"request", @"cat",
+                                  pid, @"pid",
+                                  tid, @"tid",
+                                  ts, @"ts",
+                                  args, @"args",
+                                  nil];
+    switch (entry->event) {
+      case FBTraceQueued:
+        // each request's life is an async span of its own
+        [event setObject:@"request" forKey:@"name"];
+        [event setObject:@"b" forKey:@"ph"];
+        [event setObject:requestID forKey:@"id"];
+        break;
+
+      case FBTraceFirstByte:
+        [event setObject:@"n" forKey:@"ph"];
+        [event setObject:requestID forKey:@"id"];
+        break;
+
+      case FBTraceLinked:
+        [event setObject:@"s" forKey:@"ph"];
+        [event setObject:requestID forKey:@"id"];
+        break;
+
+      default:
+        [event setObject:@"X" forKey:@"ph"];
+        [event setObject:[NSNumber numberWithDouble:entry->duration / 1000.0] forKey:@"dur"];
+        break;
+    }
+    [events addObject:event];
+
+    if (entry->event == FBTraceDelivered) {
+      NSNumber* end = [NSNumber numberWithDouble:[ts doubleValue] + entry->duration / 1000.0];
+      [events addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                         @"request", @"name",
+                         @"request", @"cat",
+                         @"e", @"ph",
+                         requestID, @"id",
+                         pid, @"pid",
+                         tid, @"tid",
+                         end, @"ts",
+                         args, @"args",
+                         nil]];
+      if ([linked containsObject:[NSNumber numberWithUnsignedLong:entry->request]]) {
+        [events addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                           @"link", @"name",
+                           @"request", @"cat",
+                           @"f", @"ph",
+                           @"e", @"bp",
+                           requestID, @"id",
+                           pid, @"pid",
+                           tid, @"tid",
+                           ts, @"ts",
+                           nil]];
+      }
+    }
+  }
+
+  for (NSUInteger i = 0; i < count; i++) {
+    [copied[i].name release];
+  }
+  free(copied);
+  return events;
+}
+
+@end
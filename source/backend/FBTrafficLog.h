@@ -0,0 +1,81 @@
+//
+//  FBTrafficLog.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+// keys of a traffic record
+#define kFBTrafficMethodKey          @"method"
+#define kFBTrafficArgumentsKey       @"arguments"
+#define kFBTrafficStartKey           @"start"
+#define kFBTrafficResponseDelayKey   @"response_delay"
+#define kFBTrafficFirstByteDelayKey  @"first_byte_delay"
+#define kFBTrafficDurationKey        @"duration"
+#define kFBTrafficStatusCodeKey      @"status_code"
+#define kFBTrafficContentEncodingKey @"content_encoding"
+#define kFBTrafficBodyKey            @"body"
+#define kFBTrafficErrorKey           @"error"
+
+
+/*!
+ * @class FBTrafficLog
+ *
+ * A file of captured API traffic, one record per HTTP request. A record is
+ * a dictionary holding the request's method and arguments, when it was sent
+ * (seconds since capture began), the delays until the response headers and
+ * first byte arrived, its total duration, and the response's status code,
+ * content encoding and body bytes as the transport delivered them, or the
+ * error it failed with.
+ *
+ * Each record is written as its fields encoded with FBBinaryCoder followed
+ * by the raw body, so a log is little bigger than the responses in it.
+ * Signatures and session keys are redacted before anything is written.
+ */
+@interface FBTrafficLog : NSObject {
+  NSFileHandle* file;
+  NSLock*       lock;
+  unsigned long recordCount;
+}
+
+/*!
+ * Reads every record in the file at path.
+ */
++ (NSArray*)recordsWithContentsOfFile:(NSString*)path error:(NSError**)error;
+
+/*!
+ * The arguments with anything that would let a reader of the log make calls
+ * as the user replaced, including within the calls of a batch.
+ */
++ (NSDictionary*)redactedArguments:(NSDictionary*)arguments;
+
+/*!
+ * A key identifying a call by its method and the arguments given by the
+ * caller, so a replayed call can be matched with its record even though it
+ * is signed afresh. The calls of a batch are keyed in the same way.
+ */
++ (NSString*)keyForMethod:(NSString*)method arguments:(NSDictionary*)arguments;
+
+/*!
+ * The arguments a caller would have passed to -callMethod:withArguments:,
+ * without those FBConnect adds to every call.
+ */
++ (NSDictionary*)callerArguments:(NSDictionary*)arguments;
+
+/*!
+ * Creates or truncates the file at path for writing.
+ */
+- (id)initWithPath:(NSString*)path error:(NSError**)error;
+
+/*!
+ * Redacts and appends record. Safe to call from any thread.
+ */
+- (void)appendRecord:(NSDictionary*)record;
+
+- (unsigned long)recordCount;
+
+- (void)close;
+
+@end
@@ -0,0 +1,225 @@
+//
+//  FBTrafficLog.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBTrafficLog.h"
+#import "FBConnect.h"
+#import "FBCocoa.h"
+#import "FBBinaryCoder.h"
+#import "FBResponseCache.h"
+#import "JSON.h"
+#import "NSString+.h"
+
+#define kTrafficLogMagic   "FBTL"
+#define kTrafficLogVersion 1
+
+#define kRedactedValue @"<redacted>"
+
+
+static NSError* FBTrafficLogError(NSString* message)
+{
+  return [NSError errorWithDomain:kFBErrorDomainKey
+                             code:FBAPIUnknownError
+                         userInfo:[NSDictionary dictionaryWithObject:message
+                                                              forKey:kFBErrorMessageKey]];
+}
+
+static void FBAppendLength(NSMutableData* data, NSUInteger length)
+{
+  uint8_t bytes[4] = {
+    length & 0xff, (length >> 8) & 0xff, (length >> 16) & 0xff, (length >> 24) & 0xff
+  };
+  [data appendBytes:bytes length:4];
+}
+
+static BOOL FBReadLength(NSData* data, NSUInteger* offset, NSUInteger* length)
+{
+  if (*offset + 4 > [data length]) {
+    return NO;
+  }
+  const uint8_t* bytes = (const uint8_t*)[data bytes] + *offset;
+  *length = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((NSUInteger)bytes[3] << 24);
+  *offset += 4;
+  return *offset + *length <= [data length];
+}
+
+
+@implementation FBTrafficLog
+
++ (NSArray*)recordsWithContentsOfFile:(NSString*)path error:(NSError**)error
+{
+  NSData* data = [NSData dataWithContentsOfMappedFile:path];
+  NSUInteger headerLength = strlen(kTrafficLogMagic) + 1;
+  if (data == nil || [data length] < headerLength ||
+      memcmp([data bytes], kTrafficLogMagic, headerLength - 1) != 0 ||
+      ((const uint8_t*)[data bytes])[headerLength - 1] != kTrafficLogVersion) {
+    if (error) {
+      *error = FBTrafficLogError([NSString stringWithFormat:@"%@ is not a traffic log", path]);
+    }
+    return nil;
+  }
+
+  NSMutableArray* records = [NSMutableArray array];
+  NSUInteger offset = headerLength;
+  while (offset < [data length]) {
+    NSUInteger fieldsLength, bodyLength;
+    NSMutableDictionary* record = nil;
+    if (FBReadLength(data, &offset, &fieldsLength)) {
+      NSData* fields = [data subdataWithRange:NSMakeRange(offset, fieldsLength)];
+      record = [FBBinaryCoder objectWithData:fields error:NULL];
+      offset += fieldsLength;
+    }
+    if (![record isKindOfClass:[NSMutableDictionary class]] ||
+        !FBReadLength(data, &offset, &bodyLength)) {
+      if (error) {
+        *error = FBTrafficLogError([NSString stringWithFormat:@"%@ is corrupt after %lu records",
+                                    path, (unsigned long)[records count]]);
+      }
+      return nil;
+    }
+    [record setObject:[data subdataWithRange:NSMakeRange(offset, bodyLength)]
+               forKey:kFBTrafficBodyKey];
+    offset += bodyLength;
+    [records addObject:record];
+  }
+  return records;
+}
+
++ (NSDictionary*)redactedArguments:(NSDictionary*)arguments
+{
+  NSMutableDictionary* redacted = [NSMutableDictionary dictionaryWithDictionary:arguments];
+  if ([redacted objectForKey:@"sig"]) {
+    [redacted setObject:kRedactedValue forKey:@"sig"];
+  }
+  if ([redacted objectForKey:@"session_key"]) {
+    [redacted setObject:kRedactedValue forKey:@"session_key"];
+  }
+
+  // each call of a batch is signed with the session too
+  NSArray* feed = [[arguments objectForKey:@"method_feed"] JSONValue];
+  if ([feed isKindOfClass:[NSArray class]]) {
+    NSMutableArray* redactedFeed = [NSMutableArray arrayWithCapacity:[feed count]];
+    for (int i = 0; i < [feed count]; i++) {
+      NSDictionary* callArguments = [[feed objectAtIndex:i] urlDecodeArguments];
+      [redactedFeed addObject:[NSString urlEncodeArguments:[self redactedArguments:callArguments]]];
+    }
+    [redacted setObject:[redactedFeed JSONRepresentation] forKey:@"method_feed"];
+  }
+  return redacted;
+}
+
++ (NSString*)keyForMethod:(NSString*)method arguments:(NSDictionary*)arguments
+{
+  NSMutableDictionary* callerArguments =
+    [NSMutableDictionary dictionaryWithDictionary:[self callerArguments:arguments]];
+  NSArray* feed = [[callerArguments objectForKey:@"method_feed"] JSONValue];
+  if (![feed isKindOfClass:[NSArray class]]) {
+    return [FBResponseCache keyForMethod:(method ? method : @"") arguments:callerArguments];
+  }
+
+  [callerArguments removeObjectForKey:@"method_feed"];
+  NSMutableArray* callKeys = [NSMutableArray arrayWithCapacity:[feed count]];
+  for (int i = 0; i < [feed count]; i++) {
+    NSDictionary* callArguments = [[feed objectAtIndex:i] urlDecodeArguments];
+    [callKeys addObject:[self keyForMethod:[callArguments objectForKey:@"method"]
+                                 arguments:callArguments]];
+  }
+  return [NSString stringWithFormat:@"%@[%@]",
+          [FBResponseCache keyForMethod:method arguments:callerArguments],
+          [callKeys componentsJoinedByString:@"|"]];
+}
+
++ (NSDictionary*)callerArguments:(NSDictionary*)arguments
+{
+  NSMutableDictionary* callerArguments = [NSMutableDictionary dictionaryWithDictionary:arguments];
+  [callerArguments removeObjectsForKeys:[NSArray arrayWithObjects:
+                                         @"method", @"api_key", @"v", @"format", @"ss",
+                                         @"call_id", @"session_key", @"sig", nil]];
+  return callerArguments;
+}
+
+- (id)initWithPath:(NSString*)path error:(NSError**)error
+{
+  if (self = [super init]) {
+    NSMutableData* header = [NSMutableData dataWithBytes:kTrafficLogMagic
+                                                  length:strlen(kTrafficLogMagic)];
+    uint8_t version = kTrafficLogVersion;
+    [header appendBytes:&version length:1];
+
+    if ([header writeToFile:path atomically:NO]) {
+      file = [[NSFileHandle fileHandleForWritingAtPath:path] retain];
+    }
+    if (file == nil) {
+      if (error) {
+        *error = FBTrafficLogError([NSString stringWithFormat:@"Can't write to %@", path]);
+      }
+      [self release];
+      return nil;
+    }
+    [file seekToEndOfFile];
+    lock = [[NSLock alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [file closeFile];
+  [file release];
+  [lock release];
+  [super dealloc];
+}
+
+- (void)appendRecord:(NSDictionary*)record
+{
+  NSMutableDictionary* fields = [NSMutableDictionary dictionaryWithDictionary:record];
+  NSData* body = [fields objectForKey:kFBTrafficBodyKey];
+  [fields removeObjectForKey:kFBTrafficBodyKey];
+  NSDictionary* arguments = [fields objectForKey:kFBTrafficArgumentsKey];
+  if (arguments) {
+    [fields setObject:[FBTrafficLog redactedArguments:arguments] forKey:kFBTrafficArgumentsKey];
+  }
+
+  NSData* encodedFields = [FBBinaryCoder dataWithObject:fields error:NULL];
+  if (encodedFields == nil) {
+    return;
+  }
+  NSMutableData* data = [NSMutableData dataWithCapacity:[encodedFields length] + [body length] + 8];
+  FBAppendLength(data, [encodedFields length]);
+  [data appendData:encodedFields];
+  FBAppendLength(data, [body length]);
+  if (body) {
+    [data appendData:body];
+  }
+
+  [lock lock];
+  @try {
+    [file writeData:data];
+    recordCount++;
+  } @catch (NSException* exception) {
+    // a full disk shouldn't take the app down with it
+  }
+  [lock unlock];
+}
+
+- (unsigned long)recordCount
+{
+  [lock lock];
+  unsigned long count = recordCount;
+  [lock unlock];
+  return count;
+}
+
+- (void)close
+{
+  [lock lock];
+  [file closeFile];
+  [file release];
+  file = nil;
+  [lock unlock];
+}
+
+@end
@@ -0,0 +1,93 @@
+//
+//  FBTrafficReplay.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+@class FBConnect;
+@class FBReplayTransport;
+
+
+/*!
+ * @class FBTrafficReplay
+ *
+ * Makes the calls in a traffic log again through an FBConnect, answered
+ * from the log by an FBReplayTransport, and measures how the client copes:
+ * throughput, the latency of each call from being made to its callback,
+ * and how much the heap grew. Calls are made at the pace they were
+ * captured, scaled by speed; batches are made as batches again. Uploads,
+ * whose arguments aren't captured, are skipped.
+ *
+ * The connect's transport is replaced for the duration of the replay, so
+ * nothing else should use the connect meanwhile. Run the replay on a thread
+ * with a run loop, usually the main thread.
+ */
+@interface FBTrafficReplay : NSObject {
+  NSArray*           records;
+  FBConnect*         connect;
+  double             speed;
+
+  FBReplayTransport* transport;
+  id                 savedTransport;
+  id                 target;
+  SEL                selector;
+
+  NSUInteger         nextRecord;
+  NSUInteger         outstandingCalls;
+  NSUInteger         failureCount;
+  NSMutableArray*    latencies;
+  NSTimeInterval     startTime;
+  NSTimeInterval     finishTime;
+  long long          startHeapSize;
+  long long          finishHeapSize;
+}
+
+- (id)initWithRecords:(NSArray*)someRecords connect:(FBConnect*)aConnect;
+
+/*!
+ * 1 by default, making calls and answering them at the captured pace. 10
+ * replays ten times faster; 0 makes every call at once and answers each
+ * without waiting, which measures the client alone.
+ */
+- (void)setSpeed:(double)factor;
+- (double)speed;
+
+/*!
+ * Begins the replay. The selector is called on target, with the replay,
+ * once every call has been answered.
+ */
+- (void)startWithTarget:(id)aTarget selector:(SEL)aSelector;
+
+- (BOOL)isFinished;
+
+- (NSUInteger)callCount;
+- (NSUInteger)failureCount;
+
+/*!
+ * Seconds from the first call being made to the last being answered.
+ */
+- (NSTimeInterval)duration;
+
+- (double)callsPerSecond;
+
+/*!
+ * The latency below which the given fraction (0.99 for the p99) of calls
+ * were answered.
+ */
+- (NSTimeInterval)latencyAtPercentile:(double)percentile;
+
+/*!
+ * How many more bytes the heap had in use at the end of the replay than at
+ * the start.
+ */
+- (long long)heapGrowth;
+
+/*!
+ * The measurements above, one to a line.
+ */
+- (NSString*)report;
+
+@end
@@ -0,0 +1,222 @@
+//
+//  FBTrafficReplay.m
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import "FBTrafficReplay.h"
+#import "FBConnect.h"
+#import "FBReplayTransport.h"
+#import "FBTrafficLog.h"
+#import "JSON.h"
+#import "NSString+.h"
+#ifdef __APPLE__
+  #include <malloc/malloc.h>
+#else
+  #include <malloc.h>
+#endif
+
+
+static long long FBHeapBytesInUse(void)
+{
+#ifdef __APPLE__
+  struct mstats stats = mstats();
+  return stats.bytes_used;
+#else
+  struct mallinfo info = mallinfo();
+  return (long long)info.uordblks + info.hblkhd;
+#endif
+}
+
+
+@interface FBTrafficReplay (Private)
+
+- (void)replayRecord:(NSDictionary*)record;
+- (void)callMethod:(NSString*)method arguments:(NSDictionary*)arguments;
+- (void)callFinished:(id<FBRequest>)request;
+- (void)finishIfDone;
+
+@end
+
+
+@implementation FBTrafficReplay
+
+- (id)initWithRecords:(NSArray*)someRecords connect:(FBConnect*)aConnect
+{
+  if (self = [super init]) {
+    NSMutableArray* replayable = [NSMutableArray arrayWithCapacity:[someRecords count]];
+    for (int i = 0; i < [someRecords count]; i++) {
+      NSDictionary* record = [someRecords objectAtIndex:i];
+      if ([record objectForKey:kFBTrafficMethodKey]) {
+        [replayable addObject:record];
+      }
+    }
+    records   = [replayable retain];
+    connect   = [aConnect retain];
+    speed     = 1;
+    latencies = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [NSObject cancelPreviousPerformRequestsWithTarget:self];
+  [records release];
+  [connect release];
+  [transport release];
+  [savedTransport release];
+  [latencies release];
+  [super dealloc];
+}
+
+- (void)setSpeed:(double)factor
+{
+  speed = MAX(0.0, factor);
+}
+
+- (double)speed
+{
+  return speed;
+}
+
+- (void)startWithTarget:(id)aTarget selector:(SEL)aSelector
+{
+  target   = aTarget;
+  selector = aSelector;
+
+  transport = [[FBReplayTransport alloc] initWithRecords:records];
+  [transport setSpeed:speed];
+  savedTransport = [[connect transport] retain];
+  [connect setTransport:transport];
+
+  startHeapSize = FBHeapBytesInUse();
+  startTime     = [NSDate timeIntervalSinceReferenceDate];
+
+  for (int i = 0; i < [records count]; i++) {
+    NSDictionary* record = [records objectAtIndex:i];
+    if (speed == 0) {
+      [self replayRecord:record];
+    } else {
+      [self performSelector:@selector(replayRecord:)
+                 withObject:record
+                 afterDelay:[[record objectForKey:kFBTrafficStartKey] doubleValue] / speed];
+    }
+  }
+  [self finishIfDone];
+}
+
+- (BOOL)isFinished
+{
+  return finishTime > 0;
+}
+
+- (NSUInteger)callCount
+{
+  return [latencies count];
+}
+
+- (NSUInteger)failureCount
+{
+  return failureCount;
+}
+
+- (NSTimeInterval)duration
+{
+  return finishTime - startTime;
+}
+
+- (double)callsPerSecond
+{
+  return [self duration] > 0 ? [latencies count] / [self duration] : 0;
+}
+
+- (NSTimeInterval)latencyAtPercentile:(double)percentile
+{
+  if ([latencies count] == 0) {
+    return 0;
+  }
+  NSArray* sorted = [latencies sortedArrayUsingSelector:@selector(compare:)];
+  NSUInteger index = MIN((NSUInteger)(percentile * [sorted count]), [sorted count] - 1);
+  return [[sorted objectAtIndex:index] doubleValue];
+}
+
+- (long long)heapGrowth
+{
+  return finishHeapSize - startHeapSize;
+}
+
+- (NSString*)report
+{
+  return [NSString stringWithFormat:
+          @"calls: %lu (%lu failed, %lu unmatched)\n"
+          @"duration: %.3fs\n"
+          @"throughput: %.1f calls/s\n"
+          @"latency p50: %.2fms p90: %.2fms p99: %.2fms max: %.2fms\n"
+          @"heap growth: %lld bytes\n",
+          (unsigned long)[self callCount], (unsigned long)failureCount,
+          [transport missCount], [self duration], [self callsPerSecond],
+          [self latencyAtPercentile:0.5] * 1000, [self latencyAtPercentile:0.9] * 1000,
+          [self latencyAtPercentile:0.99] * 1000, [self latencyAtPercentile:1] * 1000,
+          [self heapGrowth]];
+}
+
+#pragma mark Private Methods
+- (void)replayRecord:(NSDictionary*)record
+{
+  nextRecord++;
+
+  NSString* method = [record objectForKey:kFBTrafficMethodKey];
+  NSDictionary* arguments = [record objectForKey:kFBTrafficArgumentsKey];
+  NSArray* feed = [[arguments objectForKey:@"method_feed"] JSONValue];
+  if ([[method lowercaseString] isEqualToString:@"batch.run"] && [feed isKindOfClass:[NSArray class]]) {
+    [connect startBatch];
+    for (int i = 0; i < [feed count]; i++) {
+      NSDictionary* callArguments = [[feed objectAtIndex:i] urlDecodeArguments];
+      [self callMethod:[callArguments objectForKey:@"method"]
+             arguments:[FBTrafficLog callerArguments:callArguments]];
+    }
+    [connect sendBatch];
+  } else {
+    [self callMethod:method arguments:[FBTrafficLog callerArguments:arguments]];
+  }
+}
+
+- (void)callMethod:(NSString*)method arguments:(NSDictionary*)arguments
+{
+  outstandingCalls++;
+  id<FBRequest> request = [connect callMethod:method
+                                withArguments:arguments
+                                       target:self
+                                     selector:@selector(callFinished:)];
+  [request setUserData:[NSNumber numberWithDouble:[NSDate timeIntervalSinceReferenceDate]]];
+}
+
+- (void)callFinished:(id<FBRequest>)request
+{
+  NSTimeInterval latency = [NSDate timeIntervalSinceReferenceDate] - [[request userData] doubleValue];
+  [latencies addObject:[NSNumber numberWithDouble:latency]];
+  if ([request error]) {
+    failureCount++;
+  }
+  outstandingCalls--;
+  [self finishIfDone];
+}
+
+- (void)finishIfDone
+{
+  if (nextRecord < [records count] || outstandingCalls > 0 || [self isFinished]) {
+    return;
+  }
+
+  finishTime     = [NSDate timeIntervalSinceReferenceDate];
+  finishHeapSize = FBHeapBytesInUse();
+  [connect setTransport:savedTransport];
+  [savedTransport release];
+  savedTransport = nil;
+
+  DELEGATE(target, selector);
+}
+
+@end
@@ -0,0 +1,47 @@
+//
+//  FBTransport.h
+//  FBCocoa
+//
+//  Copyright 2010 Facebook Inc. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+
+/*!
+ * @protocol FBTransportConnection
+ * A single request in flight on a transport.
+ */
+@protocol FBTransportConnection <NSObject>
+
+- (void)cancel;
+
+@end
+
+
+/*!
+ * @protocol FBTransport
+ * Sends the HTTP requests built by FBMethodRequest. A transport calls the
+ * same methods on its delegate as NSURLConnection does:
+ * -connection:didReceiveResponse:, -connection:didReceiveData:,
+ * -connectionDidFinishLoading: and -connection:didFailWithError:, passing
+ * the object returned from -connectionWithRequest:delegate: as the
+ * connection. These are called on the thread which created the connection.
+ */
+@protocol FBTransport <NSObject>
+
+- (id<FBTransportConnection>)connectionWithRequest:(NSURLRequest*)request
+                                          delegate:(id)delegate;
+
+/*!
+ * YES if the data passed to the delegate has already had any gzip or deflate
+ * Content-Encoding removed, as NSURLConnection does. Otherwise the delegate
+ * receives the bytes exactly as they were sent.
+ */
+- (BOOL)decodesContentEncoding;
+
+@end
+
+
+@interface NSURLConnection (FBTransportConnection) <FBTransportConnection>
+@end
@@ -95,3 +95,28 @@ typedef NSUInteger FBErrorCode;
 
 #import <FBCocoa/FBConnect.h>
 #import <FBCocoa/FBRequest.h>
+#import <FBCocoa/FBPagedQueryRequest.h>
+#import <FBCocoa/FBLiveQuery.h>
+#import <FBCocoa/FBPoll.h>
+#import <FBCocoa/FBPollScheduler.h>
+#import <FBCocoa/FBTransport.h>
+#import <FBCocoa/FBHTTPTransport.h>
+#import <FBCocoa/FBLoopbackTransport.h>
+#import <FBCocoa/FBLatencyTracker.h>
+#import <FBCocoa/FBResponseCache.h>
+#import <FBCocoa/FBPooledClient.h>
+#import <FBCocoa/FBClientPool.h>
+#import <FBCocoa/FBSessionStore.h>
+#import <FBCocoa/FBKeychainSessionStore.h>
+#import <FBCocoa/FBCachedSessionStore.h>
+#import <FBCocoa/FBFileSessionStore.h>
+#import <FBCocoa/FBBinaryCoder.h>
+#import <FBCocoa/FBArenaParser.h>
+#import <FBCocoa/FBRowSchema.h>
+#import <FBCocoa/FBTableStore.h>
+#import <FBCocoa/FBTrafficLog.h>
+#import <FBCocoa/FBRecordingTransport.h>
+#import <FBCocoa/FBReplayTransport.h>
+#import <FBCocoa/FBTrafficReplay.h>
+#import <FBCocoa/FBTracer.h>
+#import <FBCocoa/FBSharedResponseCache.h>